@@ -21,11 +21,21 @@ typedef struct fif_open_file_s *fif_file_handle;
 // Mount options
 typedef struct 
 {
-    unsigned int block_cache_size;
+    unsigned int block_cache_size;                  // number of blocks to cache, zero disables the cache
     unsigned int mount_read_only;
     unsigned int new_file_compression_algorithm;
     unsigned int new_file_compression_level;
-    unsigned int fragmentation_threshold;
+    unsigned int fragmentation_threshold;           // files of at least this many blocks gain a fragment instead of moving when they can't grow in place, zero keeps every file contiguous
+    unsigned int skip_zero_freed_blocks;            // leave the contents of freed blocks as-is instead of clearing them
+    unsigned int max_readahead_size;                // largest read-ahead window in bytes for sequential readers, zero disables
+    unsigned int volume_growth_blocks;              // the archive grows by at least this many blocks at a time, the surplus is kept free for later allocations
+    unsigned int volume_growth_percent;             // ...or by this percentage of its current size if that's more, both zero grow it by exactly what's needed
+    unsigned int trim_on_unmount;                   // give free space at the end of the archive back at unmount
+    unsigned int descriptor_write_interval;         // superblock changes kept in memory before it's written, zero leaves it until fif_sync or unmount
+    unsigned int batch_cache_size;                  // blocks held between fif_begin_batch and fif_commit_batch when there's no block cache, a full batch is written early
+    unsigned int delayed_allocation_size;           // bytes a writer appending to a file holds in memory before allocating blocks for them, zero allocates block by block
+    unsigned int inode_cache_size;                  // number of inodes to keep cached beyond those of open files, zero disables the cache
+    unsigned int dentry_cache_size;                 // number of path components (including missing ones) to remember, zero disables the cache
 } fif_mount_options;
 
 // archive options
@@ -35,6 +45,7 @@ typedef struct
     unsigned int smallfile_size;
     unsigned int hash_table_size;
     unsigned int inode_table_count;
+    unsigned int ordered_directories;               // new directories are b+trees sorted by name instead of hashed, which makes fif_enumdir_range cheap
 } fif_volume_options;
 
 // Mount operations
@@ -45,6 +56,13 @@ LIBFIF_API int fif_mount_volume(fif_mount_handle *out_mount_handle, const fif_io
 LIBFIF_API void fif_get_mount_options(fif_mount_handle mount, fif_mount_options *options);
 LIBFIF_API void fif_get_volume_options(fif_mount_handle mount, fif_volume_options *options);
 LIBFIF_API void fif_set_log_callback(fif_mount_handle mount, fif_log_callback log_callback);
+LIBFIF_API int fif_sync(fif_mount_handle mount);
+
+// Metadata blocks changed between begin and commit are held in memory and written back at commit in block order.
+// Batches nest, only the outermost commit writes.
+LIBFIF_API int fif_begin_batch(fif_mount_handle mount);
+LIBFIF_API int fif_commit_batch(fif_mount_handle mount);
+
 LIBFIF_API int fif_unmount_volume(fif_mount_handle mount);
 
 // trace exports
@@ -56,14 +74,28 @@ LIBFIF_API int fif_trace_replay(fif_mount_handle mount, const fif_io *tracefile_
 LIBFIF_API int fif_stat(fif_mount_handle mount, const char *path, fif_fileinfo *fileinfo);
 LIBFIF_API int fif_fstat(fif_mount_handle mount, fif_file_handle file, fif_fileinfo *fileinfo);
 LIBFIF_API int fif_open(fif_mount_handle mount, const char *path, unsigned int mode, fif_file_handle *file);
+
+// Opens with the size the file is expected to end up at, writable handles reserve the blocks for it up front.
+// Whatever isn't written by the time the handle is closed is given back.
+LIBFIF_API int fif_open_ex(fif_mount_handle mount, const char *path, unsigned int mode, fif_offset_t expected_size, fif_file_handle *file);
+
 LIBFIF_API int fif_read(fif_mount_handle mount, fif_file_handle file, void *out_buffer, unsigned int count);
 LIBFIF_API int fif_write(fif_mount_handle mount, fif_file_handle file, const void *in_buffer, unsigned int count);
 LIBFIF_API fif_offset_t fif_seek(fif_mount_handle mount, fif_file_handle file, fif_offset_t offset, enum FIF_SEEK_MODE mode);
 LIBFIF_API int fif_tell(fif_mount_handle mount, fif_file_handle file);
 LIBFIF_API int fif_ftruncate(fif_mount_handle mount, fif_file_handle file, fif_offset_t size);
+
+// Reserves blocks for size bytes without changing the file size, they're kept until the file is truncated.
+LIBFIF_API int fif_fallocate(fif_mount_handle mount, fif_file_handle file, fif_offset_t size);
+
 LIBFIF_API int fif_close(fif_mount_handle mount, fif_file_handle file);
 LIBFIF_API int fif_unlink(fif_mount_handle mount, const char *filename);
 
+// Zero-copy reads, returns a read-only pointer to up to max_count bytes at offset without moving the file pointer.
+// The view can be shorter than requested, and stays valid until released, the file is closed, or the volume is written to.
+LIBFIF_API int fif_read_view(fif_mount_handle mount, fif_file_handle file, fif_offset_t offset, unsigned int max_count, const void **out_pointer, unsigned int *out_count);
+LIBFIF_API int fif_release_view(fif_mount_handle mount, fif_file_handle file, const void *pointer);
+
 // Whole-file operations
 LIBFIF_API int fif_get_file_contents(fif_mount_handle mount, const char *filename, void *buffer, unsigned int max_count);
 LIBFIF_API int fif_put_file_contents(fif_mount_handle mount, const char *filename, const void *buffer, unsigned int count);
@@ -72,6 +104,15 @@ LIBFIF_API int fif_compress_file(fif_mount_handle mount, const char *filename, e
 // Directory operations
 typedef int(*fif_enumdir_callback)(void *userdata, const char *filename);
 LIBFIF_API int fif_enumdir(fif_mount_handle mount, const char *dirname, fif_enumdir_callback callback, void *userdata);
+
+// Enumerates names from start (inclusive) up to end (exclusive) in case-insensitive order, a NULL or empty bound is open.
+// Ordered directories walk just that part of the tree, others are read in full and sorted.
+LIBFIF_API int fif_enumdir_range(fif_mount_handle mount, const char *dirname, const char *start, const char *end, fif_enumdir_callback callback, void *userdata);
+
+// Enumerates names along with their file info, filling up to max_entries of the array before each callback.
+// The names are only valid during the callback. Inodes are read in table order, so a listing shares block reads.
+typedef int(*fif_readdir_plus_callback)(void *userdata, const fif_direntry *entries, unsigned int count);
+LIBFIF_API int fif_readdir_plus(fif_mount_handle mount, const char *dirname, fif_direntry *entries, unsigned int max_entries, fif_readdir_plus_callback callback, void *userdata);
 LIBFIF_API int fif_mkdir(fif_mount_handle mount, const char *dirname);
 LIBFIF_API int fif_rmdir(fif_mount_handle mount, const char *dirname);
 
@@ -18,7 +18,35 @@ typedef int(*fif_io_zero)(fif_io_userdata userdata, fif_offset_t offset, unsigne
 typedef int(*fif_io_ftruncate)(fif_io_userdata userdata, fif_offset_t newsize);
 typedef int64_t(*fif_io_filesize)(fif_io_userdata userdata);
 
-// IO callbacks
+// Optional positional IO callbacks, these do not use or modify the current file position
+typedef int(*fif_io_pread)(fif_io_userdata userdata, void *buffer, unsigned int count, fif_offset_t offset);
+typedef int(*fif_io_pwrite)(fif_io_userdata userdata, const void *buffer, unsigned int count, fif_offset_t offset);
+
+// Optional direct access callback, returns a pointer to count bytes at offset, or NULL if that range is not addressable.
+// The pointer is only valid until the next io_ftruncate call.
+typedef void *(*fif_io_get_pointer)(fif_io_userdata userdata, fif_offset_t offset, unsigned int count);
+
+// Optional range copy callback, copies count bytes from src_offset to dst_offset within the same file.
+// The ranges do not overlap. Returns the number of bytes copied, a short count means the rest is copied by the caller.
+typedef int(*fif_io_copy_range)(fif_io_userdata userdata, fif_offset_t src_offset, fif_offset_t dst_offset, unsigned int count);
+
+// Optional discard callback, releases the storage behind count bytes at offset. The range reads back as zeros afterwards.
+// Returns count on success, anything else makes the caller fall back to io_zero.
+typedef int(*fif_io_discard)(fif_io_userdata userdata, fif_offset_t offset, unsigned int count);
+
+// Optional batch callback, performs a set of independent positional reads/writes which may complete in any order.
+// Returns zero if every request transferred its full count, otherwise -1.
+typedef struct
+{
+    void *buffer;
+    unsigned int count;
+    unsigned int write;
+    fif_offset_t offset;
+} fif_io_batch_request;
+typedef int(*fif_io_submit_batch)(fif_io_userdata userdata, const fif_io_batch_request *requests, unsigned int request_count);
+
+// IO callbacks, the optional ones come after userdata so the layout up to there is unchanged.
+// Use fif_io_init (or zero the struct) before filling it in, so optional callbacks that aren't set are NULL.
 typedef struct
 {
     fif_io_read io_read;
@@ -28,12 +56,33 @@ typedef struct
     fif_io_ftruncate io_ftruncate;
     fif_io_filesize io_filesize;
     fif_io_userdata userdata;
+    fif_io_pread io_pread;                  // optional, can be NULL
+    fif_io_pwrite io_pwrite;                // optional, can be NULL
+    fif_io_get_pointer io_get_pointer;      // optional, can be NULL
+    fif_io_copy_range io_copy_range;        // optional, can be NULL
+    fif_io_discard io_discard;              // optional, can be NULL
+    fif_io_submit_batch io_submit_batch;    // optional, can be NULL
 } fif_io;
 
+// clears every callback and the userdata
+LIBFIF_API void fif_io_init(fif_io *io);
+
 // local helper functions
 LIBFIF_API int fif_io_open_local_file(const char *path, unsigned int mode, fif_io *out_io);
 LIBFIF_API int fif_io_close_local_file(const fif_io *io);
 
+// memory-mapped local helper functions
+LIBFIF_API int fif_io_open_mapped_file(const char *path, unsigned int mode, fif_io *out_io);
+LIBFIF_API int fif_io_close_mapped_file(const fif_io *io);
+
+// io_uring local helper functions, linux only, fails elsewhere or if the kernel doesn't support it
+LIBFIF_API int fif_io_open_uring_file(const char *path, unsigned int mode, fif_io *out_io);
+LIBFIF_API int fif_io_close_uring_file(const fif_io *io);
+
+// unbuffered local helper functions, uses O_DIRECT where available with bounce buffers for unaligned transfers
+LIBFIF_API int fif_io_open_direct_file(const char *path, unsigned int mode, fif_io *out_io);
+LIBFIF_API int fif_io_close_direct_file(const fif_io *io);
+
 // memory helper functions
 LIBFIF_API int fif_io_open_memory(fif_io *out_io);
 LIBFIF_API int fif_io_close_memory(const fif_io *io);
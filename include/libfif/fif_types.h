@@ -125,4 +125,11 @@ typedef struct
     uint64_t modify_timestamp;
 } fif_fileinfo;
 
+// readdir_plus result, a name and what fif_stat would return for it
+typedef struct
+{
+    const char *filename;
+    fif_fileinfo fileinfo;
+} fif_direntry;
+
 #endif      // __FIF_TYPES_H
@@ -1,11 +1,510 @@
 #include "fif_internal.h"
 
+/**
+  * raw volume i/o
+  */
+
+static int volume_read_raw(fif_mount_handle mount, fif_offset_t file_offset, void *buffer, unsigned int bytes)
+{
+    // positional reads skip the seek entirely
+    if (mount->io.io_pread != NULL)
+    {
+        if ((unsigned int)mount->io.io_pread(mount->io.userdata, buffer, bytes, file_offset) != bytes)
+            return FIF_ERROR_IO_ERROR;
+
+        return FIF_ERROR_SUCCESS;
+    }
+
+    if (mount->io.io_seek(mount->io.userdata, file_offset, FIF_SEEK_MODE_SET) != file_offset)
+        return FIF_ERROR_BAD_OFFSET;
+
+    if ((unsigned int)mount->io.io_read(mount->io.userdata, buffer, bytes) != bytes)
+        return FIF_ERROR_IO_ERROR;
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int volume_write_raw(fif_mount_handle mount, fif_offset_t file_offset, const void *buffer, unsigned int bytes)
+{
+    // positional writes skip the seek entirely
+    if (mount->io.io_pwrite != NULL)
+    {
+        if ((unsigned int)mount->io.io_pwrite(mount->io.userdata, buffer, bytes, file_offset) != bytes)
+            return FIF_ERROR_IO_ERROR;
+
+        return FIF_ERROR_SUCCESS;
+    }
+
+    if (mount->io.io_seek(mount->io.userdata, file_offset, FIF_SEEK_MODE_SET) != file_offset)
+        return FIF_ERROR_BAD_OFFSET;
+
+    if ((unsigned int)mount->io.io_write(mount->io.userdata, buffer, bytes) != bytes)
+        return FIF_ERROR_IO_ERROR;
+
+    return FIF_ERROR_SUCCESS;
+}
+
+// requests handed to io_submit_batch at once, and the size large runs are split into for it
+#define VOLUME_BATCH_SIZE 64
+#define VOLUME_BATCH_CHUNK_SIZE (256U * 1024U)
+
+static int volume_submit_batch(fif_mount_handle mount, const fif_io_batch_request *requests, unsigned int request_count)
+{
+    int result;
+    if (mount->io.io_submit_batch != NULL)
+    {
+        if (mount->io.io_submit_batch(mount->io.userdata, requests, request_count) != 0)
+            return FIF_ERROR_IO_ERROR;
+
+        return FIF_ERROR_SUCCESS;
+    }
+
+    // no batching, so one after another
+    for (unsigned int i = 0; i < request_count; i++)
+    {
+        const fif_io_batch_request *request = &requests[i];
+        if (request->write)
+            result = volume_write_raw(mount, request->offset, request->buffer, request->count);
+        else
+            result = volume_read_raw(mount, request->offset, request->buffer, request->count);
+
+        if (result != FIF_ERROR_SUCCESS)
+            return result;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int volume_transfer_run(fif_mount_handle mount, fif_offset_t file_offset, void *buffer, unsigned int bytes, bool write)
+{
+    int result;
+
+    // small runs, or backends that can't overlap requests, get a single call
+    if (mount->io.io_submit_batch == NULL || bytes < (2 * VOLUME_BATCH_CHUNK_SIZE))
+        return (write) ? volume_write_raw(mount, file_offset, buffer, bytes) : volume_read_raw(mount, file_offset, buffer, bytes);
+
+    // otherwise split the run so the device sees several requests in flight
+    fif_io_batch_request requests[VOLUME_BATCH_SIZE];
+    unsigned char *buffer_ptr = (unsigned char *)buffer;
+    unsigned int remaining_bytes = bytes;
+    while (remaining_bytes > 0)
+    {
+        unsigned int request_count = 0;
+        while (remaining_bytes > 0 && request_count < VOLUME_BATCH_SIZE)
+        {
+            unsigned int chunk_bytes = (remaining_bytes > VOLUME_BATCH_CHUNK_SIZE) ? VOLUME_BATCH_CHUNK_SIZE : remaining_bytes;
+            requests[request_count].buffer = buffer_ptr;
+            requests[request_count].count = chunk_bytes;
+            requests[request_count].write = write;
+            requests[request_count].offset = file_offset;
+            request_count++;
+
+            buffer_ptr += chunk_bytes;
+            file_offset += chunk_bytes;
+            remaining_bytes -= chunk_bytes;
+        }
+
+        if ((result = volume_submit_batch(mount, requests, request_count)) != FIF_ERROR_SUCCESS)
+            return result;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+/**
+  * block cache
+  */
+
+static void block_cache_lru_remove(fif_mount_handle mount, struct fif_block_cache_entry *entry)
+{
+    if (entry->lru_prev != NULL)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        mount->block_cache_lru_head = entry->lru_next;
+
+    if (entry->lru_next != NULL)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        mount->block_cache_lru_tail = entry->lru_prev;
+
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void block_cache_lru_push_head(fif_mount_handle mount, struct fif_block_cache_entry *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = mount->block_cache_lru_head;
+    if (mount->block_cache_lru_head != NULL)
+        mount->block_cache_lru_head->lru_prev = entry;
+    else
+        mount->block_cache_lru_tail = entry;
+
+    mount->block_cache_lru_head = entry;
+}
+
+static void block_cache_lru_push_tail(fif_mount_handle mount, struct fif_block_cache_entry *entry)
+{
+    entry->lru_next = NULL;
+    entry->lru_prev = mount->block_cache_lru_tail;
+    if (mount->block_cache_lru_tail != NULL)
+        mount->block_cache_lru_tail->lru_next = entry;
+    else
+        mount->block_cache_lru_head = entry;
+
+    mount->block_cache_lru_tail = entry;
+}
+
+static struct fif_block_cache_entry *block_cache_lookup(fif_mount_handle mount, fif_block_index_t block_index)
+{
+    struct fif_block_cache_entry *entry = mount->block_cache_buckets[block_index % mount->block_cache_frame_count];
+    while (entry != NULL)
+    {
+        if (entry->block_index == block_index)
+            return entry;
+
+        entry = entry->hash_next;
+    }
+
+    return NULL;
+}
+
+static void block_cache_hash_remove(fif_mount_handle mount, struct fif_block_cache_entry *entry)
+{
+    struct fif_block_cache_entry **link = &mount->block_cache_buckets[entry->block_index % mount->block_cache_frame_count];
+    while (*link != entry)
+    {
+        assert(*link != NULL);
+        link = &(*link)->hash_next;
+    }
+
+    *link = entry->hash_next;
+    entry->hash_next = NULL;
+}
+
+static int block_cache_write_back(fif_mount_handle mount, struct fif_block_cache_entry *entry)
+{
+    int result;
+    assert(entry->valid && entry->dirty);
+
+    fif_offset_t file_offset = (fif_offset_t)mount->block_size * (fif_offset_t)entry->block_index;
+    if ((result = volume_write_raw(mount, file_offset, entry->data, mount->block_size)) != FIF_ERROR_SUCCESS)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "block_cache_write_back: failed to write back block %u", entry->block_index);
+        return result;
+    }
+
+    entry->dirty = false;
+    return FIF_ERROR_SUCCESS;
+}
+
+static void block_cache_invalidate_entry(fif_mount_handle mount, struct fif_block_cache_entry *entry)
+{
+    // drops the contents without writing them, the frame goes to the back of the lru list for reuse
+    block_cache_hash_remove(mount, entry);
+    entry->valid = false;
+    entry->dirty = false;
+    block_cache_lru_remove(mount, entry);
+    block_cache_lru_push_tail(mount, entry);
+}
+
+static int block_cache_get_frame(fif_mount_handle mount, fif_block_index_t block_index, bool read_contents, struct fif_block_cache_entry **out_entry)
+{
+    int result;
+
+    // already cached?
+    struct fif_block_cache_entry *entry = block_cache_lookup(mount, block_index);
+    if (entry != NULL)
+    {
+        // move to the front of the lru list
+        if (entry != mount->block_cache_lru_head)
+        {
+            block_cache_lru_remove(mount, entry);
+            block_cache_lru_push_head(mount, entry);
+        }
+
+        *out_entry = entry;
+        return FIF_ERROR_SUCCESS;
+    }
+
+    // reuse the least recently used frame that isn't pinned by a view, writing it back if needed
+    // inside a batch dirty frames are held for the sorted write at commit, so only clean ones are reused until there are none left
+    entry = mount->block_cache_lru_tail;
+    while (entry != NULL && (entry->pin_count > 0 || (mount->batch_depth > 0 && entry->valid && entry->dirty)))
+        entry = entry->lru_prev;
+    if (entry == NULL && mount->batch_depth > 0)
+    {
+        if ((result = fif_volume_flush_block_cache(mount)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        entry = mount->block_cache_lru_tail;
+        while (entry != NULL && entry->pin_count > 0)
+            entry = entry->lru_prev;
+    }
+    if (entry == NULL)
+    {
+        // every frame is pinned, the block isn't cached so the caller can go to the volume directly
+        *out_entry = NULL;
+        return FIF_ERROR_SUCCESS;
+    }
+    if (entry->valid)
+    {
+        if (entry->dirty && (result = block_cache_write_back(mount, entry)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        block_cache_hash_remove(mount, entry);
+        entry->valid = false;
+    }
+
+    // fill the frame, partial writes need the existing contents
+    if (read_contents)
+    {
+        fif_offset_t file_offset = (fif_offset_t)mount->block_size * (fif_offset_t)block_index;
+        if ((result = volume_read_raw(mount, file_offset, entry->data, mount->block_size)) != FIF_ERROR_SUCCESS)
+        {
+            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "block_cache_get_frame: failed to read block %u", block_index);
+            return result;
+        }
+    }
+
+    // insert into the hash table and the front of the lru list
+    struct fif_block_cache_entry **bucket = &mount->block_cache_buckets[block_index % mount->block_cache_frame_count];
+    entry->block_index = block_index;
+    entry->valid = true;
+    entry->dirty = false;
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    block_cache_lru_remove(mount, entry);
+    block_cache_lru_push_head(mount, entry);
+
+    *out_entry = entry;
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_volume_init_block_cache(fif_mount_handle mount, unsigned int frame_count)
+{
+    mount->block_cache_entries = NULL;
+    mount->block_cache_buckets = NULL;
+    mount->block_cache_lru_head = NULL;
+    mount->block_cache_lru_tail = NULL;
+    mount->block_cache_data = NULL;
+    mount->block_cache_flush_list = NULL;
+    mount->block_cache_frame_count = frame_count;
+    if (frame_count == 0)
+        return FIF_ERROR_SUCCESS;
+
+    // allocate the frames, one hash bucket per frame, and room to sort them when flushing
+    mount->block_cache_entries = (struct fif_block_cache_entry *)calloc(mount->block_cache_frame_count, sizeof(struct fif_block_cache_entry));
+    mount->block_cache_buckets = (struct fif_block_cache_entry **)calloc(mount->block_cache_frame_count, sizeof(struct fif_block_cache_entry *));
+    mount->block_cache_data = (unsigned char *)malloc((size_t)mount->block_cache_frame_count * (size_t)mount->block_size);
+    mount->block_cache_flush_list = (struct fif_block_cache_entry **)malloc((size_t)mount->block_cache_frame_count * sizeof(struct fif_block_cache_entry *));
+    if (mount->block_cache_entries == NULL || mount->block_cache_buckets == NULL || mount->block_cache_data == NULL || mount->block_cache_flush_list == NULL)
+    {
+        fif_volume_free_block_cache(mount);
+        return FIF_ERROR_OUT_OF_MEMORY;
+    }
+
+    // all frames start out empty in the lru list
+    for (unsigned int i = 0; i < mount->block_cache_frame_count; i++)
+    {
+        struct fif_block_cache_entry *entry = &mount->block_cache_entries[i];
+        entry->data = mount->block_cache_data + (size_t)i * (size_t)mount->block_size;
+        block_cache_lru_push_tail(mount, entry);
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+// largest staging buffer used to join runs of neighbouring dirty frames into single writes
+#define FLUSH_STAGING_MAX_SIZE (1024U * 1024U)
+
+static int block_cache_entry_compare(const void *lhs, const void *rhs)
+{
+    const struct fif_block_cache_entry *lhs_entry = *(const struct fif_block_cache_entry *const *)lhs;
+    const struct fif_block_cache_entry *rhs_entry = *(const struct fif_block_cache_entry *const *)rhs;
+    return (lhs_entry->block_index < rhs_entry->block_index) ? -1 : ((lhs_entry->block_index > rhs_entry->block_index) ? 1 : 0);
+}
+
+int fif_volume_flush_block_cache(fif_mount_handle mount)
+{
+    int result;
+    if (mount->block_cache_entries == NULL)
+        return FIF_ERROR_SUCCESS;
+
+    // gather the dirty frames in block order
+    struct fif_block_cache_entry **entries = mount->block_cache_flush_list;
+    unsigned int dirty_count = 0;
+    for (unsigned int i = 0; i < mount->block_cache_frame_count; i++)
+    {
+        struct fif_block_cache_entry *entry = &mount->block_cache_entries[i];
+        if (entry->valid && entry->dirty)
+            entries[dirty_count++] = entry;
+    }
+    if (dirty_count == 0)
+        return FIF_ERROR_SUCCESS;
+
+    qsort(entries, dirty_count, sizeof(struct fif_block_cache_entry *), block_cache_entry_compare);
+
+    // runs of neighbouring blocks are copied together and written as one request, without a staging buffer every frame is its own request
+    unsigned int staging_blocks = (dirty_count < (FLUSH_STAGING_MAX_SIZE / mount->block_size)) ? dirty_count : (FLUSH_STAGING_MAX_SIZE / mount->block_size);
+    unsigned char *staging = (staging_blocks > 1) ? (unsigned char *)malloc((size_t)staging_blocks * (size_t)mount->block_size) : NULL;
+    if (staging == NULL)
+        staging_blocks = 0;
+
+    fif_io_batch_request requests[VOLUME_BATCH_SIZE];
+    unsigned int request_count = 0;
+    unsigned int staging_used = 0;
+    unsigned int batch_start = 0;
+    unsigned int i = 0;
+    while (i < dirty_count)
+    {
+        unsigned int run = 1;
+        while ((i + run) < dirty_count && run < (staging_blocks - staging_used) && entries[i + run]->block_index == (entries[i]->block_index + run))
+            run++;
+
+        fif_io_batch_request *request = &requests[request_count++];
+        request->count = run * mount->block_size;
+        request->write = true;
+        request->offset = (fif_offset_t)mount->block_size * (fif_offset_t)entries[i]->block_index;
+        if (run == 1)
+        {
+            request->buffer = entries[i]->data;
+        }
+        else
+        {
+            unsigned char *run_buffer = staging + (size_t)staging_used * (size_t)mount->block_size;
+            for (unsigned int j = 0; j < run; j++)
+                memcpy(run_buffer + (size_t)j * (size_t)mount->block_size, entries[i + j]->data, mount->block_size);
+
+            request->buffer = run_buffer;
+            staging_used += run;
+        }
+        i += run;
+
+        // submit once the batch or the staging buffer is full, or at the end
+        if (request_count == VOLUME_BATCH_SIZE || (staging_blocks > 0 && staging_used == staging_blocks) || i == dirty_count)
+        {
+            if ((result = volume_submit_batch(mount, requests, request_count)) != FIF_ERROR_SUCCESS)
+            {
+                fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_flush_block_cache: failed to write back %u blocks", i - batch_start);
+                free(staging);
+                return result;
+            }
+
+            for (; batch_start < i; batch_start++)
+                entries[batch_start]->dirty = false;
+
+            request_count = 0;
+            staging_used = 0;
+        }
+    }
+
+    free(staging);
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_volume_flush_cached_block(fif_mount_handle mount, fif_block_index_t block_index)
+{
+    if (mount->block_cache_entries == NULL)
+        return FIF_ERROR_SUCCESS;
+
+    // only this frame goes out, the rest of the cache (and anything a batch holds) stays put
+    struct fif_block_cache_entry *entry = block_cache_lookup(mount, block_index);
+    if (entry == NULL || !entry->valid || !entry->dirty)
+        return FIF_ERROR_SUCCESS;
+
+    return block_cache_write_back(mount, entry);
+}
+
+static struct fif_block_cache_entry *block_cache_next_in_range(fif_mount_handle mount, fif_block_index_t first_block_index, unsigned int block_count, unsigned int *cursor)
+{
+    // small ranges are cheaper to look up, large ranges are cheaper to scan
+    if (block_count < mount->block_cache_frame_count)
+    {
+        while (*cursor < block_count)
+        {
+            struct fif_block_cache_entry *entry = block_cache_lookup(mount, first_block_index + (*cursor)++);
+            if (entry != NULL)
+                return entry;
+        }
+    }
+    else
+    {
+        while (*cursor < mount->block_cache_frame_count)
+        {
+            struct fif_block_cache_entry *entry = &mount->block_cache_entries[(*cursor)++];
+            if (entry->valid && entry->block_index >= first_block_index && (entry->block_index - first_block_index) < block_count)
+                return entry;
+        }
+    }
+
+    return NULL;
+}
+
+void fif_volume_invalidate_block_cache(fif_mount_handle mount, fif_block_index_t first_block_index, unsigned int block_count)
+{
+    if (mount->block_cache_entries == NULL)
+        return;
+
+    unsigned int cursor = 0;
+    struct fif_block_cache_entry *entry;
+    while ((entry = block_cache_next_in_range(mount, first_block_index, block_count, &cursor)) != NULL)
+        block_cache_invalidate_entry(mount, entry);
+}
+
+void fif_volume_free_block_cache(fif_mount_handle mount)
+{
+    free(mount->block_cache_flush_list);
+    free(mount->block_cache_data);
+    free(mount->block_cache_buckets);
+    free(mount->block_cache_entries);
+    mount->block_cache_entries = NULL;
+    mount->block_cache_buckets = NULL;
+    mount->block_cache_lru_head = NULL;
+    mount->block_cache_lru_tail = NULL;
+    mount->block_cache_data = NULL;
+    mount->block_cache_flush_list = NULL;
+    mount->block_cache_frame_count = 0;
+}
+
+bool fif_volume_block_cache_pinned(fif_mount_handle mount)
+{
+    if (mount->block_cache_entries == NULL)
+        return false;
+
+    for (unsigned int i = 0; i < mount->block_cache_frame_count; i++)
+    {
+        if (mount->block_cache_entries[i].pin_count > 0)
+            return true;
+    }
+
+    return false;
+}
+
+int fif_volume_free_batch_block_cache(fif_mount_handle mount)
+{
+    int result;
+
+    // a cache allocated for a batch goes away once the batch is committed and no read view points into its frames
+    if (!mount->batch_block_cache || mount->batch_depth > 0 || fif_volume_block_cache_pinned(mount))
+        return FIF_ERROR_SUCCESS;
+
+    // anything written through it since the commit has to go out first
+    if ((result = fif_volume_flush_block_cache(mount)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    fif_volume_free_block_cache(mount);
+    mount->batch_block_cache = false;
+    return FIF_ERROR_SUCCESS;
+}
+
 /**
   * block i/o
   */
 
 int fif_volume_read_block(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, void *buffer, unsigned int bytes)
 {
+    int result;
+
     // some sanity checks, we can't write past a block, or over a block boundary
     if ((block_offset + bytes) > mount->block_size)
     {
@@ -20,17 +519,25 @@ int fif_volume_read_block(fif_mount_handle mount, fif_block_index_t block_index,
         return FIF_ERROR_BAD_OFFSET;
     }
 
-    fif_offset_t file_offset = (fif_offset_t)mount->block_size * (fif_offset_t)block_index + (fif_offset_t)block_offset;
-    if (mount->io.io_seek(mount->io.userdata, file_offset, FIF_SEEK_MODE_SET) != file_offset)
+    // serve from the cache if it's enabled
+    if (mount->block_cache_entries != NULL)
     {
-        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_read_block: failed to seek to file offset %u for block %u offset %u", (unsigned int)file_offset, block_index, block_offset);
-        return FIF_ERROR_BAD_OFFSET;
+        struct fif_block_cache_entry *entry;
+        if ((result = block_cache_get_frame(mount, block_index, true, &entry)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        if (entry != NULL)
+        {
+            memcpy(buffer, entry->data + block_offset, bytes);
+            return FIF_ERROR_SUCCESS;
+        }
     }
 
-    if ((unsigned int)mount->io.io_read(mount->io.userdata, buffer, bytes) != bytes)
+    fif_offset_t file_offset = (fif_offset_t)mount->block_size * (fif_offset_t)block_index + (fif_offset_t)block_offset;
+    if ((result = volume_read_raw(mount, file_offset, buffer, bytes)) != FIF_ERROR_SUCCESS)
     {
         fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_read_block: failed to read %u bytes from block %u offset %u", bytes, block_index, block_offset);
-        return FIF_ERROR_IO_ERROR;
+        return result;
     }
 
     return FIF_ERROR_SUCCESS;
@@ -38,6 +545,8 @@ int fif_volume_read_block(fif_mount_handle mount, fif_block_index_t block_index,
 
 int fif_volume_write_block(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, const void *buffer, unsigned int bytes)
 {
+    int result;
+
     // some sanity checks, we can't write past a block, or over a block boundary
     if ((block_offset + bytes) > mount->block_size)
     {
@@ -52,41 +561,300 @@ int fif_volume_write_block(fif_mount_handle mount, fif_block_index_t block_index
         return FIF_ERROR_BAD_OFFSET;
     }
 
-    int64_t file_offset = (int64_t)mount->block_size * (int64_t)block_index + (int64_t)block_offset;
-    if (mount->io.io_seek(mount->io.userdata, file_offset, FIF_SEEK_MODE_SET) != file_offset)
+    // write into the cache if it's enabled, whole-block writes don't have to read the old contents
+    if (mount->block_cache_entries != NULL)
     {
-        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_write_block: failed to seek to file offset %u for block %u offset %u", (unsigned int)file_offset, block_index, block_offset);
-        return FIF_ERROR_BAD_OFFSET;
+        struct fif_block_cache_entry *entry;
+        if ((result = block_cache_get_frame(mount, block_index, (bytes != mount->block_size), &entry)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        if (entry != NULL)
+        {
+            memcpy(entry->data + block_offset, buffer, bytes);
+            entry->dirty = true;
+            return FIF_ERROR_SUCCESS;
+        }
     }
 
-    if ((unsigned int)mount->io.io_write(mount->io.userdata, buffer, bytes) != bytes)
+    fif_offset_t file_offset = (fif_offset_t)mount->block_size * (fif_offset_t)block_index + (fif_offset_t)block_offset;
+    if ((result = volume_write_raw(mount, file_offset, buffer, bytes)) != FIF_ERROR_SUCCESS)
     {
         fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_write_block: failed to write %u bytes to block %u offset %u", bytes, block_index, block_offset);
-        return FIF_ERROR_IO_ERROR;
+        return result;
     }
 
     return FIF_ERROR_SUCCESS;
 }
 
-int fif_volume_copy_blocks(fif_mount_handle mount, fif_block_index_t src_block_index, fif_block_index_t dst_block_index, unsigned int block_count)
+static int check_block_range(fif_mount_handle mount, const char *caller, fif_block_index_t block_index, unsigned int block_offset, unsigned int bytes, fif_offset_t *out_file_offset, unsigned int *out_block_count)
 {
-    // this can be optimized in the future...
-    void *buffer = malloc(mount->block_size);
-    if (buffer == NULL)
-        return FIF_ERROR_OUT_OF_MEMORY;
+    // the range can start anywhere in the first block, but has to end inside the volume
+    uint64_t start_offset = (uint64_t)mount->block_size * (uint64_t)block_index + (uint64_t)block_offset;
+    uint64_t end_offset = start_offset + (uint64_t)bytes;
+    if (block_offset >= mount->block_size || block_index >= mount->block_count || end_offset > (uint64_t)mount->block_size * (uint64_t)mount->block_count)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "%s: attempt to access out-of-range blocks (block:%u,offset:%u,bytes:%u)", caller, block_index, block_offset, bytes);
+        return FIF_ERROR_BAD_OFFSET;
+    }
+
+    *out_file_offset = (fif_offset_t)start_offset;
+    *out_block_count = (unsigned int)((end_offset + mount->block_size - 1) / mount->block_size) - block_index;
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_volume_read_blocks(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, void *buffer, unsigned int bytes)
+{
+    int result;
+    if (bytes == 0)
+        return FIF_ERROR_SUCCESS;
 
-    for (unsigned int i = 0; i < block_count; i++)
+    // bounds check the whole run once
+    fif_offset_t file_offset;
+    unsigned int block_count;
+    if ((result = check_block_range(mount, "fif_volume_read_blocks", block_index, block_offset, bytes, &file_offset, &block_count)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // directly addressable volumes are just a copy
+    const void *data_ptr = fif_volume_get_block_pointer(mount, block_index, block_offset, bytes);
+    if (data_ptr != NULL)
     {
-        int result;
+        memcpy(buffer, data_ptr, bytes);
+        return FIF_ERROR_SUCCESS;
+    }
+
+    // any dirty cached blocks in the run have to hit the volume before it's read back in one go
+    if (mount->block_cache_entries != NULL)
+    {
+        unsigned int cursor = 0;
+        struct fif_block_cache_entry *entry;
+        while ((entry = block_cache_next_in_range(mount, block_index, block_count, &cursor)) != NULL)
+        {
+            if (entry->dirty && (result = block_cache_write_back(mount, entry)) != FIF_ERROR_SUCCESS)
+                return result;
+        }
+    }
+
+    if ((result = volume_transfer_run(mount, file_offset, buffer, bytes, false)) != FIF_ERROR_SUCCESS)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_read_blocks: failed to read %u bytes from block %u offset %u", bytes, block_index, block_offset);
+        return result;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
 
-        if ((result = fif_volume_read_block(mount, src_block_index, 0, buffer, mount->block_size)) != FIF_ERROR_SUCCESS)
+int fif_volume_write_blocks(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, const void *buffer, unsigned int bytes)
+{
+    int result;
+    if (bytes == 0)
+        return FIF_ERROR_SUCCESS;
+
+    // bounds check the whole run once
+    fif_offset_t file_offset;
+    unsigned int block_count;
+    if ((result = check_block_range(mount, "fif_volume_write_blocks", block_index, block_offset, bytes, &file_offset, &block_count)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    if ((result = volume_transfer_run(mount, file_offset, (void *)buffer, bytes, true)) != FIF_ERROR_SUCCESS)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_write_blocks: failed to write %u bytes to block %u offset %u", bytes, block_index, block_offset);
+        return result;
+    }
+
+    // patch any cached copies of the run so they don't go stale
+    if (mount->block_cache_entries != NULL)
+    {
+        unsigned int cursor = 0;
+        struct fif_block_cache_entry *entry;
+        while ((entry = block_cache_next_in_range(mount, block_index, block_count, &cursor)) != NULL)
+        {
+            // work out the overlap between this block and the written range
+            uint64_t entry_start = (uint64_t)mount->block_size * (uint64_t)entry->block_index;
+            uint64_t copy_start = ((uint64_t)file_offset > entry_start) ? (uint64_t)file_offset : entry_start;
+            uint64_t copy_end = (uint64_t)file_offset + (uint64_t)bytes;
+            if (copy_end > (entry_start + mount->block_size))
+                copy_end = entry_start + mount->block_size;
+
+            memcpy(entry->data + (size_t)(copy_start - entry_start), (const unsigned char *)buffer + (size_t)(copy_start - (uint64_t)file_offset), (size_t)(copy_end - copy_start));
+        }
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+bool fif_volume_is_addressable(fif_mount_handle mount)
+{
+    // only backends that can address the volume directly support this, and the cache may hold newer data than the backend
+    return (mount->io.io_get_pointer != NULL && mount->block_cache_entries == NULL);
+}
+
+const void *fif_volume_get_block_pointer(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, unsigned int bytes)
+{
+    if (!fif_volume_is_addressable(mount))
+        return NULL;
+
+    // the range can span multiple blocks, but has to stay inside the volume
+    uint64_t start_offset = (uint64_t)mount->block_size * (uint64_t)block_index + (uint64_t)block_offset;
+    if ((start_offset + (uint64_t)bytes) > (uint64_t)mount->block_size * (uint64_t)mount->block_count)
+        return NULL;
+
+    return mount->io.io_get_pointer(mount->io.userdata, (fif_offset_t)start_offset, bytes);
+}
+
+int fif_volume_get_block_view(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, unsigned int bytes, const void **out_pointer, unsigned int *out_bytes, struct fif_block_cache_entry **out_pinned_entry)
+{
+    int result;
+    *out_pointer = NULL;
+    *out_bytes = 0;
+    *out_pinned_entry = NULL;
+
+    // mapped volumes can expose the whole range
+    const void *data_ptr = fif_volume_get_block_pointer(mount, block_index, block_offset, bytes);
+    if (data_ptr != NULL)
+    {
+        *out_pointer = data_ptr;
+        *out_bytes = bytes;
+        return FIF_ERROR_SUCCESS;
+    }
+
+    // otherwise a cached frame can expose up to the end of its block, it stays pinned until released
+    if (mount->block_cache_entries != NULL && block_offset < mount->block_size)
+    {
+        struct fif_block_cache_entry *entry;
+        if ((result = block_cache_get_frame(mount, block_index, true, &entry)) != FIF_ERROR_SUCCESS)
             return result;
 
-        if ((result = fif_volume_write_block(mount, dst_block_index, 0, buffer, mount->block_size)) != FIF_ERROR_SUCCESS)
+        if (entry != NULL)
+        {
+            entry->pin_count++;
+            *out_pointer = entry->data + block_offset;
+            *out_bytes = ((mount->block_size - block_offset) < bytes) ? (mount->block_size - block_offset) : bytes;
+            *out_pinned_entry = entry;
+        }
+    }
+
+    // no view possible is not an error, the caller copies instead
+    return FIF_ERROR_SUCCESS;
+}
+
+void fif_volume_release_block_view(fif_mount_handle mount, struct fif_block_cache_entry *pinned_entry)
+{
+    int result;
+    assert(pinned_entry->pin_count > 0);
+    pinned_entry->pin_count--;
+
+    // the last view into a committed batch's cache lets it go
+    if (pinned_entry->pin_count == 0 && (result = fif_volume_free_batch_block_cache(mount)) != FIF_ERROR_SUCCESS)
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_release_block_view: failed to write back batch cache (%i)", result);
+}
+
+int fif_volume_read_blocks_cached(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, void *buffer, unsigned int bytes)
+{
+    int result;
+
+    // one block at a time, so every piece is served from (and stays in) the block cache
+    unsigned char *dst = (unsigned char *)buffer;
+    while (bytes > 0)
+    {
+        unsigned int piece_bytes = ((mount->block_size - block_offset) < bytes) ? (mount->block_size - block_offset) : bytes;
+        if ((result = fif_volume_read_block(mount, block_index, block_offset, dst, piece_bytes)) != FIF_ERROR_SUCCESS)
             return result;
 
-        src_block_index++;
-        dst_block_index++;
+        dst += piece_bytes;
+        bytes -= piece_bytes;
+        block_index++;
+        block_offset = 0;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_volume_write_blocks_cached(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, const void *buffer, unsigned int bytes)
+{
+    int result;
+
+    // one block at a time, each one lands in a cache frame and is written back with the rest
+    const unsigned char *src = (const unsigned char *)buffer;
+    while (bytes > 0)
+    {
+        unsigned int piece_bytes = ((mount->block_size - block_offset) < bytes) ? (mount->block_size - block_offset) : bytes;
+        if ((result = fif_volume_write_block(mount, block_index, block_offset, src, piece_bytes)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        src += piece_bytes;
+        bytes -= piece_bytes;
+        block_index++;
+        block_offset = 0;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+// largest buffer used when copying block ranges through memory
+#define COPY_BUFFER_MAX_SIZE (1024U * 1024U)
+
+int fif_volume_copy_blocks(fif_mount_handle mount, fif_block_index_t src_block_index, fif_block_index_t dst_block_index, unsigned int block_count)
+{
+    int result;
+    if (block_count == 0)
+        return FIF_ERROR_SUCCESS;
+
+    // the source has to be up to date on the volume, and cached copies of the destination are about to go stale
+    if (mount->block_cache_entries != NULL)
+    {
+        unsigned int cursor = 0;
+        struct fif_block_cache_entry *entry;
+        while ((entry = block_cache_next_in_range(mount, src_block_index, block_count, &cursor)) != NULL)
+        {
+            if (entry->dirty && (result = block_cache_write_back(mount, entry)) != FIF_ERROR_SUCCESS)
+                return result;
+        }
+
+        fif_volume_invalidate_block_cache(mount, dst_block_index, block_count);
+    }
+
+    // let the backend copy as much as it can
+    unsigned int copied_blocks = 0;
+    if (mount->io.io_copy_range != NULL)
+    {
+        uint64_t src_offset = (uint64_t)mount->block_size * (uint64_t)src_block_index;
+        uint64_t dst_offset = (uint64_t)mount->block_size * (uint64_t)dst_block_index;
+        unsigned int copy_bytes = mount->block_size * block_count;
+        int copied = mount->io.io_copy_range(mount->io.userdata, (fif_offset_t)src_offset, (fif_offset_t)dst_offset, copy_bytes);
+        if (copied > 0)
+            copied_blocks = (unsigned int)copied / mount->block_size;
+        if (copied_blocks == block_count)
+            return FIF_ERROR_SUCCESS;
+    }
+
+    // copy the rest through memory in chunks of as many blocks as fit in the buffer
+    unsigned int remaining_blocks = block_count - copied_blocks;
+    unsigned int blocks_per_chunk = COPY_BUFFER_MAX_SIZE / mount->block_size;
+    if (blocks_per_chunk == 0)
+        blocks_per_chunk = 1;
+    if (blocks_per_chunk > remaining_blocks)
+        blocks_per_chunk = remaining_blocks;
+
+    void *buffer = malloc(mount->block_size * blocks_per_chunk);
+    if (buffer == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+
+    src_block_index += copied_blocks;
+    dst_block_index += copied_blocks;
+    while (remaining_blocks > 0)
+    {
+        unsigned int chunk_blocks = (remaining_blocks > blocks_per_chunk) ? blocks_per_chunk : remaining_blocks;
+        unsigned int chunk_bytes = chunk_blocks * mount->block_size;
+        if ((result = fif_volume_read_blocks(mount, src_block_index, 0, buffer, chunk_bytes)) != FIF_ERROR_SUCCESS ||
+            (result = fif_volume_write_blocks(mount, dst_block_index, 0, buffer, chunk_bytes)) != FIF_ERROR_SUCCESS)
+        {
+            free(buffer);
+            return result;
+        }
+
+        src_block_index += chunk_blocks;
+        dst_block_index += chunk_blocks;
+        remaining_blocks -= chunk_blocks;
     }
 
     free(buffer);
@@ -98,6 +866,13 @@ int fif_volume_zero_blocks(fif_mount_handle mount, fif_block_index_t first_block
     uint64_t file_offset = (uint64_t)mount->block_size * (uint64_t)first_block_index;
     unsigned int zero_count = mount->block_size * block_count;
 
+    // any cached copies of these blocks are now stale
+    fif_volume_invalidate_block_cache(mount, first_block_index, block_count);
+
+    // discarding is preferred, since it doesn't have to write anything
+    if (mount->io.io_discard != NULL && mount->io.io_discard(mount->io.userdata, file_offset, zero_count) == (int)zero_count)
+        return FIF_ERROR_SUCCESS;
+
     if (mount->io.io_zero(mount->io.userdata, file_offset, zero_count) != (int)zero_count)
         return FIF_ERROR_IO_ERROR;
 
@@ -110,6 +885,18 @@ int fif_volume_zero_block_partial(fif_mount_handle mount, fif_block_index_t bloc
     if ((offset + bytes) > mount->block_size)
         return FIF_ERROR_BAD_OFFSET;
 
+    // zero the cached copy instead if there is one, it'll be written back later
+    if (mount->block_cache_entries != NULL)
+    {
+        struct fif_block_cache_entry *entry = block_cache_lookup(mount, block_index);
+        if (entry != NULL)
+        {
+            memset(entry->data + offset, 0, bytes);
+            entry->dirty = true;
+            return FIF_ERROR_SUCCESS;
+        }
+    }
+
     int64_t file_offset = (int64_t)mount->block_size * (int64_t)block_index + (int64_t)offset;
 
     if (mount->io.io_zero(mount->io.userdata, file_offset, bytes) != (int)bytes)
@@ -136,7 +923,7 @@ int fif_volume_resize(fif_mount_handle mount, fif_block_index_t new_block_count)
 
     // update the mount info
     mount->block_count = new_block_count;
-    if ((result = fif_volume_write_descriptor(mount)) != FIF_ERROR_SUCCESS)
+    if ((result = fif_volume_update_descriptor(mount)) != FIF_ERROR_SUCCESS)
         return result;
 
     // done
@@ -144,597 +931,571 @@ int fif_volume_resize(fif_mount_handle mount, fif_block_index_t new_block_count)
 }
 
 /**
- * block allocator
+ * freeblock index
  */
 
-int fif_volume_add_freeblock(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_count)
+static unsigned int freeblock_bin_for_count(unsigned int block_count)
 {
-    int result;
-    if (mount->error_state)
-        return FIF_ERROR_CORRUPT_VOLUME;
+    // bin n holds freeblocks of 2^n to 2^(n+1)-1 blocks
+    unsigned int bin = 0;
+    while (block_count > 1)
+    {
+        block_count >>= 1;
+        bin++;
+    }
 
-    //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "fif_volume_add_freeblock(%u, %u -> %u)", block_index, block_count, block_index + block_count - 1);
-    //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "  first_free_block = %u, last_free_block = %u", mount->first_free_block, mount->last_free_block);
+    return bin;
+}
 
-    // can we merge these (now-free) blocks with another freeblock?
-    fif_block_index_t prev_free_block = 0;
-    fif_block_index_t this_free_block = mount->first_free_block;
-    FIF_VOLUME_FORMAT_FREEBLOCK_HEADER this_free_block_header;
-    FIF_VOLUME_FORMAT_FREEBLOCK_HEADER new_free_block_header;
-    while (this_free_block != 0)
+static struct fif_freeblock_node *freeblock_node(fif_mount_handle mount, unsigned int node)
+{
+    return &mount->freeblock_nodes[node];
+}
+
+static void freeblock_bin_insert(fif_mount_handle mount, unsigned int node)
+{
+    struct fif_freeblock_node *this_node = freeblock_node(mount, node);
+    unsigned int bin = freeblock_bin_for_count(this_node->block_count);
+    this_node->bin_prev = 0;
+    this_node->bin_next = mount->freeblock_bins[bin];
+    if (this_node->bin_next != 0)
+        freeblock_node(mount, this_node->bin_next)->bin_prev = node;
+
+    mount->freeblock_bins[bin] = node;
+}
+
+static void freeblock_bin_remove(fif_mount_handle mount, unsigned int node)
+{
+    struct fif_freeblock_node *this_node = freeblock_node(mount, node);
+    if (this_node->bin_prev != 0)
+        freeblock_node(mount, this_node->bin_prev)->bin_next = this_node->bin_next;
+    else
+        mount->freeblock_bins[freeblock_bin_for_count(this_node->block_count)] = this_node->bin_next;
+
+    if (this_node->bin_next != 0)
+        freeblock_node(mount, this_node->bin_next)->bin_prev = this_node->bin_prev;
+}
+
+static int freeblock_reserve_node(fif_mount_handle mount)
+{
+    // node zero is never used, it means "none"
+    if (mount->freeblock_unused_node != 0)
+        return FIF_ERROR_SUCCESS;
+
+    unsigned int old_reserve = mount->freeblock_node_reserve;
+    unsigned int new_reserve = (old_reserve > 0) ? (old_reserve * 2) : 64;
+    struct fif_freeblock_node *new_nodes = (struct fif_freeblock_node *)realloc(mount->freeblock_nodes, sizeof(struct fif_freeblock_node) * new_reserve);
+    if (new_nodes == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+    mount->freeblock_nodes = new_nodes;
+
+    unsigned int *new_order = (unsigned int *)realloc(mount->freeblock_order, sizeof(unsigned int) * new_reserve);
+    if (new_order == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+    mount->freeblock_order = new_order;
+
+    // chain the new nodes onto the unused list
+    for (unsigned int node = new_reserve - 1; node >= old_reserve && node > 0; node--)
     {
-        if ((result = fif_volume_read_block(mount, this_free_block, 0, &this_free_block_header, sizeof(this_free_block_header))) != FIF_ERROR_SUCCESS)
-            return result;
+        new_nodes[node].bin_next = mount->freeblock_unused_node;
+        mount->freeblock_unused_node = node;
+    }
 
-        //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "    read freeblock %u :: %u, %u", this_free_block, this_free_block_header.block_count, this_free_block_header.next_free_block);
+    mount->freeblock_node_reserve = new_reserve;
+    return FIF_ERROR_SUCCESS;
+}
 
-        // sanity check
-        if (this_free_block_header.magic != FIF_VOLUME_FORMAT_FREEBLOCK_HEADER_MAGIC)
-        {
-            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_add_freeblock: freeblock %u is corrupt", this_free_block);
-            return FIF_ERROR_CORRUPT_VOLUME;
-        }
+static unsigned int freeblock_lower_bound(fif_mount_handle mount, fif_block_index_t block_index)
+{
+    // position of the first freeblock starting at or after block_index
+    unsigned int low = 0;
+    unsigned int high = mount->freeblock_count;
+    while (low < high)
+    {
+        unsigned int mid = low + (high - low) / 2;
+        if (freeblock_node(mount, mount->freeblock_order[mid])->block_index < block_index)
+            low = mid + 1;
+        else
+            high = mid;
+    }
 
-        // does this freeblock end on our starting point?
-        if ((this_free_block + this_free_block_header.block_count) == block_index)
-        {
-            //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "  extend freeblock %u from %u to %u (next %u)", this_free_block, this_free_block_header.block_count, this_free_block_header.block_count + block_count, this_free_block_header.next_free_block);
+    return low;
+}
 
-            // does this freeblock now reach the next block?
-            if ((this_free_block + this_free_block_header.block_count + block_count) == this_free_block_header.next_free_block)
-            {
-                // read the next block
-                fif_block_index_t next_free_block = this_free_block_header.next_free_block;
-                FIF_VOLUME_FORMAT_FREEBLOCK_HEADER next_free_block_header;
-                if ((result = fif_volume_read_block(mount, next_free_block, 0, &next_free_block_header, sizeof(next_free_block_header))) != FIF_ERROR_SUCCESS)
-                    return result;
-
-                // sanity check it
-                if (next_free_block_header.magic != FIF_VOLUME_FORMAT_FREEBLOCK_HEADER_MAGIC)
-                {
-                    fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_add_freeblock: freeblock %u is corrupt", next_free_block);
-                    return FIF_ERROR_CORRUPT_VOLUME;
-                }
-
-                // we can merge the blocks
-                //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "    merging freeblock %u -> %u (new block %u -> %u) and %u -> %u", this_free_block, this_free_block + this_free_block_header.block_count - 1, block_index, block_index + block_count - 1, next_free_block, next_free_block + next_free_block_header.block_count - 1);
-                
-                // zero the next freeblock
-                if ((result = fif_volume_zero_block_partial(mount, next_free_block, 0, sizeof(FIF_VOLUME_FORMAT_FREEBLOCK_HEADER))) != FIF_ERROR_SUCCESS)
-                {
-                    mount->error_state = 1;
-                    return result;
-                }
-
-                // update this block to point to the initial block, the stuff we're freeing now, and the next block
-                this_free_block_header.block_count += block_count + next_free_block_header.block_count;
-                this_free_block_header.next_free_block = next_free_block_header.next_free_block;
-                if (fif_volume_write_block(mount, this_free_block, 0, &this_free_block_header, sizeof(this_free_block_header)) != FIF_ERROR_SUCCESS)
-                {
-                    mount->error_state = 1;
-                    return result;
-                }
-
-                // is the next block the last one? have to update the last pointer if that's the case
-                if (this_free_block_header.next_free_block == 0)
-                {
-                    if (mount->last_free_block != next_free_block)
-                    {
-                        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_add_freeblock: superblock has incorrect last block pointer (%u, should be %u)", mount->last_free_block, next_free_block);
-                        mount->error_state = 1;
-                        return FIF_ERROR_CORRUPT_VOLUME;
-                    }
-                    
-                    mount->last_free_block = this_free_block;
-                }
-            }
-            else
-            {
-                // simple, extend this freeblock
-                this_free_block_header.block_count += block_count;
-                if (fif_volume_write_block(mount, this_free_block, 0, &this_free_block_header, sizeof(this_free_block_header)) != FIF_ERROR_SUCCESS)
-                {
-                    mount->error_state = 1;
-                    return result;
-                }
-            }
+static fif_block_index_t freeblock_start_at(fif_mount_handle mount, unsigned int position)
+{
+    return (position < mount->freeblock_count) ? freeblock_node(mount, mount->freeblock_order[position])->block_index : 0;
+}
+
+static void freeblock_insert(fif_mount_handle mount, unsigned int position, fif_block_index_t block_index, unsigned int block_count)
+{
+    // caller has already reserved a node
+    unsigned int node = mount->freeblock_unused_node;
+    assert(node != 0);
+    mount->freeblock_unused_node = freeblock_node(mount, node)->bin_next;
+
+    freeblock_node(mount, node)->block_index = block_index;
+    freeblock_node(mount, node)->block_count = block_count;
+    freeblock_bin_insert(mount, node);
+
+    memmove(&mount->freeblock_order[position + 1], &mount->freeblock_order[position], sizeof(unsigned int) * (mount->freeblock_count - position));
+    mount->freeblock_order[position] = node;
+    mount->freeblock_count++;
+}
+
+static void freeblock_erase(fif_mount_handle mount, unsigned int position)
+{
+    unsigned int node = mount->freeblock_order[position];
+    freeblock_bin_remove(mount, node);
+    freeblock_node(mount, node)->bin_next = mount->freeblock_unused_node;
+    mount->freeblock_unused_node = node;
+
+    mount->freeblock_count--;
+    memmove(&mount->freeblock_order[position], &mount->freeblock_order[position + 1], sizeof(unsigned int) * (mount->freeblock_count - position));
+}
 
-            // extended, so no more work to do
-            break;
+static void freeblock_update(fif_mount_handle mount, unsigned int position, fif_block_index_t block_index, unsigned int block_count)
+{
+    // the address order doesn't change, but the size class might
+    unsigned int node = mount->freeblock_order[position];
+    freeblock_bin_remove(mount, node);
+    freeblock_node(mount, node)->block_index = block_index;
+    freeblock_node(mount, node)->block_count = block_count;
+    freeblock_bin_insert(mount, node);
+}
+
+static void init_freeblock_index(fif_mount_handle mount)
+{
+    mount->freeblock_nodes = NULL;
+    mount->freeblock_node_reserve = 0;
+    mount->freeblock_unused_node = 0;
+    mount->freeblock_order = NULL;
+    mount->freeblock_count = 0;
+    for (unsigned int i = 0; i < FIF_FREEBLOCK_BIN_COUNT; i++)
+        mount->freeblock_bins[i] = 0;
+}
+
+int fif_volume_load_freeblock_index(fif_mount_handle mount)
+{
+    int result;
+    init_freeblock_index(mount);
+
+    // walk the chain once, after this it is only ever written
+    unsigned int total_free_blocks = 0;
+    fif_block_index_t prev_end = 1;
+    fif_block_index_t this_free_block = mount->first_free_block;
+    while (this_free_block != 0)
+    {
+        FIF_VOLUME_FORMAT_FREEBLOCK_HEADER freeblock_header;
+        if (this_free_block < prev_end || this_free_block >= mount->block_count)
+        {
+            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_load_freeblock_index: freeblock %u is out of order", this_free_block);
+            return FIF_ERROR_CORRUPT_VOLUME;
         }
-
-        // does this free block fall on our ending point?
-        if ((block_index + block_count) == this_free_block)
+        if ((result = fif_volume_read_block(mount, this_free_block, 0, &freeblock_header, sizeof(freeblock_header))) != FIF_ERROR_SUCCESS)
+            return result;
+        if (freeblock_header.magic != FIF_VOLUME_FORMAT_FREEBLOCK_HEADER_MAGIC || freeblock_header.block_count == 0 || freeblock_header.block_count > (mount->block_count - this_free_block))
         {
-            //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "  retract freeblock %u to %u", this_free_block, block_index);
+            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_load_freeblock_index: freeblock %u is corrupt", this_free_block);
+            return FIF_ERROR_CORRUPT_VOLUME;
+        }
 
-            // update the block count, and write the retracted block in the new location
-            this_free_block_header.block_count += block_count;
-            if ((result = fif_volume_write_block(mount, block_index, 0, &this_free_block_header, sizeof(this_free_block_header))) != FIF_ERROR_SUCCESS)
-            {
-                mount->error_state = 1;
-                return result;
-            }
+        // chain is in address order, so this always appends
+        if ((result = freeblock_reserve_node(mount)) != FIF_ERROR_SUCCESS)
+            return result;
+        freeblock_insert(mount, mount->freeblock_count, this_free_block, freeblock_header.block_count);
 
-            // update the previous to point to the new starting location (seek backwards at this point but meh it's safer in terms of corruption possibilities)
-            if (prev_free_block != 0)
-            {
-                // read previous block
-                FIF_VOLUME_FORMAT_FREEBLOCK_HEADER prev_free_block_header;
-                if ((result = fif_volume_read_block(mount, prev_free_block, 0, &prev_free_block_header, sizeof(prev_free_block_header))) != FIF_ERROR_SUCCESS)
-                {
-                    mount->error_state = 1;
-                    return result;
-                }
-
-                // update next pointer (this is actually prev here)
-                if (prev_free_block_header.next_free_block != this_free_block)
-                {
-                    fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_add_freeblock: freeblock %u has bad next_free_block (%u, expected %u)", prev_free_block, prev_free_block_header.next_free_block, this_free_block);
-                    return FIF_ERROR_CORRUPT_VOLUME;
-                }
-
-                // write it
-                prev_free_block_header.next_free_block = block_index;
-                if ((result = fif_volume_write_block(mount, prev_free_block, 0, &prev_free_block_header, sizeof(prev_free_block_header))) != FIF_ERROR_SUCCESS)
-                {
-                    mount->error_state = 1;
-                    return result;
-                }
-
-                // if the last block in the superblock was pointing to the (now-retracted) block, this has to be changed to the new position
-                if (this_free_block_header.next_free_block == 0)
-                {
-                    if (mount->last_free_block != this_free_block)
-                    {
-                        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_add_freeblock: superblock has incorrect last block pointer (%u, should be %u)", mount->last_free_block, this_free_block);
-                        mount->error_state = 1;
-                        return FIF_ERROR_CORRUPT_VOLUME;
-                    }
-
-                    // update the pointer
-                    mount->last_free_block = block_index;
-                }
-            }
-            else
-            {
-                // we were the first block in the chain, so update the superblock
-                assert(mount->first_free_block == this_free_block);
-                mount->first_free_block = block_index;
-
-                // check for the last case too
-                if (this_free_block_header.next_free_block == 0)
-                {
-                    assert(mount->last_free_block == this_free_block);
-                    mount->last_free_block = block_index;
-                }
-            }
-            
-            // zero the freeblock header in the retracted location
-            if ((result = fif_volume_zero_block_partial(mount, this_free_block, 0, sizeof(this_free_block_header))) != FIF_ERROR_SUCCESS)
-            {
-                mount->error_state = 1;
-                return result;
-            }
+        total_free_blocks += freeblock_header.block_count;
+        prev_end = this_free_block + freeblock_header.block_count;
+        this_free_block = freeblock_header.next_free_block;
+    }
 
-            // retracted, no more work to do
-            break;
-        }
+    // the chain should end where the header says it does
+    if (freeblock_start_at(mount, (mount->freeblock_count > 0) ? (mount->freeblock_count - 1) : 0) != mount->last_free_block)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_load_freeblock_index: superblock has incorrect last block pointer (%u)", mount->last_free_block);
+        return FIF_ERROR_CORRUPT_VOLUME;
+    }
 
-        // if this free block greater than our block index, we need to insert between before this free block
-        if (this_free_block > block_index)
-        {
-            // shouldn't be any overlap
-            //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "    new freeblock %u -> %u", block_index, block_index + block_count - 1); 
-            assert((block_index + block_count) < this_free_block);
-
-            // initialize the new freeblock, and write it
-            new_free_block_header.magic = FIF_VOLUME_FORMAT_FREEBLOCK_HEADER_MAGIC;
-            new_free_block_header.block_count = block_count;
-            new_free_block_header.next_free_block = this_free_block;
-            if ((result = fif_volume_write_block(mount, block_index, 0, &new_free_block_header, sizeof(new_free_block_header))) != FIF_ERROR_SUCCESS)
-            {
-                mount->error_state = 1;
-                return result;
-            }
+    // the count is only informational, so trust the chain
+    if (total_free_blocks != mount->free_block_count)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_WARNING, "fif_volume_load_freeblock_index: superblock says %u free blocks, chain has %u", mount->free_block_count, total_free_blocks);
+        mount->free_block_count = total_free_blocks;
+    }
 
-            // update the previous to point to the us
-            if (prev_free_block != 0)
-            {
-                // read previous block
-                if ((result = fif_volume_read_block(mount, prev_free_block, 0, &this_free_block_header, sizeof(this_free_block_header))) != FIF_ERROR_SUCCESS)
-                {
-                    mount->error_state = 1;
-                    return result;
-                }
-
-                // update next pointer (this is actually prev here)
-                if (this_free_block_header.next_free_block != this_free_block)
-                {
-                    fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_add_freeblock: freeblock %u has bad next_free_block (%u, expected %u)", prev_free_block, this_free_block_header.next_free_block, this_free_block);
-                    return FIF_ERROR_CORRUPT_VOLUME;
-                }
-
-                // write it
-                this_free_block_header.next_free_block = block_index;
-                if ((result = fif_volume_write_block(mount, prev_free_block, 0, &this_free_block_header, sizeof(this_free_block_header))) != FIF_ERROR_SUCCESS)
-                {
-                    mount->error_state = 1;
-                    return result;
-                }
-            }
-            else
-            {
-                // we were the first block in the chain, so update the superblock, the last can be left as the old value though
-                assert(mount->first_free_block == this_free_block);
-                mount->first_free_block = block_index;
-            }
+    return FIF_ERROR_SUCCESS;
+}
+
+void fif_volume_free_freeblock_index(fif_mount_handle mount)
+{
+    free(mount->freeblock_order);
+    free(mount->freeblock_nodes);
+    mount->freeblock_order = NULL;
+    mount->freeblock_nodes = NULL;
+    mount->freeblock_node_reserve = 0;
+    mount->freeblock_unused_node = 0;
+    mount->freeblock_count = 0;
+}
 
-            // we're done now
-            break;
+static bool freeblock_find(fif_mount_handle mount, fif_block_index_t block_hint, unsigned int block_count, unsigned int *out_position)
+{
+    // smallest fit in the matching size class, otherwise anything in the next non-empty larger class
+    unsigned int found_node = 0;
+    unsigned int bin = freeblock_bin_for_count(block_count);
+    for (unsigned int node = mount->freeblock_bins[bin]; node != 0; node = freeblock_node(mount, node)->bin_next)
+    {
+        unsigned int this_count = freeblock_node(mount, node)->block_count;
+        if (this_count >= block_count && (found_node == 0 || this_count < freeblock_node(mount, found_node)->block_count))
+        {
+            found_node = node;
+            if (this_count == block_count)
+                break;
         }
+    }
+    for (bin = bin + 1; found_node == 0 && bin < FIF_FREEBLOCK_BIN_COUNT; bin++)
+        found_node = mount->freeblock_bins[bin];
 
-        // search the next free block
-        prev_free_block = this_free_block;
-        this_free_block = this_free_block_header.next_free_block;
+    // nothing big enough anywhere
+    if (found_node == 0)
+        return false;
+
+    // without a hint, that's the one
+    if (block_hint == 0)
+    {
+        *out_position = freeblock_lower_bound(mount, freeblock_node(mount, found_node)->block_index);
+        return true;
     }
 
-    // new ending block?
-    if (this_free_block == 0)
+    // otherwise work outwards from the hint, always trying the nearer side first. something will fit.
+    unsigned int after = freeblock_lower_bound(mount, block_hint);
+    unsigned int before = after;
+    for (;;)
     {
-        assert(block_index > mount->last_free_block);
+        bool use_after;
+        if (after == mount->freeblock_count)
+            use_after = false;
+        else if (before == 0)
+            use_after = true;
+        else
+            use_after = (freeblock_start_at(mount, after) - block_hint) <= (block_hint - freeblock_start_at(mount, before - 1));
 
-        // initialize the new freeblock at the end
-        //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "    new freeblock %u -> %u", block_index, block_index + block_count - 1);
-        new_free_block_header.magic = FIF_VOLUME_FORMAT_FREEBLOCK_HEADER_MAGIC;
-        new_free_block_header.block_count = block_count;
-        new_free_block_header.next_free_block = 0;
-        if ((result = fif_volume_write_block(mount, block_index, 0, &new_free_block_header, sizeof(new_free_block_header))) != FIF_ERROR_SUCCESS)
+        unsigned int candidate = (use_after) ? after++ : --before;
+        if (freeblock_node(mount, mount->freeblock_order[candidate])->block_count >= block_count)
         {
-            mount->error_state = 1;
-            return result;
+            *out_position = candidate;
+            return true;
         }
+    }
+}
 
-        // update the current last free block to point to us
-        if (mount->last_free_block != 0)
-        {
-            if ((result = fif_volume_read_block(mount, mount->last_free_block, 0, &this_free_block_header, sizeof(this_free_block_header))) != FIF_ERROR_SUCCESS)
-                return result;
+/**
+ * block allocator
+ */
 
-            // sanity check
-            if (this_free_block_header.magic != FIF_VOLUME_FORMAT_FREEBLOCK_HEADER_MAGIC)
-            {
-                fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_add_freeblock: freeblock %u is corrupt", mount->last_free_block);
-                return FIF_ERROR_CORRUPT_VOLUME;
-            }
+static int write_freeblock_header(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_count, fif_block_index_t next_free_block)
+{
+    FIF_VOLUME_FORMAT_FREEBLOCK_HEADER freeblock_header;
+    freeblock_header.magic = FIF_VOLUME_FORMAT_FREEBLOCK_HEADER_MAGIC;
+    freeblock_header.block_count = block_count;
+    freeblock_header.next_free_block = next_free_block;
+    return fif_volume_write_block(mount, block_index, 0, &freeblock_header, sizeof(freeblock_header));
+}
 
-            // check that it's the last block in the chain
-            if (this_free_block_header.next_free_block != 0)
-            {
-                fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_add_freeblock: freeblock %u has bad next_free_block (%u, expected zero)", mount->last_free_block, this_free_block_header.next_free_block);
-                return FIF_ERROR_CORRUPT_VOLUME;
-            }
+static int link_freeblock_after(fif_mount_handle mount, unsigned int position, fif_block_index_t next_free_block)
+{
+    // point whatever precedes the freeblock at position to next_free_block, either an earlier freeblock or the superblock
+    if (position == 0)
+    {
+        mount->first_free_block = next_free_block;
+        return FIF_ERROR_SUCCESS;
+    }
 
-            // update it to point to us
-            this_free_block_header.next_free_block = block_index;
-            if ((result = fif_volume_write_block(mount, mount->last_free_block, 0, &this_free_block_header, sizeof(this_free_block_header))) != FIF_ERROR_SUCCESS)
-            {
-                mount->error_state = 1;
-                return result;
-            }
+    struct fif_freeblock_node *prev_node = freeblock_node(mount, mount->freeblock_order[position - 1]);
+    return write_freeblock_header(mount, prev_node->block_index, prev_node->block_count, next_free_block);
+}
 
-            // and update the last block pointer
-            mount->last_free_block = block_index;
-        }
-        else
+int fif_volume_rebuild_freeblock_index(fif_mount_handle mount, const unsigned char *block_usage)
+{
+    int result;
+    init_freeblock_index(mount);
+
+    // the chain's head can be out of date, so instead every run of blocks that nothing uses is free
+    unsigned int total_free_blocks = 0;
+    fif_block_index_t block_index = 1;
+    while (block_index < mount->block_count)
+    {
+        if (block_usage[block_index] != 0)
         {
-            // there was no last free block, therefore there shouldn't be any first either
-            assert(mount->first_free_block == 0);
-            mount->first_free_block = block_index;
-            mount->last_free_block = block_index;
+            block_index++;
+            continue;
         }
+
+        fif_block_index_t run_end = block_index + 1;
+        while (run_end < mount->block_count && block_usage[run_end] == 0)
+            run_end++;
+
+        if ((result = freeblock_reserve_node(mount)) != FIF_ERROR_SUCCESS)
+            return result;
+        freeblock_insert(mount, mount->freeblock_count, block_index, run_end - block_index);
+
+        total_free_blocks += run_end - block_index;
+        block_index = run_end;
     }
 
-    // update the header with the new free blocks
-    mount->free_block_count += block_count;
-    if ((result = fif_volume_write_descriptor(mount)) != FIF_ERROR_SUCCESS)
+    // then write the chain to match
+    for (unsigned int position = 0; position < mount->freeblock_count && !mount->read_only; position++)
     {
-        mount->error_state = 1;
-        return result;
+        struct fif_freeblock_node *node = freeblock_node(mount, mount->freeblock_order[position]);
+        if ((result = write_freeblock_header(mount, node->block_index, node->block_count, freeblock_start_at(mount, position + 1))) != FIF_ERROR_SUCCESS)
+            return result;
     }
 
-    // done
-    //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "  first_free_block now = %u, last_free_block now = %u", mount->first_free_block, mount->last_free_block);
+    fif_block_index_t first_free_block = freeblock_start_at(mount, 0);
+    fif_block_index_t last_free_block = freeblock_start_at(mount, (mount->freeblock_count > 0) ? (mount->freeblock_count - 1) : 0);
+    if (first_free_block != mount->first_free_block || last_free_block != mount->last_free_block || total_free_blocks != mount->free_block_count)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_WARNING, "fif_volume_rebuild_freeblock_index: superblock says %u free blocks from %u to %u, volume has %u from %u to %u",
+                    mount->free_block_count, mount->first_free_block, mount->last_free_block, total_free_blocks, first_free_block, last_free_block);
+    }
+
+    mount->first_free_block = first_free_block;
+    mount->last_free_block = last_free_block;
+    mount->free_block_count = total_free_blocks;
     return FIF_ERROR_SUCCESS;
 }
 
-int fif_volume_remove_freeblock(fif_mount_handle mount, fif_block_index_t block_index, fif_block_index_t prevblock_index)
+int fif_volume_add_freeblock(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_count)
 {
     int result;
     if (mount->error_state)
         return FIF_ERROR_CORRUPT_VOLUME;
 
-    // read in the current free block
-    FIF_VOLUME_FORMAT_FREEBLOCK_HEADER freeblock_header;
-    if ((result = fif_volume_read_block(mount, block_index, 0, &freeblock_header, sizeof(freeblock_header))) != FIF_ERROR_SUCCESS)
+    // might need a node for a new freeblock
+    if ((result = freeblock_reserve_node(mount)) != FIF_ERROR_SUCCESS)
         return result;
 
-    // sanity check
-    //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "fif_volume_remove_freeblock(%u) :: %u,%u", block_index, freeblock_header.block_count, freeblock_header.next_free_block);
-    if (freeblock_header.magic != FIF_VOLUME_FORMAT_FREEBLOCK_HEADER_MAGIC)
+    // find the freeblocks either side
+    unsigned int position = freeblock_lower_bound(mount, block_index);
+    struct fif_freeblock_node *prev_node = (position > 0) ? freeblock_node(mount, mount->freeblock_order[position - 1]) : NULL;
+    struct fif_freeblock_node *next_node = (position < mount->freeblock_count) ? freeblock_node(mount, mount->freeblock_order[position]) : NULL;
+
+    // shouldn't be any overlap
+    if ((prev_node != NULL && (prev_node->block_index + prev_node->block_count) > block_index) ||
+        (next_node != NULL && (block_index + block_count) > next_node->block_index))
     {
-        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_remove_freeblock: freeblock %u is corrupt", block_index);
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_add_freeblock: blocks %u -> %u are already free", block_index, block_index + block_count - 1);
+        mount->error_state = 1;
         return FIF_ERROR_CORRUPT_VOLUME;
     }
 
-    // since we're removing the free block from the chain entirely, we need to update the previous block pointing to it
-    if (prevblock_index != 0)
+    bool merge_prev = (prev_node != NULL && (prev_node->block_index + prev_node->block_count) == block_index);
+    bool merge_next = (next_node != NULL && (block_index + block_count) == next_node->block_index);
+    if (merge_prev && merge_next)
     {
-        // read the previous block
-        FIF_VOLUME_FORMAT_FREEBLOCK_HEADER prevblock_header;
-        if ((result = fif_volume_read_block(mount, prevblock_index, 0, &prevblock_header, sizeof(prevblock_header))) != FIF_ERROR_SUCCESS)
-            return result;
-
-        // check magic
-        if (prevblock_header.magic != FIF_VOLUME_FORMAT_FREEBLOCK_HEADER_MAGIC)
+        // bridges two freeblocks, so the earlier one swallows the new blocks and the later one
+        fif_block_index_t next_free_block = next_node->block_index;
+        fif_block_index_t following_free_block = freeblock_start_at(mount, position + 1);
+        unsigned int merged_count = prev_node->block_count + block_count + next_node->block_count;
+        if ((result = write_freeblock_header(mount, prev_node->block_index, merged_count, following_free_block)) != FIF_ERROR_SUCCESS ||
+            (result = fif_volume_zero_block_partial(mount, next_free_block, 0, sizeof(FIF_VOLUME_FORMAT_FREEBLOCK_HEADER))) != FIF_ERROR_SUCCESS)
         {
-            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_remove_freeblock: freeblock %u has incorrect magic", prevblock_index);
-            return FIF_ERROR_CORRUPT_VOLUME;
+            mount->error_state = 1;
+            return result;
         }
 
-        // corruption check here
-        if (prevblock_header.next_free_block != block_index)
-        {
-            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_remove_freeblock: freeblock %u has incorrect next block pointer (%u, should be %u)", prevblock_index, prevblock_header.next_free_block, block_index);
-            return FIF_ERROR_CORRUPT_VOLUME;
-        }
+        if (mount->last_free_block == next_free_block)
+            mount->last_free_block = prev_node->block_index;
 
-        // handle case where we're the last block in the chain, so set the last block to the previous free block
-        if (freeblock_header.next_free_block == 0)
+        freeblock_update(mount, position - 1, prev_node->block_index, merged_count);
+        freeblock_erase(mount, position);
+    }
+    else if (merge_prev)
+    {
+        // simple, extend the previous freeblock
+        if ((result = write_freeblock_header(mount, prev_node->block_index, prev_node->block_count + block_count, freeblock_start_at(mount, position))) != FIF_ERROR_SUCCESS)
         {
-            if (mount->last_free_block != block_index)
-            {
-                fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_remove_freeblock: superblock has incorrect last block pointer (%u, should be %u)", mount->last_free_block, block_index);
-                mount->error_state = 1;
-                return FIF_ERROR_CORRUPT_VOLUME;
-            }
-
-            // update last block
-            mount->last_free_block = prevblock_index;
+            mount->error_state = 1;
+            return result;
         }
 
-        // update next block
-        prevblock_header.next_free_block = freeblock_header.next_free_block;
-        if ((result = fif_volume_write_block(mount, prevblock_index, 0, &prevblock_header, sizeof(prevblock_header))) != FIF_ERROR_SUCCESS)
+        freeblock_update(mount, position - 1, prev_node->block_index, prev_node->block_count + block_count);
+    }
+    else if (merge_next)
+    {
+        // retract the next freeblock back to our starting point, and point its predecessor at the new location
+        fif_block_index_t next_free_block = next_node->block_index;
+        unsigned int merged_count = block_count + next_node->block_count;
+        if ((result = write_freeblock_header(mount, block_index, merged_count, freeblock_start_at(mount, position + 1))) != FIF_ERROR_SUCCESS ||
+            (result = link_freeblock_after(mount, position, block_index)) != FIF_ERROR_SUCCESS ||
+            (result = fif_volume_zero_block_partial(mount, next_free_block, 0, sizeof(FIF_VOLUME_FORMAT_FREEBLOCK_HEADER))) != FIF_ERROR_SUCCESS)
         {
             mount->error_state = 1;
             return result;
         }
+
+        if (mount->last_free_block == next_free_block)
+            mount->last_free_block = block_index;
+
+        freeblock_update(mount, position, block_index, merged_count);
     }
     else
     {
-        // we're the first block in the chain, so update the superblock
-        assert(mount->first_free_block == block_index);
-        mount->first_free_block = freeblock_header.next_free_block;
-        if (freeblock_header.next_free_block == 0)
+        // a new freeblock between its neighbours
+        if ((result = write_freeblock_header(mount, block_index, block_count, freeblock_start_at(mount, position))) != FIF_ERROR_SUCCESS ||
+            (result = link_freeblock_after(mount, position, block_index)) != FIF_ERROR_SUCCESS)
         {
-            // we're also the last block in the chain
-            assert(mount->last_free_block == block_index);
-            mount->last_free_block = 0;
+            mount->error_state = 1;
+            return result;
         }
-    }
 
-    // 
+        if (next_node == NULL)
+            mount->last_free_block = block_index;
 
-    // update superblock
-    assert(mount->free_block_count >= freeblock_header.block_count);
-    mount->free_block_count -= freeblock_header.block_count;
-    if ((result = fif_volume_write_descriptor(mount)) != FIF_ERROR_SUCCESS)
+        freeblock_insert(mount, position, block_index, block_count);
+    }
+
+    // update the header with the new free blocks
+    mount->free_block_count += block_count;
+    if ((result = fif_volume_update_descriptor(mount)) != FIF_ERROR_SUCCESS)
     {
         mount->error_state = 1;
         return result;
     }
 
-    // all done
+    // done
     return FIF_ERROR_SUCCESS;
 }
 
-int fif_volume_shrink_freeblock(fif_mount_handle mount, fif_block_index_t block_index, fif_block_index_t new_block_count, fif_block_index_t prevblock_index)
+static int take_from_freeblock(fif_mount_handle mount, unsigned int position, unsigned int block_count)
 {
+    // allocates block_count blocks from the start of the freeblock at position
     int result;
-    if (mount->error_state)
-        return FIF_ERROR_CORRUPT_VOLUME;
-
-    // read in the current free block
-    FIF_VOLUME_FORMAT_FREEBLOCK_HEADER freeblock_header;
-    if ((result = fif_volume_read_block(mount, block_index, 0, &freeblock_header, sizeof(freeblock_header))) != FIF_ERROR_SUCCESS)
-        return result;
-
-    // sanity check
-    //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "fif_volume_shrink_freeblock(%u, %u -> %u) :: %u,%u", block_index, freeblock_header.block_count, new_block_count, freeblock_header.block_count, freeblock_header.next_free_block);
-    if (freeblock_header.magic != FIF_VOLUME_FORMAT_FREEBLOCK_HEADER_MAGIC)
-    {
-        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_shrink_freeblock: freeblock %u is corrupt", block_index);
-        return FIF_ERROR_CORRUPT_VOLUME;
-    }
-
-    // should always be > new_block_count
-    unsigned int old_freeblock_size = freeblock_header.block_count;
-    assert(old_freeblock_size > new_block_count);
-
-    // calculate the new free block index
-    unsigned int shrink_block_count = old_freeblock_size - new_block_count;
-    fif_block_index_t new_free_block_index = block_index + shrink_block_count;
-    //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "  shrink_block_count = %u", shrink_block_count);
-    //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "  new_free_block_index = %u", new_free_block_index);
-
-    // do we have to update the previous free block?
-    if (prevblock_index != 0)
+    struct fif_freeblock_node *this_node = freeblock_node(mount, mount->freeblock_order[position]);
+    fif_block_index_t this_free_block = this_node->block_index;
+    fif_block_index_t next_free_block = freeblock_start_at(mount, position + 1);
+    assert(this_node->block_count >= block_count);
+    if (this_node->block_count == block_count)
     {
-        // read the previous block
-        FIF_VOLUME_FORMAT_FREEBLOCK_HEADER prevblock_header;
-        if ((result = fif_volume_read_block(mount, prevblock_index, 0, &prevblock_header, sizeof(prevblock_header))) != FIF_ERROR_SUCCESS)
-            return result;
-
-        // corruption check here
-        if (prevblock_header.next_free_block != block_index)
-        {
-            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_shrink_block: freeblock %u has incorrect next block pointer (%u, should be %u)", prevblock_index, prevblock_header.next_free_block, block_index);
-            return FIF_ERROR_CORRUPT_VOLUME;
-        }
-
-        // update next block
-        prevblock_header.next_free_block = new_free_block_index;
-        if ((result = fif_volume_write_block(mount, prevblock_index, 0, &prevblock_header, sizeof(prevblock_header))) != FIF_ERROR_SUCCESS)
+        // taking up the entire freeblock, so remove it from the chain
+        if ((result = link_freeblock_after(mount, position, next_free_block)) != FIF_ERROR_SUCCESS)
         {
             mount->error_state = 1;
             return result;
         }
+
+        if (mount->last_free_block == this_free_block)
+            mount->last_free_block = (position > 0) ? freeblock_start_at(mount, position - 1) : 0;
+
+        freeblock_erase(mount, position);
     }
     else
     {
-        // if it's zero, it means it's the first free block
-        if (mount->first_free_block != block_index)
+        // shrink the freeblock, moving its header past the taken blocks
+        fif_block_index_t new_free_block = this_free_block + block_count;
+        unsigned int new_count = this_node->block_count - block_count;
+        if ((result = write_freeblock_header(mount, new_free_block, new_count, next_free_block)) != FIF_ERROR_SUCCESS ||
+            (result = link_freeblock_after(mount, position, new_free_block)) != FIF_ERROR_SUCCESS)
         {
-            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_shrink_block: superblock has incorrect first block pointer (%u, should be %u)", mount->first_free_block, block_index);
-            return FIF_ERROR_CORRUPT_VOLUME;
+            mount->error_state = 1;
+            return result;
         }
 
-        // update the header/superblock
-        mount->first_free_block = new_free_block_index;
-    }
-
-    // check if we're the ending free block in the volume
-    if (freeblock_header.next_free_block == 0)
-    {
-        // if it's zero, it means it's the first free block
-        if (mount->last_free_block != block_index)
-        {
-            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_shrink_block: superblock has incorrect last block pointer (%u, should be %u)", mount->last_free_block, block_index);
-            return FIF_ERROR_CORRUPT_VOLUME;
-        }
+        if (mount->last_free_block == this_free_block)
+            mount->last_free_block = new_free_block;
 
-        // update the header/superblock
-        mount->last_free_block = new_free_block_index;
+        freeblock_update(mount, position, new_free_block, new_count);
     }
 
-    // we can mostly reuse the found block header, just modifying the count
-    freeblock_header.block_count = new_block_count;
-    //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "  %u %u", freeblock_header.block_count, freeblock_header.next_free_block);
-    if ((result = fif_volume_write_block(mount, new_free_block_index, 0, &freeblock_header, sizeof(freeblock_header))) != FIF_ERROR_SUCCESS)
-    {
-        mount->error_state = 1;
+    // zero the old header so the blocks come back clean
+    if ((result = fif_volume_zero_block_partial(mount, this_free_block, 0, sizeof(FIF_VOLUME_FORMAT_FREEBLOCK_HEADER))) != FIF_ERROR_SUCCESS)
         return result;
-    }
 
-    // update header
-    mount->free_block_count -= shrink_block_count;
-    if ((result = fif_volume_write_descriptor(mount)) != FIF_ERROR_SUCCESS)
+    // update superblock
+    assert(mount->free_block_count >= block_count);
+    mount->free_block_count -= block_count;
+    if ((result = fif_volume_update_descriptor(mount)) != FIF_ERROR_SUCCESS)
     {
         mount->error_state = 1;
         return result;
     }
 
-    // all done
     return FIF_ERROR_SUCCESS;
 }
 
-int fif_volume_alloc_blocks(fif_mount_handle mount, fif_block_index_t block_hint, unsigned int block_count, fif_block_index_t *block_index)
+static unsigned int trailing_free_block_count(fif_mount_handle mount, unsigned int *out_position)
 {
-    int result;
-    if (mount->error_state)
-        return FIF_ERROR_CORRUPT_VOLUME;
+    // size of the freeblock that runs up to the end of the archive, if there is one
+    if (mount->freeblock_count == 0)
+        return 0;
 
-    //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "fif_volume_alloc_blocks(%u, %u)", block_hint, block_count);
+    struct fif_freeblock_node *last_node = freeblock_node(mount, mount->freeblock_order[mount->freeblock_count - 1]);
+    if ((last_node->block_index + last_node->block_count) != mount->block_count)
+        return 0;
 
-    // do we have any free blocks?
-    if (mount->first_free_block > 0)
-    {
-        fif_block_index_t prev_free_block = 0;
-        fif_block_index_t next_free_block = mount->first_free_block;
-        fif_block_index_t found_block_prev = 0;
-        fif_block_index_t found_block_index = 0;
-        fif_block_index_t found_block_distance = UINT32_MAX;
-        FIF_VOLUME_FORMAT_FREEBLOCK_HEADER freeblock_header;
-        FIF_VOLUME_FORMAT_FREEBLOCK_HEADER found_block_header;
+    if (out_position != NULL)
+        *out_position = mount->freeblock_count - 1;
 
-        // try to find a free block > block_hint if possible
-        while (next_free_block != 0)
-        {
-            //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "  next_free_block = %u", next_free_block);
-            if ((result = fif_volume_read_block(mount, next_free_block, 0, &freeblock_header, sizeof(freeblock_header))) != FIF_ERROR_SUCCESS)
-                return result;
+    return last_node->block_count;
+}
 
-            // sanity check here
-            if (freeblock_header.magic != FIF_VOLUME_FORMAT_FREEBLOCK_HEADER_MAGIC)
-            {
-                fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_shrink_freeblock: freeblock %u is corrupt", next_free_block);
-                return FIF_ERROR_CORRUPT_VOLUME;
-            }
+static int grow_volume(fif_mount_handle mount, unsigned int required_blocks)
+{
+    int result;
 
-            // is there sufficient space inside this block?
-            if (freeblock_header.block_count >= block_count)
-            {
-                // calculate distance from hint to block
-                fif_block_index_t distance = (next_free_block >= block_hint) ? (next_free_block - block_hint) : (block_hint - next_free_block);
-
-                // is this block closer?
-                if (distance < found_block_distance)
-                {
-                    found_block_prev = prev_free_block;
-                    found_block_index = next_free_block;
-                    found_block_distance = distance;
-                    memcpy(&found_block_header, &freeblock_header, sizeof(found_block_header));
-
-                    // if there's no hint, use the first-found block
-                    if (block_hint == 0)
-                        break;
-                }
-            }
+    // grow by at least the configured step, or a share of the current size, so a run of small allocations doesn't resize every time
+    unsigned int grow_blocks = required_blocks;
+    if (grow_blocks < mount->volume_growth_blocks)
+        grow_blocks = mount->volume_growth_blocks;
+    if (grow_blocks < (unsigned int)(((uint64_t)mount->block_count * mount->volume_growth_percent) / 100))
+        grow_blocks = (unsigned int)(((uint64_t)mount->block_count * mount->volume_growth_percent) / 100);
 
-            // go to the next free block
-            prev_free_block = next_free_block;
-            next_free_block = freeblock_header.next_free_block;
-        }
+    // the new blocks all go on the free list, merging with a freeblock at the end
+    fif_block_index_t first_new_block = mount->block_count;
+    if ((result = fif_volume_resize(mount, mount->block_count + grow_blocks)) != FIF_ERROR_SUCCESS)
+        return result;
 
-        // did we find a free block?
-        if (found_block_index != 0)
-        {
-            // does this free block require splitting?
-            assert(found_block_header.block_count >= block_count);
-            if (found_block_header.block_count > block_count)
-            {
-                // shrink the free block
-                if ((result = fif_volume_shrink_freeblock(mount, found_block_index, found_block_header.block_count - block_count, found_block_prev)) != FIF_ERROR_SUCCESS)
-                    return result;
-            }
-            else
-            {
-                // remove the free block from the chain
-                if ((result = fif_volume_remove_freeblock(mount, found_block_index, found_block_prev)) != FIF_ERROR_SUCCESS)
-                    return result;
-            }
+    return fif_volume_add_freeblock(mount, first_new_block, grow_blocks);
+}
 
-            // zero the found block header
-            if ((result = fif_volume_zero_block_partial(mount, found_block_index, 0, sizeof(FIF_VOLUME_FORMAT_FREEBLOCK_HEADER))) != FIF_ERROR_SUCCESS)
-                return result;
+int fif_volume_alloc_blocks(fif_mount_handle mount, fif_block_index_t block_hint, unsigned int block_count, fif_block_index_t *block_index)
+{
+    int result;
+    if (mount->error_state)
+        return FIF_ERROR_CORRUPT_VOLUME;
 
-            // block is now allocated!
-            //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "   -> %u", found_block_index);
-            *block_index = found_block_index;
-            return FIF_ERROR_SUCCESS;
-        }
+    // do we have a free block big enough? closest to the hint if there is one, otherwise the best fit
+    unsigned int position = 0;
+    if (freeblock_find(mount, block_hint, block_count, &position))
+    {
+        fif_block_index_t found_block_index = freeblock_start_at(mount, position);
+        if ((result = take_from_freeblock(mount, position, block_count)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        // block is now allocated!
+        *block_index = found_block_index;
+        return FIF_ERROR_SUCCESS;
     }
 
-    // the current block count is the block index we're handing back
-    *block_index = mount->block_count;
+    // we didn't find any free blocks, thus have to extend the archive. a freeblock at the end only needs topping up.
+    unsigned int trailing_blocks = trailing_free_block_count(mount, &position);
+    if ((result = grow_volume(mount, block_count - trailing_blocks)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // now the last freeblock is big enough
+    if (trailing_free_block_count(mount, &position) < block_count)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_alloc_blocks: no freeblock of %u blocks at the end after growing the volume", block_count);
+        mount->error_state = 1;
+        return FIF_ERROR_CORRUPT_VOLUME;
+    }
 
-    // we didn't find any free blocks, thus have to extend the archive, so calculate the new archive size and truncate it
-    if ((result = fif_volume_resize(mount, mount->block_count + block_count)) != FIF_ERROR_SUCCESS)
+    fif_block_index_t found_block_index = freeblock_start_at(mount, position);
+    if ((result = take_from_freeblock(mount, position, block_count)) != FIF_ERROR_SUCCESS)
         return result;
-    
+
     // all done
-    //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "   -> %u", *block_index);
+    *block_index = found_block_index;
     return FIF_ERROR_SUCCESS;
 }
 
@@ -744,14 +1505,91 @@ int fif_volume_free_blocks(fif_mount_handle mount, fif_block_index_t block_index
     assert((block_index + block_count) <= mount->block_count);
     //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "fif_volume_free_blocks(%u, %u)", block_index, block_count);
 
-    // zero the blocks
-    if ((result = fif_volume_zero_blocks(mount, block_index, block_count)) != FIF_ERROR_SUCCESS)
+    // zero the blocks, unless the mount doesn't care what freed blocks contain
+    if (!mount->skip_zero_freed_blocks && (result = fif_volume_zero_blocks(mount, block_index, block_count)) != FIF_ERROR_SUCCESS)
         return result;
 
     // add freeblocks
     return fif_volume_add_freeblock(mount, block_index, block_count);
 }
 
+int fif_volume_extend_block_range(fif_mount_handle mount, fif_block_index_t block_index, unsigned int current_block_count, unsigned int new_block_count, bool *out_extended)
+{
+    int result;
+    fif_block_index_t required_index = block_index + current_block_count;
+    fif_block_index_t required_blocks = new_block_count - current_block_count;
+    assert(new_block_count > current_block_count);
+    *out_extended = false;
+
+    // how much is free straight after the range?
+    unsigned int position = freeblock_lower_bound(mount, required_index);
+    unsigned int available_blocks = (freeblock_start_at(mount, position) == required_index) ? freeblock_node(mount, mount->freeblock_order[position])->block_count : 0;
+    if (available_blocks < required_blocks)
+    {
+        // can't be done without moving the range, unless it reaches the end of the archive and we can extend it out
+        if ((required_index + available_blocks) != mount->block_count)
+            return FIF_ERROR_SUCCESS;
+        if ((result = grow_volume(mount, required_blocks - available_blocks)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        position = freeblock_lower_bound(mount, required_index);
+    }
+
+    // take the start of the freeblock
+    if ((result = take_from_freeblock(mount, position, required_blocks)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    *out_extended = true;
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_volume_trim(fif_mount_handle mount)
+{
+    int result;
+    if (mount->error_state)
+        return FIF_ERROR_CORRUPT_VOLUME;
+
+    // anything free at the end of the archive?
+    unsigned int position;
+    unsigned int trailing_blocks = trailing_free_block_count(mount, &position);
+    if (trailing_blocks == 0)
+        return FIF_ERROR_SUCCESS;
+
+    // unlink it from the chain
+    fif_block_index_t trailing_free_block = freeblock_start_at(mount, position);
+    if ((result = link_freeblock_after(mount, position, 0)) != FIF_ERROR_SUCCESS)
+    {
+        mount->error_state = 1;
+        return result;
+    }
+
+    mount->last_free_block = (position > 0) ? freeblock_start_at(mount, position - 1) : 0;
+    freeblock_erase(mount, position);
+
+    // nothing cached past the new end can be written back
+    fif_volume_invalidate_block_cache(mount, trailing_free_block, trailing_blocks);
+
+    // cut the archive down
+    int64_t new_archive_size = (int64_t)mount->block_size * (int64_t)trailing_free_block;
+    if ((result = mount->io.io_ftruncate(mount->io.userdata, new_archive_size)) != FIF_ERROR_SUCCESS)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_trim: failed to shrink archive from %u blocks to %u blocks", mount->block_count, trailing_free_block);
+        mount->error_state = 1;
+        return result;
+    }
+
+    // update the header
+    mount->block_count = trailing_free_block;
+    mount->free_block_count -= trailing_blocks;
+    if ((result = fif_volume_update_descriptor(mount)) != FIF_ERROR_SUCCESS)
+    {
+        mount->error_state = 1;
+        return result;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
 int fif_volume_resize_block_range(fif_mount_handle mount, fif_block_index_t block_index, unsigned int current_block_count, unsigned int new_block_count, fif_block_index_t *new_block_index)
 {
     int result;
@@ -760,69 +1598,17 @@ int fif_volume_resize_block_range(fif_mount_handle mount, fif_block_index_t bloc
     // process for extending a block range
     if (new_block_count > current_block_count)
     {
-        fif_block_index_t required_index = block_index + current_block_count;
-        fif_block_index_t required_blocks = new_block_count - current_block_count;
-
-        // is this block at the end of the archive?
-        if (required_index == mount->block_count)
+        // grow in place if possible
+        bool extended;
+        if ((result = fif_volume_extend_block_range(mount, block_index, current_block_count, new_block_count, &extended)) != FIF_ERROR_SUCCESS)
+            return result;
+        if (extended)
         {
-            // simply extend the archive out
-            if ((result = fif_volume_resize(mount, mount->block_count + required_blocks)) != FIF_ERROR_SUCCESS)
-                return result;
-
             // the block index is not changing
             *new_block_index = block_index;
             return FIF_ERROR_SUCCESS;
         }
 
-        // search for a free block immediately after block_index of size <= new_block_count
-        fif_block_index_t prev_free_block_index = 0;
-        fif_block_index_t this_free_block_index = mount->first_free_block;
-        FIF_VOLUME_FORMAT_FREEBLOCK_HEADER freeblock_header;
-        while (this_free_block_index != 0)
-        {
-            // no point searching if the index is too high
-            if (this_free_block_index > required_index)
-                break;
-
-            // read the block
-            if ((result = fif_volume_read_block(mount, this_free_block_index, 0, &freeblock_header, sizeof(freeblock_header))) != FIF_ERROR_SUCCESS)
-                return result;
-
-            // does this one match?
-            if (this_free_block_index == required_index)
-            {
-                // well we're halfway there, now we need to see if it'll fit
-                if (freeblock_header.block_count > required_blocks)
-                {
-                    // simple enough now, just shrink the freeblock the required number of blocks
-                    if ((result = fif_volume_shrink_freeblock(mount, this_free_block_index, freeblock_header.block_count - required_blocks, prev_free_block_index)) != FIF_ERROR_SUCCESS)
-                        return result;
-
-                    // and return the same block index
-                    *new_block_index = block_index;
-                    return FIF_ERROR_SUCCESS;
-                }
-                else if (freeblock_header.block_count == required_blocks)
-                {
-                    // taking up the entire free block, so remove it from the chain
-                    if ((result = fif_volume_remove_freeblock(mount, this_free_block_index, prev_free_block_index)) != FIF_ERROR_SUCCESS)
-                        return result;
-
-                    // and return the same block index
-                    *new_block_index = block_index;
-                    return FIF_ERROR_SUCCESS;
-                }
-
-                // it won't fit, so no point looking through any more block since they won't match the index...
-                break;
-            }
-
-            // move to next
-            prev_free_block_index = this_free_block_index;
-            this_free_block_index = freeblock_header.next_free_block;
-        }
-
         // allocate new blocks of new_block_count
         fif_block_index_t allocated_index;
         if ((result = fif_volume_alloc_blocks(mount, block_index, new_block_count, &allocated_index)) != FIF_ERROR_SUCCESS)
@@ -842,12 +1628,12 @@ int fif_volume_resize_block_range(fif_mount_handle mount, fif_block_index_t bloc
     else if (new_block_count < current_block_count)
     {
         // shrinking the block range, so just add a freeblock after new_block_count
-        unsigned int freeblock_count = new_block_count - current_block_count;
-        if ((result = fif_volume_free_blocks(mount, current_block_count + new_block_count, freeblock_count)) != FIF_ERROR_SUCCESS)
+        unsigned int freeblock_count = current_block_count - new_block_count;
+        if ((result = fif_volume_free_blocks(mount, block_index + new_block_count, freeblock_count)) != FIF_ERROR_SUCCESS)
             return result;
 
-        // set to the same
-        *new_block_index = block_index;
+        // set to the same, unless there's nothing left
+        *new_block_index = (new_block_count > 0) ? block_index : 0;
     }
 
     // done with success, or did nothing at all
@@ -1,6 +1,889 @@
 #include "fif_internal.h"
 #include "trace.h"
 
+static unsigned int directory_header_size(const FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER *header)
+{
+    return (header->magic == FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER_MAGIC) ? sizeof(FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER) : sizeof(FIF_VOLUME_FORMAT_DIRECTORY_HEADER);
+}
+
+static unsigned int directory_entries_offset(const FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER *header)
+{
+    return directory_header_size(header) + header->hash_table_size * sizeof(uint32_t);
+}
+
+static int compare_filename(const char *filename, const char *entry_filename)
+{
+#ifdef _MSC_VER
+    return _stricmp(filename, entry_filename);
+#else
+    return strcasecmp(filename, entry_filename);
+#endif
+}
+
+// enumeration hands each entry's inode along too, the public callbacks only take the name
+typedef int(*directory_entry_callback)(void *userdata, const char *filename, fif_inode_index_t inode_index);
+
+static int read_directory_at(fif_mount_handle mount, fif_file_handle directory_file, unsigned int offset, void *buffer, unsigned int bytes)
+{
+    int result;
+    if (fif_file_seek(mount, directory_file, offset, FIF_SEEK_MODE_SET) < 0)
+        return FIF_ERROR_CORRUPT_VOLUME;
+    if ((result = fif_file_read(mount, directory_file, buffer, bytes)) != (int)bytes)
+        return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int write_directory_at(fif_mount_handle mount, fif_file_handle directory_file, unsigned int offset, const void *buffer, unsigned int bytes)
+{
+    int result;
+    if (fif_file_seek(mount, directory_file, offset, FIF_SEEK_MODE_SET) < 0)
+        return FIF_ERROR_CORRUPT_VOLUME;
+    if ((result = fif_file_write(mount, directory_file, buffer, bytes)) != (int)bytes)
+        return (result >= 0) ? FIF_ERROR_IO_ERROR : result;
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int read_directory_header(fif_mount_handle mount, fif_inode_index_t directory_inode_index, fif_file_handle directory_file, FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER *header)
+{
+    int result;
+
+    // the hashed header starts with the same fields as the linear one, so read that much first
+    if ((result = read_directory_at(mount, directory_file, 0, header, sizeof(FIF_VOLUME_FORMAT_DIRECTORY_HEADER))) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // linear and ordered directories have no hash table, the tree fields of ordered ones are read separately
+    if (header->magic == FIF_VOLUME_FORMAT_DIRECTORY_HEADER_MAGIC || header->magic == FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER_MAGIC)
+    {
+        header->hash_table_size = 0;
+        header->dead_entry_bytes = 0;
+        return FIF_ERROR_SUCCESS;
+    }
+
+    // read the rest of the hashed header
+    if (header->magic != FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER_MAGIC ||
+        (result = fif_file_read(mount, directory_file, (unsigned char *)header + sizeof(FIF_VOLUME_FORMAT_DIRECTORY_HEADER), sizeof(*header) - sizeof(FIF_VOLUME_FORMAT_DIRECTORY_HEADER))) != (int)(sizeof(*header) - sizeof(FIF_VOLUME_FORMAT_DIRECTORY_HEADER)) ||
+        header->hash_table_size == 0)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "read_directory_header: bad directory header in inode %u", directory_inode_index);
+        return FIF_ERROR_CORRUPT_VOLUME;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int write_directory_header(fif_mount_handle mount, fif_file_handle directory_file, const FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER *header)
+{
+    return write_directory_at(mount, directory_file, 0, header, directory_header_size(header));
+}
+
+/**
+  * path lookup cache
+  */
+
+static bool dentry_name_matches(const struct fif_dentry_cache_entry *entry, const char *filename, unsigned int filename_length)
+{
+    // the cached name is already folded to lowercase
+    if (entry->name_length != filename_length)
+        return false;
+
+    for (unsigned int i = 0; i < filename_length; i++)
+    {
+        char ch = filename[i];
+        if (ch >= 'A' && ch <= 'Z')
+            ch += 'a' - 'A';
+        if (ch != entry->name[i])
+            return false;
+    }
+
+    return true;
+}
+
+static void dentry_cache_lru_remove(fif_mount_handle mount, struct fif_dentry_cache_entry *entry)
+{
+    if (entry->lru_prev != NULL)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        mount->dentry_cache_lru_head = entry->lru_next;
+
+    if (entry->lru_next != NULL)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        mount->dentry_cache_lru_tail = entry->lru_prev;
+
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void dentry_cache_lru_push_head(fif_mount_handle mount, struct fif_dentry_cache_entry *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = mount->dentry_cache_lru_head;
+    if (mount->dentry_cache_lru_head != NULL)
+        mount->dentry_cache_lru_head->lru_prev = entry;
+    else
+        mount->dentry_cache_lru_tail = entry;
+
+    mount->dentry_cache_lru_head = entry;
+}
+
+static struct fif_dentry_cache_entry **dentry_cache_find_link(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename, unsigned int filename_length, uint32_t name_hash)
+{
+    struct fif_dentry_cache_entry **link = &mount->dentry_cache_buckets[(name_hash ^ directory_inode_index) % mount->dentry_cache_size];
+    while (*link != NULL)
+    {
+        struct fif_dentry_cache_entry *entry = *link;
+        if (entry->directory_inode_index == directory_inode_index && entry->name_hash == name_hash && dentry_name_matches(entry, filename, filename_length))
+            break;
+
+        link = &entry->hash_next;
+    }
+
+    return link;
+}
+
+static void dentry_cache_remove(fif_mount_handle mount, struct fif_dentry_cache_entry **link)
+{
+    struct fif_dentry_cache_entry *entry = *link;
+    *link = entry->hash_next;
+    dentry_cache_lru_remove(mount, entry);
+    mount->dentry_cache_count--;
+    free(entry);
+}
+
+static bool dentry_cache_lookup(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename, unsigned int filename_length, uint32_t name_hash, fif_inode_index_t *out_inode_index)
+{
+    if (mount->dentry_cache_buckets == NULL)
+        return false;
+
+    struct fif_dentry_cache_entry *entry = *dentry_cache_find_link(mount, directory_inode_index, filename, filename_length, name_hash);
+    if (entry == NULL)
+        return false;
+
+    // move to the front of the lru list
+    if (entry != mount->dentry_cache_lru_head)
+    {
+        dentry_cache_lru_remove(mount, entry);
+        dentry_cache_lru_push_head(mount, entry);
+    }
+
+    *out_inode_index = entry->inode_index;
+    return true;
+}
+
+static void dentry_cache_store(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename, unsigned int filename_length, uint32_t name_hash, fif_inode_index_t inode_index)
+{
+    if (mount->dentry_cache_buckets == NULL)
+        return;
+
+    // already have this name? just update it
+    struct fif_dentry_cache_entry **link = dentry_cache_find_link(mount, directory_inode_index, filename, filename_length, name_hash);
+    if (*link != NULL)
+    {
+        (*link)->inode_index = inode_index;
+        return;
+    }
+
+    // make room by dropping the least recently used name
+    if (mount->dentry_cache_count >= mount->dentry_cache_size)
+    {
+        struct fif_dentry_cache_entry *victim = mount->dentry_cache_lru_tail;
+        dentry_cache_remove(mount, dentry_cache_find_link(mount, victim->directory_inode_index, victim->name, victim->name_length, victim->name_hash));
+    }
+
+    // the name is stored folded, straight after the entry. failing to allocate just means it isn't cached.
+    struct fif_dentry_cache_entry *entry = (struct fif_dentry_cache_entry *)malloc(sizeof(struct fif_dentry_cache_entry) + filename_length + 1);
+    if (entry == NULL)
+        return;
+
+    entry->directory_inode_index = directory_inode_index;
+    entry->inode_index = inode_index;
+    entry->name_hash = name_hash;
+    entry->name_length = filename_length;
+    entry->name = (char *)(entry + 1);
+    for (unsigned int i = 0; i < filename_length; i++)
+    {
+        char ch = filename[i];
+        entry->name[i] = (ch >= 'A' && ch <= 'Z') ? (char)(ch + ('a' - 'A')) : ch;
+    }
+    entry->name[filename_length] = '\0';
+
+    // link it in
+    struct fif_dentry_cache_entry **bucket = &mount->dentry_cache_buckets[(name_hash ^ directory_inode_index) % mount->dentry_cache_size];
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    dentry_cache_lru_push_head(mount, entry);
+    mount->dentry_cache_count++;
+}
+
+static void dentry_cache_forget(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename, unsigned int filename_length)
+{
+    if (mount->dentry_cache_buckets == NULL)
+        return;
+
+    struct fif_dentry_cache_entry **link = dentry_cache_find_link(mount, directory_inode_index, filename, filename_length, fif_hash_filename(filename, filename_length));
+    if (*link != NULL)
+        dentry_cache_remove(mount, link);
+}
+
+int fif_init_dentry_cache(fif_mount_handle mount)
+{
+    mount->dentry_cache_buckets = NULL;
+    mount->dentry_cache_lru_head = NULL;
+    mount->dentry_cache_lru_tail = NULL;
+    mount->dentry_cache_count = 0;
+    if (mount->dentry_cache_size == 0)
+        return FIF_ERROR_SUCCESS;
+
+    // one bucket per entry
+    mount->dentry_cache_buckets = (struct fif_dentry_cache_entry **)calloc(mount->dentry_cache_size, sizeof(struct fif_dentry_cache_entry *));
+    if (mount->dentry_cache_buckets == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+
+    return FIF_ERROR_SUCCESS;
+}
+
+void fif_free_dentry_cache(fif_mount_handle mount)
+{
+    struct fif_dentry_cache_entry *entry = mount->dentry_cache_lru_head;
+    while (entry != NULL)
+    {
+        struct fif_dentry_cache_entry *next_entry = entry->lru_next;
+        free(entry);
+        entry = next_entry;
+    }
+
+    free(mount->dentry_cache_buckets);
+    mount->dentry_cache_buckets = NULL;
+    mount->dentry_cache_lru_head = NULL;
+    mount->dentry_cache_lru_tail = NULL;
+    mount->dentry_cache_count = 0;
+}
+
+/**
+  * ordered directories
+  */
+
+// nodes are never smaller than this, so even long names leave plenty of entries per node
+#define ORDERED_DIRECTORY_MIN_NODE_SIZE 4096
+
+// deeper than any real tree could get, anything past this is a loop
+#define ORDERED_DIRECTORY_MAX_DEPTH 32
+
+static int compare_folded_name(const char *name, unsigned int name_length, const char *other_name, unsigned int other_name_length)
+{
+    // compare the lowercased names, the same folding as fif_hash_filename
+    unsigned int length = (name_length < other_name_length) ? name_length : other_name_length;
+    for (unsigned int i = 0; i < length; i++)
+    {
+        unsigned char ch = (unsigned char)name[i];
+        unsigned char other_ch = (unsigned char)other_name[i];
+        if (ch >= 'A' && ch <= 'Z')
+            ch += 'a' - 'A';
+        if (other_ch >= 'A' && other_ch <= 'Z')
+            other_ch += 'a' - 'A';
+        if (ch != other_ch)
+            return (ch < other_ch) ? -1 : 1;
+    }
+
+    if (name_length == other_name_length)
+        return 0;
+    else
+        return (name_length < other_name_length) ? -1 : 1;
+}
+
+static unsigned int ordered_node_max_entry_size(const FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER *header)
+{
+    // a quarter of a node, so splitting always leaves entries on both sides
+    return (header->node_size - sizeof(FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE)) / 4;
+}
+
+static int read_ordered_header(fif_mount_handle mount, fif_file_handle directory_file, FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER *header)
+{
+    int result;
+    if ((result = read_directory_at(mount, directory_file, 0, header, sizeof(*header))) != FIF_ERROR_SUCCESS ||
+        header->magic != FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER_MAGIC ||
+        header->node_size < ORDERED_DIRECTORY_MIN_NODE_SIZE || header->node_count < 2 ||
+        header->root_node == 0 || header->root_node >= header->node_count ||
+        header->first_leaf_node == 0 || header->first_leaf_node >= header->node_count ||
+        directory_file->file_size != header->node_count * header->node_size)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "read_ordered_header: bad directory header in inode %u", directory_file->inode_index);
+        return FIF_ERROR_CORRUPT_VOLUME;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int write_ordered_header(fif_mount_handle mount, fif_file_handle directory_file, const FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER *header)
+{
+    return write_directory_at(mount, directory_file, 0, header, sizeof(*header));
+}
+
+static int read_ordered_node(fif_mount_handle mount, fif_file_handle directory_file, const FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER *header, uint32_t node_index, unsigned char *node)
+{
+    // check every entry fits now, so walking the node later can't run off the end
+    FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE node_header;
+    if (node_index != 0 && node_index < header->node_count &&
+        read_directory_at(mount, directory_file, node_index * header->node_size, node, header->node_size) == FIF_ERROR_SUCCESS)
+    {
+        memcpy(&node_header, node, sizeof(node_header));
+        unsigned int offset = sizeof(node_header);
+        unsigned int i = 0;
+        for (; node_header.used_bytes >= offset && node_header.used_bytes <= header->node_size && i < node_header.entry_count; i++)
+        {
+            FIF_VOLUME_FORMAT_DIRECTORY_ENTRY entry;
+            if ((node_header.used_bytes - offset) < sizeof(entry))
+                break;
+
+            memcpy(&entry, node + offset, sizeof(entry));
+            if (entry.name_length > (node_header.used_bytes - offset - sizeof(entry)))
+                break;
+
+            offset += sizeof(entry) + entry.name_length;
+        }
+
+        if (i == node_header.entry_count && offset == node_header.used_bytes)
+            return FIF_ERROR_SUCCESS;
+    }
+
+    fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "read_ordered_node: bad node %u in directory inode %u", node_index, directory_file->inode_index);
+    return FIF_ERROR_CORRUPT_VOLUME;
+}
+
+static int write_ordered_node(fif_mount_handle mount, fif_file_handle directory_file, const FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER *header, uint32_t node_index, unsigned char *node)
+{
+    // clear whatever is left past the entries, nodes are always written whole
+    FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE node_header;
+    memcpy(&node_header, node, sizeof(node_header));
+    memset(node + node_header.used_bytes, 0, header->node_size - node_header.used_bytes);
+    return write_directory_at(mount, directory_file, node_index * header->node_size, node, header->node_size);
+}
+
+static void search_ordered_node(const unsigned char *node, const char *name, unsigned int name_length, unsigned int *out_offset, bool *out_match, uint32_t *out_child)
+{
+    // finds the first entry that doesn't sort before the name, and for branches, the child covering the name
+    FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE node_header;
+    memcpy(&node_header, node, sizeof(node_header));
+    uint32_t child = node_header.link;
+    unsigned int offset = sizeof(node_header);
+    for (unsigned int i = 0; i < node_header.entry_count; i++)
+    {
+        FIF_VOLUME_FORMAT_DIRECTORY_ENTRY entry;
+        memcpy(&entry, node + offset, sizeof(entry));
+        int comparison = compare_folded_name((const char *)node + offset + sizeof(entry), entry.name_length, name, name_length);
+        if (comparison > 0)
+            break;
+
+        if (comparison == 0)
+        {
+            *out_offset = offset;
+            *out_match = true;
+            *out_child = entry.inode_index;
+            return;
+        }
+
+        child = entry.inode_index;
+        offset += sizeof(entry) + entry.name_length;
+    }
+
+    *out_offset = offset;
+    *out_match = false;
+    *out_child = child;
+}
+
+static int descend_ordered_directory(fif_mount_handle mount, fif_file_handle directory_file, const FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER *header, const char *name, unsigned int name_length,
+                                     unsigned char *node, uint32_t *path, unsigned int *out_depth)
+{
+    // walk from the root to the leaf that would hold the name, remembering the nodes on the way
+    int result;
+    uint32_t node_index = header->root_node;
+    uint32_t expected_level = 0;
+    for (unsigned int depth = 0; depth < ORDERED_DIRECTORY_MAX_DEPTH; depth++)
+    {
+        if ((result = read_ordered_node(mount, directory_file, header, node_index, node)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        // levels count down by one to the leaves
+        FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE node_header;
+        memcpy(&node_header, node, sizeof(node_header));
+        if (depth > 0 && node_header.level != expected_level)
+            break;
+
+        path[depth] = node_index;
+        if (node_header.level == 0)
+        {
+            *out_depth = depth + 1;
+            return FIF_ERROR_SUCCESS;
+        }
+
+        unsigned int offset;
+        bool match;
+        search_ordered_node(node, name, name_length, &offset, &match, &node_index);
+        expected_level = node_header.level - 1;
+    }
+
+    fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "descend_ordered_directory: bad tree structure in directory inode %u", directory_file->inode_index);
+    return FIF_ERROR_CORRUPT_VOLUME;
+}
+
+static int find_ordered_entry(fif_mount_handle mount, fif_file_handle directory_file, const char *filename, unsigned int filename_length, fif_inode_index_t *out_inode_index)
+{
+    int result;
+    FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER header;
+    if ((result = read_ordered_header(mount, directory_file, &header)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    unsigned char *node = (unsigned char *)malloc(header.node_size);
+    if (node == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+
+    uint32_t path[ORDERED_DIRECTORY_MAX_DEPTH];
+    unsigned int depth;
+    if ((result = descend_ordered_directory(mount, directory_file, &header, filename, filename_length, node, path, &depth)) == FIF_ERROR_SUCCESS)
+    {
+        unsigned int offset;
+        bool match;
+        uint32_t inode_index;
+        search_ordered_node(node, filename, filename_length, &offset, &match, &inode_index);
+        if (match)
+            *out_inode_index = inode_index;
+        else
+            result = FIF_ERROR_FILE_NOT_FOUND;
+    }
+
+    free(node);
+    return result;
+}
+
+static void insert_ordered_node_entry(unsigned char *node, unsigned int offset, const char *name, unsigned int name_length, uint32_t value)
+{
+    // the node buffer has room for one more entry past node_size, splitting sorts that out
+    FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE node_header;
+    memcpy(&node_header, node, sizeof(node_header));
+    FIF_VOLUME_FORMAT_DIRECTORY_ENTRY entry;
+    entry.name_length = name_length;
+    entry.inode_index = value;
+    unsigned int entry_size = sizeof(entry) + name_length;
+    memmove(node + offset + entry_size, node + offset, node_header.used_bytes - offset);
+    memcpy(node + offset, &entry, sizeof(entry));
+    memcpy(node + offset + sizeof(entry), name, name_length);
+    node_header.entry_count++;
+    node_header.used_bytes += entry_size;
+    memcpy(node, &node_header, sizeof(node_header));
+}
+
+static void split_ordered_node(unsigned char *node, unsigned char *right_node, uint32_t right_node_index, char *separator, unsigned int *separator_length)
+{
+    FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE node_header;
+    memcpy(&node_header, node, sizeof(node_header));
+
+    // find the first entry starting in the back half
+    unsigned int half = sizeof(node_header) + (node_header.used_bytes - sizeof(node_header)) / 2;
+    unsigned int offset = sizeof(node_header);
+    unsigned int left_count = 0;
+    FIF_VOLUME_FORMAT_DIRECTORY_ENTRY entry;
+    for (;;)
+    {
+        memcpy(&entry, node + offset, sizeof(entry));
+        if (offset >= half)
+            break;
+
+        offset += sizeof(entry) + entry.name_length;
+        left_count++;
+    }
+
+    // that entry's name separates the two nodes
+    FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE right_header;
+    memcpy(separator, node + offset + sizeof(entry), entry.name_length);
+    *separator_length = entry.name_length;
+    right_header.level = node_header.level;
+    if (node_header.level == 0)
+    {
+        // leaves keep the entry on the right, and stay chained in order
+        right_header.link = node_header.link;
+        node_header.link = right_node_index;
+        right_header.entry_count = node_header.entry_count - left_count;
+        right_header.used_bytes = sizeof(right_header) + (node_header.used_bytes - offset);
+        memcpy(right_node + sizeof(right_header), node + offset, node_header.used_bytes - offset);
+    }
+    else
+    {
+        // branches move the entry up, its child becoming the right node's first
+        unsigned int entry_end = offset + sizeof(entry) + entry.name_length;
+        right_header.link = entry.inode_index;
+        right_header.entry_count = node_header.entry_count - left_count - 1;
+        right_header.used_bytes = sizeof(right_header) + (node_header.used_bytes - entry_end);
+        memcpy(right_node + sizeof(right_header), node + entry_end, node_header.used_bytes - entry_end);
+    }
+
+    memcpy(right_node, &right_header, sizeof(right_header));
+    node_header.entry_count = left_count;
+    node_header.used_bytes = offset;
+    memcpy(node, &node_header, sizeof(node_header));
+}
+
+static int add_ordered_entry(fif_mount_handle mount, fif_file_handle directory_file, const char *filename, unsigned int filename_length, fif_inode_index_t fileinode)
+{
+    int result;
+    FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER header;
+    if ((result = read_ordered_header(mount, directory_file, &header)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // names have to fit a quarter of a node
+    unsigned int entry_size = sizeof(FIF_VOLUME_FORMAT_DIRECTORY_ENTRY) + filename_length;
+    unsigned int max_entry_size = ordered_node_max_entry_size(&header);
+    if (entry_size > max_entry_size)
+        return FIF_ERROR_BAD_PATH;
+
+    // the working node can overflow by an entry, the right half of a split goes after it
+    unsigned char *node = (unsigned char *)malloc(header.node_size * 3);
+    char *separator = (char *)malloc(max_entry_size);
+    if (node == NULL || separator == NULL)
+    {
+        free(separator);
+        free(node);
+        return FIF_ERROR_OUT_OF_MEMORY;
+    }
+    unsigned char *right_node = node + header.node_size * 2;
+
+    uint32_t path[ORDERED_DIRECTORY_MAX_DEPTH];
+    unsigned int depth;
+    if ((result = descend_ordered_directory(mount, directory_file, &header, filename, filename_length, node, path, &depth)) != FIF_ERROR_SUCCESS)
+    {
+        free(separator);
+        free(node);
+        return result;
+    }
+
+    // insert into the leaf, then carry separators up for as long as nodes split
+    const char *insert_name = filename;
+    unsigned int insert_name_length = filename_length;
+    uint32_t insert_value = fileinode;
+    for (unsigned int level = depth; level-- > 0; )
+    {
+        unsigned int offset;
+        bool match;
+        uint32_t child;
+        search_ordered_node(node, insert_name, insert_name_length, &offset, &match, &child);
+        if (match)
+        {
+            result = (level == depth - 1) ? FIF_ERROR_ALREADY_EXISTS : FIF_ERROR_CORRUPT_VOLUME;
+            break;
+        }
+
+        insert_ordered_node_entry(node, offset, insert_name, insert_name_length, insert_value);
+        FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE node_header;
+        memcpy(&node_header, node, sizeof(node_header));
+        if (node_header.used_bytes <= header.node_size)
+        {
+            result = write_ordered_node(mount, directory_file, &header, path[level], node);
+            break;
+        }
+
+        // split, the new right node goes on the end of the directory
+        uint32_t right_node_index = header.node_count++;
+        split_ordered_node(node, right_node, right_node_index, separator, &insert_name_length);
+        if ((result = write_ordered_node(mount, directory_file, &header, right_node_index, right_node)) != FIF_ERROR_SUCCESS ||
+            (result = write_ordered_node(mount, directory_file, &header, path[level], node)) != FIF_ERROR_SUCCESS)
+        {
+            break;
+        }
+
+        insert_name = separator;
+        insert_value = right_node_index;
+        if (level == 0)
+        {
+            // the root split, so grow a new one above it
+            FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE root_header;
+            root_header.level = node_header.level + 1;
+            root_header.entry_count = 0;
+            root_header.used_bytes = sizeof(root_header);
+            root_header.link = path[0];
+            memcpy(node, &root_header, sizeof(root_header));
+            insert_ordered_node_entry(node, sizeof(root_header), insert_name, insert_name_length, insert_value);
+            header.root_node = header.node_count++;
+            result = write_ordered_node(mount, directory_file, &header, header.root_node, node);
+            break;
+        }
+
+        if ((result = read_ordered_node(mount, directory_file, &header, path[level - 1], node)) != FIF_ERROR_SUCCESS)
+            break;
+    }
+
+    free(separator);
+    free(node);
+    if (result != FIF_ERROR_SUCCESS)
+        return result;
+
+    header.entry_bytes += entry_size;
+    return write_ordered_header(mount, directory_file, &header);
+}
+
+static int rebuild_ordered_directory(fif_mount_handle mount, fif_file_handle directory_file, FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER *header)
+{
+    int result;
+    unsigned int node_capacity = header->node_size - sizeof(FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE);
+
+    // copy every leaf entry out in order, each leaf will hold at least one so that's enough children too
+    unsigned char *entries = (unsigned char *)malloc(header->entry_bytes + 1);
+    unsigned char *node = (unsigned char *)malloc(header->node_size);
+    uint32_t *child_nodes = (uint32_t *)malloc((header->entry_bytes / sizeof(FIF_VOLUME_FORMAT_DIRECTORY_ENTRY) + 1) * sizeof(uint32_t));
+    unsigned int *child_keys = (unsigned int *)malloc((header->entry_bytes / sizeof(FIF_VOLUME_FORMAT_DIRECTORY_ENTRY) + 1) * sizeof(unsigned int));
+    if (entries == NULL || node == NULL || child_nodes == NULL || child_keys == NULL)
+    {
+        result = FIF_ERROR_OUT_OF_MEMORY;
+        goto CLEANUP_LABEL;
+    }
+
+    unsigned int entries_size = 0;
+    uint32_t node_index = header->first_leaf_node;
+    for (unsigned int visited = 0; node_index != 0; visited++)
+    {
+        FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE node_header;
+        if ((result = read_ordered_node(mount, directory_file, header, node_index, node)) != FIF_ERROR_SUCCESS)
+            goto CLEANUP_LABEL;
+
+        memcpy(&node_header, node, sizeof(node_header));
+        if (visited >= header->node_count || node_header.level != 0 || (node_header.used_bytes - sizeof(node_header)) > (header->entry_bytes - entries_size))
+        {
+            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "rebuild_ordered_directory: bad leaf chain in directory inode %u", directory_file->inode_index);
+            result = FIF_ERROR_CORRUPT_VOLUME;
+            goto CLEANUP_LABEL;
+        }
+
+        memcpy(entries + entries_size, node + sizeof(node_header), node_header.used_bytes - sizeof(node_header));
+        entries_size += node_header.used_bytes - sizeof(node_header);
+        node_index = node_header.link;
+    }
+
+    // pack the leaves full from node one onwards, there's always at least one leaf
+    uint32_t next_node_index = 1;
+    unsigned int child_count = 0;
+    unsigned int entries_offset = 0;
+    do
+    {
+        FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE node_header;
+        node_header.level = 0;
+        node_header.entry_count = 0;
+        node_header.used_bytes = sizeof(node_header);
+        child_nodes[child_count] = next_node_index;
+        child_keys[child_count++] = entries_offset;
+        while (entries_offset < entries_size)
+        {
+            FIF_VOLUME_FORMAT_DIRECTORY_ENTRY entry;
+            memcpy(&entry, entries + entries_offset, sizeof(entry));
+            unsigned int entry_size = sizeof(entry) + entry.name_length;
+            if (entry_size > (entries_size - entries_offset) || entry_size > node_capacity)
+            {
+                fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "rebuild_ordered_directory: bad entry in directory inode %u", directory_file->inode_index);
+                result = FIF_ERROR_CORRUPT_VOLUME;
+                goto CLEANUP_LABEL;
+            }
+            if (entry_size > (header->node_size - node_header.used_bytes))
+                break;
+
+            memcpy(node + node_header.used_bytes, entries + entries_offset, entry_size);
+            node_header.used_bytes += entry_size;
+            node_header.entry_count++;
+            entries_offset += entry_size;
+        }
+
+        node_header.link = (entries_offset < entries_size) ? (next_node_index + 1) : 0;
+        memcpy(node, &node_header, sizeof(node_header));
+        if ((result = write_ordered_node(mount, directory_file, header, next_node_index++, node)) != FIF_ERROR_SUCCESS)
+            goto CLEANUP_LABEL;
+    }
+    while (entries_offset < entries_size);
+
+    // then each level of branches above, until there's a single root
+    for (uint32_t level = 1; child_count > 1; level++)
+    {
+        unsigned int parent_count = 0;
+        for (unsigned int i = 0; i < child_count; )
+        {
+            FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE node_header;
+            node_header.level = level;
+            node_header.entry_count = 0;
+            node_header.used_bytes = sizeof(node_header);
+            node_header.link = child_nodes[i];
+            unsigned int first_key = child_keys[i++];
+            while (i < child_count)
+            {
+                FIF_VOLUME_FORMAT_DIRECTORY_ENTRY entry;
+                memcpy(&entry, entries + child_keys[i], sizeof(entry));
+                unsigned int entry_size = sizeof(entry) + entry.name_length;
+                if (entry_size > (header->node_size - node_header.used_bytes))
+                    break;
+
+                entry.inode_index = child_nodes[i];
+                memcpy(node + node_header.used_bytes, &entry, sizeof(entry));
+                memcpy(node + node_header.used_bytes + sizeof(entry), entries + child_keys[i] + sizeof(entry), entry.name_length);
+                node_header.used_bytes += entry_size;
+                node_header.entry_count++;
+                i++;
+            }
+
+            memcpy(node, &node_header, sizeof(node_header));
+            child_nodes[parent_count] = next_node_index;
+            child_keys[parent_count++] = first_key;
+            if ((result = write_ordered_node(mount, directory_file, header, next_node_index++, node)) != FIF_ERROR_SUCCESS)
+                goto CLEANUP_LABEL;
+        }
+
+        child_count = parent_count;
+    }
+
+    // drop the nodes past the new tree
+    header->root_node = child_nodes[0];
+    header->first_leaf_node = 1;
+    header->node_count = next_node_index;
+    if ((result = fif_file_truncate(mount, directory_file, header->node_count * header->node_size)) != FIF_ERROR_SUCCESS)
+        goto CLEANUP_LABEL;
+
+    result = write_ordered_header(mount, directory_file, header);
+
+CLEANUP_LABEL:
+    free(child_keys);
+    free(child_nodes);
+    free(node);
+    free(entries);
+    return result;
+}
+
+static int remove_ordered_entry(fif_mount_handle mount, fif_file_handle directory_file, const char *filename, unsigned int filename_length)
+{
+    int result;
+    FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER header;
+    if ((result = read_ordered_header(mount, directory_file, &header)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    unsigned char *node = (unsigned char *)malloc(header.node_size);
+    if (node == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+
+    // find the entry in its leaf
+    uint32_t path[ORDERED_DIRECTORY_MAX_DEPTH];
+    unsigned int depth, offset;
+    bool match;
+    uint32_t inode_index;
+    if ((result = descend_ordered_directory(mount, directory_file, &header, filename, filename_length, node, path, &depth)) != FIF_ERROR_SUCCESS)
+    {
+        free(node);
+        return result;
+    }
+    search_ordered_node(node, filename, filename_length, &offset, &match, &inode_index);
+    if (!match)
+    {
+        free(node);
+        return FIF_ERROR_FILE_NOT_FOUND;
+    }
+
+    // close the gap, nodes are left to empty out rather than being merged
+    FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE node_header;
+    memcpy(&node_header, node, sizeof(node_header));
+    unsigned int entry_size = sizeof(FIF_VOLUME_FORMAT_DIRECTORY_ENTRY) + filename_length;
+    memmove(node + offset, node + offset + entry_size, node_header.used_bytes - offset - entry_size);
+    node_header.entry_count--;
+    node_header.used_bytes -= entry_size;
+    memcpy(node, &node_header, sizeof(node_header));
+    result = write_ordered_node(mount, directory_file, &header, path[depth - 1], node);
+    free(node);
+    if (result != FIF_ERROR_SUCCESS)
+        return result;
+
+    // rebuild once the nodes are under a quarter full on average
+    header.entry_bytes -= entry_size;
+    if (header.node_count > 3 && header.entry_bytes < ((header.node_count - 1) * (header.node_size - sizeof(FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE))) / 4)
+        return rebuild_ordered_directory(mount, directory_file, &header);
+
+    return write_ordered_header(mount, directory_file, &header);
+}
+
+static int enumerate_ordered_directory(fif_mount_handle mount, fif_file_handle directory_file, const char *start, const char *end, directory_entry_callback callback, void *userdata)
+{
+    int result;
+    FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER header;
+    if ((result = read_ordered_header(mount, directory_file, &header)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    unsigned char *node = (unsigned char *)malloc(header.node_size);
+    char *filename_buffer = (char *)malloc(header.node_size);
+    if (node == NULL || filename_buffer == NULL)
+    {
+        free(filename_buffer);
+        free(node);
+        return FIF_ERROR_OUT_OF_MEMORY;
+    }
+
+    // start at the leaf holding the first name in range, or the first leaf
+    unsigned int offset = sizeof(FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE);
+    if (start != NULL && *start != '\0')
+    {
+        uint32_t path[ORDERED_DIRECTORY_MAX_DEPTH];
+        unsigned int depth;
+        bool match;
+        uint32_t child;
+        if ((result = descend_ordered_directory(mount, directory_file, &header, start, (unsigned int)strlen(start), node, path, &depth)) == FIF_ERROR_SUCCESS)
+            search_ordered_node(node, start, (unsigned int)strlen(start), &offset, &match, &child);
+    }
+    else
+    {
+        result = read_ordered_node(mount, directory_file, &header, header.first_leaf_node, node);
+    }
+
+    // walk along the leaves until we pass the end
+    unsigned int end_length = (end != NULL) ? (unsigned int)strlen(end) : 0;
+    for (unsigned int visited = 0; result == FIF_ERROR_SUCCESS; visited++)
+    {
+        FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE node_header;
+        memcpy(&node_header, node, sizeof(node_header));
+        if (visited >= header.node_count || node_header.level != 0)
+        {
+            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "enumerate_ordered_directory: bad leaf chain in directory inode %u", directory_file->inode_index);
+            result = FIF_ERROR_CORRUPT_VOLUME;
+            break;
+        }
+
+        bool finished = false;
+        while (offset < node_header.used_bytes)
+        {
+            FIF_VOLUME_FORMAT_DIRECTORY_ENTRY entry;
+            memcpy(&entry, node + offset, sizeof(entry));
+            const char *entry_name = (const char *)node + offset + sizeof(entry);
+            if (end_length > 0 && compare_folded_name(entry_name, entry.name_length, end, end_length) >= 0)
+            {
+                finished = true;
+                break;
+            }
+
+            memcpy(filename_buffer, entry_name, entry.name_length);
+            filename_buffer[entry.name_length] = '\0';
+            if ((result = callback(userdata, filename_buffer, entry.inode_index)) != 0)
+            {
+                finished = true;
+                break;
+            }
+
+            offset += sizeof(entry) + entry.name_length;
+        }
+
+        if (finished || node_header.link == 0)
+            break;
+
+        offset = sizeof(node_header);
+        result = read_ordered_node(mount, directory_file, &header, node_header.link, node);
+    }
+
+    free(filename_buffer);
+    free(node);
+    return result;
+}
+
+/**
+  * directories
+  */
+
 int fif_create_directory(fif_mount_handle mount, fif_inode_index_t inode_hint, fif_inode_index_t *out_directory_inode_index)
 {
     int result;
@@ -33,17 +916,78 @@ int fif_create_directory(fif_mount_handle mount, fif_inode_index_t inode_hint, f
     if ((result = fif_open_file_by_inode(mount, directory_inode_index, FIF_OPEN_MODE_WRITE | FIF_OPEN_MODE_TRUNCATE | FIF_OPEN_MODE_STREAMED | FIF_OPEN_MODE_DIRECTORY, &directory_file)) != FIF_ERROR_SUCCESS)
         return result;
 
-    // write root directory header
-    FIF_VOLUME_FORMAT_DIRECTORY_HEADER root_header;
-    root_header.magic = FIF_VOLUME_FORMAT_DIRECTORY_HEADER_MAGIC;
-    root_header.file_count = 0;
-    root_header.max_filename_length = 0;
-    root_header.first_file_inode = root_header.last_file_inode = 0;
-    if ((result = fif_file_write(mount, directory_file, &root_header, sizeof(root_header))) != sizeof(root_header))
+    // ordered volumes start each directory as a header node and one empty leaf
+    if (mount->volume_flags & FIF_VOLUME_FORMAT_FLAG_ORDERED_DIRECTORIES)
     {
-        fif_file_close(mount, directory_file);
-        if (result > 0)
-            result = FIF_ERROR_IO_ERROR;
+        FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER ordered_header;
+        ordered_header.magic = FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER_MAGIC;
+        ordered_header.file_count = 0;
+        ordered_header.max_filename_length = 0;
+        ordered_header.first_file_inode = ordered_header.last_file_inode = 0;
+        ordered_header.node_size = (mount->block_size > ORDERED_DIRECTORY_MIN_NODE_SIZE) ? mount->block_size : ORDERED_DIRECTORY_MIN_NODE_SIZE;
+        ordered_header.node_count = 2;
+        ordered_header.root_node = ordered_header.first_leaf_node = 1;
+        ordered_header.entry_bytes = 0;
+
+        FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE leaf_header;
+        leaf_header.level = 0;
+        leaf_header.entry_count = 0;
+        leaf_header.used_bytes = sizeof(leaf_header);
+        leaf_header.link = 0;
+
+        unsigned char *nodes = (unsigned char *)calloc(2, ordered_header.node_size);
+        if (nodes == NULL)
+        {
+            fif_file_close(mount, directory_file);
+            return FIF_ERROR_OUT_OF_MEMORY;
+        }
+
+        memcpy(nodes, &ordered_header, sizeof(ordered_header));
+        memcpy(nodes + ordered_header.node_size, &leaf_header, sizeof(leaf_header));
+        result = fif_file_write(mount, directory_file, nodes, ordered_header.node_size * 2);
+        free(nodes);
+        if (result != (int)(ordered_header.node_size * 2))
+        {
+            fif_file_close(mount, directory_file);
+            return (result >= 0) ? FIF_ERROR_IO_ERROR : result;
+        }
+    }
+    else
+    {
+        // new directories are hashed, unless the volume was created without a hash table size
+        FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER root_header;
+        root_header.magic = (mount->hash_table_size > 0) ? FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER_MAGIC : FIF_VOLUME_FORMAT_DIRECTORY_HEADER_MAGIC;
+        root_header.file_count = 0;
+        root_header.max_filename_length = 0;
+        root_header.first_file_inode = root_header.last_file_inode = 0;
+        root_header.hash_table_size = mount->hash_table_size;
+        root_header.dead_entry_bytes = 0;
+
+        // write root directory header, followed by the empty buckets
+        unsigned int header_size = directory_header_size(&root_header);
+        unsigned int table_size = root_header.hash_table_size * sizeof(uint32_t);
+        if ((result = fif_file_write(mount, directory_file, &root_header, header_size)) != (int)header_size)
+        {
+            fif_file_close(mount, directory_file);
+            return (result >= 0) ? FIF_ERROR_IO_ERROR : result;
+        }
+        if (table_size > 0)
+        {
+            uint32_t *buckets = (uint32_t *)calloc(root_header.hash_table_size, sizeof(uint32_t));
+            if (buckets == NULL)
+            {
+                fif_file_close(mount, directory_file);
+                return FIF_ERROR_OUT_OF_MEMORY;
+            }
+
+            result = fif_file_write(mount, directory_file, buckets, table_size);
+            free(buckets);
+            if (result != (int)table_size)
+            {
+                fif_file_close(mount, directory_file);
+                return (result >= 0) ? FIF_ERROR_IO_ERROR : result;
+            }
+        }
     }
 
     // close root directory file
@@ -70,10 +1014,8 @@ int fif_resolve_directory_name(fif_mount_handle mount, const char *dirname, fif_
     char *dirname_copy = (char *)alloca(dirname_length + 1);
     memcpy(dirname_copy, dirname, dirname_length + 1);
 
-    // split the path
-    int path_components = fif_split_path(dirname_copy);
-    if (path_components == 0)
-        return FIF_ERROR_BAD_PATH;
+    // split the path, there's always one more part than separators
+    int path_components = fif_split_path(dirname_copy) + 1;
 
     // process each part
     int result;
@@ -82,10 +1024,13 @@ int fif_resolve_directory_name(fif_mount_handle mount, const char *dirname, fif_
     for (int i = 0; i < path_components; i++)
     {
         // get next path part
-        path_part = fif_path_next_part(path_part);
+        if (i > 0)
+            path_part = fif_path_next_part(path_part);
+        if (*path_part == '\0')
+            return FIF_ERROR_BAD_PATH;
 
         // search the current directory for a file with this name
-        if ((result = fif_find_file_in_directory(mount, current_inode_index, path_part, &current_inode_index, NULL)) != FIF_ERROR_SUCCESS)
+        if ((result = fif_find_file_in_directory(mount, current_inode_index, path_part, &current_inode_index)) != FIF_ERROR_SUCCESS)
             return result;
     }
 
@@ -94,31 +1039,164 @@ int fif_resolve_directory_name(fif_mount_handle mount, const char *dirname, fif_
     return FIF_ERROR_SUCCESS;
 }
 
-int fif_find_file_in_directory(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename, fif_inode_index_t *file_inode_index, unsigned int *file_index_in_directory)
+static int find_hashed_entry(fif_mount_handle mount, fif_file_handle directory_file, const FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER *header, const char *filename, unsigned int filename_length,
+                             FIF_VOLUME_FORMAT_HASHED_DIRECTORY_ENTRY *out_entry, unsigned int *out_entry_offset, unsigned int *out_link_offset)
+{
+    int result;
+
+    // start at the bucket for this name
+    uint32_t name_hash = fif_hash_filename(filename, filename_length);
+    unsigned int link_offset = directory_header_size(header) + (name_hash % header->hash_table_size) * sizeof(uint32_t);
+    uint32_t entry_offset;
+    if ((result = read_directory_at(mount, directory_file, link_offset, &entry_offset, sizeof(entry_offset))) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // walk the chain, entries always link to earlier ones so a loop means corruption
+    char *entry_filename = (char *)alloca(filename_length + 1);
+    while (entry_offset != 0)
+    {
+        FIF_VOLUME_FORMAT_HASHED_DIRECTORY_ENTRY directory_entry;
+        if (entry_offset < directory_entries_offset(header) ||
+            (result = read_directory_at(mount, directory_file, entry_offset, &directory_entry, sizeof(directory_entry))) != FIF_ERROR_SUCCESS ||
+            (directory_entry.next_entry_offset != 0 && directory_entry.next_entry_offset >= entry_offset))
+        {
+            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "find_hashed_entry: bad entry at offset %u in directory inode %u", entry_offset, directory_file->inode_index);
+            return FIF_ERROR_CORRUPT_VOLUME;
+        }
+
+        // only read the name when the hash and length match
+        if (directory_entry.name_hash == name_hash && directory_entry.name_length == filename_length)
+        {
+            if ((result = fif_file_read(mount, directory_file, entry_filename, filename_length)) != (int)filename_length)
+                return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
+
+            entry_filename[filename_length] = '\0';
+            if (compare_filename(filename, entry_filename) == 0)
+            {
+                *out_entry = directory_entry;
+                *out_entry_offset = entry_offset;
+                *out_link_offset = link_offset;
+                return FIF_ERROR_SUCCESS;
+            }
+        }
+
+        link_offset = entry_offset + offsetof(FIF_VOLUME_FORMAT_HASHED_DIRECTORY_ENTRY, next_entry_offset);
+        entry_offset = directory_entry.next_entry_offset;
+    }
+
+    return FIF_ERROR_FILE_NOT_FOUND;
+}
+
+static int compact_hashed_directory(fif_mount_handle mount, fif_file_handle directory_file, FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER *header)
+{
+    int result;
+    unsigned int header_size = directory_header_size(header);
+    unsigned int table_size = header->hash_table_size * sizeof(uint32_t);
+    unsigned int entries_offset = header_size + table_size;
+    unsigned int old_entries_size = directory_file->file_size - entries_offset;
+
+    // read the old entries, and build the new table and entries in one buffer
+    unsigned char *old_entries = (unsigned char *)malloc(old_entries_size);
+    unsigned char *new_data = (unsigned char *)calloc(1, table_size + old_entries_size);
+    if (old_entries == NULL || new_data == NULL)
+    {
+        free(new_data);
+        free(old_entries);
+        return FIF_ERROR_OUT_OF_MEMORY;
+    }
+    if ((result = read_directory_at(mount, directory_file, entries_offset, old_entries, old_entries_size)) != FIF_ERROR_SUCCESS)
+    {
+        free(new_data);
+        free(old_entries);
+        return result;
+    }
+
+    // copy live entries in their original order, so chains still only link backwards
+    uint32_t *buckets = (uint32_t *)new_data;
+    unsigned int new_entries_size = 0;
+    unsigned int old_position = 0;
+    while (old_position < old_entries_size)
+    {
+        FIF_VOLUME_FORMAT_HASHED_DIRECTORY_ENTRY directory_entry;
+        if ((old_entries_size - old_position) < sizeof(directory_entry))
+            break;
+
+        memcpy(&directory_entry, old_entries + old_position, sizeof(directory_entry));
+        unsigned int entry_size = sizeof(directory_entry) + directory_entry.name_length;
+        if (entry_size > (old_entries_size - old_position))
+            break;
+
+        if (directory_entry.inode_index != 0)
+        {
+            unsigned int bucket = directory_entry.name_hash % header->hash_table_size;
+            directory_entry.next_entry_offset = buckets[bucket];
+            buckets[bucket] = entries_offset + new_entries_size;
+            memcpy(new_data + table_size + new_entries_size, &directory_entry, sizeof(directory_entry));
+            memcpy(new_data + table_size + new_entries_size + sizeof(directory_entry), old_entries + old_position + sizeof(directory_entry), directory_entry.name_length);
+            new_entries_size += entry_size;
+        }
+
+        old_position += entry_size;
+    }
+    free(old_entries);
+
+    // anything left over means an entry ran past the end of the directory
+    if (old_position != old_entries_size)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "compact_hashed_directory: truncated entry in directory inode %u", directory_file->inode_index);
+        free(new_data);
+        return FIF_ERROR_CORRUPT_VOLUME;
+    }
+
+    // write it back, and drop the tail
+    result = write_directory_at(mount, directory_file, header_size, new_data, table_size + new_entries_size);
+    free(new_data);
+    if (result != FIF_ERROR_SUCCESS ||
+        (result = fif_file_truncate(mount, directory_file, entries_offset + new_entries_size)) != FIF_ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    header->dead_entry_bytes = 0;
+    return FIF_ERROR_SUCCESS;
+}
+
+static int search_directory(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename, unsigned int filename_length, fif_inode_index_t *file_inode_index)
 {
     int result;
     fif_offset_t seek_result;
-    unsigned int filename_length = (unsigned int)strlen(filename);
 
     // open the directory as a file
     fif_file_handle directory_file_handle;
-    if ((result = fif_open_file_by_inode(mount, directory_inode_index, FIF_OPEN_MODE_READ | FIF_OPEN_MODE_STREAMED | FIF_OPEN_MODE_DIRECTORY, &directory_file_handle)) != FIF_ERROR_SUCCESS)
+    if ((result = fif_open_file_by_inode(mount, directory_inode_index, FIF_OPEN_MODE_READ | FIF_OPEN_MODE_DIRECTORY, &directory_file_handle)) != FIF_ERROR_SUCCESS)
         return result;
 
     // read the directory header
-    FIF_VOLUME_FORMAT_DIRECTORY_HEADER directory_header;
-    if ((result = fif_file_read(mount, directory_file_handle, &directory_header, sizeof(directory_header))) != sizeof(directory_header))
+    FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER directory_header;
+    if ((result = read_directory_header(mount, directory_inode_index, directory_file_handle, &directory_header)) != FIF_ERROR_SUCCESS)
     {
         fif_file_close(mount, directory_file_handle);
-        return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
+        return result;
     }
 
-    // check it
-    if (directory_header.magic != FIF_VOLUME_FORMAT_DIRECTORY_HEADER_MAGIC)
+    // ordered directories walk down the tree
+    if (directory_header.magic == FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER_MAGIC)
     {
-        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_find_file_in_directory: bad directory magic in inode %u", directory_inode_index);
+        result = find_ordered_entry(mount, directory_file_handle, filename, filename_length, file_inode_index);
         fif_file_close(mount, directory_file_handle);
-        return FIF_ERROR_CORRUPT_VOLUME;
+        return result;
+    }
+
+    // hashed directories only need to look at one bucket
+    if (directory_header.hash_table_size > 0)
+    {
+        FIF_VOLUME_FORMAT_HASHED_DIRECTORY_ENTRY directory_entry;
+        unsigned int entry_offset, link_offset;
+        if ((result = find_hashed_entry(mount, directory_file_handle, &directory_header, filename, filename_length, &directory_entry, &entry_offset, &link_offset)) == FIF_ERROR_SUCCESS)
+            *file_inode_index = directory_entry.inode_index;
+
+        fif_file_close(mount, directory_file_handle);
+        return result;
     }
 
     // iterate through each file
@@ -137,7 +1215,7 @@ int fif_find_file_in_directory(fif_mount_handle mount, fif_inode_index_t directo
         if (directory_entry.name_length == filename_length)
         {
             // read the filename
-            if ((result = fif_file_read(mount, directory_file_handle, entry_filename, filename_length)) != filename_length)
+            if ((result = fif_file_read(mount, directory_file_handle, entry_filename, filename_length)) != (int)filename_length)
             {
                 fif_file_close(mount, directory_file_handle);
                 return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
@@ -145,17 +1223,10 @@ int fif_find_file_in_directory(fif_mount_handle mount, fif_inode_index_t directo
 
             // compare it
             entry_filename[filename_length] = '\0';
-#ifdef _MSC_VER
-            if (_stricmp(filename, entry_filename) == 0)
-#else
-            if (strcasecmp(filename, entry_filename) == 0)
-#endif
+            if (compare_filename(filename, entry_filename) == 0)
             {
                 // found the file, store the info
-                if (file_inode_index != NULL)
-                    *file_inode_index = directory_entry.inode_index;
-                if (file_index_in_directory != NULL)
-                    *file_index_in_directory = i;
+                *file_inode_index = directory_entry.inode_index;
 
                 // close handle and exit
                 fif_file_close(mount, directory_file_handle);
@@ -172,15 +1243,70 @@ int fif_find_file_in_directory(fif_mount_handle mount, fif_inode_index_t directo
         }
     }
 
-    // not found :(
-    fif_file_close(mount, directory_file_handle);
-    return FIF_ERROR_FILE_NOT_FOUND;
+    // not found :(
+    fif_file_close(mount, directory_file_handle);
+    return FIF_ERROR_FILE_NOT_FOUND;
+}
+
+int fif_find_file_in_directory(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename, fif_inode_index_t *file_inode_index)
+{
+    int result;
+    unsigned int filename_length = (unsigned int)strlen(filename);
+    uint32_t name_hash = fif_hash_filename(filename, filename_length);
+
+    // names that don't exist are cached too, as a zero inode. entries left behind by a removed directory
+    // are all missing names by then, which is still true if the inode is reused for a new directory.
+    fif_inode_index_t found_inode_index;
+    if (!dentry_cache_lookup(mount, directory_inode_index, filename, filename_length, name_hash, &found_inode_index))
+    {
+        if ((result = search_directory(mount, directory_inode_index, filename, filename_length, &found_inode_index)) == FIF_ERROR_FILE_NOT_FOUND)
+            found_inode_index = 0;
+        else if (result != FIF_ERROR_SUCCESS)
+            return result;
+
+        dentry_cache_store(mount, directory_inode_index, filename, filename_length, name_hash, found_inode_index);
+    }
+
+    if (found_inode_index == 0)
+        return FIF_ERROR_FILE_NOT_FOUND;
+
+    if (file_inode_index != NULL)
+        *file_inode_index = found_inode_index;
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int add_hashed_entry(fif_mount_handle mount, fif_file_handle directory_file, const FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER *header, const char *filename, unsigned int filename_length, fif_inode_index_t fileinode)
+{
+    int result;
+
+    // the new entry goes at the end, at the head of its bucket's chain
+    FIF_VOLUME_FORMAT_HASHED_DIRECTORY_ENTRY directory_entry;
+    directory_entry.name_length = filename_length;
+    directory_entry.inode_index = fileinode;
+    directory_entry.name_hash = fif_hash_filename(filename, filename_length);
+    unsigned int bucket_offset = directory_header_size(header) + (directory_entry.name_hash % header->hash_table_size) * sizeof(uint32_t);
+    if ((result = read_directory_at(mount, directory_file, bucket_offset, &directory_entry.next_entry_offset, sizeof(directory_entry.next_entry_offset))) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // write the entry before pointing the bucket at it
+    uint32_t entry_offset = directory_file->file_size;
+    if ((result = write_directory_at(mount, directory_file, entry_offset, &directory_entry, sizeof(directory_entry))) != FIF_ERROR_SUCCESS ||
+        (result = fif_file_write(mount, directory_file, filename, filename_length)) != (int)filename_length)
+    {
+        return (result >= 0) ? FIF_ERROR_IO_ERROR : result;
+    }
+
+    return write_directory_at(mount, directory_file, bucket_offset, &entry_offset, sizeof(entry_offset));
 }
 
 int fif_add_file_to_directory(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename, fif_inode_index_t fileinode)
 {
     int result;
-    fif_offset_t seek_result;
+
+    // whatever happens, the cached answer for this name is about to be wrong
+    int filename_length = (int)strlen(filename);
+    dentry_cache_forget(mount, directory_inode_index, filename, filename_length);
 
     // open the directory inode as a file
     fif_file_handle directory_file;
@@ -188,22 +1314,45 @@ int fif_add_file_to_directory(fif_mount_handle mount, fif_inode_index_t director
         return result;
 
     // read the directory header
-    FIF_VOLUME_FORMAT_DIRECTORY_HEADER directory_header;
-    if (fif_file_read(mount, directory_file, &directory_header, sizeof(directory_header)) != sizeof(directory_header))
+    FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER directory_header;
+    if ((result = read_directory_header(mount, directory_inode_index, directory_file, &directory_header)) != FIF_ERROR_SUCCESS)
     {
         fif_file_close(mount, directory_file);
-        return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
+        return result;
     }
 
-    // validate header
-    if (directory_header.magic != FIF_VOLUME_FORMAT_DIRECTORY_HEADER_MAGIC)
+    // add the entry
+    if (directory_header.magic == FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER_MAGIC)
     {
-        fif_file_close(mount, directory_file);
-        return FIF_ERROR_CORRUPT_VOLUME;
+        if ((result = add_ordered_entry(mount, directory_file, filename, filename_length, fileinode)) != FIF_ERROR_SUCCESS)
+        {
+            fif_file_close(mount, directory_file);
+            return result;
+        }
+    }
+    else if (directory_header.hash_table_size > 0)
+    {
+        if ((result = add_hashed_entry(mount, directory_file, &directory_header, filename, filename_length, fileinode)) != FIF_ERROR_SUCCESS)
+        {
+            fif_file_close(mount, directory_file);
+            return result;
+        }
+    }
+    else
+    {
+        // construct the entry, todo vectored write to write entry and filename in one swoop
+        FIF_VOLUME_FORMAT_DIRECTORY_ENTRY directory_entry;
+        directory_entry.inode_index = fileinode;
+        directory_entry.name_length = filename_length;
+        if ((result = write_directory_at(mount, directory_file, directory_file->file_size, &directory_entry, sizeof(directory_entry))) != FIF_ERROR_SUCCESS ||
+            (result = fif_file_write(mount, directory_file, filename, filename_length)) != filename_length)
+        {
+            fif_file_close(mount, directory_file);
+            return (result >= 0) ? FIF_ERROR_IO_ERROR : result;
+        }
     }
 
     // update header
-    int filename_length = (int)strlen(filename);
     if ((directory_header.file_count++) == 0)
     {
         // first file
@@ -222,60 +1371,57 @@ int fif_add_file_to_directory(fif_mount_handle mount, fif_inode_index_t director
     }
 
     // rewrite header
-    if ((seek_result = fif_file_seek(mount, directory_file, 0, FIF_SEEK_MODE_SET)) < 0 || (result = fif_file_write(mount, directory_file, &directory_header, sizeof(directory_header))) != sizeof(directory_header))
+    if ((result = write_directory_header(mount, directory_file, &directory_header)) != FIF_ERROR_SUCCESS)
     {
         fif_file_close(mount, directory_file);
-        return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
-    }
-
-    // construct the entry, todo vectored write to write entry and filename in one swoop
-    FIF_VOLUME_FORMAT_DIRECTORY_ENTRY directory_entry;
-    directory_entry.inode_index = fileinode;
-    directory_entry.name_length = filename_length;
-    if ((seek_result = fif_file_seek(mount, directory_file, 0, FIF_SEEK_MODE_END)) < 0 ||
-        (result = fif_file_write(mount, directory_file, &directory_entry, sizeof(directory_entry))) != sizeof(directory_entry) ||
-        (result = fif_file_write(mount, directory_file, filename, filename_length)) != filename_length)
-    {
-        fif_file_close(mount, directory_file);
-        return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
+        return result;
     }
 
     // done with the directory now
-    fif_file_close(mount, directory_file);
+    if ((result = fif_file_close(mount, directory_file)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    dentry_cache_store(mount, directory_inode_index, filename, filename_length, fif_hash_filename(filename, filename_length), fileinode);
     return FIF_ERROR_SUCCESS;
 }
 
-int fif_remove_file_from_directory(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename)
+static int remove_hashed_entry(fif_mount_handle mount, fif_file_handle directory_file, FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER *header, const char *filename, unsigned int filename_length)
 {
-    // optimize this...
     int result;
-    fif_offset_t seek_result;
-    unsigned int filename_length = (unsigned int)strlen(filename);
 
-    // open the directory as a file
-    fif_file_handle directory_file_handle;
-    if ((result = fif_open_file_by_inode(mount, directory_inode_index, FIF_OPEN_MODE_READ | FIF_OPEN_MODE_WRITE | FIF_OPEN_MODE_STREAMED | FIF_OPEN_MODE_DIRECTORY, &directory_file_handle)) != FIF_ERROR_SUCCESS)
+    // find the entry, and what links to it
+    FIF_VOLUME_FORMAT_HASHED_DIRECTORY_ENTRY directory_entry;
+    unsigned int entry_offset, link_offset;
+    if ((result = find_hashed_entry(mount, directory_file, header, filename, filename_length, &directory_entry, &entry_offset, &link_offset)) != FIF_ERROR_SUCCESS)
         return result;
 
-    // read the directory header
-    FIF_VOLUME_FORMAT_DIRECTORY_HEADER directory_header;
-    if ((result = fif_file_read(mount, directory_file_handle, &directory_header, sizeof(directory_header))) != sizeof(directory_header))
+    // unlink it from the chain, and leave it in place as a dead entry
+    uint32_t next_entry_offset = directory_entry.next_entry_offset;
+    directory_entry.inode_index = 0;
+    directory_entry.next_entry_offset = 0;
+    if ((result = write_directory_at(mount, directory_file, link_offset, &next_entry_offset, sizeof(next_entry_offset))) != FIF_ERROR_SUCCESS ||
+        (result = write_directory_at(mount, directory_file, entry_offset, &directory_entry, sizeof(directory_entry))) != FIF_ERROR_SUCCESS)
     {
-        fif_file_close(mount, directory_file_handle);
-        return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
+        return result;
     }
 
-    // check it
-    if (directory_header.magic != FIF_VOLUME_FORMAT_DIRECTORY_HEADER_MAGIC)
-    {
-        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_find_file_in_directory: bad directory magic in inode %u", directory_inode_index);
-        fif_file_close(mount, directory_file_handle);
-        return FIF_ERROR_CORRUPT_VOLUME;
-    }
+    // compact once at least half the entries (and a whole block) are dead
+    header->dead_entry_bytes += sizeof(directory_entry) + directory_entry.name_length;
+    unsigned int entries_size = directory_file->file_size - directory_entries_offset(header);
+    if (header->dead_entry_bytes >= mount->block_size && header->dead_entry_bytes >= (entries_size / 2))
+        return compact_hashed_directory(mount, directory_file, header);
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int remove_linear_entry(fif_mount_handle mount, fif_file_handle directory_file_handle, const FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER *header, const char *filename, unsigned int filename_length)
+{
+    int result;
+    fif_offset_t seek_result;
 
     // iterate through each file
     char *entry_filename = (char *)alloca(filename_length + 1);
-    unsigned int file_count = directory_header.file_count;
+    unsigned int file_count = header->file_count;
     for (unsigned int i = 0; i < file_count; i++)
     {
         // store current entry's offset
@@ -284,108 +1430,206 @@ int fif_remove_file_from_directory(fif_mount_handle mount, fif_inode_index_t dir
         // read entry
         FIF_VOLUME_FORMAT_DIRECTORY_ENTRY directory_entry;
         if ((result = fif_file_read(mount, directory_file_handle, &directory_entry, sizeof(directory_entry))) != sizeof(directory_entry))
-        {
-            fif_file_close(mount, directory_file_handle);
             return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
-        }
 
         // does the name length match? if not, we can skip reading it
-        if (directory_entry.name_length == filename_length)
+        if (directory_entry.name_length != filename_length)
         {
-            // read the filename
-            if ((result = fif_file_read(mount, directory_file_handle, entry_filename, filename_length)) != filename_length)
-            {
-                fif_file_close(mount, directory_file_handle);
-                return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
-            }
-
-            // compare it
-            entry_filename[filename_length] = '\0';
-#ifdef _MSC_VER
-            if (_stricmp(filename, entry_filename) == 0)
-#else
-            if (strcasecmp(filename, entry_filename) == 0)
-#endif
-            {
-                // get the remaining file size after this directory entry, and read in this data
-                unsigned int remaining_bytes = directory_file_handle->file_size - directory_file_handle->current_offset;
-                unsigned char *remaining_data = NULL;
-                if (remaining_bytes > 0)
-                {
-                    remaining_data = (unsigned char *)malloc(remaining_bytes);
-                    if (remaining_data == NULL)
-                    {
-                        free(remaining_data);
-                        return FIF_ERROR_OUT_OF_MEMORY;
-                    }
-                    if ((result = fif_file_read(mount, directory_file_handle, remaining_data, remaining_bytes)) != remaining_bytes)
-                    {
-                        free(remaining_data);
-                        fif_file_close(mount, directory_file_handle);
-                        return (result >= 0) ? FIF_ERROR_IO_ERROR : result;
-                    }
-
-                    // seek back to this entry's offset, and write the remaining data, thus overwriting it
-                    if ((seek_result = fif_file_seek(mount, directory_file_handle, current_entry_offset, FIF_SEEK_MODE_SET)) < 0 ||
-                        (result = fif_file_write(mount, directory_file_handle, remaining_data, remaining_bytes)) != remaining_bytes)
-                    {
-                        free(remaining_data);
-                        fif_file_close(mount, directory_file_handle);
-                        return (result >= 0) ? FIF_ERROR_IO_ERROR : result;
-                    }
-
-                    // buffer can go now
-                    free(remaining_data);
-                }
-
-                // truncate to the correct size
-                if ((result = fif_file_truncate(mount, directory_file_handle, current_entry_offset + remaining_bytes)) != FIF_ERROR_SUCCESS)
-                {
-                    fif_file_close(mount, directory_file_handle);
-                    return result;
-                }
+            if ((seek_result = fif_file_seek(mount, directory_file_handle, directory_entry.name_length, FIF_SEEK_MODE_CUR)) < 0)
+                return FIF_ERROR_CORRUPT_VOLUME;
 
-                // close handle and exit
-                fif_file_close(mount, directory_file_handle);
-                return FIF_ERROR_SUCCESS;
-            }
+            continue;
         }
-        else
+
+        // read the filename
+        if ((result = fif_file_read(mount, directory_file_handle, entry_filename, filename_length)) != (int)filename_length)
+            return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
+
+        // compare it
+        entry_filename[filename_length] = '\0';
+        if (compare_filename(filename, entry_filename) != 0)
+            continue;
+
+        // get the remaining file size after this directory entry, and read in this data
+        unsigned int remaining_bytes = directory_file_handle->file_size - directory_file_handle->current_offset;
+        if (remaining_bytes > 0)
         {
-            if ((seek_result = fif_file_seek(mount, directory_file_handle, directory_entry.name_length, FIF_SEEK_MODE_CUR)) < 0)
+            unsigned char *remaining_data = (unsigned char *)malloc(remaining_bytes);
+            if (remaining_data == NULL)
+                return FIF_ERROR_OUT_OF_MEMORY;
+
+            // seek back to this entry's offset, and write the remaining data, thus overwriting it
+            if ((result = fif_file_read(mount, directory_file_handle, remaining_data, remaining_bytes)) != (int)remaining_bytes ||
+                (result = write_directory_at(mount, directory_file_handle, current_entry_offset, remaining_data, remaining_bytes)) != FIF_ERROR_SUCCESS)
             {
-                fif_file_close(mount, directory_file_handle);
-                return FIF_ERROR_CORRUPT_VOLUME;
+                free(remaining_data);
+                return (result >= 0) ? FIF_ERROR_IO_ERROR : result;
             }
+
+            // buffer can go now
+            free(remaining_data);
         }
+
+        // truncate to the correct size
+        return fif_file_truncate(mount, directory_file_handle, current_entry_offset + remaining_bytes);
     }
 
     // not found :(
-    fif_file_close(mount, directory_file_handle);
     return FIF_ERROR_FILE_NOT_FOUND;
 }
 
-static int read_entry_and_invoke_callback(fif_mount_handle mount, fif_file_handle directory_file, fif_enumdir_callback callback, void *userdata)
+int fif_remove_file_from_directory(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename)
+{
+    int result;
+    unsigned int filename_length = (unsigned int)strlen(filename);
+
+    // whatever happens, the cached answer for this name is about to be wrong
+    dentry_cache_forget(mount, directory_inode_index, filename, filename_length);
+
+    // open the directory as a file
+    fif_file_handle directory_file_handle;
+    if ((result = fif_open_file_by_inode(mount, directory_inode_index, FIF_OPEN_MODE_READ | FIF_OPEN_MODE_WRITE | FIF_OPEN_MODE_DIRECTORY, &directory_file_handle)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // read the directory header
+    FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER directory_header;
+    if ((result = read_directory_header(mount, directory_inode_index, directory_file_handle, &directory_header)) != FIF_ERROR_SUCCESS)
+    {
+        fif_file_close(mount, directory_file_handle);
+        return result;
+    }
+
+    // remove the entry
+    if (directory_header.magic == FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER_MAGIC)
+        result = remove_ordered_entry(mount, directory_file_handle, filename, filename_length);
+    else if (directory_header.hash_table_size > 0)
+        result = remove_hashed_entry(mount, directory_file_handle, &directory_header, filename, filename_length);
+    else
+        result = remove_linear_entry(mount, directory_file_handle, &directory_header, filename, filename_length);
+
+    // update the header
+    if (result == FIF_ERROR_SUCCESS)
+    {
+        directory_header.file_count--;
+        result = write_directory_header(mount, directory_file_handle, &directory_header);
+    }
+
+    // close handle and exit
+    if (result != FIF_ERROR_SUCCESS)
+    {
+        fif_file_close(mount, directory_file_handle);
+        return result;
+    }
+    if ((result = fif_file_close(mount, directory_file_handle)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    dentry_cache_store(mount, directory_inode_index, filename, filename_length, fif_hash_filename(filename, filename_length), 0);
+    return FIF_ERROR_SUCCESS;
+}
+
+static int read_entry_and_invoke_callback(fif_mount_handle mount, fif_file_handle directory_file, bool hashed, directory_entry_callback callback, void *userdata, bool *out_live)
 {
     int result;
 
-    FIF_VOLUME_FORMAT_DIRECTORY_ENTRY directory_entry;
-    if ((result = fif_file_read(mount, directory_file, &directory_entry, sizeof(directory_entry))) != sizeof(directory_entry))
+    // both entry formats start with the name length and inode
+    FIF_VOLUME_FORMAT_HASHED_DIRECTORY_ENTRY directory_entry;
+    unsigned int entry_size = hashed ? sizeof(FIF_VOLUME_FORMAT_HASHED_DIRECTORY_ENTRY) : sizeof(FIF_VOLUME_FORMAT_DIRECTORY_ENTRY);
+    if ((result = fif_file_read(mount, directory_file, &directory_entry, entry_size)) != (int)entry_size)
         return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
 
+    // skip over removed entries
+    *out_live = (directory_entry.inode_index != 0);
+    if (!*out_live)
+        return (fif_file_seek(mount, directory_file, directory_entry.name_length, FIF_SEEK_MODE_CUR) < 0) ? FIF_ERROR_CORRUPT_VOLUME : FIF_ERROR_SUCCESS;
+
     char *filename_buffer = (char *)alloca(directory_entry.name_length + 1);
-    if ((result = fif_file_read(mount, directory_file, filename_buffer, directory_entry.name_length)) != directory_entry.name_length)
+    if ((result = fif_file_read(mount, directory_file, filename_buffer, directory_entry.name_length)) != (int)directory_entry.name_length)
         return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
 
     filename_buffer[directory_entry.name_length] = '\0';
-    return callback(userdata, filename_buffer);
+    return callback(userdata, filename_buffer, directory_entry.inode_index);
 }
 
-int fif_enumdir(fif_mount_handle mount, const char *dirname, fif_enumdir_callback callback, void *userdata)
+static int enumerate_unordered_directory(fif_mount_handle mount, fif_file_handle directory_file, const FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER *directory_header, directory_entry_callback callback, void *userdata)
+{
+    int result;
+
+    // entries of hashed directories start after the buckets
+    bool hashed = (directory_header->hash_table_size > 0);
+    if (fif_file_seek(mount, directory_file, directory_entries_offset(directory_header), FIF_SEEK_MODE_SET) < 0)
+        return FIF_ERROR_CORRUPT_VOLUME;
+
+    // loop through each entry
+    unsigned int file_count = directory_header->file_count;
+    for (unsigned int i = 0; i < file_count; )
+    {
+        bool live;
+        if ((result = read_entry_and_invoke_callback(mount, directory_file, hashed, callback, userdata, &live)) != 0)
+            return result;
+        if (live)
+            i++;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+// entries from an unordered directory that fall in the requested range, to be sorted afterwards
+struct sorted_entry
+{
+    char *filename;
+    fif_inode_index_t inode_index;
+};
+struct sorted_entry_list
+{
+    const char *start;
+    const char *end;
+    struct sorted_entry *entries;
+    unsigned int entry_count;
+    unsigned int entry_reserve;
+};
+
+static int collect_entry_in_range(void *userdata, const char *filename, fif_inode_index_t inode_index)
+{
+    struct sorted_entry_list *list = (struct sorted_entry_list *)userdata;
+    unsigned int filename_length = (unsigned int)strlen(filename);
+    if ((list->start != NULL && compare_folded_name(filename, filename_length, list->start, (unsigned int)strlen(list->start)) < 0) ||
+        (list->end != NULL && *list->end != '\0' && compare_folded_name(filename, filename_length, list->end, (unsigned int)strlen(list->end)) >= 0))
+    {
+        return FIF_ERROR_SUCCESS;
+    }
+
+    if (list->entry_count == list->entry_reserve)
+    {
+        unsigned int new_reserve = (list->entry_reserve > 0) ? (list->entry_reserve * 2) : 64;
+        struct sorted_entry *new_entries = (struct sorted_entry *)realloc(list->entries, new_reserve * sizeof(struct sorted_entry));
+        if (new_entries == NULL)
+            return FIF_ERROR_OUT_OF_MEMORY;
+
+        list->entries = new_entries;
+        list->entry_reserve = new_reserve;
+    }
+
+    char *filename_copy = (char *)malloc(filename_length + 1);
+    if (filename_copy == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+
+    memcpy(filename_copy, filename, filename_length + 1);
+    list->entries[list->entry_count].filename = filename_copy;
+    list->entries[list->entry_count].inode_index = inode_index;
+    list->entry_count++;
+    return FIF_ERROR_SUCCESS;
+}
+
+static int compare_sorted_entries(const void *left, const void *right)
+{
+    const char *left_name = ((const struct sorted_entry *)left)->filename;
+    const char *right_name = ((const struct sorted_entry *)right)->filename;
+    return compare_folded_name(left_name, (unsigned int)strlen(left_name), right_name, (unsigned int)strlen(right_name));
+}
+
+static int enumerate_directory_range(fif_mount_handle mount, const char *dirname, const char *start, const char *end, bool sorted, directory_entry_callback callback, void *userdata)
 {
     int result;
-    if (mount->trace_stream != NULL && (result = fif_trace_write_enumdir(mount, dirname)) != FIF_ERROR_SUCCESS)
-        return result;
 
     // resolve the directory name as a file
     fif_inode_index_t directory_inode_index;
@@ -398,41 +1642,223 @@ int fif_enumdir(fif_mount_handle mount, const char *dirname, fif_enumdir_callbac
         return result;
 
     // read the directory header
-    FIF_VOLUME_FORMAT_DIRECTORY_HEADER directory_header;
-    if (fif_file_read(mount, directory_file, &directory_header, sizeof(directory_header)) != sizeof(directory_header))
+    FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER directory_header;
+    if ((result = read_directory_header(mount, directory_inode_index, directory_file, &directory_header)) != FIF_ERROR_SUCCESS)
     {
         fif_file_close(mount, directory_file);
-        return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
+        return result;
     }
 
-    // validate header
-    if (directory_header.magic != FIF_VOLUME_FORMAT_DIRECTORY_HEADER_MAGIC)
+    // if the directory is empty, bail out early
+    if (directory_header.file_count == 0)
     {
         fif_file_close(mount, directory_file);
-        return FIF_ERROR_CORRUPT_VOLUME;
+        return FIF_ERROR_SUCCESS;
     }
 
-    // if the directory is empty, bail out early
-    if (directory_header.file_count == 0)
+    // ordered directories only visit the leaves in range
+    if (directory_header.magic == FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER_MAGIC)
     {
+        result = enumerate_ordered_directory(mount, directory_file, start, end, callback, userdata);
         fif_file_close(mount, directory_file);
-        return FIF_ERROR_SUCCESS;
+        return result;
     }
 
-    // loop through each entry
-    unsigned int file_count = directory_header.file_count;
-    for (unsigned int i = 0; i < file_count; i++)
+    // others are streamed as-is, unless they have to be sorted first
+    if (!sorted)
+    {
+        result = enumerate_unordered_directory(mount, directory_file, &directory_header, callback, userdata);
+        fif_file_close(mount, directory_file);
+        return result;
+    }
+
+    struct sorted_entry_list list;
+    list.start = start;
+    list.end = end;
+    list.entries = NULL;
+    list.entry_count = 0;
+    list.entry_reserve = 0;
+    result = enumerate_unordered_directory(mount, directory_file, &directory_header, collect_entry_in_range, &list);
+    fif_file_close(mount, directory_file);
+    if (result == FIF_ERROR_SUCCESS)
     {
-        if ((result = read_entry_and_invoke_callback(mount, directory_file, callback, userdata)) != 0)
+        if (list.entry_count > 1)
+            qsort(list.entries, list.entry_count, sizeof(struct sorted_entry), compare_sorted_entries);
+        for (unsigned int i = 0; i < list.entry_count; i++)
         {
-            fif_file_close(mount, directory_file);
-            return result;
+            if ((result = callback(userdata, list.entries[i].filename, list.entries[i].inode_index)) != 0)
+                break;
         }
     }
 
-    // close file
-    fif_file_close(mount, directory_file);
-    return FIF_ERROR_SUCCESS;
+    for (unsigned int i = 0; i < list.entry_count; i++)
+        free(list.entries[i].filename);
+    free(list.entries);
+    return result;
+}
+
+// passes entries on to a public enumdir callback
+struct enumdir_callback_adapter
+{
+    fif_enumdir_callback callback;
+    void *userdata;
+};
+
+static int invoke_enumdir_callback(void *userdata, const char *filename, fif_inode_index_t inode_index)
+{
+    struct enumdir_callback_adapter *adapter = (struct enumdir_callback_adapter *)userdata;
+    (void)inode_index;
+    return adapter->callback(adapter->userdata, filename);
+}
+
+int fif_enumdir(fif_mount_handle mount, const char *dirname, fif_enumdir_callback callback, void *userdata)
+{
+    int result;
+    if (mount->trace_stream != NULL && (result = fif_trace_write_enumdir(mount, dirname)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    struct enumdir_callback_adapter adapter = { callback, userdata };
+    return enumerate_directory_range(mount, dirname, NULL, NULL, false, invoke_enumdir_callback, &adapter);
+}
+
+int fif_enumdir_range(fif_mount_handle mount, const char *dirname, const char *start, const char *end, fif_enumdir_callback callback, void *userdata)
+{
+    int result;
+    if (mount->trace_stream != NULL && (result = fif_trace_write_enumdir_range(mount, dirname, start, end)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    struct enumdir_callback_adapter adapter = { callback, userdata };
+    return enumerate_directory_range(mount, dirname, start, end, true, invoke_enumdir_callback, &adapter);
+}
+
+// a batch of readdir_plus entries, names are kept in one buffer until the batch is handed over
+struct readdir_plus_slot
+{
+    fif_inode_index_t inode_index;
+    unsigned int entry_index;
+};
+struct readdir_plus_batch
+{
+    fif_mount_handle mount;
+    fif_direntry *entries;
+    unsigned int max_entries;
+    unsigned int entry_count;
+    struct readdir_plus_slot *by_inode;
+    fif_inode_index_t *inode_indices;
+    FIF_VOLUME_FORMAT_INODE *inodes;
+    char *names;
+    unsigned int names_size;
+    unsigned int names_reserve;
+    fif_readdir_plus_callback callback;
+    void *userdata;
+};
+
+static int compare_readdir_plus_slots(const void *left, const void *right)
+{
+    fif_inode_index_t left_inode_index = ((const struct readdir_plus_slot *)left)->inode_index;
+    fif_inode_index_t right_inode_index = ((const struct readdir_plus_slot *)right)->inode_index;
+    return (left_inode_index < right_inode_index) ? -1 : ((left_inode_index > right_inode_index) ? 1 : 0);
+}
+
+static int flush_readdir_plus_batch(struct readdir_plus_batch *batch)
+{
+    int result;
+    if (batch->entry_count == 0)
+        return FIF_ERROR_SUCCESS;
+
+    // read the inodes in table order, the entries themselves stay in directory order
+    qsort(batch->by_inode, batch->entry_count, sizeof(struct readdir_plus_slot), compare_readdir_plus_slots);
+    for (unsigned int i = 0; i < batch->entry_count; i++)
+        batch->inode_indices[i] = batch->by_inode[i].inode_index;
+    if ((result = fif_read_inodes(batch->mount, batch->inode_indices, batch->entry_count, batch->inodes)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    for (unsigned int i = 0; i < batch->entry_count; i++)
+    {
+        fif_inode_to_fileinfo(&batch->inodes[i], &batch->entries[batch->by_inode[i].entry_index].fileinfo);
+    }
+
+    // the names buffer won't move again until the next batch
+    unsigned int name_offset = 0;
+    for (unsigned int i = 0; i < batch->entry_count; i++)
+    {
+        batch->entries[i].filename = batch->names + name_offset;
+        name_offset += (unsigned int)strlen(batch->entries[i].filename) + 1;
+    }
+
+    unsigned int entry_count = batch->entry_count;
+    batch->entry_count = 0;
+    batch->names_size = 0;
+    return batch->callback(batch->userdata, batch->entries, entry_count);
+}
+
+static int add_readdir_plus_entry(void *userdata, const char *filename, fif_inode_index_t inode_index)
+{
+    struct readdir_plus_batch *batch = (struct readdir_plus_batch *)userdata;
+    unsigned int filename_size = (unsigned int)strlen(filename) + 1;
+    if ((batch->names_reserve - batch->names_size) < filename_size)
+    {
+        unsigned int new_reserve = (batch->names_reserve > 0) ? batch->names_reserve : 1024;
+        while ((new_reserve - batch->names_size) < filename_size)
+            new_reserve *= 2;
+
+        char *new_names = (char *)realloc(batch->names, new_reserve);
+        if (new_names == NULL)
+            return FIF_ERROR_OUT_OF_MEMORY;
+
+        batch->names = new_names;
+        batch->names_reserve = new_reserve;
+    }
+
+    memcpy(batch->names + batch->names_size, filename, filename_size);
+    batch->names_size += filename_size;
+    batch->by_inode[batch->entry_count].inode_index = inode_index;
+    batch->by_inode[batch->entry_count].entry_index = batch->entry_count;
+    batch->entry_count++;
+
+    // hand over full batches as we go
+    return (batch->entry_count == batch->max_entries) ? flush_readdir_plus_batch(batch) : FIF_ERROR_SUCCESS;
+}
+
+int fif_readdir_plus(fif_mount_handle mount, const char *dirname, fif_direntry *entries, unsigned int max_entries, fif_readdir_plus_callback callback, void *userdata)
+{
+    int result;
+    if (mount->trace_stream != NULL && (result = fif_trace_write_readdir_plus(mount, dirname, max_entries)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    if (max_entries == 0)
+        return FIF_ERROR_GENERIC_ERROR;
+
+    struct readdir_plus_batch batch;
+    batch.mount = mount;
+    batch.entries = entries;
+    batch.max_entries = max_entries;
+    batch.entry_count = 0;
+    batch.by_inode = (struct readdir_plus_slot *)malloc(max_entries * sizeof(struct readdir_plus_slot));
+    batch.inode_indices = (fif_inode_index_t *)malloc(max_entries * sizeof(fif_inode_index_t));
+    batch.inodes = (FIF_VOLUME_FORMAT_INODE *)malloc(max_entries * sizeof(FIF_VOLUME_FORMAT_INODE));
+    batch.names = NULL;
+    batch.names_size = 0;
+    batch.names_reserve = 0;
+    batch.callback = callback;
+    batch.userdata = userdata;
+    if (batch.by_inode == NULL || batch.inode_indices == NULL || batch.inodes == NULL)
+    {
+        result = FIF_ERROR_OUT_OF_MEMORY;
+    }
+    else
+    {
+        // then whatever is left over once the directory has been read
+        result = enumerate_directory_range(mount, dirname, NULL, NULL, false, add_readdir_plus_entry, &batch);
+        if (result == FIF_ERROR_SUCCESS)
+            result = flush_readdir_plus_batch(&batch);
+    }
+
+    free(batch.names);
+    free(batch.inodes);
+    free(batch.inode_indices);
+    free(batch.by_inode);
+    return result;
 }
 
 int fif_mkdir(fif_mount_handle mount, const char *dirname)
@@ -458,7 +1884,7 @@ int fif_mkdir(fif_mount_handle mount, const char *dirname)
         return result;
 
     // check something doesn't exist already
-    if ((result = fif_find_file_in_directory(mount, containing_inode, real_basename, NULL, NULL)) != FIF_ERROR_FILE_NOT_FOUND)
+    if ((result = fif_find_file_in_directory(mount, containing_inode, real_basename, NULL)) != FIF_ERROR_FILE_NOT_FOUND)
         return (result == FIF_ERROR_SUCCESS) ? FIF_ERROR_ALREADY_EXISTS : result;
 
     // create the directory inode near the containing directory
@@ -501,27 +1927,20 @@ int fif_rmdir(fif_mount_handle mount, const char *dirname)
 
     // find the directory
     fif_inode_index_t directory_inode_index;
-    if ((result = fif_find_file_in_directory(mount, containing_inode, real_basename, &directory_inode_index, NULL)) != FIF_ERROR_SUCCESS)
+    if ((result = fif_find_file_in_directory(mount, containing_inode, real_basename, &directory_inode_index)) != FIF_ERROR_SUCCESS)
         return result;
 
     // open the directory inode as a file
     fif_file_handle directory_file;
-    if ((result = fif_open_file_by_inode(mount, directory_inode_index, FIF_OPEN_MODE_READ | FIF_OPEN_MODE_WRITE | FIF_OPEN_MODE_STREAMED | FIF_OPEN_MODE_DIRECTORY, &directory_file)) != FIF_ERROR_SUCCESS)
+    if ((result = fif_open_file_by_inode(mount, directory_inode_index, FIF_OPEN_MODE_READ | FIF_OPEN_MODE_WRITE | FIF_OPEN_MODE_DIRECTORY, &directory_file)) != FIF_ERROR_SUCCESS)
         return result;
 
     // read the directory header
-    FIF_VOLUME_FORMAT_DIRECTORY_HEADER directory_header;
-    if (fif_file_read(mount, directory_file, &directory_header, sizeof(directory_header)) != sizeof(directory_header))
-    {
-        fif_file_close(mount, directory_file);
-        return (result >= 0) ? FIF_ERROR_CORRUPT_VOLUME : result;
-    }
-
-    // validate header
-    if (directory_header.magic != FIF_VOLUME_FORMAT_DIRECTORY_HEADER_MAGIC)
+    FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER directory_header;
+    if ((result = read_directory_header(mount, directory_inode_index, directory_file, &directory_header)) != FIF_ERROR_SUCCESS)
     {
         fif_file_close(mount, directory_file);
-        return FIF_ERROR_CORRUPT_VOLUME;
+        return result;
     }
 
     // check there are no files
@@ -539,16 +1958,16 @@ int fif_rmdir(fif_mount_handle mount, const char *dirname)
     }
 
     // if this is the last reference, free the directory inode itself
-    if (directory_file->inode.reference_count == 1)
+    if (directory_file->inode->reference_count == 1)
     {
-        fif_free_file_blocks(mount, directory_inode_index, &directory_file->inode);
+        fif_free_file_blocks(mount, directory_inode_index, directory_file->inode);
         fif_file_close(mount, directory_file);
         return fif_free_inode(mount, directory_inode_index);
     }
     else
     {
-        directory_file->inode.reference_count--;
-        result = fif_write_inode(mount, directory_inode_index, &directory_file->inode);
+        directory_file->inode->reference_count--;
+        result = fif_write_inode(mount, directory_inode_index, directory_file->inode);
         fif_file_close(mount, directory_file);
         return result;
     }
@@ -11,8 +11,15 @@
 #define FIF_VOLUME_FORMAT_HEADER_MAGIC (0x11223344U)
 #define FIF_VOLUME_FORMAT_INODE_TABLE_HEADER_MAGIC (0x44556677U)
 #define FIF_VOLUME_FORMAT_DIRECTORY_HEADER_MAGIC (0x77889900U)
+#define FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER_MAGIC (0x778899AAU)
+#define FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER_MAGIC (0x778899BBU)
 #define FIF_VOLUME_FORMAT_FRAGMENTATION_HEADER_MAGIC (0x00AABBCCU)
 #define FIF_VOLUME_FORMAT_FREEBLOCK_HEADER_MAGIC (0xCCDDEEFFU)
+#define FIF_VOLUME_FORMAT_SMALLFILE_HEADER_MAGIC (0xFF001122U)
+
+// volume flags
+#define FIF_VOLUME_FORMAT_FLAG_ORDERED_DIRECTORIES (1U << 0)
+#define FIF_VOLUME_FORMAT_FLAG_DIRTY (1U << 1)
 
 #pragma pack(push, 1)
 
@@ -34,6 +41,8 @@ typedef struct
     uint32_t first_free_block;
     uint32_t last_free_block;
     uint32_t root_inode;
+    uint32_t first_partial_smallfile_block;
+    uint32_t flags;
 } FIF_VOLUME_FORMAT_HEADER;
 
 typedef struct
@@ -68,12 +77,75 @@ typedef struct
     uint32_t inode_index;
 } FIF_VOLUME_FORMAT_DIRECTORY_ENTRY;
 
+// hashed directories start with the same fields as linear ones, followed by hash_table_size
+// bucket offsets (uint32_t, zero when empty), then the entries. removed entries are left
+// in place with an inode_index of zero until the directory is compacted.
+typedef struct
+{
+    uint32_t magic;
+    uint32_t file_count;
+    uint32_t max_filename_length;
+    uint32_t first_file_inode;
+    uint32_t last_file_inode;
+    uint32_t hash_table_size;
+    uint32_t dead_entry_bytes;
+} FIF_VOLUME_FORMAT_HASHED_DIRECTORY_HEADER;
+
+typedef struct
+{
+    uint32_t name_length;
+    uint32_t inode_index;
+    uint32_t name_hash;
+    uint32_t next_entry_offset;
+} FIF_VOLUME_FORMAT_HASHED_DIRECTORY_ENTRY;
+
+// ordered directories are b+trees keyed on the case-folded name, and also start with the linear
+// header fields. the directory is split into node_size byte nodes, node n living at n * node_size,
+// with this header in node zero. entry_bytes is the size of every leaf entry, used to tell when
+// removals have left the tree sparse enough to rebuild.
+typedef struct
+{
+    uint32_t magic;
+    uint32_t file_count;
+    uint32_t max_filename_length;
+    uint32_t first_file_inode;
+    uint32_t last_file_inode;
+    uint32_t node_size;
+    uint32_t node_count;
+    uint32_t root_node;
+    uint32_t first_leaf_node;
+    uint32_t entry_bytes;
+} FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_HEADER;
+
+// each node is this header followed by entry_count FIF_VOLUME_FORMAT_DIRECTORY_ENTRYs and their names,
+// in name order. leaves (level zero) link to the next leaf. in branches, entries give the child node
+// in place of an inode, covering names from that entry's up to the next one's, and link is the child
+// for names before the first entry.
+typedef struct
+{
+    uint32_t level;
+    uint32_t entry_count;
+    uint32_t used_bytes;
+    uint32_t link;
+} FIF_VOLUME_FORMAT_ORDERED_DIRECTORY_NODE;
+
+// fragmented files point first_block_index at a fragment map instead of their data. the map takes
+// up map_block_count blocks, holding this header followed by fragment_count fragments in file order.
+// the inode's block_count is still the number of data blocks.
 typedef struct
 {
     uint32_t magic;
     uint32_t fragment_count;
+    uint32_t map_block_count;
 } FIF_VOLUME_FORMAT_FRAGMENTATION_HEADER;
 
+typedef struct
+{
+    uint32_t file_block_index;
+    uint32_t first_block_index;
+    uint32_t block_count;
+} FIF_VOLUME_FORMAT_FRAGMENT;
+
 typedef struct
 {
     uint32_t magic;
@@ -81,10 +153,16 @@ typedef struct
     uint32_t next_free_block;
 } FIF_VOLUME_FORMAT_FREEBLOCK_HEADER;
 
+// small files share blocks. each one holds this header, slot_count inode indices saying who owns
+// each slot (zero when free), then slot_count slots of smallfile_size bytes. blocks with a free
+// slot are chained from first_partial_smallfile_block in the superblock.
 typedef struct
 {
     uint32_t magic;
     uint32_t smallfile_size;
+    uint32_t slot_count;
+    uint32_t used_slot_count;
+    uint32_t next_partial_block;
 } FIF_VOLUME_FORMAT_SMALLFILE_HEADER;
 
 #pragma pack(pop)
@@ -7,6 +7,7 @@
 
 // from c library
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <time.h>
 #include <assert.h>
@@ -18,6 +19,62 @@
 #include "libfif/fif_types.h"
 #include "fif_format.h"
 
+// block cache frame
+struct fif_block_cache_entry
+{
+    fif_block_index_t block_index;
+    bool valid;
+    bool dirty;
+    unsigned int pin_count;
+    unsigned char *data;
+    struct fif_block_cache_entry *hash_next;
+    struct fif_block_cache_entry *lru_prev;
+    struct fif_block_cache_entry *lru_next;
+};
+
+// inode cache entry, shared by every open handle on the inode
+struct fif_inode_cache_entry
+{
+    fif_inode_index_t inode_index;
+    FIF_VOLUME_FORMAT_INODE inode;
+    bool dirty;
+    unsigned int ref_count;
+    unsigned int reader_count;
+    unsigned int writer_count;
+    struct fif_inode_cache_entry *hash_next;
+    struct fif_inode_cache_entry *lru_prev;
+    struct fif_inode_cache_entry *lru_next;
+};
+
+// path lookup cache entry, a case-folded name in a directory and the inode it names (zero if it doesn't exist)
+struct fif_dentry_cache_entry
+{
+    fif_inode_index_t directory_inode_index;
+    fif_inode_index_t inode_index;
+    uint32_t name_hash;
+    unsigned int name_length;
+    char *name;
+    struct fif_dentry_cache_entry *hash_next;
+    struct fif_dentry_cache_entry *lru_prev;
+    struct fif_dentry_cache_entry *lru_next;
+};
+
+// freeblock index node, a free block range that is also linked into its size class bin
+struct fif_freeblock_node
+{
+    fif_block_index_t block_index;
+    unsigned int block_count;
+    unsigned int bin_prev;
+    unsigned int bin_next;
+};
+
+// freeblock size classes, one per power of two
+#define FIF_FREEBLOCK_BIN_COUNT 32
+
+// per-block flags built up while recovering a volume that wasn't unmounted cleanly
+#define FIF_BLOCK_USAGE_USED (1U << 0)
+#define FIF_BLOCK_USAGE_SMALLFILE (1U << 1)
+
 struct fif_mount_s
 {
     fif_io io;
@@ -27,9 +84,19 @@ struct fif_mount_s
 
     // mount options
     unsigned int block_cache_size;
+    unsigned int inode_cache_size;
+    unsigned int dentry_cache_size;
     unsigned int new_file_compression_algorithm;
     unsigned int new_file_compression_level;
     unsigned int fragmentation_threshold;
+    unsigned int skip_zero_freed_blocks;
+    unsigned int max_readahead_size;
+    unsigned int volume_growth_blocks;
+    unsigned int volume_growth_percent;
+    unsigned int trim_on_unmount;
+    unsigned int descriptor_write_interval;
+    unsigned int batch_cache_size;
+    unsigned int delayed_allocation_size;
 
     // info from superblock
     unsigned int block_size;
@@ -46,22 +113,80 @@ struct fif_mount_s
     fif_block_index_t first_free_block;
     fif_block_index_t last_free_block;
     fif_inode_index_t root_inode;
+    fif_block_index_t first_partial_smallfile_block;
+    unsigned int volume_flags;
+
+    // superblock changes not yet written back
+    bool descriptor_dirty;
+    unsigned int descriptor_change_count;
 
     // calculated helper fields
     fif_inode_index_t inodes_per_table;
+    unsigned int smallfile_slot_count;
+
+    // block of each inode table, indexed by table number (inode_table_count entries)
+    fif_block_index_t *inode_table_blocks;
+    unsigned int inode_table_blocks_reserve;
+
+    // in-memory copy of the freeblock chain, node numbers sorted by address plus size class bins (node zero is "none")
+    struct fif_freeblock_node *freeblock_nodes;
+    unsigned int freeblock_node_reserve;
+    unsigned int freeblock_unused_node;
+    unsigned int *freeblock_order;
+    unsigned int freeblock_count;
+    unsigned int freeblock_bins[FIF_FREEBLOCK_BIN_COUNT];
+
+    // block cache, only allocated when block_cache_size is nonzero or a batch needs one, with block_cache_frame_count frames
+    struct fif_block_cache_entry *block_cache_entries;
+    struct fif_block_cache_entry **block_cache_buckets;
+    struct fif_block_cache_entry *block_cache_lru_head;
+    struct fif_block_cache_entry *block_cache_lru_tail;
+    unsigned char *block_cache_data;
+    struct fif_block_cache_entry **block_cache_flush_list;
+    unsigned int block_cache_frame_count;
 
-    // currently open files
+    // metadata batch nesting depth, and whether the block cache was only allocated for the batch
+    unsigned int batch_depth;
+    bool batch_block_cache;
+
+    // inode cache, the lru list only holds unreferenced entries (at most inode_cache_size of them), the table grows to fit every entry
+    struct fif_inode_cache_entry **inode_cache_buckets;
+    unsigned int inode_cache_bucket_count;
+    struct fif_inode_cache_entry *inode_cache_lru_head;
+    struct fif_inode_cache_entry *inode_cache_lru_tail;
+    unsigned int inode_cache_unreferenced_count;
+    unsigned int inode_cache_count;
+
+    // path lookup cache, only allocated when dentry_cache_size is nonzero
+    struct fif_dentry_cache_entry **dentry_cache_buckets;
+    struct fif_dentry_cache_entry *dentry_cache_lru_head;
+    struct fif_dentry_cache_entry *dentry_cache_lru_tail;
+    unsigned int dentry_cache_count;
+
+    // currently open files, indexed by handle number, and a min-heap of the free slots
     fif_file_handle *open_files;
     unsigned int open_file_count;
+    unsigned int *open_file_free_slots;
+    unsigned int open_file_free_count;
 
     // trace stream (if enabled)
     struct fif_trace_stream *trace_stream;
 };
 
+// outstanding read view on an open file
+struct fif_file_view
+{
+    const void *pointer;
+    struct fif_block_cache_entry *pinned_entry;
+    void *owned_buffer;
+    struct fif_file_view *next;
+};
+
 struct fif_open_file_s
 {
     fif_inode_index_t inode_index;
-    FIF_VOLUME_FORMAT_INODE inode;
+    struct fif_inode_cache_entry *inode_entry;
+    FIF_VOLUME_FORMAT_INODE *inode;
 
     unsigned int handle_index;
     unsigned int open_mode;
@@ -73,13 +198,20 @@ struct fif_open_file_s
     unsigned int buffer_size;
     unsigned int buffer_range_start;
     unsigned int buffer_range_size;
+    unsigned int readahead_size;
     bool buffer_dirty;
 
+    // blocks reserved from a size hint at open, the unused ones are given back at close
+    bool trim_reserved_blocks;
+
     // compressor/decompressor
     const struct fif_compressor_functions *compressor;
     void *compressor_data;
     const struct fif_decompressor_functions *decompressor;
     void *decompressor_data;
+
+    // read views handed out and not yet released
+    struct fif_file_view *views;
 };
 
 // compressor/decompressor function prototypes
@@ -123,41 +255,77 @@ char *fif_path_next_part(char *path);
 bool fif_path_next_part_ptr(char *start, int length, char **current);
 bool fif_canonicalize_path(char *dest, int dest_size, const char *path);
 void fif_split_path_dirbase(char *path, char **dirname, char **basename);
+uint32_t fif_hash_filename(const char *filename, unsigned int filename_length);
 
-// header rewriting
+// header rewriting, updates are written back at sync and unmount, or every descriptor_write_interval changes
 int fif_volume_write_descriptor(fif_mount_handle mount);
+int fif_volume_update_descriptor(fif_mount_handle mount);
+
+// block cache
+int fif_volume_init_block_cache(fif_mount_handle mount, unsigned int frame_count);
+int fif_volume_flush_block_cache(fif_mount_handle mount);
+int fif_volume_flush_cached_block(fif_mount_handle mount, fif_block_index_t block_index);
+void fif_volume_invalidate_block_cache(fif_mount_handle mount, fif_block_index_t first_block_index, unsigned int block_count);
+void fif_volume_free_block_cache(fif_mount_handle mount);
+bool fif_volume_block_cache_pinned(fif_mount_handle mount);
+int fif_volume_free_batch_block_cache(fif_mount_handle mount);
 
 // block i/o
 int fif_volume_read_block(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, void *buffer, unsigned int bytes);
 int fif_volume_write_block(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, const void *buffer, unsigned int bytes);
+int fif_volume_read_blocks(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, void *buffer, unsigned int bytes);
+int fif_volume_write_blocks(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, const void *buffer, unsigned int bytes);
+int fif_volume_read_blocks_cached(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, void *buffer, unsigned int bytes);
+int fif_volume_write_blocks_cached(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, const void *buffer, unsigned int bytes);
+bool fif_volume_is_addressable(fif_mount_handle mount);
+const void *fif_volume_get_block_pointer(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, unsigned int bytes);
+int fif_volume_get_block_view(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, unsigned int bytes, const void **out_pointer, unsigned int *out_bytes, struct fif_block_cache_entry **out_pinned_entry);
+void fif_volume_release_block_view(fif_mount_handle mount, struct fif_block_cache_entry *pinned_entry);
 int fif_volume_copy_blocks(fif_mount_handle mount, fif_block_index_t src_block_index, fif_block_index_t dst_block_index, unsigned int block_count);
 int fif_volume_zero_blocks(fif_mount_handle mount, fif_block_index_t first_block_index, unsigned int block_count);
 int fif_volume_zero_block_partial(fif_mount_handle mount, fif_block_index_t block_index, unsigned int offset, unsigned int bytes);
 int fif_volume_resize(fif_mount_handle mount, fif_block_index_t new_block_count);
 
 // block allocator
+int fif_volume_load_freeblock_index(fif_mount_handle mount);
+int fif_volume_rebuild_freeblock_index(fif_mount_handle mount, const unsigned char *block_usage);
+void fif_volume_free_freeblock_index(fif_mount_handle mount);
 int fif_volume_add_freeblock(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_count);
-int fif_volume_remove_freeblock(fif_mount_handle mount, fif_block_index_t block_index, fif_block_index_t prevblock_index);
-int fif_volume_shrink_freeblock(fif_mount_handle mount, fif_block_index_t block_index, fif_block_index_t new_block_count, fif_block_index_t prevblock_index);
 int fif_volume_alloc_blocks(fif_mount_handle mount, fif_block_index_t block_hint, unsigned int block_count, fif_block_index_t *block_index);
 int fif_volume_free_blocks(fif_mount_handle mount, fif_block_index_t first_block_index, unsigned int block_count);
+int fif_volume_extend_block_range(fif_mount_handle mount, fif_block_index_t block_index, unsigned int current_block_count, unsigned int new_block_count, bool *out_extended);
 int fif_volume_resize_block_range(fif_mount_handle mount, fif_block_index_t first_block_index, unsigned int current_block_count, unsigned int new_block_count, fif_block_index_t *new_block_index);
+int fif_volume_trim(fif_mount_handle mount);
 
 // inode table allocator
 int fif_alloc_inode_table(fif_mount_handle mount, fif_block_index_t *inode_table_block_index);
+int fif_load_inode_table_index(fif_mount_handle mount, bool recover);
+void fif_free_inode_table_index(fif_mount_handle mount);
+
+// inode cache
+int fif_init_inode_cache(fif_mount_handle mount);
+int fif_flush_inode_cache(fif_mount_handle mount);
+void fif_free_inode_cache(fif_mount_handle mount);
+int fif_acquire_inode(fif_mount_handle mount, fif_inode_index_t inode_index, struct fif_inode_cache_entry **out_entry);
+int fif_release_inode(fif_mount_handle mount, struct fif_inode_cache_entry *entry);
+struct fif_inode_cache_entry *fif_find_open_inode(fif_mount_handle mount, fif_inode_index_t inode_index);
 
 // inode reader/writer
 int fif_read_inode(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_VOLUME_FORMAT_INODE *inode);
+int fif_read_inodes(fif_mount_handle mount, const fif_inode_index_t *inode_indices, unsigned int count, FIF_VOLUME_FORMAT_INODE *inodes);
 int fif_write_inode(fif_mount_handle mount, fif_inode_index_t inode_index, const FIF_VOLUME_FORMAT_INODE *inode);
 
 // inode allocator
 int fif_alloc_inode(fif_mount_handle mount, fif_inode_index_t inode_hint, fif_inode_index_t *inode_index);
 int fif_free_inode(fif_mount_handle mount, fif_inode_index_t inode_index);
+int fif_rebuild_free_inode_chain(fif_mount_handle mount, unsigned char *block_usage);
 
 // file low-level block access
 int fif_create_file(fif_mount_handle mount, const char *filename, fif_inode_index_t directory_inode, fif_inode_index_t *out_inode_index);
 int fif_resize_file(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_VOLUME_FORMAT_INODE *inode, unsigned int new_size);
 int fif_free_file_blocks(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_VOLUME_FORMAT_INODE *inode);
+int fif_mark_file_blocks(fif_mount_handle mount, fif_inode_index_t inode_index, const FIF_VOLUME_FORMAT_INODE *inode, unsigned char *block_usage);
+int fif_rebuild_smallfile_chain(fif_mount_handle mount, const unsigned char *block_usage);
 
 // file data reader/writer
 int fif_read_file_data(fif_mount_handle mount, fif_inode_index_t inode_index, const FIF_VOLUME_FORMAT_INODE *inode, unsigned int offset, void *buffer, unsigned int bytes);
@@ -166,18 +334,27 @@ int fif_write_file_data(fif_mount_handle mount, fif_inode_index_t inode_index, F
 // file reading/writing
 fif_offset_t fif_file_seek(fif_mount_handle mount, fif_file_handle file, fif_offset_t offset, enum FIF_SEEK_MODE mode);
 int fif_file_read(fif_mount_handle mount, fif_file_handle file, void *out_buffer, unsigned int count);
+int fif_file_read_view(fif_mount_handle mount, fif_file_handle file, fif_offset_t offset, unsigned int max_count, const void **out_pointer, unsigned int *out_count);
+int fif_file_release_view(fif_mount_handle mount, fif_file_handle file, const void *pointer);
 int fif_file_write(fif_mount_handle mount, fif_file_handle file, const void *in_buffer, unsigned int count);
 int fif_file_truncate(fif_mount_handle mount, fif_file_handle file, fif_offset_t size);
+int fif_file_allocate(fif_mount_handle mount, fif_file_handle file, fif_offset_t size);
 int fif_file_close(fif_mount_handle mount, fif_file_handle file);
 
 // file opener by inode
 int fif_resolve_file_name(fif_mount_handle mount, const char *path, fif_inode_index_t *out_inode_index, fif_inode_index_t *out_directory_inode_index);
 int fif_open_file_by_inode(fif_mount_handle mount, fif_inode_index_t inode_index, unsigned int mode, fif_file_handle *handle);
+void fif_free_open_file_table(fif_mount_handle mount);
+void fif_inode_to_fileinfo(const FIF_VOLUME_FORMAT_INODE *inode, fif_fileinfo *fileinfo);
+
+// path lookup cache
+int fif_init_dentry_cache(fif_mount_handle mount);
+void fif_free_dentry_cache(fif_mount_handle mount);
 
 // directory low-level access
 int fif_create_directory(fif_mount_handle mount, fif_inode_index_t inode_hint, fif_inode_index_t *out_directory_inode_index);
 int fif_resolve_directory_name(fif_mount_handle mount, const char *dirname, fif_inode_index_t *directory_inode_index);
-int fif_find_file_in_directory(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename, fif_inode_index_t *file_inode_index, unsigned int *file_index_in_directory);
+int fif_find_file_in_directory(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename, fif_inode_index_t *file_inode_index);
 int fif_add_file_to_directory(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename, fif_inode_index_t fileinode);
 int fif_remove_file_from_directory(fif_mount_handle mount, fif_inode_index_t directory_inode_index, const char *filename);
 
@@ -37,21 +37,625 @@ int fif_create_file(fif_mount_handle mount, const char *filename, fif_inode_inde
     return result;
 }
 
+// where a file's data blocks are, contiguous files are a single fragment
+struct file_block_map
+{
+    FIF_VOLUME_FORMAT_FRAGMENTATION_HEADER header;
+    FIF_VOLUME_FORMAT_FRAGMENT *fragments;
+    unsigned int fragment_reserve;
+    FIF_VOLUME_FORMAT_FRAGMENT single_fragment;
+};
+
+static int load_block_map(fif_mount_handle mount, const FIF_VOLUME_FORMAT_INODE *inode, struct file_block_map *map)
+{
+    int result;
+    map->fragments = &map->single_fragment;
+    map->fragment_reserve = 1;
+
+    // contiguous files don't have a map on disk
+    if (!(inode->attributes & FIF_FILE_ATTRIBUTE_FRAGMENTED))
+    {
+        map->header.magic = 0;
+        map->header.fragment_count = (inode->block_count > 0) ? 1 : 0;
+        map->header.map_block_count = 0;
+        map->single_fragment.file_block_index = 0;
+        map->single_fragment.first_block_index = inode->first_block_index;
+        map->single_fragment.block_count = inode->block_count;
+        return FIF_ERROR_SUCCESS;
+    }
+
+    // read and check the header
+    if ((result = fif_volume_read_block(mount, inode->first_block_index, 0, &map->header, sizeof(map->header))) != FIF_ERROR_SUCCESS)
+        return result;
+    if (map->header.magic != FIF_VOLUME_FORMAT_FRAGMENTATION_HEADER_MAGIC || map->header.fragment_count == 0 ||
+        (sizeof(map->header) + (uint64_t)map->header.fragment_count * sizeof(FIF_VOLUME_FORMAT_FRAGMENT)) > ((uint64_t)map->header.map_block_count * mount->block_size))
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "load_block_map: fragment map in block %u is corrupt", inode->first_block_index);
+        return FIF_ERROR_CORRUPT_VOLUME;
+    }
+
+    // read the fragments, leaving room to add one
+    map->fragment_reserve = map->header.fragment_count + 1;
+    if ((map->fragments = (FIF_VOLUME_FORMAT_FRAGMENT *)malloc(sizeof(FIF_VOLUME_FORMAT_FRAGMENT) * map->fragment_reserve)) == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+    if ((result = fif_volume_read_blocks(mount, inode->first_block_index, sizeof(map->header), map->fragments, sizeof(FIF_VOLUME_FORMAT_FRAGMENT) * map->header.fragment_count)) != FIF_ERROR_SUCCESS)
+    {
+        free(map->fragments);
+        map->fragments = &map->single_fragment;
+        return result;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static void release_block_map(struct file_block_map *map)
+{
+    if (map->fragments != &map->single_fragment)
+        free(map->fragments);
+
+    map->fragments = &map->single_fragment;
+}
+
+static int reserve_block_map(struct file_block_map *map, unsigned int fragment_count)
+{
+    if (fragment_count <= map->fragment_reserve)
+        return FIF_ERROR_SUCCESS;
+
+    FIF_VOLUME_FORMAT_FRAGMENT *new_fragments = (FIF_VOLUME_FORMAT_FRAGMENT *)malloc(sizeof(FIF_VOLUME_FORMAT_FRAGMENT) * fragment_count);
+    if (new_fragments == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+
+    memcpy(new_fragments, map->fragments, sizeof(FIF_VOLUME_FORMAT_FRAGMENT) * map->header.fragment_count);
+    release_block_map(map);
+    map->fragments = new_fragments;
+    map->fragment_reserve = fragment_count;
+    return FIF_ERROR_SUCCESS;
+}
+
+static int write_block_map(fif_mount_handle mount, FIF_VOLUME_FORMAT_INODE *inode, struct file_block_map *map)
+{
+    int result;
+    bool fragmented = (inode->attributes & FIF_FILE_ATTRIBUTE_FRAGMENTED) != 0;
+
+    // down to one fragment (or none), so the file is contiguous again and doesn't need a map
+    if (map->header.fragment_count <= 1)
+    {
+        if (fragmented && (result = fif_volume_free_blocks(mount, inode->first_block_index, map->header.map_block_count)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        inode->attributes &= ~FIF_FILE_ATTRIBUTE_FRAGMENTED;
+        inode->first_block_index = (map->header.fragment_count > 0) ? map->fragments[0].first_block_index : 0;
+        return FIF_ERROR_SUCCESS;
+    }
+
+    // does the map still fit where it is? if not, move it somewhere with room to grow
+    unsigned int map_bytes = sizeof(map->header) + map->header.fragment_count * sizeof(FIF_VOLUME_FORMAT_FRAGMENT);
+    unsigned int map_block_count = (map_bytes + mount->block_size - 1) / mount->block_size;
+    fif_block_index_t map_block_index = (fragmented) ? inode->first_block_index : 0;
+    fif_block_index_t old_map_block_index = 0;
+    unsigned int old_map_block_count = 0;
+    if (!fragmented || map_block_count > map->header.map_block_count)
+    {
+        if (fragmented)
+        {
+            old_map_block_index = map_block_index;
+            old_map_block_count = map->header.map_block_count;
+            if (map_block_count < old_map_block_count * 2)
+                map_block_count = old_map_block_count * 2;
+        }
+
+        if ((result = fif_volume_alloc_blocks(mount, map->fragments[0].first_block_index, map_block_count, &map_block_index)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        map->header.map_block_count = map_block_count;
+    }
+
+    // write the header and fragments
+    map->header.magic = FIF_VOLUME_FORMAT_FRAGMENTATION_HEADER_MAGIC;
+    if ((result = fif_volume_write_block(mount, map_block_index, 0, &map->header, sizeof(map->header))) != FIF_ERROR_SUCCESS ||
+        (result = fif_volume_write_blocks(mount, map_block_index, sizeof(map->header), map->fragments, sizeof(FIF_VOLUME_FORMAT_FRAGMENT) * map->header.fragment_count)) != FIF_ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    // the old map can go now
+    if (old_map_block_count > 0 && (result = fif_volume_free_blocks(mount, old_map_block_index, old_map_block_count)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    inode->attributes |= FIF_FILE_ATTRIBUTE_FRAGMENTED;
+    inode->first_block_index = map_block_index;
+    return FIF_ERROR_SUCCESS;
+}
+
+static unsigned int map_file_range(fif_mount_handle mount, const struct file_block_map *map, unsigned int offset, unsigned int bytes, fif_block_index_t *out_block_index)
+{
+    // find the fragment holding offset
+    unsigned int file_block_index = offset / mount->block_size;
+    unsigned int low = 0;
+    unsigned int high = map->header.fragment_count;
+    while (low < high)
+    {
+        unsigned int mid = low + (high - low) / 2;
+        if ((map->fragments[mid].file_block_index + map->fragments[mid].block_count) <= file_block_index)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low == map->header.fragment_count || map->fragments[low].file_block_index > file_block_index)
+        return 0;
+
+    // hand back the volume block, and how many of the bytes carry on contiguously from it
+    const FIF_VOLUME_FORMAT_FRAGMENT *fragment = &map->fragments[low];
+    *out_block_index = fragment->first_block_index + (file_block_index - fragment->file_block_index);
+    uint64_t run_bytes = (uint64_t)(fragment->file_block_index + fragment->block_count) * mount->block_size - offset;
+    return (run_bytes < bytes) ? (unsigned int)run_bytes : bytes;
+}
+
+static int grow_file_blocks(fif_mount_handle mount, FIF_VOLUME_FORMAT_INODE *inode, unsigned int required_blocks)
+{
+    int result;
+    unsigned int extra_blocks = required_blocks - inode->block_count;
+    bool extended;
+
+    // contiguous files stay that way if they can grow in place, or are small enough that moving them is cheap
+    if (!(inode->attributes & FIF_FILE_ATTRIBUTE_FRAGMENTED))
+    {
+        if ((result = fif_volume_extend_block_range(mount, inode->first_block_index, inode->block_count, required_blocks, &extended)) != FIF_ERROR_SUCCESS)
+            return result;
+        if (extended)
+            return FIF_ERROR_SUCCESS;
+
+        if (mount->fragmentation_threshold == 0 || inode->block_count < mount->fragmentation_threshold)
+            return fif_volume_resize_block_range(mount, inode->first_block_index, inode->block_count, required_blocks, &inode->first_block_index);
+    }
+
+    // otherwise the growth goes on the end of the last fragment, or in a new one
+    struct file_block_map map;
+    if ((result = load_block_map(mount, inode, &map)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    FIF_VOLUME_FORMAT_FRAGMENT *last_fragment = &map.fragments[map.header.fragment_count - 1];
+    extended = false;
+    if ((inode->attributes & FIF_FILE_ATTRIBUTE_FRAGMENTED) &&
+        (result = fif_volume_extend_block_range(mount, last_fragment->first_block_index, last_fragment->block_count, last_fragment->block_count + extra_blocks, &extended)) != FIF_ERROR_SUCCESS)
+    {
+        release_block_map(&map);
+        return result;
+    }
+
+    if (extended)
+    {
+        last_fragment->block_count += extra_blocks;
+    }
+    else
+    {
+        // make sure there's room for the new fragment before taking the blocks
+        if ((result = reserve_block_map(&map, map.header.fragment_count + 1)) != FIF_ERROR_SUCCESS)
+        {
+            release_block_map(&map);
+            return result;
+        }
+
+        fif_block_index_t new_block_index;
+        last_fragment = &map.fragments[map.header.fragment_count - 1];
+        if ((result = fif_volume_alloc_blocks(mount, last_fragment->first_block_index + last_fragment->block_count, extra_blocks, &new_block_index)) != FIF_ERROR_SUCCESS)
+        {
+            release_block_map(&map);
+            return result;
+        }
+
+        // might have landed right after the last fragment anyway
+        if (new_block_index == (last_fragment->first_block_index + last_fragment->block_count))
+        {
+            last_fragment->block_count += extra_blocks;
+        }
+        else
+        {
+            FIF_VOLUME_FORMAT_FRAGMENT *new_fragment = &map.fragments[map.header.fragment_count++];
+            new_fragment->file_block_index = inode->block_count;
+            new_fragment->first_block_index = new_block_index;
+            new_fragment->block_count = extra_blocks;
+        }
+    }
+
+    result = write_block_map(mount, inode, &map);
+    release_block_map(&map);
+    return result;
+}
+
+static int shrink_file_blocks(fif_mount_handle mount, FIF_VOLUME_FORMAT_INODE *inode, unsigned int required_blocks)
+{
+    int result;
+    if (!(inode->attributes & FIF_FILE_ATTRIBUTE_FRAGMENTED))
+        return fif_volume_resize_block_range(mount, inode->first_block_index, inode->block_count, required_blocks, &inode->first_block_index);
+
+    struct file_block_map map;
+    if ((result = load_block_map(mount, inode, &map)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // free from the end, dropping whole fragments and trimming the one that straddles the new end
+    while (map.header.fragment_count > 0)
+    {
+        FIF_VOLUME_FORMAT_FRAGMENT *last_fragment = &map.fragments[map.header.fragment_count - 1];
+        unsigned int keep_blocks = (required_blocks > last_fragment->file_block_index) ? (required_blocks - last_fragment->file_block_index) : 0;
+        if (keep_blocks >= last_fragment->block_count)
+            break;
+
+        if ((result = fif_volume_free_blocks(mount, last_fragment->first_block_index + keep_blocks, last_fragment->block_count - keep_blocks)) != FIF_ERROR_SUCCESS)
+        {
+            release_block_map(&map);
+            return result;
+        }
+
+        last_fragment->block_count = keep_blocks;
+        if (keep_blocks > 0)
+            break;
+
+        map.header.fragment_count--;
+    }
+
+    result = write_block_map(mount, inode, &map);
+    release_block_map(&map);
+    return result;
+}
+
+static unsigned int smallfile_slot_offset(fif_mount_handle mount, unsigned int slot)
+{
+    return sizeof(FIF_VOLUME_FORMAT_SMALLFILE_HEADER) + (mount->smallfile_slot_count * sizeof(uint32_t)) + (slot * mount->smallfile_size);
+}
+
+static int read_smallfile_block(fif_mount_handle mount, fif_block_index_t block_index, unsigned char *block_data)
+{
+    // the whole block in one read, so the header, owners and data all come together
+    int result;
+    if ((result = fif_volume_read_block(mount, block_index, 0, block_data, mount->block_size)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    const FIF_VOLUME_FORMAT_SMALLFILE_HEADER *header = (const FIF_VOLUME_FORMAT_SMALLFILE_HEADER *)block_data;
+    if (header->magic != FIF_VOLUME_FORMAT_SMALLFILE_HEADER_MAGIC || header->smallfile_size != mount->smallfile_size ||
+        header->slot_count != mount->smallfile_slot_count || header->used_slot_count > header->slot_count)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "read_smallfile_block: small file block %u is corrupt", block_index);
+        return FIF_ERROR_CORRUPT_VOLUME;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int find_smallfile_slot(fif_mount_handle mount, fif_inode_index_t inode_index, const FIF_VOLUME_FORMAT_INODE *inode, unsigned char *block_data, unsigned int *out_slot)
+{
+    int result;
+    if ((result = read_smallfile_block(mount, inode->first_block_index, block_data)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // the owner list says which slot is ours
+    const uint32_t *slot_owners = (const uint32_t *)(block_data + sizeof(FIF_VOLUME_FORMAT_SMALLFILE_HEADER));
+    for (unsigned int slot = 0; slot < mount->smallfile_slot_count; slot++)
+    {
+        if (slot_owners[slot] == inode_index)
+        {
+            *out_slot = slot;
+            return FIF_ERROR_SUCCESS;
+        }
+    }
+
+    fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "find_smallfile_slot: small file block %u has no slot for inode %u", inode->first_block_index, inode_index);
+    return FIF_ERROR_CORRUPT_VOLUME;
+}
+
+static int alloc_smallfile_slot(fif_mount_handle mount, fif_inode_index_t inode_index, fif_block_index_t *out_block_index)
+{
+    int result;
+    unsigned char *block_data = (unsigned char *)alloca(mount->block_size);
+    FIF_VOLUME_FORMAT_SMALLFILE_HEADER *header = (FIF_VOLUME_FORMAT_SMALLFILE_HEADER *)block_data;
+    uint32_t *slot_owners = (uint32_t *)(block_data + sizeof(FIF_VOLUME_FORMAT_SMALLFILE_HEADER));
+
+    // use the first block with a free slot, or start a new one
+    fif_block_index_t block_index = mount->first_partial_smallfile_block;
+    if (block_index != 0)
+    {
+        if ((result = read_smallfile_block(mount, block_index, block_data)) != FIF_ERROR_SUCCESS)
+            return result;
+    }
+    else
+    {
+        if ((result = fif_volume_alloc_blocks(mount, 0, 1, &block_index)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        memset(block_data, 0, mount->block_size);
+        header->magic = FIF_VOLUME_FORMAT_SMALLFILE_HEADER_MAGIC;
+        header->smallfile_size = mount->smallfile_size;
+        header->slot_count = mount->smallfile_slot_count;
+        header->used_slot_count = 0;
+        header->next_partial_block = 0;
+        if ((result = fif_volume_write_block(mount, block_index, 0, block_data, mount->block_size)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        mount->first_partial_smallfile_block = block_index;
+    }
+
+    // take the first free slot
+    unsigned int slot = 0;
+    while (slot < header->slot_count && slot_owners[slot] != 0)
+        slot++;
+    if (slot == header->slot_count || header->used_slot_count == header->slot_count)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "alloc_smallfile_slot: small file block %u is on the partial chain but full", block_index);
+        return FIF_ERROR_CORRUPT_VOLUME;
+    }
+
+    slot_owners[slot] = inode_index;
+    header->used_slot_count++;
+
+    // full blocks come off the chain, it's always the head so that's easy
+    if (header->used_slot_count == header->slot_count)
+    {
+        mount->first_partial_smallfile_block = header->next_partial_block;
+        header->next_partial_block = 0;
+    }
+
+    // write the header and owners back
+    if ((result = fif_volume_write_block(mount, block_index, 0, block_data, smallfile_slot_offset(mount, 0))) != FIF_ERROR_SUCCESS ||
+        (result = fif_volume_update_descriptor(mount)) != FIF_ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    *out_block_index = block_index;
+    return FIF_ERROR_SUCCESS;
+}
+
+static int unlink_partial_smallfile_block(fif_mount_handle mount, fif_block_index_t block_index, fif_block_index_t next_partial_block)
+{
+    int result;
+    if (mount->first_partial_smallfile_block == block_index)
+    {
+        mount->first_partial_smallfile_block = next_partial_block;
+        return fif_volume_update_descriptor(mount);
+    }
+
+    // anywhere else, the block before it on the chain has to be found first. the chain only holds blocks with a
+    // free slot, and this only happens when a block empties, so the walk is short and rare.
+    FIF_VOLUME_FORMAT_SMALLFILE_HEADER prev_header;
+    fif_block_index_t prev_block_index = mount->first_partial_smallfile_block;
+    unsigned int chain_length = 0;
+    while (prev_block_index != 0)
+    {
+        if (prev_block_index >= mount->block_count || chain_length++ >= mount->block_count)
+        {
+            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "unlink_partial_smallfile_block: partial small file chain has bad block %u", prev_block_index);
+            return FIF_ERROR_CORRUPT_VOLUME;
+        }
+
+        if ((result = fif_volume_read_block(mount, prev_block_index, 0, &prev_header, sizeof(prev_header))) != FIF_ERROR_SUCCESS)
+            return result;
+
+        if (prev_header.next_partial_block == block_index)
+        {
+            prev_header.next_partial_block = next_partial_block;
+            return fif_volume_write_block(mount, prev_block_index, 0, &prev_header, sizeof(prev_header));
+        }
+
+        prev_block_index = prev_header.next_partial_block;
+    }
+
+    fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "unlink_partial_smallfile_block: small file block %u isn't on the partial chain", block_index);
+    return FIF_ERROR_CORRUPT_VOLUME;
+}
+
+static int free_smallfile_slot(fif_mount_handle mount, fif_inode_index_t inode_index, const FIF_VOLUME_FORMAT_INODE *inode)
+{
+    int result;
+    unsigned char *block_data = (unsigned char *)alloca(mount->block_size);
+    FIF_VOLUME_FORMAT_SMALLFILE_HEADER *header = (FIF_VOLUME_FORMAT_SMALLFILE_HEADER *)block_data;
+    uint32_t *slot_owners = (uint32_t *)(block_data + sizeof(FIF_VOLUME_FORMAT_SMALLFILE_HEADER));
+    fif_block_index_t block_index = inode->first_block_index;
+
+    unsigned int slot;
+    if ((result = find_smallfile_slot(mount, inode_index, inode, block_data, &slot)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // an empty block comes off the chain and goes back to the allocator
+    slot_owners[slot] = 0;
+    header->used_slot_count--;
+    if (header->used_slot_count == 0)
+    {
+        if ((result = unlink_partial_smallfile_block(mount, block_index, header->next_partial_block)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        return fif_volume_free_blocks(mount, block_index, 1);
+    }
+
+    // a block that was full has a free slot again, so it goes back on the chain
+    if (header->used_slot_count == (header->slot_count - 1))
+    {
+        header->next_partial_block = mount->first_partial_smallfile_block;
+        mount->first_partial_smallfile_block = block_index;
+        if ((result = fif_volume_update_descriptor(mount)) != FIF_ERROR_SUCCESS)
+            return result;
+    }
+
+    // clear the slot, and write the header and owners back
+    if ((result = fif_volume_zero_block_partial(mount, block_index, smallfile_slot_offset(mount, slot), mount->smallfile_size)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    return fif_volume_write_block(mount, block_index, 0, block_data, smallfile_slot_offset(mount, 0));
+}
+
+static int mark_block_range(fif_mount_handle mount, fif_inode_index_t inode_index, fif_block_index_t first_block_index, unsigned int block_count, unsigned char *block_usage)
+{
+    if (first_block_index == 0 || first_block_index >= mount->block_count || block_count > (mount->block_count - first_block_index))
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "mark_block_range: inode %u has bad blocks %u -> %u", inode_index, first_block_index, first_block_index + block_count - 1);
+        return FIF_ERROR_CORRUPT_VOLUME;
+    }
+
+    for (unsigned int i = 0; i < block_count; i++)
+        block_usage[first_block_index + i] |= FIF_BLOCK_USAGE_USED;
+
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_mark_file_blocks(fif_mount_handle mount, fif_inode_index_t inode_index, const FIF_VOLUME_FORMAT_INODE *inode, unsigned char *block_usage)
+{
+    int result;
+
+    // small files hold a slot in a shared block
+    if (inode->attributes & FIF_FILE_ATTRIBUTE_SMALL_FILE)
+    {
+        if ((result = mark_block_range(mount, inode_index, inode->first_block_index, 1, block_usage)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        block_usage[inode->first_block_index] |= FIF_BLOCK_USAGE_SMALLFILE;
+        return FIF_ERROR_SUCCESS;
+    }
+
+    // everything else has its data blocks, and fragmented files their map too
+    if (inode->block_count == 0)
+        return FIF_ERROR_SUCCESS;
+
+    struct file_block_map map;
+    if ((result = load_block_map(mount, inode, &map)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    if (map.header.map_block_count > 0)
+        result = mark_block_range(mount, inode_index, inode->first_block_index, map.header.map_block_count, block_usage);
+    for (unsigned int i = 0; i < map.header.fragment_count && result == FIF_ERROR_SUCCESS; i++)
+        result = mark_block_range(mount, inode_index, map.fragments[i].first_block_index, map.fragments[i].block_count, block_usage);
+
+    release_block_map(&map);
+    return result;
+}
+
+int fif_rebuild_smallfile_chain(fif_mount_handle mount, const unsigned char *block_usage)
+{
+    int result;
+    unsigned char *block_data = (unsigned char *)alloca(mount->block_size);
+    FIF_VOLUME_FORMAT_SMALLFILE_HEADER *header = (FIF_VOLUME_FORMAT_SMALLFILE_HEADER *)block_data;
+    FIF_VOLUME_FORMAT_SMALLFILE_HEADER prev_header;
+
+    // chain every small file block with a free slot in address order, rewriting only the links that differ
+    fif_block_index_t first_partial_block = 0;
+    fif_block_index_t prev_block_index = 0;
+    unsigned int partial_block_count = 0;
+    for (fif_block_index_t block_index = 1; block_index < mount->block_count; block_index++)
+    {
+        if (!(block_usage[block_index] & FIF_BLOCK_USAGE_SMALLFILE))
+            continue;
+
+        if ((result = read_smallfile_block(mount, block_index, block_data)) != FIF_ERROR_SUCCESS)
+            return result;
+        if (header->used_slot_count == header->slot_count)
+            continue;
+
+        if (prev_block_index == 0)
+        {
+            first_partial_block = block_index;
+        }
+        else if (prev_header.next_partial_block != block_index && !mount->read_only)
+        {
+            prev_header.next_partial_block = block_index;
+            if ((result = fif_volume_write_block(mount, prev_block_index, 0, &prev_header, sizeof(prev_header))) != FIF_ERROR_SUCCESS)
+                return result;
+        }
+
+        prev_block_index = block_index;
+        memcpy(&prev_header, header, sizeof(prev_header));
+        partial_block_count++;
+    }
+
+    // the last one ends the chain
+    if (prev_block_index != 0 && prev_header.next_partial_block != 0 && !mount->read_only)
+    {
+        prev_header.next_partial_block = 0;
+        if ((result = fif_volume_write_block(mount, prev_block_index, 0, &prev_header, sizeof(prev_header))) != FIF_ERROR_SUCCESS)
+            return result;
+    }
+
+    if (first_partial_block != mount->first_partial_smallfile_block)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_WARNING, "fif_rebuild_smallfile_chain: superblock says partial small file blocks start at %u, there are %u from %u",
+                    mount->first_partial_smallfile_block, partial_block_count, first_partial_block);
+    }
+
+    mount->first_partial_smallfile_block = first_partial_block;
+    return FIF_ERROR_SUCCESS;
+}
+
+static int resize_small_file(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_VOLUME_FORMAT_INODE *inode, unsigned int new_size)
+{
+    int result;
+
+    // still fits in the slot?
+    if (new_size > 0 && new_size <= mount->smallfile_size)
+    {
+        inode->data_size = new_size;
+        return FIF_ERROR_SUCCESS;
+    }
+
+    // outgrown it, so keep what's there to move into blocks of its own
+    unsigned char *old_data = (unsigned char *)alloca(mount->smallfile_size);
+    unsigned int old_size = inode->data_size;
+    if (new_size > 0 && old_size > 0)
+    {
+        unsigned char *block_data = (unsigned char *)alloca(mount->block_size);
+        unsigned int slot;
+        if ((result = find_smallfile_slot(mount, inode_index, inode, block_data, &slot)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        memcpy(old_data, block_data + smallfile_slot_offset(mount, slot), old_size);
+    }
+
+    // give up the slot
+    if ((result = free_smallfile_slot(mount, inode_index, inode)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    inode->attributes &= ~FIF_FILE_ATTRIBUTE_SMALL_FILE;
+    inode->first_block_index = 0;
+    inode->block_count = 0;
+    inode->data_size = 0;
+    if ((result = fif_write_inode(mount, inode_index, inode)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // now it's an ordinary file
+    if (new_size == 0)
+        return FIF_ERROR_SUCCESS;
+    if ((result = fif_resize_file(mount, inode_index, inode, new_size)) != FIF_ERROR_SUCCESS)
+        return result;
+    if (old_size > 0 && (result = fif_volume_write_blocks(mount, inode->first_block_index, 0, old_data, old_size)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    return FIF_ERROR_SUCCESS;
+}
+
 int fif_resize_file(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_VOLUME_FORMAT_INODE *inode, unsigned int new_size)
 {
     int result;
     //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "fif_resize_file(%p, %u, %u -> %u)", mount, inode_index, inode->data_size, new_size);
 
+    // small files live in a slot of a shared block until they outgrow it
+    if (inode->attributes & FIF_FILE_ATTRIBUTE_SMALL_FILE)
+        return resize_small_file(mount, inode_index, inode, new_size);
+    if (inode->block_count == 0 && new_size > 0 && new_size <= mount->smallfile_size && mount->smallfile_slot_count > 0 && !(inode->attributes & FIF_FILE_ATTRIBUTE_DIRECTORY))
+    {
+        if ((result = alloc_smallfile_slot(mount, inode_index, &inode->first_block_index)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        inode->attributes |= FIF_FILE_ATTRIBUTE_SMALL_FILE;
+        inode->data_size = new_size;
+        return fif_write_inode(mount, inode_index, inode);
+    }
+
     // calculate required blocks for file
     unsigned int required_blocks = new_size / mount->block_size;
     if ((new_size % mount->block_size) != 0)
         required_blocks++;
 
-    // is this more than the current number of blocks?
-    if (required_blocks != inode->block_count)
+    // growing into blocks reserved ahead of time leaves them be, only an explicit truncate gives them back
+    if (required_blocks > inode->block_count || (required_blocks < inode->block_count && new_size <= inode->data_size))
     {
         // does the file currently have any blocks allocated? if not, we need to allocate, not resize
-        if (inode->data_size == 0)
+        if (inode->block_count == 0)
         {
             // allocate blocks
             assert(inode->first_block_index == 0);
@@ -60,9 +664,9 @@ int fif_resize_file(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_V
         }
         else
         {
-            // have to extend the block range of the file
+            // have to change the block range(s) of the file
             assert(inode->first_block_index != 0 && inode->block_count > 0);
-            if ((result = fif_volume_resize_block_range(mount, inode->first_block_index, inode->block_count, required_blocks, &inode->first_block_index)) != FIF_ERROR_SUCCESS)
+            if ((result = (required_blocks > inode->block_count) ? grow_file_blocks(mount, inode, required_blocks) : shrink_file_blocks(mount, inode, required_blocks)) != FIF_ERROR_SUCCESS)
                 return result;
         }
 
@@ -79,11 +683,57 @@ int fif_resize_file(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_V
     return FIF_ERROR_SUCCESS;
 }
 
-int fif_read_file_data(fif_mount_handle mount, fif_inode_index_t inode_index, const FIF_VOLUME_FORMAT_INODE *inode, unsigned int offset, void *buffer, unsigned int bytes)
+static int reserve_file_blocks(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_VOLUME_FORMAT_INODE *inode, unsigned int size)
+{
+    int result;
+
+    // anything that fits in a small file slot gets one when it's first written
+    if (size <= inode->data_size || (size <= mount->smallfile_size && mount->smallfile_slot_count > 0))
+        return FIF_ERROR_SUCCESS;
+
+    // a small file that's going to outgrow its slot moves out now, into blocks for the whole size
+    if (inode->attributes & FIF_FILE_ATTRIBUTE_SMALL_FILE)
+    {
+        unsigned int data_size = inode->data_size;
+        if ((result = resize_small_file(mount, inode_index, inode, size)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        inode->data_size = data_size;
+        return fif_write_inode(mount, inode_index, inode);
+    }
+
+    // calculate required blocks for the reservation
+    unsigned int required_blocks = size / mount->block_size;
+    if ((size % mount->block_size) != 0)
+        required_blocks++;
+    if (required_blocks <= inode->block_count)
+        return FIF_ERROR_SUCCESS;
+
+    // take the blocks in one go, the file size doesn't change
+    if (inode->block_count == 0)
+    {
+        assert(inode->first_block_index == 0);
+        if ((result = fif_volume_alloc_blocks(mount, 0, required_blocks, &inode->first_block_index)) != FIF_ERROR_SUCCESS)
+            return result;
+    }
+    else
+    {
+        if ((result = grow_file_blocks(mount, inode, required_blocks)) != FIF_ERROR_SUCCESS)
+            return result;
+    }
+
+    inode->block_count = required_blocks;
+    return fif_write_inode(mount, inode_index, inode);
+}
+
+static bool held_by_batch(fif_mount_handle mount, const FIF_VOLUME_FORMAT_INODE *inode)
 {
-    (void)inode_index;
+    // directory contents are metadata, inside a batch they go through the block cache block by block and stay there until commit
+    return (mount->batch_depth > 0 && mount->block_cache_entries != NULL && (inode->attributes & FIF_FILE_ATTRIBUTE_DIRECTORY));
+}
 
-    // todo: fragmentation, etc
+int fif_read_file_data(fif_mount_handle mount, fif_inode_index_t inode_index, const FIF_VOLUME_FORMAT_INODE *inode, unsigned int offset, void *buffer, unsigned int bytes)
+{
     int result;
     //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "fif_read_file_data(%p, %u, %u, %u)", mount, inode_index, offset, bytes);
 
@@ -91,35 +741,48 @@ int fif_read_file_data(fif_mount_handle mount, fif_inode_index_t inode_index, co
     if ((offset + bytes) > inode->data_size)
         return FIF_ERROR_BAD_OFFSET;
 
-    // loop while reading blocks
-    unsigned char *buffer_ptr = (unsigned char*)buffer;
-    fif_block_index_t current_block = offset / mount->block_size;
-    unsigned int block_offset = offset % mount->block_size;
-    unsigned int remaining_bytes = bytes;
-    while (remaining_bytes > 0)
+    // small files come straight out of their slot
+    if (inode->attributes & FIF_FILE_ATTRIBUTE_SMALL_FILE)
     {
-        // find out remaining blocks in this block
-        unsigned int bytes_from_this_block = mount->block_size - block_offset;
-        if (bytes_from_this_block > remaining_bytes)
-            bytes_from_this_block = remaining_bytes;
+        unsigned char *block_data = (unsigned char *)alloca(mount->block_size);
+        unsigned int slot;
+        if ((result = find_smallfile_slot(mount, inode_index, inode, block_data, &slot)) != FIF_ERROR_SUCCESS)
+            return 0;
 
-        // range check
-        if (current_block >= inode->block_count)
-            return bytes - remaining_bytes;
+        memcpy(buffer, block_data + smallfile_slot_offset(mount, slot) + offset, bytes);
+        return bytes;
+    }
 
-        // read the block
-        if ((result = fif_volume_read_block(mount, inode->first_block_index + current_block, block_offset, buffer_ptr, bytes_from_this_block)) != FIF_ERROR_SUCCESS)
-            return bytes - remaining_bytes;
+    struct file_block_map map;
+    if ((result = load_block_map(mount, inode, &map)) != FIF_ERROR_SUCCESS)
+        return result;
 
-        // move to next block
-        remaining_bytes -= bytes_from_this_block;
-        buffer_ptr += bytes_from_this_block;
-        current_block++;
-        block_offset = 0;
+    // each contiguous run goes out as a single read, unless its changes are being held by a batch
+    bool batched = held_by_batch(mount, inode);
+    unsigned int bytes_read = 0;
+    while (bytes_read < bytes)
+    {
+        fif_block_index_t run_block_index;
+        unsigned int run_bytes = map_file_range(mount, &map, offset + bytes_read, bytes - bytes_read, &run_block_index);
+        if (run_bytes == 0)
+            break;
+
+        unsigned int run_offset = (offset + bytes_read) % mount->block_size;
+        if (batched)
+            result = fif_volume_read_blocks_cached(mount, run_block_index, run_offset, (unsigned char *)buffer + bytes_read, run_bytes);
+        else
+            result = fif_volume_read_blocks(mount, run_block_index, run_offset, (unsigned char *)buffer + bytes_read, run_bytes);
+        if (result != FIF_ERROR_SUCCESS)
+        {
+            bytes_read = 0;
+            break;
+        }
+
+        bytes_read += run_bytes;
     }
 
-    // done
-    return bytes;
+    release_block_map(&map);
+    return bytes_read;
 }
 
 int fif_write_file_data(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_VOLUME_FORMAT_INODE *inode, unsigned int offset, const void *buffer, unsigned int bytes)
@@ -141,43 +804,65 @@ int fif_write_file_data(fif_mount_handle mount, fif_inode_index_t inode_index, F
             return result;
     }
 
-    // loop while writing blocks
-    unsigned char *buffer_ptr = (unsigned char*)buffer;
-    fif_block_index_t current_block = (offset / mount->block_size);
-    unsigned int block_offset = offset % mount->block_size;
-    unsigned int remaining_bytes = bytes;
-    while (remaining_bytes > 0)
+    // small files go straight into their slot
+    if (inode->attributes & FIF_FILE_ATTRIBUTE_SMALL_FILE)
     {
-        // find out remaining blocks in this block
-        unsigned int bytes_from_this_block = mount->block_size - block_offset;
-        if (bytes_from_this_block > remaining_bytes)
-            bytes_from_this_block = remaining_bytes;
+        unsigned char *block_data = (unsigned char *)alloca(mount->block_size);
+        unsigned int slot;
+        if ((result = find_smallfile_slot(mount, inode_index, inode, block_data, &slot)) != FIF_ERROR_SUCCESS ||
+            (result = fif_volume_write_block(mount, inode->first_block_index, smallfile_slot_offset(mount, slot) + offset, buffer, bytes)) != FIF_ERROR_SUCCESS)
+        {
+            return 0;
+        }
 
-        // check block range
-        if (current_block >= inode->block_count)
-            return bytes - remaining_bytes;
+        return bytes;
+    }
 
-        // read the block
-        if ((result = fif_volume_write_block(mount, inode->first_block_index + current_block, block_offset, buffer_ptr, bytes_from_this_block)) != FIF_ERROR_SUCCESS)
-            return bytes - remaining_bytes;
+    struct file_block_map map;
+    if ((result = load_block_map(mount, inode, &map)) != FIF_ERROR_SUCCESS)
+        return result;
 
-        // move to next block
-        remaining_bytes -= bytes_from_this_block;
-        buffer_ptr += bytes_from_this_block;
-        current_block++;
-        block_offset = 0;
+    // each contiguous run goes out as a single write, unless a batch is holding it
+    bool batched = held_by_batch(mount, inode);
+    unsigned int bytes_written = 0;
+    while (bytes_written < bytes)
+    {
+        fif_block_index_t run_block_index;
+        unsigned int run_bytes = map_file_range(mount, &map, offset + bytes_written, bytes - bytes_written, &run_block_index);
+        if (run_bytes == 0)
+            break;
+
+        unsigned int run_offset = (offset + bytes_written) % mount->block_size;
+        if (batched)
+            result = fif_volume_write_blocks_cached(mount, run_block_index, run_offset, (const unsigned char *)buffer + bytes_written, run_bytes);
+        else
+            result = fif_volume_write_blocks(mount, run_block_index, run_offset, (const unsigned char *)buffer + bytes_written, run_bytes);
+        if (result != FIF_ERROR_SUCCESS)
+        {
+            bytes_written = 0;
+            break;
+        }
+
+        bytes_written += run_bytes;
     }
 
-    // wrote everything
-    return bytes;
+    release_block_map(&map);
+    return bytes_written;
 }
 
 int fif_free_file_blocks(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_VOLUME_FORMAT_INODE *inode)
 {
     int result;
-    if (inode->block_count > 0)
+    if (inode->attributes & FIF_FILE_ATTRIBUTE_SMALL_FILE)
     {
-        if ((result = fif_volume_free_blocks(mount, inode->first_block_index, inode->block_count)) != FIF_ERROR_SUCCESS)
+        if ((result = free_smallfile_slot(mount, inode_index, inode)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        inode->attributes &= ~FIF_FILE_ATTRIBUTE_SMALL_FILE;
+    }
+    else if (inode->block_count > 0)
+    {
+        if ((result = shrink_file_blocks(mount, inode, 0)) != FIF_ERROR_SUCCESS)
             return result;
     }
 
@@ -197,7 +882,18 @@ int fif_resolve_file_name(fif_mount_handle mount, const char *path, fif_inode_in
     int path_length = (int)strlen(path);
     char *path_copy = (char *)alloca(path_length + 1);
     if (!fif_canonicalize_path(path_copy, path_length + 1, path))
-        return FIF_ERROR_BAD_PATH;
+    {
+        // the root directory has no name to look up, it is its own parent
+        if (path_length == 0 || path_copy[0] != '/')
+            return FIF_ERROR_BAD_PATH;
+
+        if (out_inode_index != NULL)
+            *out_inode_index = mount->root_inode;
+        if (out_directory_inode_index != NULL)
+            *out_directory_inode_index = mount->root_inode;
+
+        return FIF_ERROR_SUCCESS;
+    }
 
     // split to dirname and basename
     char *dirname, *basename;
@@ -212,7 +908,7 @@ int fif_resolve_file_name(fif_mount_handle mount, const char *path, fif_inode_in
 
     // does the file exist in the directory?
     fif_inode_index_t file_inode_index;
-    if ((result = fif_find_file_in_directory(mount, directory_inode, basename, &file_inode_index, NULL)) != FIF_ERROR_SUCCESS)
+    if ((result = fif_find_file_in_directory(mount, directory_inode, basename, &file_inode_index)) != FIF_ERROR_SUCCESS)
         return result;
 
     // return the inode
@@ -226,33 +922,106 @@ int fif_resolve_file_name(fif_mount_handle mount, const char *path, fif_inode_in
 
 static int can_open_file(fif_mount_handle mount, fif_inode_index_t inode, unsigned int mode)
 {
+    // open handles share the cached inode, which counts how many of them read and write it
+    struct fif_inode_cache_entry *entry = fif_find_open_inode(mount, inode);
     if (mode & (FIF_OPEN_MODE_WRITE | FIF_OPEN_MODE_TRUNCATE))
     {
         if (mount->read_only)
             return FIF_ERROR_READ_ONLY;
 
-        // check there isn't any open files for reading or writing with this inode
-        for (unsigned int i = 0; i < mount->open_file_count; i++)
-        {
-            fif_file_handle file = mount->open_files[i];
-            if (file != NULL && file->inode_index == inode && (file->open_mode & (FIF_OPEN_MODE_READ |FIF_OPEN_MODE_WRITE)))
-                return FIF_ERROR_SHARING_VIOLATION;
-        }
+        // check there isn't any open files for reading or writing with this inode
+        if (entry != NULL && (entry->reader_count > 0 || entry->writer_count > 0))
+            return FIF_ERROR_SHARING_VIOLATION;
+
+        return FIF_ERROR_SUCCESS;
+    }
+    else
+    {
+        // check there isn't any open files for writing with this inode
+        if (entry != NULL && entry->writer_count > 0)
+            return FIF_ERROR_SHARING_VIOLATION;
+
+        return FIF_ERROR_SUCCESS;
+    }
+}
+
+// smallest open file table, it doubles from there
+#define OPEN_FILE_TABLE_MIN_SIZE 16
+
+static void push_free_open_file_slot(fif_mount_handle mount, unsigned int handle_index)
+{
+    // free slots are a min-heap, so the lowest one is always reused first
+    unsigned int *heap = mount->open_file_free_slots;
+    unsigned int position = mount->open_file_free_count++;
+    while (position > 0 && heap[(position - 1) / 2] > handle_index)
+    {
+        heap[position] = heap[(position - 1) / 2];
+        position = (position - 1) / 2;
+    }
+    heap[position] = handle_index;
+}
+
+static unsigned int pop_free_open_file_slot(fif_mount_handle mount)
+{
+    unsigned int *heap = mount->open_file_free_slots;
+    unsigned int lowest = heap[0];
+    unsigned int last = heap[--mount->open_file_free_count];
+    unsigned int position = 0;
+    for (;;)
+    {
+        unsigned int child = position * 2 + 1;
+        if (child >= mount->open_file_free_count)
+            break;
+        if ((child + 1) < mount->open_file_free_count && heap[child + 1] < heap[child])
+            child++;
+        if (heap[child] >= last)
+            break;
+
+        heap[position] = heap[child];
+        position = child;
+    }
+    if (mount->open_file_free_count > 0)
+        heap[position] = last;
+
+    return lowest;
+}
+
+static int alloc_open_file_slot(fif_mount_handle mount, unsigned int *out_handle_index)
+{
+    // out of slots, grow the table and the heap to match
+    if (mount->open_file_free_count == 0)
+    {
+        unsigned int new_open_file_count = (mount->open_file_count > 0) ? (mount->open_file_count * 2) : OPEN_FILE_TABLE_MIN_SIZE;
+        fif_file_handle *new_open_files = (fif_file_handle *)realloc(mount->open_files, sizeof(fif_file_handle) * new_open_file_count);
+        if (new_open_files == NULL)
+            return FIF_ERROR_OUT_OF_MEMORY;
+        mount->open_files = new_open_files;
+
+        unsigned int *new_free_slots = (unsigned int *)realloc(mount->open_file_free_slots, sizeof(unsigned int) * new_open_file_count);
+        if (new_free_slots == NULL)
+            return FIF_ERROR_OUT_OF_MEMORY;
+        mount->open_file_free_slots = new_free_slots;
+
+        // the heap is empty, and the new slots in ascending order already satisfy it
+        memset(new_open_files + mount->open_file_count, 0, sizeof(fif_file_handle) * (new_open_file_count - mount->open_file_count));
+        for (unsigned int i = mount->open_file_count; i < new_open_file_count; i++)
+            mount->open_file_free_slots[mount->open_file_free_count++] = i;
 
-        return FIF_ERROR_SUCCESS;
+        mount->open_file_count = new_open_file_count;
     }
-    else
-    {
-        // check there isn't any open files for writing with this inode
-        for (unsigned int i = 0; i < mount->open_file_count; i++)
-        {
-            fif_file_handle file = mount->open_files[i];
-            if (file != NULL && file->inode_index == inode && (file->open_mode & FIF_OPEN_MODE_WRITE))
-                return FIF_ERROR_SHARING_VIOLATION;
-        }
 
-        return FIF_ERROR_SUCCESS;
-    }
+    *out_handle_index = pop_free_open_file_slot(mount);
+    return FIF_ERROR_SUCCESS;
+}
+
+void fif_free_open_file_table(fif_mount_handle mount)
+{
+    free(mount->open_file_free_slots);
+    free(mount->open_files);
+    mount->open_file_free_slots = NULL;
+    mount->open_file_free_count = 0;
+    mount->open_files = NULL;
+    mount->open_file_count = 0;
 }
 
 static int resize_open_file_buffer(fif_file_handle handle, unsigned int new_size)
@@ -278,9 +1047,9 @@ static int update_file_buffer(fif_mount_handle mount, fif_file_handle handle, un
     {
         // write it
         if (handle->compressor != NULL)
-            result = handle->compressor->compressor_write(mount, handle->inode_index, &handle->inode, handle->compressor_data, handle->buffer_range_start, handle->buffer_data, handle->buffer_range_size);
+            result = handle->compressor->compressor_write(mount, handle->inode_index, handle->inode, handle->compressor_data, handle->buffer_range_start, handle->buffer_data, handle->buffer_range_size);
         else
-            result = fif_write_file_data(mount, handle->inode_index, &handle->inode, handle->buffer_range_start, handle->buffer_data, handle->buffer_range_size);
+            result = fif_write_file_data(mount, handle->inode_index, handle->inode, handle->buffer_range_start, handle->buffer_data, handle->buffer_range_size);
 
         if ((unsigned int)result != handle->buffer_range_size)
             return (result >= 0) ? FIF_ERROR_IO_ERROR : result;
@@ -292,12 +1061,34 @@ static int update_file_buffer(fif_mount_handle mount, fif_file_handle handle, un
     handle->buffer_range_start = new_start;
     handle->buffer_range_size = 0;
 
+    // read-only handles grow their window while reads are sequential, and drop back to a block when they aren't
+    if (!(handle->open_mode & FIF_OPEN_MODE_WRITE) && handle->buffer_size > 0 && mount->max_readahead_size > mount->block_size)
+    {
+        unsigned int new_readahead_size = mount->block_size;
+        if (old_buffer_range_size > 0 && new_start == (old_buffer_range_start + old_buffer_range_size))
+        {
+            new_readahead_size = handle->readahead_size * 2;
+            if (new_readahead_size > mount->max_readahead_size)
+                new_readahead_size = mount->max_readahead_size;
+        }
+
+        // the buffer only ever grows, so a reader that keeps switching patterns doesn't reallocate each time
+        if (new_readahead_size > handle->buffer_size && (result = resize_open_file_buffer(handle, new_readahead_size)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        handle->readahead_size = new_readahead_size;
+    }
+
+    // a writer's buffer grown by delayed allocation drops back once it's flushed, as only readahead_size bytes are read into it below
+    if ((handle->open_mode & FIF_OPEN_MODE_WRITE) && handle->buffer_size > handle->readahead_size && (result = resize_open_file_buffer(handle, handle->readahead_size)) != FIF_ERROR_SUCCESS)
+        return result;
+
     // update the buffer contents
     if ((handle->open_mode & FIF_OPEN_MODE_READ) && new_start < handle->file_size)
     {
         unsigned int remaining_bytes = (handle->file_size - new_start);
-        if (remaining_bytes > handle->buffer_size)
-            handle->buffer_range_size = handle->buffer_size;
+        if (remaining_bytes > handle->readahead_size)
+            handle->buffer_range_size = handle->readahead_size;
         else
             handle->buffer_range_size = remaining_bytes;
 
@@ -311,15 +1102,15 @@ static int update_file_buffer(fif_mount_handle mount, fif_file_handle handle, un
                 //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "  old_buffer_range_start = %u, old_buffer_range_size = %u", old_buffer_range_start, old_buffer_range_size);
                 //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "  new buffer_range_start = %u, new buffer_range_size = %u", handle->buffer_range_start, handle->buffer_range_size);
                 //fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "  skipping %u decompressed bytes", skip_count);
-                if ((result = handle->decompressor->decompressor_skip(mount, handle->inode_index, &handle->inode, handle->decompressor_data, skip_count)) != (int)skip_count)
+                if ((result = handle->decompressor->decompressor_skip(mount, handle->inode_index, handle->inode, handle->decompressor_data, skip_count)) != (int)skip_count)
                     return (result >= 0) ? FIF_ERROR_IO_ERROR : result;
             }
 
-            result = handle->decompressor->decompressor_read(mount, handle->inode_index, &handle->inode, handle->decompressor_data, handle->buffer_range_start, handle->buffer_data, handle->buffer_range_size);
+            result = handle->decompressor->decompressor_read(mount, handle->inode_index, handle->inode, handle->decompressor_data, handle->buffer_range_start, handle->buffer_data, handle->buffer_range_size);
         }
         else
         {
-            result = fif_read_file_data(mount, handle->inode_index, &handle->inode, handle->buffer_range_start, handle->buffer_data, handle->buffer_range_size);
+            result = fif_read_file_data(mount, handle->inode_index, handle->inode, handle->buffer_range_start, handle->buffer_data, handle->buffer_range_size);
         }
 
         if ((unsigned int)result != handle->buffer_range_size)
@@ -330,8 +1121,12 @@ static int update_file_buffer(fif_mount_handle mount, fif_file_handle handle, un
     return FIF_ERROR_SUCCESS;
 }
 
-static void cleanup_open_file(fif_mount_handle mount, fif_file_handle handle)
+static int cleanup_open_file(fif_mount_handle mount, fif_file_handle handle)
 {
+    // views can't outlive the handle
+    while (handle->views != NULL)
+        fif_file_release_view(mount, handle, handle->views->pointer);
+
     if (handle->compressor != NULL)
         handle->compressor->compressor_cleanup(mount, handle->compressor_data);
 
@@ -340,9 +1135,18 @@ static void cleanup_open_file(fif_mount_handle mount, fif_file_handle handle)
 
     assert(handle->handle_index < mount->open_file_count && mount->open_files[handle->handle_index] == handle);
     mount->open_files[handle->handle_index] = NULL;
+    push_free_open_file_slot(mount, handle->handle_index);
+
+    // stop counting against the inode's sharing, and drop our reference to it, this can write it back
+    if (handle->open_mode & FIF_OPEN_MODE_READ)
+        handle->inode_entry->reader_count--;
+    if (handle->open_mode & FIF_OPEN_MODE_WRITE)
+        handle->inode_entry->writer_count--;
+    int result = fif_release_inode(mount, handle->inode_entry);
 
     free(handle->buffer_data);
     free(handle);
+    return result;
 }
 
 int fif_open_file_by_inode(fif_mount_handle mount, fif_inode_index_t inode_index, unsigned int mode, fif_file_handle *handle)
@@ -388,33 +1192,36 @@ int fif_open_file_by_inode(fif_mount_handle mount, fif_inode_index_t inode_index
         }
     }
 
-    // find an index
+    // take the lowest free slot
     unsigned int handle_index;
-    for (handle_index = 0; handle_index < mount->open_file_count; handle_index++)
-    {
-        if (mount->open_files[handle_index] == NULL)
-            break;
-    }
-    if (handle_index == mount->open_file_count)
-    {
-        unsigned int new_open_file_count = mount->open_file_count + 1;
-        fif_file_handle *new_open_files = (fif_file_handle *)realloc(mount->open_files, sizeof(fif_file_handle) * new_open_file_count);
-        if (new_open_files == NULL)
-            return FIF_ERROR_OUT_OF_MEMORY;
-
-        memset(new_open_files + mount->open_file_count, 0, sizeof(fif_file_handle *) * (new_open_file_count - mount->open_file_count));
-        mount->open_files = new_open_files;
-        mount->open_file_count = new_open_file_count;
-    }
+    if ((result = alloc_open_file_slot(mount, &handle_index)) != FIF_ERROR_SUCCESS)
+        return result;
 
     // allocate new handle
     fif_file_handle new_handle = (fif_file_handle)malloc(sizeof(struct fif_open_file_s));
     if (new_handle == NULL)
+    {
+        push_free_open_file_slot(mount, handle_index);
         return FIF_ERROR_OUT_OF_MEMORY;
+    }
+
+    // share the cached inode with any other handles to it
+    if ((result = fif_acquire_inode(mount, inode_index, &new_handle->inode_entry)) != FIF_ERROR_SUCCESS)
+    {
+        push_free_open_file_slot(mount, handle_index);
+        free(new_handle);
+        return result;
+    }
+
+    // count the handle towards later sharing checks, until it's cleaned up
+    if (mode & FIF_OPEN_MODE_READ)
+        new_handle->inode_entry->reader_count++;
+    if (mode & FIF_OPEN_MODE_WRITE)
+        new_handle->inode_entry->writer_count++;
 
     // fill handle info
     new_handle->inode_index = inode_index;
-    memcpy(&new_handle->inode, &inode, sizeof(new_handle->inode));
+    new_handle->inode = &new_handle->inode_entry->inode;
     new_handle->handle_index = handle_index;
     new_handle->open_mode = mode;
     new_handle->current_offset = 0;
@@ -423,28 +1230,31 @@ int fif_open_file_by_inode(fif_mount_handle mount, fif_inode_index_t inode_index
     new_handle->buffer_size = 0;
     new_handle->buffer_range_start = UINT_MAX;
     new_handle->buffer_range_size = 0;
+    new_handle->readahead_size = 0;
     new_handle->buffer_dirty = false;
+    new_handle->trim_reserved_blocks = false;
     new_handle->compressor = NULL;
     new_handle->compressor_data = NULL;
     new_handle->decompressor = NULL;
     new_handle->decompressor_data = NULL;
+    new_handle->views = NULL;
 
     // store handle
     assert(mount->open_files[new_handle->handle_index] == NULL);
     mount->open_files[new_handle->handle_index] = new_handle;
 
     // initialize compressor
-    if (new_handle->inode.compression_algorithm != FIF_COMPRESSION_ALGORITHM_NONE)
+    if (new_handle->inode->compression_algorithm != FIF_COMPRESSION_ALGORITHM_NONE)
     {
         if (mode & FIF_OPEN_MODE_WRITE)
         {
-            if ((new_handle->compressor = fif_get_compressor_functions(new_handle->inode.compression_algorithm)) == NULL)
+            if ((new_handle->compressor = fif_get_compressor_functions(new_handle->inode->compression_algorithm)) == NULL)
             {
                 cleanup_open_file(mount, new_handle);
                 return FIF_ERROR_COMPRESSOR_NOT_FOUND;
             }
 
-            if ((result = new_handle->compressor->compressor_init(mount, new_handle->inode_index, &new_handle->inode, &new_handle->compressor_data, new_handle->inode.compression_level)) != FIF_ERROR_SUCCESS)
+            if ((result = new_handle->compressor->compressor_init(mount, new_handle->inode_index, new_handle->inode, &new_handle->compressor_data, new_handle->inode->compression_level)) != FIF_ERROR_SUCCESS)
             {
                 cleanup_open_file(mount, new_handle);
                 return result;
@@ -453,13 +1263,13 @@ int fif_open_file_by_inode(fif_mount_handle mount, fif_inode_index_t inode_index
 
         if (mode & FIF_OPEN_MODE_READ)
         {
-            if ((new_handle->decompressor = fif_get_decompressor_functions(new_handle->inode.compression_algorithm)) == NULL)
+            if ((new_handle->decompressor = fif_get_decompressor_functions(new_handle->inode->compression_algorithm)) == NULL)
             {
                 cleanup_open_file(mount, new_handle);
                 return FIF_ERROR_COMPRESSOR_NOT_FOUND;
             }
 
-            if ((result = new_handle->decompressor->decompressor_init(mount, new_handle->inode_index, &new_handle->inode, &new_handle->decompressor_data)) != FIF_ERROR_SUCCESS)
+            if ((result = new_handle->decompressor->decompressor_init(mount, new_handle->inode_index, new_handle->inode, &new_handle->decompressor_data)) != FIF_ERROR_SUCCESS)
             {
                 cleanup_open_file(mount, new_handle);
                 return result;
@@ -471,7 +1281,7 @@ int fif_open_file_by_inode(fif_mount_handle mount, fif_inode_index_t inode_index
     unsigned int buffer_size;
     if (mode & FIF_OPEN_MODE_FULLY_BUFFERED)
         buffer_size = (inode.uncompressed_size > 0) ? inode.uncompressed_size : mount->block_size;
-    else if (mode & FIF_OPEN_MODE_DIRECT)
+    else if ((mode & FIF_OPEN_MODE_DIRECT) && new_handle->compressor == NULL && new_handle->decompressor == NULL)
         buffer_size = 0;
     else
         buffer_size = mount->block_size;
@@ -482,12 +1292,13 @@ int fif_open_file_by_inode(fif_mount_handle mount, fif_inode_index_t inode_index
         cleanup_open_file(mount, new_handle);
         return result;
     }
+    new_handle->readahead_size = buffer_size;
 
     // if we're opening the file with truncate, free all the blocks associated with the file and update the inode
-    if (mode & FIF_OPEN_MODE_TRUNCATE && new_handle->file_size > 0)
+    if (mode & FIF_OPEN_MODE_TRUNCATE && (new_handle->file_size > 0 || new_handle->inode->block_count > 0))
     {
         // free the blocks
-        if ((result = fif_free_file_blocks(mount, new_handle->inode_index, &new_handle->inode)) != FIF_ERROR_SUCCESS)
+        if ((result = fif_free_file_blocks(mount, new_handle->inode_index, new_handle->inode)) != FIF_ERROR_SUCCESS)
         {
             cleanup_open_file(mount, new_handle);
             return result;
@@ -499,7 +1310,7 @@ int fif_open_file_by_inode(fif_mount_handle mount, fif_inode_index_t inode_index
     {
         assert(new_handle->buffer_size >= inode.uncompressed_size);
         if (new_handle->decompressor != NULL)
-            result = new_handle->decompressor->decompressor_read(mount, new_handle->inode_index, &new_handle->inode, new_handle->decompressor_data, 0, new_handle->buffer_data, inode.uncompressed_size);
+            result = new_handle->decompressor->decompressor_read(mount, new_handle->inode_index, new_handle->inode, new_handle->decompressor_data, 0, new_handle->buffer_data, inode.uncompressed_size);
         else
             result = fif_read_file_data(mount, inode_index, &inode, 0, new_handle->buffer_data, inode.uncompressed_size);
 
@@ -528,6 +1339,16 @@ int fif_file_read(fif_mount_handle mount, fif_file_handle file, void *out_buffer
     if ((file->current_offset + count) > file->file_size)
         count = file->file_size - file->current_offset;
 
+    // unbuffered handles, and read-only uncompressed files on a directly addressable volume, skip the handle buffer
+    if (file->decompressor == NULL && count > 0 &&
+        (file->buffer_size == 0 || (!(file->open_mode & (FIF_OPEN_MODE_WRITE | FIF_OPEN_MODE_FULLY_BUFFERED)) && fif_volume_is_addressable(mount))))
+    {
+        if ((result = fif_read_file_data(mount, file->inode_index, file->inode, file->current_offset, out_buffer, count)) > 0)
+            file->current_offset += result;
+
+        return result;
+    }
+
     // buffered reads
     unsigned char *out_buffer_ptr = (unsigned char *)out_buffer;
     unsigned int remaining_bytes = count;
@@ -567,6 +1388,143 @@ int fif_file_read(fif_mount_handle mount, fif_file_handle file, void *out_buffer
     return count;
 }
 
+int fif_file_read_view(fif_mount_handle mount, fif_file_handle file, fif_offset_t offset, unsigned int max_count, const void **out_pointer, unsigned int *out_count)
+{
+    int result;
+    *out_pointer = NULL;
+    *out_count = 0;
+
+    // streamed compressed data can only be read in order, so there is nothing to point at
+    if (!(file->open_mode & FIF_OPEN_MODE_READ) || (file->decompressor != NULL && !(file->open_mode & FIF_OPEN_MODE_FULLY_BUFFERED)))
+        return FIF_ERROR_BAD_OFFSET;
+
+    // past the end is an empty view
+    if (offset < 0 || (uint64_t)offset >= file->file_size || max_count == 0)
+        return FIF_ERROR_SUCCESS;
+
+    unsigned int view_offset = (unsigned int)offset;
+    unsigned int count = file->file_size - view_offset;
+    if (count > max_count)
+        count = max_count;
+
+    struct fif_file_view *view = (struct fif_file_view *)malloc(sizeof(struct fif_file_view));
+    if (view == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+
+    view->pointer = NULL;
+    view->pinned_entry = NULL;
+    view->owned_buffer = NULL;
+
+    if (file->open_mode & FIF_OPEN_MODE_FULLY_BUFFERED)
+    {
+        // the whole file is already in memory
+        view->pointer = file->buffer_data + view_offset;
+    }
+    else if (!file->buffer_dirty)
+    {
+        // uncompressed data is contiguous within a fragment, so the volume can hand out a pointer if it's mapped or cached
+        struct file_block_map map;
+        if ((result = load_block_map(mount, file->inode, &map)) != FIF_ERROR_SUCCESS)
+        {
+            free(view);
+            return result;
+        }
+
+        fif_block_index_t run_block_index;
+        unsigned int run_bytes = map_file_range(mount, &map, view_offset, count, &run_block_index);
+        release_block_map(&map);
+
+        unsigned int view_count;
+        if (run_bytes > 0 && (result = fif_volume_get_block_view(mount, run_block_index, view_offset % mount->block_size, run_bytes, &view->pointer, &view_count, &view->pinned_entry)) != FIF_ERROR_SUCCESS)
+        {
+            free(view);
+            return result;
+        }
+        if (view->pointer != NULL)
+            count = view_count;
+    }
+
+    // otherwise read a private copy, without moving the file pointer
+    if (view->pointer == NULL)
+    {
+        if ((view->owned_buffer = malloc(count)) == NULL)
+        {
+            free(view);
+            return FIF_ERROR_OUT_OF_MEMORY;
+        }
+
+        if (file->buffer_dirty)
+        {
+            // unwritten data in the handle buffer has to be included
+            unsigned int saved_offset = file->current_offset;
+            file->current_offset = view_offset;
+            result = fif_file_read(mount, file, view->owned_buffer, count);
+            file->current_offset = saved_offset;
+        }
+        else
+        {
+            result = fif_read_file_data(mount, file->inode_index, file->inode, view_offset, view->owned_buffer, count);
+        }
+
+        if (result <= 0)
+        {
+            free(view->owned_buffer);
+            free(view);
+            return (result < 0) ? result : FIF_ERROR_IO_ERROR;
+        }
+
+        count = (unsigned int)result;
+        view->pointer = view->owned_buffer;
+    }
+
+    view->next = file->views;
+    file->views = view;
+    *out_pointer = view->pointer;
+    *out_count = count;
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_file_release_view(fif_mount_handle mount, fif_file_handle file, const void *pointer)
+{
+    struct fif_file_view **link = &file->views;
+    while (*link != NULL)
+    {
+        struct fif_file_view *view = *link;
+        if (view->pointer == pointer)
+        {
+            *link = view->next;
+            if (view->pinned_entry != NULL)
+                fif_volume_release_block_view(mount, view->pinned_entry);
+
+            free(view->owned_buffer);
+            free(view);
+            return FIF_ERROR_SUCCESS;
+        }
+
+        link = &view->next;
+    }
+
+    return FIF_ERROR_BAD_OFFSET;
+}
+
+static bool can_delay_allocation(fif_mount_handle mount, fif_file_handle file)
+{
+    // only plain files, with a full buffer that's being appended to and runs past what's on the volume
+    return (file->compressor == NULL &&
+            !(file->open_mode & FIF_OPEN_MODE_DIRECTORY) &&
+            file->buffer_size < mount->delayed_allocation_size &&
+            file->buffer_range_start != UINT_MAX &&
+            file->buffer_range_size == file->buffer_size &&
+            file->current_offset == (file->buffer_range_start + file->buffer_range_size) &&
+            file->current_offset > file->inode->data_size);
+}
+
+static unsigned int next_delayed_buffer_size(fif_mount_handle mount, fif_file_handle file)
+{
+    unsigned int new_size = file->buffer_size * 2;
+    return (new_size > mount->delayed_allocation_size) ? mount->delayed_allocation_size : new_size;
+}
+
 int fif_file_write(fif_mount_handle mount, fif_file_handle file, const void *in_buffer, unsigned int count)
 {
     int result;
@@ -576,6 +1534,20 @@ int fif_file_write(fif_mount_handle mount, fif_file_handle file, const void *in_
     if (count == 0)
         return 0;
 
+    // unbuffered handles write straight through to the volume
+    if (file->buffer_size == 0)
+    {
+        assert(file->compressor == NULL);
+        if ((result = fif_write_file_data(mount, file->inode_index, file->inode, file->current_offset, in_buffer, count)) > 0)
+        {
+            file->current_offset += result;
+            if (file->current_offset > file->file_size)
+                file->file_size = file->current_offset;
+        }
+
+        return result;
+    }
+
     // special case for fully-buffered files
     if (file->open_mode & FIF_OPEN_MODE_FULLY_BUFFERED)
     {
@@ -604,11 +1576,11 @@ int fif_file_write(fif_mount_handle mount, fif_file_handle file, const void *in_
     unsigned int remaining_bytes = count;
     while (remaining_bytes > 0)
     {
-        // write to the current buffer if possible
+        // write to the current buffer if possible, as long as it doesn't leave a gap of bytes that were never read in
         if (file->buffer_range_start <= file->current_offset)
         {
             unsigned int buffer_offset = (file->current_offset - file->buffer_range_start);
-            if (buffer_offset < file->buffer_size)
+            if (buffer_offset < file->buffer_size && buffer_offset <= file->buffer_range_size)
             {
                 unsigned int buffer_space_remaining = (file->buffer_size - buffer_offset);
                 unsigned int bytes_to_buffer = buffer_space_remaining;
@@ -637,6 +1609,10 @@ int fif_file_write(fif_mount_handle mount, fif_file_handle file, const void *in_
             }
         }
 
+        // appends past the end of the file on the volume keep growing the buffer instead, so close (or the threshold) allocates their blocks in one go
+        if (can_delay_allocation(mount, file) && resize_open_file_buffer(file, next_delayed_buffer_size(mount, file)) == FIF_ERROR_SUCCESS)
+            continue;
+
         // flush the buffer and move it forwards
         if ((result = update_file_buffer(mount, file, file->current_offset)) != FIF_ERROR_SUCCESS)
             return count - remaining_bytes;
@@ -677,16 +1653,147 @@ fif_offset_t fif_file_seek(fif_mount_handle mount, fif_file_handle file, fif_off
     return file->current_offset;
 }
 
+static int zero_volume_range(fif_mount_handle mount, fif_block_index_t block_index, unsigned int block_offset, unsigned int bytes)
+{
+    int result;
+    fif_block_index_t current_block = block_index;
+    unsigned int remaining_bytes = bytes;
+    while (remaining_bytes > 0)
+    {
+        // whole blocks can be zeroed as one run, partial ones are done individually
+        if (block_offset == 0 && remaining_bytes >= mount->block_size)
+        {
+            unsigned int run_blocks = remaining_bytes / mount->block_size;
+            if ((result = fif_volume_zero_blocks(mount, current_block, run_blocks)) != FIF_ERROR_SUCCESS)
+                return result;
+
+            current_block += run_blocks;
+            remaining_bytes -= run_blocks * mount->block_size;
+            continue;
+        }
+
+        unsigned int bytes_from_this_block = mount->block_size - block_offset;
+        if (bytes_from_this_block > remaining_bytes)
+            bytes_from_this_block = remaining_bytes;
+
+        if ((result = fif_volume_zero_block_partial(mount, current_block, block_offset, bytes_from_this_block)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        current_block++;
+        block_offset = 0;
+        remaining_bytes -= bytes_from_this_block;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int zero_file_range(fif_mount_handle mount, fif_inode_index_t inode_index, const FIF_VOLUME_FORMAT_INODE *inode, unsigned int offset, unsigned int bytes)
+{
+    int result;
+    if (inode->attributes & FIF_FILE_ATTRIBUTE_SMALL_FILE)
+    {
+        unsigned char *block_data = (unsigned char *)alloca(mount->block_size);
+        unsigned int slot;
+        if ((result = find_smallfile_slot(mount, inode_index, inode, block_data, &slot)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        return fif_volume_zero_block_partial(mount, inode->first_block_index, smallfile_slot_offset(mount, slot) + offset, bytes);
+    }
+
+    struct file_block_map map;
+    if ((result = load_block_map(mount, inode, &map)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // zero each contiguous run of the range
+    while (bytes > 0)
+    {
+        fif_block_index_t run_block_index;
+        unsigned int run_bytes = map_file_range(mount, &map, offset, bytes, &run_block_index);
+        if (run_bytes == 0)
+        {
+            result = FIF_ERROR_BAD_OFFSET;
+            break;
+        }
+
+        if ((result = zero_volume_range(mount, run_block_index, offset % mount->block_size, run_bytes)) != FIF_ERROR_SUCCESS)
+            break;
+
+        offset += run_bytes;
+        bytes -= run_bytes;
+    }
+
+    release_block_map(&map);
+    return result;
+}
+
 int fif_file_truncate(fif_mount_handle mount, fif_file_handle file, fif_offset_t size)
 {
     int result;
-    if ((result = fif_resize_file(mount, file->inode_index, &file->inode, (unsigned int)size)) != FIF_ERROR_SUCCESS)
+
+    // compressed data is one stream written out at close, so there's no offset in it to cut at
+    if (file->compressor != NULL)
+        return FIF_ERROR_BAD_OFFSET;
+
+    unsigned int old_size = file->inode->data_size;
+    if ((result = fif_resize_file(mount, file->inode_index, file->inode, (unsigned int)size)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // extending exposes whatever the blocks held before, which isn't necessarily zero (stale tail, or skip_zero_freed_blocks)
+    if ((unsigned int)size > old_size &&
+        (result = zero_file_range(mount, file->inode_index, file->inode, old_size, (unsigned int)size - old_size)) != FIF_ERROR_SUCCESS)
+    {
         return result;
+    }
+
+    // drop anything buffered past the new end, so it isn't written back and extends the file again
+    if (file->buffer_range_start >= (unsigned int)size)
+    {
+        file->buffer_range_start = UINT_MAX;
+        file->buffer_range_size = 0;
+        file->buffer_dirty = false;
+    }
+    else if ((file->buffer_range_start + file->buffer_range_size) > (unsigned int)size)
+    {
+        file->buffer_range_size = (unsigned int)size - file->buffer_range_start;
+    }
 
     file->file_size = (unsigned int)size;
     return FIF_ERROR_SUCCESS;
 }
 
+int fif_file_allocate(fif_mount_handle mount, fif_file_handle file, fif_offset_t size)
+{
+    if (!(file->open_mode & FIF_OPEN_MODE_WRITE))
+        return FIF_ERROR_READ_ONLY;
+
+    // compressed files don't know how much they'll store until it's written
+    if (file->compressor != NULL)
+        return FIF_ERROR_SUCCESS;
+
+    return reserve_file_blocks(mount, file->inode_index, file->inode, (unsigned int)size);
+}
+
+static int fail_file_close(fif_mount_handle mount, fif_file_handle file, int error)
+{
+    // the cached inode is written back once the handle lets go of it, so it has to agree with what actually reached the volume
+    if (file->compressor != NULL)
+    {
+        // an unfinished compressed stream can't be read back, so the file is left empty, and keeps its blocks if they can't be freed either
+        file->inode->uncompressed_size = 0;
+        file->inode->data_size = 0;
+        fif_free_file_blocks(mount, file->inode_index, file->inode);
+    }
+    else
+    {
+        // whatever was flushed before the failure is all the file holds
+        file->inode->uncompressed_size = file->inode->data_size;
+    }
+    fif_write_inode(mount, file->inode_index, file->inode);
+
+    cleanup_open_file(mount, file);
+    return error;
+}
+
 int fif_file_close(fif_mount_handle mount, fif_file_handle file)
 {
     if (file->open_mode & FIF_OPEN_MODE_WRITE)
@@ -697,38 +1804,48 @@ int fif_file_close(fif_mount_handle mount, fif_file_handle file)
         if (file->buffer_range_size > 0 && file->buffer_dirty)
         {
             if (file->compressor != NULL)
-                result = file->compressor->compressor_write(mount, file->inode_index, &file->inode, file->compressor_data, file->buffer_range_start, file->buffer_data, file->buffer_range_size);
+                result = file->compressor->compressor_write(mount, file->inode_index, file->inode, file->compressor_data, file->buffer_range_start, file->buffer_data, file->buffer_range_size);
             else
-                result = fif_write_file_data(mount, file->inode_index, &file->inode, file->buffer_range_start, file->buffer_data, file->buffer_range_size);
+                result = fif_write_file_data(mount, file->inode_index, file->inode, file->buffer_range_start, file->buffer_data, file->buffer_range_size);
 
             // write the data
             if ((unsigned int)result != file->buffer_range_size)
-            {
-                cleanup_open_file(mount, file);
-                return (result >= 0) ? FIF_ERROR_IO_ERROR : result;
-            }
+                return fail_file_close(mount, file, (result >= 0) ? FIF_ERROR_IO_ERROR : result);
         }
 
         // for filtered files, end the filter
         if (file->compressor != NULL)
         {
-            if ((result = file->compressor->compressor_end(mount, file->inode_index, &file->inode, file->compressor_data)) != FIF_ERROR_SUCCESS)
-            {
-                cleanup_open_file(mount, file);
-                return result;
-            }
+            if ((result = file->compressor->compressor_end(mount, file->inode_index, file->inode, file->compressor_data)) != FIF_ERROR_SUCCESS)
+                return fail_file_close(mount, file, result);
         }
 
+        // give back whatever the size hint over-reserved
+        if (file->trim_reserved_blocks && (result = fif_resize_file(mount, file->inode_index, file->inode, file->inode->data_size)) != FIF_ERROR_SUCCESS)
+            return fail_file_close(mount, file, result);
+
         // update information in the inode
-        file->inode.uncompressed_size = file->file_size;
-        file->inode.modification_timestamp = fif_current_timestamp();
-        if ((result = fif_write_inode(mount, file->inode_index, &file->inode)) != FIF_ERROR_SUCCESS)
-            return result;
+        file->inode->uncompressed_size = file->file_size;
+        file->inode->modification_timestamp = fif_current_timestamp();
+        if ((result = fif_write_inode(mount, file->inode_index, file->inode)) != FIF_ERROR_SUCCESS)
+            return fail_file_close(mount, file, result);
     }
 
     // cleanup and done
-    cleanup_open_file(mount, file);
-    return FIF_ERROR_SUCCESS;
+    return cleanup_open_file(mount, file);
+}
+
+void fif_inode_to_fileinfo(const FIF_VOLUME_FORMAT_INODE *inode, fif_fileinfo *fileinfo)
+{
+    fileinfo->attributes = inode->attributes;
+    fileinfo->block_count = inode->block_count;
+    fileinfo->compression_algorithm = inode->compression_algorithm;
+    fileinfo->compression_level = inode->compression_level;
+    fileinfo->data_size = inode->data_size;
+    fileinfo->size = inode->uncompressed_size;
+    fileinfo->checksum = inode->checksum;
+    fileinfo->creation_timestamp = inode->creation_timestamp;
+    fileinfo->modify_timestamp = inode->modification_timestamp;
 }
 
 int fif_stat(fif_mount_handle mount, const char *path, fif_fileinfo *fileinfo)
@@ -748,15 +1865,7 @@ int fif_stat(fif_mount_handle mount, const char *path, fif_fileinfo *fileinfo)
         return result;
 
     // store info
-    fileinfo->attributes = inode.attributes;
-    fileinfo->block_count = inode.block_count;
-    fileinfo->compression_algorithm = inode.compression_algorithm;
-    fileinfo->compression_level = inode.compression_level;
-    fileinfo->data_size = inode.data_size;
-    fileinfo->size = inode.uncompressed_size;
-    fileinfo->checksum = inode.checksum;
-    fileinfo->creation_timestamp = inode.creation_timestamp;
-    fileinfo->modify_timestamp = inode.modification_timestamp;
+    fif_inode_to_fileinfo(&inode, fileinfo);
     return FIF_ERROR_SUCCESS;
 }
 
@@ -767,26 +1876,13 @@ int fif_fstat(fif_mount_handle mount, fif_file_handle file, fif_fileinfo *filein
         return result;
 
     // store info from open file
-    fileinfo->attributes = file->inode.attributes;
-    fileinfo->block_count = file->inode.block_count;
-    fileinfo->compression_algorithm = file->inode.compression_algorithm;
-    fileinfo->compression_level = file->inode.compression_level;
-    fileinfo->data_size = file->inode.data_size;
-    fileinfo->size = file->inode.uncompressed_size;
-    fileinfo->checksum = file->inode.checksum;
-    fileinfo->creation_timestamp = file->inode.creation_timestamp;
-    fileinfo->modify_timestamp = file->inode.modification_timestamp;
+    fif_inode_to_fileinfo(file->inode, fileinfo);
     return FIF_ERROR_SUCCESS;
 }
 
-int fif_open(fif_mount_handle mount, const char *path, unsigned int mode, fif_file_handle *file)
+static int open_file_by_path(fif_mount_handle mount, const char *path, unsigned int mode, fif_offset_t expected_size, fif_file_handle *file)
 {
     int result;
-    if (mount->trace_stream != NULL && (result = fif_trace_write_open(mount, path, mode)) != FIF_ERROR_SUCCESS)
-    {
-        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_trace_write_open failed: %i", result);
-        return result;
-    }
 
     // copy the path, canonicalize it
     int path_length = (int)strlen(path);
@@ -807,7 +1903,7 @@ int fif_open(fif_mount_handle mount, const char *path, unsigned int mode, fif_fi
 
     // does the file exist in the directory?
     fif_inode_index_t file_inode_index;
-    if ((result = fif_find_file_in_directory(mount, directory_inode, basename, &file_inode_index, NULL)) != FIF_ERROR_SUCCESS)
+    if ((result = fif_find_file_in_directory(mount, directory_inode, basename, &file_inode_index)) != FIF_ERROR_SUCCESS)
     {
         // if the error was NOT_FOUND, and we have a create open mode, create the file
         if (result != FIF_ERROR_FILE_NOT_FOUND || !(mode & FIF_OPEN_MODE_CREATE))
@@ -822,7 +1918,46 @@ int fif_open(fif_mount_handle mount, const char *path, unsigned int mode, fif_fi
     mode &= ~(FIF_OPEN_MODE_DIRECTORY);
 
     // forward through to open by inode
-    return fif_open_file_by_inode(mount, file_inode_index, mode, file);
+    if ((result = fif_open_file_by_inode(mount, file_inode_index, mode, file)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // reserve the expected size up front, so writing it out doesn't grow the file a piece at a time
+    if (expected_size > 0 && (mode & FIF_OPEN_MODE_WRITE) && (*file)->compressor == NULL)
+    {
+        if ((result = fif_file_allocate(mount, *file, expected_size)) != FIF_ERROR_SUCCESS)
+        {
+            cleanup_open_file(mount, *file);
+            return result;
+        }
+
+        (*file)->trim_reserved_blocks = true;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_open(fif_mount_handle mount, const char *path, unsigned int mode, fif_file_handle *file)
+{
+    int result;
+    if (mount->trace_stream != NULL && (result = fif_trace_write_open(mount, path, mode)) != FIF_ERROR_SUCCESS)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_trace_write_open failed: %i", result);
+        return result;
+    }
+
+    return open_file_by_path(mount, path, mode, 0, file);
+}
+
+int fif_open_ex(fif_mount_handle mount, const char *path, unsigned int mode, fif_offset_t expected_size, fif_file_handle *file)
+{
+    int result;
+    if (mount->trace_stream != NULL && (result = fif_trace_write_open_ex(mount, path, mode, expected_size)) != FIF_ERROR_SUCCESS)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_trace_write_open_ex failed: %i", result);
+        return result;
+    }
+
+    return open_file_by_path(mount, path, mode, expected_size, file);
 }
 
 int fif_read(fif_mount_handle mount, fif_file_handle file, void *out_buffer, unsigned int count)
@@ -849,6 +1984,16 @@ int fif_write(fif_mount_handle mount, fif_file_handle file, const void *in_buffe
     return fif_file_write(mount, file, in_buffer, count);
 }
 
+int fif_read_view(fif_mount_handle mount, fif_file_handle file, fif_offset_t offset, unsigned int max_count, const void **out_pointer, unsigned int *out_count)
+{
+    return fif_file_read_view(mount, file, offset, max_count, out_pointer, out_count);
+}
+
+int fif_release_view(fif_mount_handle mount, fif_file_handle file, const void *pointer)
+{
+    return fif_file_release_view(mount, file, pointer);
+}
+
 fif_offset_t fif_seek(fif_mount_handle mount, fif_file_handle file, fif_offset_t offset, enum FIF_SEEK_MODE mode)
 {
     int result;
@@ -885,6 +2030,18 @@ int fif_ftruncate(fif_mount_handle mount, fif_file_handle file, fif_offset_t siz
     return fif_file_truncate(mount, file, size);
 }
 
+int fif_fallocate(fif_mount_handle mount, fif_file_handle file, fif_offset_t size)
+{
+    int result;
+    if (mount->trace_stream != NULL && (result = fif_trace_write_fallocate(mount, file, size)) != FIF_ERROR_SUCCESS)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_trace_write_fallocate failed: %i", result);
+        return result;
+    }
+
+    return fif_file_allocate(mount, file, size);
+}
+
 int fif_close(fif_mount_handle mount, fif_file_handle handle)
 {
     int result;
@@ -924,7 +2081,7 @@ int fif_unlink(fif_mount_handle mount, const char *filename)
 
     // find the file in the directory
     fif_inode_index_t file_inode_index;
-    if ((result = fif_find_file_in_directory(mount, containing_inode, real_basename, &file_inode_index, NULL)) != FIF_ERROR_SUCCESS)
+    if ((result = fif_find_file_in_directory(mount, containing_inode, real_basename, &file_inode_index)) != FIF_ERROR_SUCCESS)
         return result;
 
     // verify we can write to this file
@@ -1045,7 +2202,7 @@ int fif_put_file_contents(fif_mount_handle mount, const char *filename, const vo
 
     // does the file exist in the directory?
     fif_inode_index_t file_inode_index;
-    if ((result = fif_find_file_in_directory(mount, directory_inode, basename, &file_inode_index, NULL)) != FIF_ERROR_SUCCESS)
+    if ((result = fif_find_file_in_directory(mount, directory_inode, basename, &file_inode_index)) != FIF_ERROR_SUCCESS)
     {
         // if the error was NOT_FOUND, and we have a create open mode, create the file
         if (result != FIF_ERROR_FILE_NOT_FOUND)
@@ -1070,8 +2227,8 @@ int fif_put_file_contents(fif_mount_handle mount, const char *filename, const vo
     if (inode.compression_algorithm != FIF_COMPRESSION_ALGORITHM_NONE && (compressor = fif_get_compressor_functions(inode.compression_algorithm)) == NULL)
         return FIF_ERROR_COMPRESSOR_NOT_FOUND;
 
-    // nuke any contents of the file
-    if (inode.data_size > 0)
+    // nuke any contents of the file, including anything reserved past the end
+    if (inode.data_size > 0 || inode.block_count > 0)
     {
         if ((result = fif_free_file_blocks(mount, file_inode_index, &inode)) != FIF_ERROR_SUCCESS)
             return result;
@@ -1,19 +1,40 @@
 #include "fif_internal.h"
 
-// todo: inode table caching
+static int reserve_inode_table_index(fif_mount_handle mount, unsigned int count)
+{
+    if (count <= mount->inode_table_blocks_reserve)
+        return FIF_ERROR_SUCCESS;
 
-static int get_inode_table_for_inode(fif_mount_handle mount, fif_block_index_t *table_block, fif_inode_index_t *table_offset, fif_inode_index_t inode_index)
+    unsigned int new_reserve = (mount->inode_table_blocks_reserve > 0) ? (mount->inode_table_blocks_reserve * 2) : 16;
+    if (new_reserve < count)
+        new_reserve = count;
+
+    fif_block_index_t *new_blocks = (fif_block_index_t *)realloc(mount->inode_table_blocks, sizeof(fif_block_index_t) * new_reserve);
+    if (new_blocks == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+
+    mount->inode_table_blocks = new_blocks;
+    mount->inode_table_blocks_reserve = new_reserve;
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_load_inode_table_index(fif_mount_handle mount, bool recover)
 {
     int result;
+    if ((result = reserve_inode_table_index(mount, mount->inode_table_count)) != FIF_ERROR_SUCCESS)
+        return result;
 
-    // find the inode table index
-    fif_inode_index_t inode_table_index = inode_index / mount->inodes_per_table;
-
-    // search through each table until we find our table
-    fif_inode_index_t current_table_index = 0;
+    // walk the chain of tables once, so lookups never have to. recovering, the header's count may be out of date, so follow the chain to its end instead
     fif_block_index_t current_table_block = mount->first_inode_table_block;
-    while (current_table_index != inode_table_index)
+    unsigned int table_count = 0;
+    while ((recover) ? (current_table_block != 0) : (table_count < mount->inode_table_count))
     {
+        if (current_table_block == 0 || current_table_block >= mount->block_count || table_count >= mount->block_count)
+        {
+            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_load_inode_table_index: inode table %u has bad block %u", table_count, current_table_block);
+            return FIF_ERROR_CORRUPT_VOLUME;
+        }
+
         // read this table's first inode
         FIF_VOLUME_FORMAT_INODE first_inode;
         if ((result = fif_volume_read_block(mount, current_table_block, 0, &first_inode, sizeof(first_inode))) != FIF_ERROR_SUCCESS)
@@ -22,25 +43,55 @@ static int get_inode_table_for_inode(fif_mount_handle mount, fif_block_index_t *
         // it should have the internal attribute set, otherwise the archive is corrupt
         if (first_inode.attributes != 0)
         {
-            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "get_inode_table_for_inode: descriptor inode in block %u is corrupt", current_table_block);
+            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_load_inode_table_index: descriptor inode in block %u is corrupt", current_table_block);
             return FIF_ERROR_CORRUPT_VOLUME;
         }
 
-        // is there a next table?
-        if (first_inode.next_entry == 0)
-        {
-            // not the best, should really be 'inode not found' but file not found will do
-            return FIF_ERROR_FILE_NOT_FOUND;
-        }
+        if ((result = reserve_inode_table_index(mount, table_count + 1)) != FIF_ERROR_SUCCESS)
+            return result;
 
-        // update with the next table
-        current_table_index++;
+        mount->inode_table_blocks[table_count++] = current_table_block;
         current_table_block = first_inode.next_entry;
     }
 
+    // take the chain's word for it when recovering
+    if (recover && (table_count != mount->inode_table_count || (table_count > 0 && mount->inode_table_blocks[table_count - 1] != mount->last_inode_table_block)))
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_WARNING, "fif_load_inode_table_index: superblock says %u inode tables, chain has %u", mount->inode_table_count, table_count);
+        mount->inode_table_count = table_count;
+        mount->last_inode_table_block = (table_count > 0) ? mount->inode_table_blocks[table_count - 1] : 0;
+    }
+
+    // the chain should end exactly where the header says it does
+    if (current_table_block != 0 || (mount->inode_table_count > 0 && mount->inode_table_blocks[mount->inode_table_count - 1] != mount->last_inode_table_block))
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_load_inode_table_index: inode table chain doesn't match the %u tables in the header", mount->inode_table_count);
+        return FIF_ERROR_CORRUPT_VOLUME;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+void fif_free_inode_table_index(fif_mount_handle mount)
+{
+    free(mount->inode_table_blocks);
+    mount->inode_table_blocks = NULL;
+    mount->inode_table_blocks_reserve = 0;
+}
+
+static int get_inode_table_for_inode(fif_mount_handle mount, fif_block_index_t *table_block, fif_inode_index_t *table_offset, fif_inode_index_t inode_index)
+{
+    // find the inode table index
+    fif_inode_index_t inode_table_index = inode_index / mount->inodes_per_table;
+    if (inode_table_index >= mount->inode_table_count)
+    {
+        // not the best, should really be 'inode not found' but file not found will do
+        return FIF_ERROR_FILE_NOT_FOUND;
+    }
+
     // calculate offset into table
-    fif_inode_index_t table_start_offset = current_table_index * mount->inodes_per_table;
-    fif_inode_index_t current_table_offset = inode_index - table_start_offset;
+    fif_block_index_t current_table_block = mount->inode_table_blocks[inode_table_index];
+    fif_inode_index_t current_table_offset = inode_index - (inode_table_index * mount->inodes_per_table);
 
     // sanity check
     if (current_table_block == 0 || current_table_block >= mount->block_count ||
@@ -63,6 +114,10 @@ int fif_alloc_inode_table(fif_mount_handle mount, fif_block_index_t *inode_table
     // calculate the new inode indices
     fif_inode_index_t first_new_inode_index = mount->inode_table_count * mount->inodes_per_table;
 
+    // make room in the index first, so running out of memory doesn't leave the volume half-updated
+    if ((result = reserve_inode_table_index(mount, mount->inode_table_count + 1)) != FIF_ERROR_SUCCESS)
+        return result;
+
     // allocating a new block
     fif_block_index_t allocated_block_index;
     if ((result = fif_volume_alloc_blocks(mount, 0, 1, &allocated_block_index)) != FIF_ERROR_SUCCESS)
@@ -126,6 +181,9 @@ int fif_alloc_inode_table(fif_mount_handle mount, fif_block_index_t *inode_table
         mount->last_free_inode = first_new_inode_index + (mount->inodes_per_table - 1);
     }
 
+    // everything but the descriptor is free
+    mount->free_inode_count += mount->inodes_per_table - 1;
+
     // update the last inode table's next inode table to be us
     if (mount->last_inode_table_block != 0)
     {
@@ -157,8 +215,9 @@ int fif_alloc_inode_table(fif_mount_handle mount, fif_block_index_t *inode_table
     }
 
     // update inode table count in header
+    mount->inode_table_blocks[mount->inode_table_count] = allocated_block_index;
     mount->inode_table_count++;
-    if ((result = fif_volume_write_descriptor(mount)) != FIF_ERROR_SUCCESS)
+    if ((result = fif_volume_update_descriptor(mount)) != FIF_ERROR_SUCCESS)
         return result;
 
     // all done
@@ -168,7 +227,7 @@ int fif_alloc_inode_table(fif_mount_handle mount, fif_block_index_t *inode_table
     return FIF_ERROR_SUCCESS;
 }
 
-int fif_read_inode(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_VOLUME_FORMAT_INODE *inode)
+static int read_inode_from_table(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_VOLUME_FORMAT_INODE *inode)
 {
     int result;
 
@@ -186,7 +245,7 @@ int fif_read_inode(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_VO
     return FIF_ERROR_SUCCESS;
 }
 
-int fif_write_inode(fif_mount_handle mount, fif_inode_index_t inode_index, const FIF_VOLUME_FORMAT_INODE *inode)
+static int write_inode_to_table(fif_mount_handle mount, fif_inode_index_t inode_index, const FIF_VOLUME_FORMAT_INODE *inode)
 {
     int result;
 
@@ -204,6 +263,367 @@ int fif_write_inode(fif_mount_handle mount, fif_inode_index_t inode_index, const
     return FIF_ERROR_SUCCESS;
 }
 
+/**
+  * inode cache
+  */
+
+#define INODE_CACHE_MIN_BUCKET_COUNT 64
+
+static void inode_cache_lru_remove(fif_mount_handle mount, struct fif_inode_cache_entry *entry)
+{
+    if (entry->lru_prev != NULL)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        mount->inode_cache_lru_head = entry->lru_next;
+
+    if (entry->lru_next != NULL)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        mount->inode_cache_lru_tail = entry->lru_prev;
+
+    entry->lru_prev = entry->lru_next = NULL;
+    mount->inode_cache_unreferenced_count--;
+}
+
+static void inode_cache_lru_push_head(fif_mount_handle mount, struct fif_inode_cache_entry *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = mount->inode_cache_lru_head;
+    if (mount->inode_cache_lru_head != NULL)
+        mount->inode_cache_lru_head->lru_prev = entry;
+    else
+        mount->inode_cache_lru_tail = entry;
+
+    mount->inode_cache_lru_head = entry;
+    mount->inode_cache_unreferenced_count++;
+}
+
+static struct fif_inode_cache_entry *inode_cache_lookup(fif_mount_handle mount, fif_inode_index_t inode_index)
+{
+    struct fif_inode_cache_entry *entry = mount->inode_cache_buckets[inode_index % mount->inode_cache_bucket_count];
+    while (entry != NULL)
+    {
+        if (entry->inode_index == inode_index)
+            return entry;
+
+        entry = entry->hash_next;
+    }
+
+    return NULL;
+}
+
+static void inode_cache_touch(fif_mount_handle mount, struct fif_inode_cache_entry *entry)
+{
+    // referenced entries aren't in the lru list, they can't be evicted anyway
+    if (entry->ref_count == 0 && entry != mount->inode_cache_lru_head)
+    {
+        inode_cache_lru_remove(mount, entry);
+        inode_cache_lru_push_head(mount, entry);
+    }
+}
+
+static int inode_cache_write_back(fif_mount_handle mount, struct fif_inode_cache_entry *entry)
+{
+    int result;
+    assert(entry->dirty);
+
+    if ((result = write_inode_to_table(mount, entry->inode_index, &entry->inode)) != FIF_ERROR_SUCCESS)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "inode_cache_write_back: failed to write back inode %u", entry->inode_index);
+        return result;
+    }
+
+    entry->dirty = false;
+    return FIF_ERROR_SUCCESS;
+}
+
+static int inode_cache_trim(fif_mount_handle mount)
+{
+    int result;
+
+    // evict unreferenced entries from the back of the lru list until we're within the limit
+    while (mount->inode_cache_unreferenced_count > mount->inode_cache_size)
+    {
+        struct fif_inode_cache_entry *entry = mount->inode_cache_lru_tail;
+        assert(entry != NULL && entry->ref_count == 0);
+        if (entry->dirty && (result = inode_cache_write_back(mount, entry)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        // unlink from the hash table
+        struct fif_inode_cache_entry **link = &mount->inode_cache_buckets[entry->inode_index % mount->inode_cache_bucket_count];
+        while (*link != entry)
+        {
+            assert(*link != NULL);
+            link = &(*link)->hash_next;
+        }
+        *link = entry->hash_next;
+
+        inode_cache_lru_remove(mount, entry);
+        mount->inode_cache_count--;
+        free(entry);
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static void inode_cache_grow_buckets(fif_mount_handle mount)
+{
+    // a failed allocation keeps the old table, the chains are just longer
+    unsigned int new_bucket_count = mount->inode_cache_bucket_count * 2;
+    struct fif_inode_cache_entry **new_buckets = (struct fif_inode_cache_entry **)calloc(new_bucket_count, sizeof(struct fif_inode_cache_entry *));
+    if (new_buckets == NULL)
+        return;
+
+    for (unsigned int i = 0; i < mount->inode_cache_bucket_count; i++)
+    {
+        struct fif_inode_cache_entry *entry = mount->inode_cache_buckets[i];
+        while (entry != NULL)
+        {
+            struct fif_inode_cache_entry *next_entry = entry->hash_next;
+            struct fif_inode_cache_entry **bucket = &new_buckets[entry->inode_index % new_bucket_count];
+            entry->hash_next = *bucket;
+            *bucket = entry;
+            entry = next_entry;
+        }
+    }
+
+    free(mount->inode_cache_buckets);
+    mount->inode_cache_buckets = new_buckets;
+    mount->inode_cache_bucket_count = new_bucket_count;
+}
+
+static int inode_cache_insert(fif_mount_handle mount, fif_inode_index_t inode_index, const FIF_VOLUME_FORMAT_INODE *inode, bool dirty, unsigned int ref_count, struct fif_inode_cache_entry **out_entry)
+{
+    struct fif_inode_cache_entry *entry = (struct fif_inode_cache_entry *)malloc(sizeof(struct fif_inode_cache_entry));
+    if (entry == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+
+    // fill the entry, and add it to the hash table
+    struct fif_inode_cache_entry **bucket = &mount->inode_cache_buckets[inode_index % mount->inode_cache_bucket_count];
+    entry->inode_index = inode_index;
+    memcpy(&entry->inode, inode, sizeof(entry->inode));
+    entry->dirty = dirty;
+    entry->ref_count = ref_count;
+    entry->reader_count = 0;
+    entry->writer_count = 0;
+    entry->hash_next = *bucket;
+    entry->lru_prev = entry->lru_next = NULL;
+    *bucket = entry;
+    if (out_entry != NULL)
+        *out_entry = entry;
+
+    // referenced entries aren't limited by the cache size, so the table grows with however many files are open
+    if (++mount->inode_cache_count > mount->inode_cache_bucket_count)
+        inode_cache_grow_buckets(mount);
+
+    // unreferenced entries count against the cache size
+    if (ref_count > 0)
+        return FIF_ERROR_SUCCESS;
+
+    inode_cache_lru_push_head(mount, entry);
+    return inode_cache_trim(mount);
+}
+
+int fif_init_inode_cache(fif_mount_handle mount)
+{
+    mount->inode_cache_lru_head = NULL;
+    mount->inode_cache_lru_tail = NULL;
+    mount->inode_cache_unreferenced_count = 0;
+    mount->inode_cache_count = 0;
+
+    // the table always exists, since open files share their inode through it even when caching is disabled
+    mount->inode_cache_bucket_count = (mount->inode_cache_size > INODE_CACHE_MIN_BUCKET_COUNT) ? mount->inode_cache_size : INODE_CACHE_MIN_BUCKET_COUNT;
+    mount->inode_cache_buckets = (struct fif_inode_cache_entry **)calloc(mount->inode_cache_bucket_count, sizeof(struct fif_inode_cache_entry *));
+    if (mount->inode_cache_buckets == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_flush_inode_cache(fif_mount_handle mount)
+{
+    int result;
+    if (mount->inode_cache_buckets == NULL)
+        return FIF_ERROR_SUCCESS;
+
+    for (unsigned int i = 0; i < mount->inode_cache_bucket_count; i++)
+    {
+        for (struct fif_inode_cache_entry *entry = mount->inode_cache_buckets[i]; entry != NULL; entry = entry->hash_next)
+        {
+            if (entry->dirty && (result = inode_cache_write_back(mount, entry)) != FIF_ERROR_SUCCESS)
+                return result;
+        }
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+void fif_free_inode_cache(fif_mount_handle mount)
+{
+    if (mount->inode_cache_buckets == NULL)
+        return;
+
+    for (unsigned int i = 0; i < mount->inode_cache_bucket_count; i++)
+    {
+        struct fif_inode_cache_entry *entry = mount->inode_cache_buckets[i];
+        while (entry != NULL)
+        {
+            struct fif_inode_cache_entry *next_entry = entry->hash_next;
+            free(entry);
+            entry = next_entry;
+        }
+    }
+
+    free(mount->inode_cache_buckets);
+    mount->inode_cache_buckets = NULL;
+    mount->inode_cache_lru_head = NULL;
+    mount->inode_cache_lru_tail = NULL;
+    mount->inode_cache_unreferenced_count = 0;
+    mount->inode_cache_count = 0;
+}
+
+int fif_acquire_inode(fif_mount_handle mount, fif_inode_index_t inode_index, struct fif_inode_cache_entry **out_entry)
+{
+    int result;
+
+    // already cached? take it out of the lru list if nobody else holds it
+    struct fif_inode_cache_entry *entry = inode_cache_lookup(mount, inode_index);
+    if (entry != NULL)
+    {
+        if (entry->ref_count == 0)
+            inode_cache_lru_remove(mount, entry);
+
+        entry->ref_count++;
+        *out_entry = entry;
+        return FIF_ERROR_SUCCESS;
+    }
+
+    // read it in, and create a referenced entry
+    FIF_VOLUME_FORMAT_INODE inode;
+    if ((result = read_inode_from_table(mount, inode_index, &inode)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    return inode_cache_insert(mount, inode_index, &inode, false, 1, out_entry);
+}
+
+struct fif_inode_cache_entry *fif_find_open_inode(fif_mount_handle mount, fif_inode_index_t inode_index)
+{
+    // only open handles hold references, an unreferenced entry is just cached
+    struct fif_inode_cache_entry *entry = inode_cache_lookup(mount, inode_index);
+    return (entry != NULL && entry->ref_count > 0) ? entry : NULL;
+}
+
+int fif_release_inode(fif_mount_handle mount, struct fif_inode_cache_entry *entry)
+{
+    assert(entry->ref_count > 0);
+    if (--entry->ref_count > 0)
+        return FIF_ERROR_SUCCESS;
+
+    // last reference gone, it's now an ordinary cached inode (which may push something out, or itself when the cache is disabled)
+    inode_cache_lru_push_head(mount, entry);
+    return inode_cache_trim(mount);
+}
+
+int fif_read_inode(fif_mount_handle mount, fif_inode_index_t inode_index, FIF_VOLUME_FORMAT_INODE *inode)
+{
+    int result;
+
+    // cached copy is always the most recent
+    struct fif_inode_cache_entry *entry = inode_cache_lookup(mount, inode_index);
+    if (entry != NULL)
+    {
+        inode_cache_touch(mount, entry);
+        memcpy(inode, &entry->inode, sizeof(FIF_VOLUME_FORMAT_INODE));
+        return FIF_ERROR_SUCCESS;
+    }
+
+    // read from the table, keeping a copy if the cache is enabled
+    if ((result = read_inode_from_table(mount, inode_index, inode)) != FIF_ERROR_SUCCESS)
+        return result;
+    if (mount->inode_cache_size > 0 && (result = inode_cache_insert(mount, inode_index, inode, false, 0, NULL)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // done
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_read_inodes(fif_mount_handle mount, const fif_inode_index_t *inode_indices, unsigned int count, FIF_VOLUME_FORMAT_INODE *inodes)
+{
+    int result;
+
+    // whole tables are read at once, so neighbouring inodes (sorted by the caller) share a read
+    FIF_VOLUME_FORMAT_INODE *table = NULL;
+    fif_block_index_t table_block_in_buffer = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        // cached copies are always the most recent
+        struct fif_inode_cache_entry *entry = inode_cache_lookup(mount, inode_indices[i]);
+        if (entry != NULL)
+        {
+            memcpy(&inodes[i], &entry->inode, sizeof(FIF_VOLUME_FORMAT_INODE));
+            continue;
+        }
+
+        fif_block_index_t table_block;
+        fif_inode_index_t table_offset;
+        if ((result = get_inode_table_for_inode(mount, &table_block, &table_offset, inode_indices[i])) != FIF_ERROR_SUCCESS)
+        {
+            free(table);
+            return result;
+        }
+
+        if (table == NULL && (table = (FIF_VOLUME_FORMAT_INODE *)malloc(mount->block_size)) == NULL)
+            return FIF_ERROR_OUT_OF_MEMORY;
+
+        if (table_block != table_block_in_buffer)
+        {
+            if ((result = fif_volume_read_block(mount, table_block, 0, table, mount->block_size)) != FIF_ERROR_SUCCESS)
+            {
+                free(table);
+                return result;
+            }
+
+            table_block_in_buffer = table_block;
+        }
+
+        // not added to the cache, a listing would just push out the inodes that are actually in use
+        memcpy(&inodes[i], &table[table_offset], sizeof(FIF_VOLUME_FORMAT_INODE));
+    }
+
+    free(table);
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_write_inode(fif_mount_handle mount, fif_inode_index_t inode_index, const FIF_VOLUME_FORMAT_INODE *inode)
+{
+    int result;
+
+    // update the cached copy, open handles pass the cached copy itself in
+    struct fif_inode_cache_entry *entry = inode_cache_lookup(mount, inode_index);
+    if (entry != NULL)
+    {
+        if (&entry->inode != inode)
+            memcpy(&entry->inode, inode, sizeof(FIF_VOLUME_FORMAT_INODE));
+
+        entry->dirty = true;
+        inode_cache_touch(mount, entry);
+        return FIF_ERROR_SUCCESS;
+    }
+
+    // without the cache, write straight through
+    if (mount->inode_cache_size == 0)
+        return write_inode_to_table(mount, inode_index, inode);
+
+    // check the inode exists now, rather than failing at write-back time
+    fif_block_index_t table_block;
+    fif_inode_index_t table_offset;
+    if ((result = get_inode_table_for_inode(mount, &table_block, &table_offset, inode_index)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // done
+    return inode_cache_insert(mount, inode_index, inode, true, 0, NULL);
+}
+
 int fif_alloc_inode(fif_mount_handle mount, fif_inode_index_t inode_hint, fif_inode_index_t *inode_index)
 {
     int result;
@@ -272,19 +692,22 @@ int fif_alloc_inode(fif_mount_handle mount, fif_inode_index_t inode_hint, fif_in
             {
                 // this is the first free inode
                 mount->first_free_inode = found_inode_next;
-                if ((result = fif_volume_write_descriptor(mount)) != FIF_ERROR_SUCCESS)
+                if ((result = fif_volume_update_descriptor(mount)) != FIF_ERROR_SUCCESS)
                     return result;
             }
 
-            // is this the last free inode?
+            // is this the last free inode? the one before it (if any) is the new last
             if (found_inode_next == 0)
             {
                 assert(mount->last_free_inode == found_inode_index);
-                mount->last_free_inode = 0;
-                if ((result = fif_volume_write_descriptor(mount)) != FIF_ERROR_SUCCESS)
-                    return result;
+                mount->last_free_inode = found_inode_prev;
             }
 
+            // one less free inode
+            mount->free_inode_count--;
+            if ((result = fif_volume_update_descriptor(mount)) != FIF_ERROR_SUCCESS)
+                return result;
+
             // return this index
             *inode_index = found_inode_index;
             return FIF_ERROR_SUCCESS;
@@ -301,7 +724,8 @@ int fif_alloc_inode(fif_mount_handle mount, fif_inode_index_t inode_hint, fif_in
 
     // set the next free inode to be the index + 1
     mount->first_free_inode = new_inode_index + 1;
-    if ((result = fif_volume_write_descriptor(mount)) != FIF_ERROR_SUCCESS)
+    mount->free_inode_count--;
+    if ((result = fif_volume_update_descriptor(mount)) != FIF_ERROR_SUCCESS)
         return result;
 
     // and the index
@@ -315,8 +739,8 @@ int fif_free_inode(fif_mount_handle mount, fif_inode_index_t inode_index)
 
     // build new inode contents
     FIF_VOLUME_FORMAT_INODE free_inode;
-    free_inode.attributes = FIF_FILE_ATTRIBUTE_FREE_INODE;
     memset(&free_inode, 0, sizeof(free_inode));
+    free_inode.attributes = FIF_FILE_ATTRIBUTE_FREE_INODE;
 
     // are we the new head inode? if so, we can skip all this
     if (mount->first_free_inode == 0 || inode_index < mount->first_free_inode)
@@ -406,13 +830,93 @@ int fif_free_inode(fif_mount_handle mount, fif_inode_index_t inode_index)
     }
 
     // increment free inode count
-    mount->last_free_inode++;
+    mount->free_inode_count++;
 
     // commit the header
-    if ((result = fif_volume_write_descriptor(mount)) != FIF_ERROR_SUCCESS)
+    if ((result = fif_volume_update_descriptor(mount)) != FIF_ERROR_SUCCESS)
         return result;
 
     // done
     return FIF_ERROR_SUCCESS;
 }
 
+
+int fif_rebuild_free_inode_chain(fif_mount_handle mount, unsigned char *block_usage)
+{
+    int result;
+    FIF_VOLUME_FORMAT_INODE *inodes = (FIF_VOLUME_FORMAT_INODE *)malloc(sizeof(FIF_VOLUME_FORMAT_INODE) * mount->inodes_per_table);
+    if (inodes == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+
+    // the superblock's ends of the chain can't be trusted, but the inodes themselves say whether they're free.
+    // the chain is kept in index order, so link up every free inode in table order, rewriting only the links that differ.
+    // the inodes in use are all seen on the way, so this is also where their blocks are marked.
+    fif_inode_index_t first_free_inode = 0;
+    fif_inode_index_t last_free_inode = 0;
+    FIF_VOLUME_FORMAT_INODE last_inode;
+    unsigned int free_inode_count = 0;
+    memset(&last_inode, 0, sizeof(last_inode));
+    for (unsigned int table_index = 0; table_index < mount->inode_table_count; table_index++)
+    {
+        block_usage[mount->inode_table_blocks[table_index]] |= FIF_BLOCK_USAGE_USED;
+        if ((result = fif_volume_read_block(mount, mount->inode_table_blocks[table_index], 0, inodes, sizeof(FIF_VOLUME_FORMAT_INODE) * mount->inodes_per_table)) != FIF_ERROR_SUCCESS)
+        {
+            free(inodes);
+            return result;
+        }
+
+        for (unsigned int i = 1; i < mount->inodes_per_table; i++)
+        {
+            fif_inode_index_t inode_index = table_index * mount->inodes_per_table + i;
+            if (!(inodes[i].attributes & FIF_FILE_ATTRIBUTE_FREE_INODE))
+            {
+                if ((result = fif_mark_file_blocks(mount, inode_index, &inodes[i], block_usage)) != FIF_ERROR_SUCCESS)
+                {
+                    free(inodes);
+                    return result;
+                }
+
+                continue;
+            }
+
+            if (last_free_inode == 0)
+            {
+                first_free_inode = inode_index;
+            }
+            else if (last_inode.next_entry != inode_index && !mount->read_only)
+            {
+                last_inode.next_entry = inode_index;
+                if ((result = fif_write_inode(mount, last_free_inode, &last_inode)) != FIF_ERROR_SUCCESS)
+                {
+                    free(inodes);
+                    return result;
+                }
+            }
+
+            last_free_inode = inode_index;
+            last_inode = inodes[i];
+            free_inode_count++;
+        }
+    }
+
+    free(inodes);
+
+    // the last one ends the chain
+    if (last_free_inode != 0 && last_inode.next_entry != 0 && !mount->read_only)
+    {
+        last_inode.next_entry = 0;
+        if ((result = fif_write_inode(mount, last_free_inode, &last_inode)) != FIF_ERROR_SUCCESS)
+            return result;
+    }
+
+    if (first_free_inode != mount->first_free_inode || last_free_inode != mount->last_free_inode || free_inode_count != mount->free_inode_count)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_WARNING, "fif_rebuild_free_inode_chain: superblock says %u free inodes from %u to %u, tables have %u from %u to %u",
+                    mount->free_inode_count, mount->first_free_inode, mount->last_free_inode, free_inode_count, first_free_inode, last_free_inode);
+    }
+
+    mount->first_free_inode = first_free_inode;
+    mount->last_free_inode = last_free_inode;
+    mount->free_inode_count = free_inode_count;
+    return FIF_ERROR_SUCCESS;
+}
@@ -1,5 +1,12 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE 1       // copy_file_range, fallocate
+#endif
+
 #include "libfif/fif_io.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -11,6 +18,15 @@
     #include <share.h>
 #else
     #include <unistd.h>
+    #include <errno.h>
+    #include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+    #include <sys/syscall.h>
+    #ifdef __NR_io_uring_setup
+        #include <linux/io_uring.h>
+    #endif
 #endif
 
 static int io_local_read(fif_io_userdata userdata, void *buffer, unsigned int count)
@@ -36,6 +52,69 @@ static int io_local_write(fif_io_userdata userdata, const void *buffer, unsigned
     return bytes;
 }
 
+static int io_local_pread(fif_io_userdata userdata, void *buffer, unsigned int count, fif_offset_t offset)
+{
+    int fd = (int)userdata;
+#ifdef _MSC_VER
+    // ReadFile with an offset in the OVERLAPPED structure is the closest thing to pread
+    HANDLE hFile = (HANDLE)_get_osfhandle(fd);
+    OVERLAPPED overlapped;
+    DWORD bytes;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset = (DWORD)((uint64_t)offset & 0xFFFFFFFFU);
+    overlapped.OffsetHigh = (DWORD)((uint64_t)offset >> 32);
+    if (!ReadFile(hFile, buffer, count, &bytes, &overlapped))
+        return -1;
+
+    return (int)bytes;
+#else
+    int bytes = (int)pread(fd, buffer, count, offset);
+    return bytes;
+#endif
+}
+
+static int io_local_pwrite(fif_io_userdata userdata, const void *buffer, unsigned int count, fif_offset_t offset)
+{
+    int fd = (int)userdata;
+#ifdef _MSC_VER
+    HANDLE hFile = (HANDLE)_get_osfhandle(fd);
+    OVERLAPPED overlapped;
+    DWORD bytes;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset = (DWORD)((uint64_t)offset & 0xFFFFFFFFU);
+    overlapped.OffsetHigh = (DWORD)((uint64_t)offset >> 32);
+    if (!WriteFile(hFile, buffer, count, &bytes, &overlapped))
+        return -1;
+
+    return (int)bytes;
+#else
+    int bytes = (int)pwrite(fd, buffer, count, offset);
+    return bytes;
+#endif
+}
+
+#ifdef __linux__
+static int io_local_copy_range(fif_io_userdata userdata, fif_offset_t src_offset, fif_offset_t dst_offset, unsigned int count)
+{
+    // copy_file_range lets the kernel (or filesystem, with reflinks) do the copy without a round trip through userspace
+    int fd = (int)userdata;
+    loff_t src_pos = (loff_t)src_offset;
+    loff_t dst_pos = (loff_t)dst_offset;
+    unsigned int remaining = count;
+    while (remaining > 0)
+    {
+        ssize_t copied = copy_file_range(fd, &src_pos, fd, &dst_pos, remaining, 0);
+        if (copied <= 0)
+            break;
+
+        remaining -= (unsigned int)copied;
+    }
+
+    // a short count (e.g. ENOSYS/EXDEV on older kernels) makes the caller finish the copy
+    return (int)(count - remaining);
+}
+#endif
+
 static int64_t io_local_seek(fif_io_userdata userdata, fif_offset_t offset, enum FIF_SEEK_MODE mode)
 {
     int fd = (int)userdata;
@@ -56,7 +135,7 @@ static int64_t io_local_seek(fif_io_userdata userdata, fif_offset_t offset, enum
 
 static int io_local_zero(fif_io_userdata userdata, fif_offset_t offset, unsigned int count)
 {
-    static char zero_bytes[128] = { 0 };
+    static char zero_bytes[65536] = { 0 };
     uint64_t current_offset = io_local_seek(userdata, 0, FIF_SEEK_MODE_CUR);
 
     if (io_local_seek(userdata, offset, FIF_SEEK_MODE_SET) != offset)
@@ -79,6 +158,18 @@ static int io_local_zero(fif_io_userdata userdata, fif_offset_t offset, unsigned
     return (int)(count - remaining);
 }
 
+#ifdef __linux__
+static int io_local_discard(fif_io_userdata userdata, fif_offset_t offset, unsigned int count)
+{
+    // punching a hole frees the storage and the range reads back as zeros, without writing anything
+    int fd = (int)userdata;
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)count) < 0)
+        return -1;
+
+    return (int)count;
+}
+#endif
+
 static int io_local_ftruncate(fif_io_userdata userdata, fif_offset_t newsize)
 {
 #ifdef _MSC_VER
@@ -124,10 +215,10 @@ static int64_t io_local_filesize(fif_io_userdata userdata)
 #endif
 }
 
-int fif_io_open_local_file(const char *path, unsigned int mode, fif_io *out_io)
+static int open_local_fd(const char *path, unsigned int mode, int extra_os_mode, int *out_fd)
 {
     // convert mode
-    int os_mode = 0;
+    int os_mode = extra_os_mode;
     if (mode & FIF_OPEN_MODE_CREATE)
         os_mode |= O_CREAT;
 
@@ -147,24 +238,40 @@ int fif_io_open_local_file(const char *path, unsigned int mode, fif_io *out_io)
     if (err != 0)
         return -1;
 #else
-    int fd = open(path, os_mode);
+    int fd = open(path, os_mode, 0644);
     if (fd < 0)
         return -1;
 #endif
 
+    *out_fd = fd;
+    return 0;
+}
+
+int fif_io_open_local_file(const char *path, unsigned int mode, fif_io *out_io)
+{
+    int fd;
+    if (open_local_fd(path, mode, 0, &fd) != 0)
+        return -1;
+
+    fif_io_init(out_io);
     out_io->io_read = io_local_read;
     out_io->io_write = io_local_write;
     out_io->io_seek = io_local_seek;
     out_io->io_zero = io_local_zero;
     out_io->io_ftruncate = io_local_ftruncate;
     out_io->io_filesize = io_local_filesize;
+    out_io->io_pread = io_local_pread;
+    out_io->io_pwrite = io_local_pwrite;
+#ifdef __linux__
+    out_io->io_copy_range = io_local_copy_range;
+    out_io->io_discard = io_local_discard;
+#endif
     out_io->userdata = (fif_io_userdata)fd;
     return 0;
 }
 
-int fif_io_close_local_file(const fif_io *io)
+static int io_local_close_fd(int fd)
 {
-    int fd = (int)io->userdata;
 #ifdef _MSC_VER
     if (_close(fd) < 0)
         return -1;
@@ -175,3 +282,799 @@ int fif_io_close_local_file(const fif_io *io)
 
     return 0;
 }
+
+int fif_io_close_local_file(const fif_io *io)
+{
+    return io_local_close_fd((int)io->userdata);
+}
+
+/**
+ * memory-mapped local files
+ */
+
+struct io_mapped_state
+{
+    int fd;
+    bool writable;
+    unsigned char *mapping;
+    size_t mapping_size;
+    size_t position;
+#ifdef _MSC_VER
+    HANDLE mapping_handle;
+#endif
+};
+
+static void io_mapped_unmap(struct io_mapped_state *state)
+{
+    if (state->mapping != NULL)
+    {
+#ifdef _MSC_VER
+        UnmapViewOfFile(state->mapping);
+        CloseHandle(state->mapping_handle);
+        state->mapping_handle = NULL;
+#else
+        munmap(state->mapping, state->mapping_size);
+#endif
+    }
+
+    state->mapping = NULL;
+    state->mapping_size = 0;
+}
+
+static int io_mapped_map(struct io_mapped_state *state, size_t size)
+{
+    assert(state->mapping == NULL);
+
+    // zero-length files can't be mapped, accesses just fail until the file is grown
+    if (size == 0)
+        return 0;
+
+#ifdef _MSC_VER
+    HANDLE hFile = (HANDLE)_get_osfhandle(state->fd);
+    state->mapping_handle = CreateFileMappingA(hFile, NULL, state->writable ? PAGE_READWRITE : PAGE_READONLY, (DWORD)((uint64_t)size >> 32), (DWORD)((uint64_t)size & 0xFFFFFFFFU), NULL);
+    if (state->mapping_handle == NULL)
+        return -1;
+
+    state->mapping = (unsigned char *)MapViewOfFile(state->mapping_handle, state->writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+    if (state->mapping == NULL)
+    {
+        CloseHandle(state->mapping_handle);
+        state->mapping_handle = NULL;
+        return -1;
+    }
+#else
+    void *mapping = mmap(NULL, size, state->writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, state->fd, 0);
+    if (mapping == MAP_FAILED)
+        return -1;
+
+    state->mapping = (unsigned char *)mapping;
+#endif
+
+    state->mapping_size = size;
+    return 0;
+}
+
+static int io_mapped_ftruncate(fif_io_userdata userdata, fif_offset_t newsize)
+{
+    struct io_mapped_state *state = (struct io_mapped_state *)userdata;
+    if (!state->writable)
+        return -1;
+
+    // the mapping has to go before the file can change size (windows won't shrink a mapped file)
+    io_mapped_unmap(state);
+    if (io_local_ftruncate((fif_io_userdata)state->fd, newsize) != 0)
+    {
+        io_mapped_map(state, (size_t)io_local_filesize((fif_io_userdata)state->fd));
+        return -1;
+    }
+
+    return io_mapped_map(state, (size_t)newsize);
+}
+
+static int io_mapped_pread(fif_io_userdata userdata, void *buffer, unsigned int count, fif_offset_t offset)
+{
+    struct io_mapped_state *state = (struct io_mapped_state *)userdata;
+    if (offset < 0 || (size_t)offset >= state->mapping_size)
+        return 0;
+
+    size_t remaining = state->mapping_size - (size_t)offset;
+    size_t copylen = (remaining < (size_t)count) ? remaining : (size_t)count;
+    memcpy(buffer, state->mapping + (size_t)offset, copylen);
+    return (int)copylen;
+}
+
+static int io_mapped_pwrite(fif_io_userdata userdata, const void *buffer, unsigned int count, fif_offset_t offset)
+{
+    struct io_mapped_state *state = (struct io_mapped_state *)userdata;
+    if (!state->writable || offset < 0)
+        return -1;
+
+    // writes past the end grow the file
+    size_t end_position = (size_t)offset + (size_t)count;
+    if (end_position > state->mapping_size && io_mapped_ftruncate(userdata, (fif_offset_t)end_position) != 0)
+        return -1;
+
+    memcpy(state->mapping + (size_t)offset, buffer, count);
+    return (int)count;
+}
+
+static int io_mapped_read(fif_io_userdata userdata, void *buffer, unsigned int count)
+{
+    struct io_mapped_state *state = (struct io_mapped_state *)userdata;
+    int bytes = io_mapped_pread(userdata, buffer, count, (fif_offset_t)state->position);
+    if (bytes > 0)
+        state->position += (size_t)bytes;
+
+    return bytes;
+}
+
+static int io_mapped_write(fif_io_userdata userdata, const void *buffer, unsigned int count)
+{
+    struct io_mapped_state *state = (struct io_mapped_state *)userdata;
+    int bytes = io_mapped_pwrite(userdata, buffer, count, (fif_offset_t)state->position);
+    if (bytes > 0)
+        state->position += (size_t)bytes;
+
+    return bytes;
+}
+
+static int64_t io_mapped_seek(fif_io_userdata userdata, fif_offset_t offset, enum FIF_SEEK_MODE mode)
+{
+    struct io_mapped_state *state = (struct io_mapped_state *)userdata;
+
+    fif_offset_t new_offset;
+    if (mode == FIF_SEEK_MODE_SET)
+        new_offset = offset;
+    else if (mode == FIF_SEEK_MODE_CUR)
+        new_offset = (fif_offset_t)state->position + offset;
+    else if (mode == FIF_SEEK_MODE_END)
+        new_offset = (fif_offset_t)state->mapping_size + offset;
+    else
+        return -1;
+
+    if (new_offset < 0)
+        return -1;
+
+    state->position = (size_t)new_offset;
+    return new_offset;
+}
+
+static int io_mapped_zero(fif_io_userdata userdata, fif_offset_t offset, unsigned int count)
+{
+    struct io_mapped_state *state = (struct io_mapped_state *)userdata;
+    if (!state->writable || offset < 0)
+        return -1;
+
+    size_t end_position = (size_t)offset + (size_t)count;
+    if (end_position > state->mapping_size && io_mapped_ftruncate(userdata, (fif_offset_t)end_position) != 0)
+        return -1;
+
+    memset(state->mapping + (size_t)offset, 0, count);
+    return (int)count;
+}
+
+static int io_mapped_discard(fif_io_userdata userdata, fif_offset_t offset, unsigned int count)
+{
+    struct io_mapped_state *state = (struct io_mapped_state *)userdata;
+    if (!state->writable || offset < 0 || ((size_t)offset + (size_t)count) > state->mapping_size)
+        return -1;
+
+#ifdef __linux__
+    // the mapping is shared, so a hole punched in the file shows up as zeros in it too
+    if (fallocate(state->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)count) == 0)
+        return (int)count;
+#endif
+
+    memset(state->mapping + (size_t)offset, 0, count);
+    return (int)count;
+}
+
+static int64_t io_mapped_filesize(fif_io_userdata userdata)
+{
+    struct io_mapped_state *state = (struct io_mapped_state *)userdata;
+    return (int64_t)state->mapping_size;
+}
+
+static void *io_mapped_get_pointer(fif_io_userdata userdata, fif_offset_t offset, unsigned int count)
+{
+    struct io_mapped_state *state = (struct io_mapped_state *)userdata;
+    if (offset < 0 || ((size_t)offset + (size_t)count) > state->mapping_size)
+        return NULL;
+
+    return state->mapping + (size_t)offset;
+}
+
+static int io_mapped_copy_range(fif_io_userdata userdata, fif_offset_t src_offset, fif_offset_t dst_offset, unsigned int count)
+{
+    struct io_mapped_state *state = (struct io_mapped_state *)userdata;
+    if (!state->writable || src_offset < 0 || dst_offset < 0 || ((size_t)src_offset + (size_t)count) > state->mapping_size)
+        return -1;
+
+    // copies past the end grow the file
+    size_t end_position = (size_t)dst_offset + (size_t)count;
+    if (end_position > state->mapping_size && io_mapped_ftruncate(userdata, (fif_offset_t)end_position) != 0)
+        return -1;
+
+    memmove(state->mapping + (size_t)dst_offset, state->mapping + (size_t)src_offset, count);
+    return (int)count;
+}
+
+int fif_io_open_mapped_file(const char *path, unsigned int mode, fif_io *out_io)
+{
+    int fd;
+    if (open_local_fd(path, mode, 0, &fd) != 0)
+        return -1;
+
+    struct io_mapped_state *state = (struct io_mapped_state *)malloc(sizeof(struct io_mapped_state));
+    if (state == NULL)
+    {
+        io_local_close_fd(fd);
+        return -1;
+    }
+
+    state->fd = fd;
+    state->writable = (mode & FIF_OPEN_MODE_WRITE) != 0;
+    state->mapping = NULL;
+    state->mapping_size = 0;
+    state->position = 0;
+#ifdef _MSC_VER
+    state->mapping_handle = NULL;
+#endif
+
+    // map whatever is there already
+    if (io_mapped_map(state, (size_t)io_local_filesize((fif_io_userdata)fd)) != 0)
+    {
+        io_local_close_fd(fd);
+        free(state);
+        return -1;
+    }
+
+    fif_io_init(out_io);
+    out_io->io_read = io_mapped_read;
+    out_io->io_write = io_mapped_write;
+    out_io->io_seek = io_mapped_seek;
+    out_io->io_zero = io_mapped_zero;
+    out_io->io_ftruncate = io_mapped_ftruncate;
+    out_io->io_filesize = io_mapped_filesize;
+    out_io->io_pread = io_mapped_pread;
+    out_io->io_pwrite = io_mapped_pwrite;
+    out_io->io_get_pointer = io_mapped_get_pointer;
+    out_io->io_copy_range = io_mapped_copy_range;
+    out_io->io_discard = io_mapped_discard;
+    out_io->userdata = (fif_io_userdata)state;
+    return 0;
+}
+
+int fif_io_close_mapped_file(const fif_io *io)
+{
+    struct io_mapped_state *state = (struct io_mapped_state *)io->userdata;
+    io_mapped_unmap(state);
+
+    int result = io_local_close_fd(state->fd);
+    free(state);
+    return result;
+}
+
+/**
+ * io_uring local files (linux only)
+ */
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+
+// requests in flight at once, larger batches are split
+#define IO_URING_QUEUE_DEPTH 64
+
+struct io_uring_state
+{
+    int fd;
+    int ring_fd;
+
+    // submission ring
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int sq_entries;
+
+    // completion ring, can share the submission ring's mapping
+    void *cq_ring;
+    size_t cq_ring_size;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static void io_uring_unmap(struct io_uring_state *state)
+{
+    if (state->sqes != NULL && state->sqes != MAP_FAILED)
+        munmap(state->sqes, state->sqes_size);
+    if (state->cq_ring != NULL && state->cq_ring != MAP_FAILED && state->cq_ring != state->sq_ring)
+        munmap(state->cq_ring, state->cq_ring_size);
+    if (state->sq_ring != NULL && state->sq_ring != MAP_FAILED)
+        munmap(state->sq_ring, state->sq_ring_size);
+    if (state->ring_fd >= 0)
+        close(state->ring_fd);
+
+    state->sqes = NULL;
+    state->cq_ring = NULL;
+    state->sq_ring = NULL;
+    state->ring_fd = -1;
+}
+
+static int io_uring_map(struct io_uring_state *state)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    state->ring_fd = (int)syscall(__NR_io_uring_setup, IO_URING_QUEUE_DEPTH, &params);
+    if (state->ring_fd < 0)
+        return -1;
+
+    state->sq_entries = params.sq_entries;
+    state->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    state->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    // newer kernels map both rings with a single mmap
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && state->cq_ring_size > state->sq_ring_size)
+        state->sq_ring_size = state->cq_ring_size;
+
+    state->sq_ring = mmap(NULL, state->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, state->ring_fd, IORING_OFF_SQ_RING);
+    if (state->sq_ring == MAP_FAILED)
+        return -1;
+
+    if (single_mmap)
+    {
+        state->cq_ring = state->sq_ring;
+    }
+    else
+    {
+        state->cq_ring = mmap(NULL, state->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, state->ring_fd, IORING_OFF_CQ_RING);
+        if (state->cq_ring == MAP_FAILED)
+            return -1;
+    }
+
+    state->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    state->sqes = (struct io_uring_sqe *)mmap(NULL, state->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, state->ring_fd, IORING_OFF_SQES);
+    if (state->sqes == MAP_FAILED)
+        return -1;
+
+    unsigned char *sq_base = (unsigned char *)state->sq_ring;
+    state->sq_head = (unsigned int *)(sq_base + params.sq_off.head);
+    state->sq_tail = (unsigned int *)(sq_base + params.sq_off.tail);
+    state->sq_mask = (unsigned int *)(sq_base + params.sq_off.ring_mask);
+    state->sq_array = (unsigned int *)(sq_base + params.sq_off.array);
+
+    unsigned char *cq_base = (unsigned char *)state->cq_ring;
+    state->cq_head = (unsigned int *)(cq_base + params.cq_off.head);
+    state->cq_tail = (unsigned int *)(cq_base + params.cq_off.tail);
+    state->cq_mask = (unsigned int *)(cq_base + params.cq_off.ring_mask);
+    state->cqes = (struct io_uring_cqe *)(cq_base + params.cq_off.cqes);
+    return 0;
+}
+
+static int io_uring_complete_sync(struct io_uring_state *state, const fif_io_batch_request *request, unsigned int done)
+{
+    // finish a request the ring couldn't (short transfer, or an opcode the kernel doesn't know) with plain calls
+    while (done < request->count)
+    {
+        unsigned char *buffer_ptr = (unsigned char *)request->buffer + done;
+        unsigned int remaining = request->count - done;
+        fif_offset_t offset = request->offset + (fif_offset_t)done;
+        int bytes = (request->write) ? io_local_pwrite((fif_io_userdata)state->fd, buffer_ptr, remaining, offset) : io_local_pread((fif_io_userdata)state->fd, buffer_ptr, remaining, offset);
+        if (bytes <= 0)
+            return -1;
+
+        done += (unsigned int)bytes;
+    }
+
+    return 0;
+}
+
+static unsigned int io_uring_reap(struct io_uring_state *state, int *results, unsigned int group_count)
+{
+    // collect whatever has completed, returns how many did
+    unsigned int reaped = 0;
+    unsigned int head = *state->cq_head;
+    unsigned int cq_tail = __atomic_load_n(state->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != cq_tail)
+    {
+        struct io_uring_cqe *cqe = &state->cqes[head & *state->cq_mask];
+        if (cqe->user_data < group_count)
+            results[cqe->user_data] = cqe->res;
+
+        reaped++;
+        head++;
+    }
+    __atomic_store_n(state->cq_head, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+static int io_uring_abandon_ring(struct io_uring_state *state, unsigned int tail, int *results, unsigned int group_count, unsigned int completed)
+{
+    // take back the entries the kernel hasn't picked up, they'd otherwise go out with the next batch
+    unsigned int sq_head = __atomic_load_n(state->sq_head, __ATOMIC_ACQUIRE);
+    unsigned int submitted = group_count - (tail - sq_head);
+    __atomic_store_n(state->sq_tail, sq_head, __ATOMIC_RELEASE);
+
+    // the ones it has are using the caller's buffers, so wait for them before giving the buffers back
+    int result = 0;
+    while (completed < submitted)
+    {
+        long entered = syscall(__NR_io_uring_enter, state->ring_fd, 0, submitted - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (entered < 0 && errno != EINTR)
+        {
+            result = -1;
+            break;
+        }
+
+        completed += io_uring_reap(state, results, group_count);
+    }
+
+    // the ring can't be trusted after this, so everything from now on goes through pread/pwrite
+    io_uring_unmap(state);
+    return result;
+}
+
+static int io_uring_submit_batch(fif_io_userdata userdata, const fif_io_batch_request *requests, unsigned int request_count)
+{
+    struct io_uring_state *state = (struct io_uring_state *)userdata;
+    int results[IO_URING_QUEUE_DEPTH];
+    int result = 0;
+
+    for (unsigned int first = 0; first < request_count; )
+    {
+        // without a ring, every request is done with plain calls
+        if (state->ring_fd < 0)
+        {
+            if (io_uring_complete_sync(state, &requests[first], 0) != 0)
+                result = -1;
+
+            first++;
+            continue;
+        }
+
+        unsigned int group_count = request_count - first;
+        if (group_count > state->sq_entries)
+            group_count = state->sq_entries;
+        if (group_count > IO_URING_QUEUE_DEPTH)
+            group_count = IO_URING_QUEUE_DEPTH;
+
+        // queue the group
+        unsigned int tail = *state->sq_tail;
+        for (unsigned int i = 0; i < group_count; i++)
+        {
+            const fif_io_batch_request *request = &requests[first + i];
+            unsigned int slot = tail & *state->sq_mask;
+            struct io_uring_sqe *sqe = &state->sqes[slot];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = (request->write) ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe->fd = state->fd;
+            sqe->addr = (uint64_t)(uintptr_t)request->buffer;
+            sqe->len = request->count;
+            sqe->off = (uint64_t)request->offset;
+            sqe->user_data = i;
+            state->sq_array[slot] = slot;
+            results[i] = -1;
+            tail++;
+        }
+        __atomic_store_n(state->sq_tail, tail, __ATOMIC_RELEASE);
+
+        // submit and wait for the whole group
+        unsigned int to_submit = group_count;
+        unsigned int completed = 0;
+        while (completed < group_count)
+        {
+            long entered = syscall(__NR_io_uring_enter, state->ring_fd, to_submit, group_count - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (entered < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                // the rest of the group is finished synchronously below, unless the kernel might still be using its buffers
+                if (io_uring_abandon_ring(state, tail, results, group_count, completed) != 0)
+                    return -1;
+
+                break;
+            }
+            to_submit -= ((unsigned int)entered < to_submit) ? (unsigned int)entered : to_submit;
+            completed += io_uring_reap(state, results, group_count);
+        }
+
+        // anything that came back short is finished synchronously
+        for (unsigned int i = 0; i < group_count; i++)
+        {
+            const fif_io_batch_request *request = &requests[first + i];
+            unsigned int done = (results[i] > 0) ? (unsigned int)results[i] : 0;
+            if (done < request->count && io_uring_complete_sync(state, request, done) != 0)
+                result = -1;
+        }
+
+        first += group_count;
+    }
+
+    return result;
+}
+
+static int io_uring_read(fif_io_userdata userdata, void *buffer, unsigned int count)
+{
+    return io_local_read((fif_io_userdata)((struct io_uring_state *)userdata)->fd, buffer, count);
+}
+
+static int io_uring_write(fif_io_userdata userdata, const void *buffer, unsigned int count)
+{
+    return io_local_write((fif_io_userdata)((struct io_uring_state *)userdata)->fd, buffer, count);
+}
+
+static int io_uring_pread(fif_io_userdata userdata, void *buffer, unsigned int count, fif_offset_t offset)
+{
+    return io_local_pread((fif_io_userdata)((struct io_uring_state *)userdata)->fd, buffer, count, offset);
+}
+
+static int io_uring_pwrite(fif_io_userdata userdata, const void *buffer, unsigned int count, fif_offset_t offset)
+{
+    return io_local_pwrite((fif_io_userdata)((struct io_uring_state *)userdata)->fd, buffer, count, offset);
+}
+
+static int64_t io_uring_seek(fif_io_userdata userdata, fif_offset_t offset, enum FIF_SEEK_MODE mode)
+{
+    return io_local_seek((fif_io_userdata)((struct io_uring_state *)userdata)->fd, offset, mode);
+}
+
+static int io_uring_zero(fif_io_userdata userdata, fif_offset_t offset, unsigned int count)
+{
+    return io_local_zero((fif_io_userdata)((struct io_uring_state *)userdata)->fd, offset, count);
+}
+
+static int io_uring_ftruncate(fif_io_userdata userdata, fif_offset_t newsize)
+{
+    return io_local_ftruncate((fif_io_userdata)((struct io_uring_state *)userdata)->fd, newsize);
+}
+
+static int64_t io_uring_filesize(fif_io_userdata userdata)
+{
+    return io_local_filesize((fif_io_userdata)((struct io_uring_state *)userdata)->fd);
+}
+
+static int io_uring_copy_range(fif_io_userdata userdata, fif_offset_t src_offset, fif_offset_t dst_offset, unsigned int count)
+{
+    return io_local_copy_range((fif_io_userdata)((struct io_uring_state *)userdata)->fd, src_offset, dst_offset, count);
+}
+
+static int io_uring_discard(fif_io_userdata userdata, fif_offset_t offset, unsigned int count)
+{
+    return io_local_discard((fif_io_userdata)((struct io_uring_state *)userdata)->fd, offset, count);
+}
+
+int fif_io_open_uring_file(const char *path, unsigned int mode, fif_io *out_io)
+{
+    struct io_uring_state *state = (struct io_uring_state *)calloc(1, sizeof(struct io_uring_state));
+    if (state == NULL)
+        return -1;
+
+    // set up the ring first, so kernels without io_uring fail before the file is touched
+    state->ring_fd = -1;
+    if (io_uring_map(state) != 0 || open_local_fd(path, mode, 0, &state->fd) != 0)
+    {
+        io_uring_unmap(state);
+        free(state);
+        return -1;
+    }
+
+    fif_io_init(out_io);
+    out_io->io_read = io_uring_read;
+    out_io->io_write = io_uring_write;
+    out_io->io_seek = io_uring_seek;
+    out_io->io_zero = io_uring_zero;
+    out_io->io_ftruncate = io_uring_ftruncate;
+    out_io->io_filesize = io_uring_filesize;
+    out_io->io_pread = io_uring_pread;
+    out_io->io_pwrite = io_uring_pwrite;
+    out_io->io_copy_range = io_uring_copy_range;
+    out_io->io_discard = io_uring_discard;
+    out_io->io_submit_batch = io_uring_submit_batch;
+    out_io->userdata = (fif_io_userdata)state;
+    return 0;
+}
+
+int fif_io_close_uring_file(const fif_io *io)
+{
+    struct io_uring_state *state = (struct io_uring_state *)io->userdata;
+    io_uring_unmap(state);
+
+    int result = io_local_close_fd(state->fd);
+    free(state);
+    return result;
+}
+
+#else       // io_uring not available
+
+int fif_io_open_uring_file(const char *path, unsigned int mode, fif_io *out_io)
+{
+    (void)path;
+    (void)mode;
+    (void)out_io;
+    return -1;
+}
+
+int fif_io_close_uring_file(const fif_io *io)
+{
+    (void)io;
+    return -1;
+}
+
+#endif
+
+/**
+ * unbuffered (O_DIRECT) local files
+ */
+
+#ifdef O_DIRECT
+
+// transfers have to be aligned to the device's logical block size in memory, offset and length, this covers everything common
+#define IO_DIRECT_ALIGNMENT 4096U
+
+static bool io_direct_is_aligned(const void *buffer, unsigned int count, fif_offset_t offset)
+{
+    return ((uintptr_t)buffer % IO_DIRECT_ALIGNMENT) == 0 && (count % IO_DIRECT_ALIGNMENT) == 0 && ((uint64_t)offset % IO_DIRECT_ALIGNMENT) == 0;
+}
+
+static int io_direct_pread(fif_io_userdata userdata, void *buffer, unsigned int count, fif_offset_t offset)
+{
+    int fd = (int)userdata;
+    if (io_direct_is_aligned(buffer, count, offset))
+        return (int)pread(fd, buffer, count, offset);
+
+    // read the aligned range covering the request into a bounce buffer
+    uint64_t aligned_start = (uint64_t)offset & ~(uint64_t)(IO_DIRECT_ALIGNMENT - 1);
+    uint64_t aligned_end = ((uint64_t)offset + count + IO_DIRECT_ALIGNMENT - 1) & ~(uint64_t)(IO_DIRECT_ALIGNMENT - 1);
+    size_t bounce_size = (size_t)(aligned_end - aligned_start);
+    void *bounce;
+    if (posix_memalign(&bounce, IO_DIRECT_ALIGNMENT, bounce_size) != 0)
+        return -1;
+
+    int result = -1;
+    ssize_t bytes = pread(fd, bounce, bounce_size, (off_t)aligned_start);
+    if (bytes >= 0)
+    {
+        // the read can stop short at the end of the file
+        size_t head = (size_t)((uint64_t)offset - aligned_start);
+        size_t available = ((size_t)bytes > head) ? ((size_t)bytes - head) : 0;
+        result = (int)((available < count) ? available : count);
+        memcpy(buffer, (unsigned char *)bounce + head, (size_t)result);
+    }
+
+    free(bounce);
+    return result;
+}
+
+static int io_direct_pwrite(fif_io_userdata userdata, const void *buffer, unsigned int count, fif_offset_t offset)
+{
+    int fd = (int)userdata;
+    if (io_direct_is_aligned(buffer, count, offset))
+        return (int)pwrite(fd, buffer, count, offset);
+
+    uint64_t aligned_start = (uint64_t)offset & ~(uint64_t)(IO_DIRECT_ALIGNMENT - 1);
+    uint64_t aligned_end = ((uint64_t)offset + count + IO_DIRECT_ALIGNMENT - 1) & ~(uint64_t)(IO_DIRECT_ALIGNMENT - 1);
+    size_t bounce_size = (size_t)(aligned_end - aligned_start);
+    void *bounce;
+    if (posix_memalign(&bounce, IO_DIRECT_ALIGNMENT, bounce_size) != 0)
+        return -1;
+
+    // the partial blocks at either edge keep what's already on disk, anything past the end of the file reads as zero
+    int64_t file_size = io_local_filesize(userdata);
+    memset(bounce, 0, bounce_size);
+    if (pread(fd, bounce, IO_DIRECT_ALIGNMENT, (off_t)aligned_start) < 0 ||
+        (bounce_size > IO_DIRECT_ALIGNMENT && pread(fd, (unsigned char *)bounce + bounce_size - IO_DIRECT_ALIGNMENT, IO_DIRECT_ALIGNMENT, (off_t)(aligned_end - IO_DIRECT_ALIGNMENT)) < 0))
+    {
+        free(bounce);
+        return -1;
+    }
+
+    memcpy((unsigned char *)bounce + (size_t)((uint64_t)offset - aligned_start), buffer, count);
+    ssize_t bytes = pwrite(fd, bounce, bounce_size, (off_t)aligned_start);
+    free(bounce);
+    if (bytes != (ssize_t)bounce_size)
+        return -1;
+
+    // writing whole blocks may have pushed the end of the file out further than requested
+    uint64_t end_position = (uint64_t)offset + count;
+    if (aligned_end > (uint64_t)file_size && aligned_end > end_position)
+    {
+        uint64_t new_size = (end_position > (uint64_t)file_size) ? end_position : (uint64_t)file_size;
+        if (ftruncate(fd, (off_t)new_size) != 0)
+            return -1;
+    }
+
+    return (int)count;
+}
+
+static int io_direct_read(fif_io_userdata userdata, void *buffer, unsigned int count)
+{
+    int64_t position = io_local_seek(userdata, 0, FIF_SEEK_MODE_CUR);
+    int bytes = io_direct_pread(userdata, buffer, count, position);
+    if (bytes > 0)
+        io_local_seek(userdata, position + bytes, FIF_SEEK_MODE_SET);
+
+    return bytes;
+}
+
+static int io_direct_write(fif_io_userdata userdata, const void *buffer, unsigned int count)
+{
+    int64_t position = io_local_seek(userdata, 0, FIF_SEEK_MODE_CUR);
+    int bytes = io_direct_pwrite(userdata, buffer, count, position);
+    if (bytes > 0)
+        io_local_seek(userdata, position + bytes, FIF_SEEK_MODE_SET);
+
+    return bytes;
+}
+
+static int io_direct_zero(fif_io_userdata userdata, fif_offset_t offset, unsigned int count)
+{
+    // needs an aligned source, so a static buffer won't do
+    unsigned int chunk_size = 65536;
+    void *zero_bytes;
+    if (posix_memalign(&zero_bytes, IO_DIRECT_ALIGNMENT, chunk_size) != 0)
+        return -1;
+
+    memset(zero_bytes, 0, chunk_size);
+    unsigned int remaining = count;
+    while (remaining > 0)
+    {
+        unsigned int count_to_write = (remaining > chunk_size) ? chunk_size : remaining;
+        if (io_direct_pwrite(userdata, zero_bytes, count_to_write, offset + (fif_offset_t)(count - remaining)) != (int)count_to_write)
+            break;
+
+        remaining -= count_to_write;
+    }
+
+    free(zero_bytes);
+    return (int)(count - remaining);
+}
+
+int fif_io_open_direct_file(const char *path, unsigned int mode, fif_io *out_io)
+{
+    int fd;
+    if (open_local_fd(path, mode, O_DIRECT, &fd) != 0)
+        return -1;
+
+    fif_io_init(out_io);
+    out_io->io_read = io_direct_read;
+    out_io->io_write = io_direct_write;
+    out_io->io_seek = io_local_seek;
+    out_io->io_zero = io_direct_zero;
+    out_io->io_ftruncate = io_local_ftruncate;
+    out_io->io_filesize = io_local_filesize;
+    out_io->io_pread = io_direct_pread;
+    out_io->io_pwrite = io_direct_pwrite;
+#ifdef __linux__
+    out_io->io_copy_range = io_local_copy_range;
+    out_io->io_discard = io_local_discard;
+#endif
+    out_io->userdata = (fif_io_userdata)fd;
+    return 0;
+}
+
+int fif_io_close_direct_file(const fif_io *io)
+{
+    return io_local_close_fd((int)io->userdata);
+}
+
+#else       // O_DIRECT not available
+
+int fif_io_open_direct_file(const char *path, unsigned int mode, fif_io *out_io)
+{
+    // no way to bypass the cache, so this is just a normal local file
+    return fif_io_open_local_file(path, mode, out_io);
+}
+
+int fif_io_close_direct_file(const fif_io *io)
+{
+    return fif_io_close_local_file(io);
+}
+
+#endif
@@ -16,7 +16,7 @@ static int io_memory_resize(struct io_memory_state *state, size_t new_size)
     {
         size_t new_reserve = state->buffer_reserve * 2;
         if (new_size > new_reserve)
-            new_size = new_reserve;
+            new_reserve = new_size;
 
         unsigned char *new_buffer = (unsigned char *)realloc(state->buffer, new_reserve);
         if (new_buffer == NULL)
@@ -62,6 +62,52 @@ static int io_memory_write(fif_io_userdata userdata, const void *buffer, unsigne
     return (int)count;
 }
 
+static int io_memory_pread(fif_io_userdata userdata, void *buffer, unsigned int count, fif_offset_t offset)
+{
+    struct io_memory_state *state = (struct io_memory_state *)userdata;
+    if ((size_t)offset >= state->buffer_size)
+        return 0;
+
+    size_t remaining = state->buffer_size - (size_t)offset;
+    size_t copylen = (remaining < (size_t)count) ? remaining : (size_t)count;
+    memcpy(buffer, state->buffer + (size_t)offset, copylen);
+    return (int)copylen;
+}
+
+static int io_memory_pwrite(fif_io_userdata userdata, const void *buffer, unsigned int count, fif_offset_t offset)
+{
+    struct io_memory_state *state = (struct io_memory_state *)userdata;
+
+    size_t end_position = (size_t)offset + (size_t)count;
+    if (end_position > state->buffer_size)
+    {
+        int result;
+        if ((result = io_memory_resize(state, end_position)) != FIF_ERROR_SUCCESS)
+            return result;
+    }
+
+    memcpy(state->buffer + (size_t)offset, buffer, count);
+    return (int)count;
+}
+
+static int io_memory_copy_range(fif_io_userdata userdata, fif_offset_t src_offset, fif_offset_t dst_offset, unsigned int count)
+{
+    struct io_memory_state *state = (struct io_memory_state *)userdata;
+    if (((size_t)src_offset + (size_t)count) > state->buffer_size)
+        return -1;
+
+    size_t end_position = (size_t)dst_offset + (size_t)count;
+    if (end_position > state->buffer_size)
+    {
+        int result;
+        if ((result = io_memory_resize(state, end_position)) != FIF_ERROR_SUCCESS)
+            return result;
+    }
+
+    memmove(state->buffer + (size_t)dst_offset, state->buffer + (size_t)src_offset, count);
+    return (int)count;
+}
+
 static int64_t io_memory_seek(fif_io_userdata userdata, fif_offset_t offset, enum FIF_SEEK_MODE mode)
 {
     struct io_memory_state *state = (struct io_memory_state *)userdata;
@@ -80,7 +126,7 @@ static int64_t io_memory_seek(fif_io_userdata userdata, fif_offset_t offset, enu
         return FIF_ERROR_BAD_OFFSET;
 
     state->buffer_position = new_offset;
-    return FIF_ERROR_SUCCESS;
+    return (int64_t)new_offset;
 }
 
 static int io_memory_zero(fif_io_userdata userdata, fif_offset_t offset, unsigned int count)
@@ -99,6 +145,17 @@ static int io_memory_zero(fif_io_userdata userdata, fif_offset_t offset, unsigne
     return (int)count;
 }
 
+static int io_memory_discard(fif_io_userdata userdata, fif_offset_t offset, unsigned int count)
+{
+    // the buffer is heap memory, so there is nothing to give back, just clear it
+    struct io_memory_state *state = (struct io_memory_state *)userdata;
+    if (((size_t)offset + (size_t)count) > state->buffer_size)
+        return -1;
+
+    memset(state->buffer + (size_t)offset, 0, count);
+    return (int)count;
+}
+
 static int io_memory_ftruncate(fif_io_userdata userdata, fif_offset_t newsize)
 {
     struct io_memory_state *state = (struct io_memory_state *)userdata;
@@ -132,12 +189,17 @@ int fif_io_open_memory(fif_io *out_io)
     state->buffer_position = 0;
     state->buffer_size = 0;
 
+    fif_io_init(out_io);
     out_io->io_read = io_memory_read;
     out_io->io_write = io_memory_write;
     out_io->io_seek = io_memory_seek;
     out_io->io_zero = io_memory_zero;
     out_io->io_ftruncate = io_memory_ftruncate;
     out_io->io_filesize = io_memory_filesize;
+    out_io->io_pread = io_memory_pread;
+    out_io->io_pwrite = io_memory_pwrite;
+    out_io->io_copy_range = io_memory_copy_range;
+    out_io->io_discard = io_memory_discard;
     out_io->userdata = (fif_io_userdata)state;
 
     return FIF_ERROR_SUCCESS;
@@ -41,8 +41,11 @@ void fif_log_fmt(fif_mount_handle mount, enum FIF_LOG_LEVEL level, const char *f
             mount->log_callback(level, buffer);
         }
 #else
-        // calculate the length first
-        int length = vsnprintf(NULL, 0, format, ap);
+        // calculate the length first, on a copy since the list can't be walked twice
+        va_list length_ap;
+        va_copy(length_ap, ap);
+        int length = vsnprintf(NULL, 0, format, length_ap);
+        va_end(length_ap);
         if (length > 0)
         {
             // allocate a buffer, print it, and pass through
@@ -1,13 +1,27 @@
 #include "fif_internal.h"
+#include "trace.h"
 #include "trace_stream.h"
 
 static void finalize_mount_structure(fif_mount_handle mount)
 {
     mount->inodes_per_table = mount->block_size / sizeof(FIF_VOLUME_FORMAT_INODE);
+
+    // each small file slot costs its data plus an owner entry, and packing is pointless below two per block
+    mount->smallfile_slot_count = 0;
+    if (mount->smallfile_size > 0 && mount->block_size > sizeof(FIF_VOLUME_FORMAT_SMALLFILE_HEADER))
+        mount->smallfile_slot_count = (mount->block_size - sizeof(FIF_VOLUME_FORMAT_SMALLFILE_HEADER)) / (mount->smallfile_size + sizeof(uint32_t));
+    if (mount->smallfile_slot_count < 2)
+        mount->smallfile_slot_count = 0;
 }
 
 static void free_mount_structure(fif_mount_handle mount)
 {
+    fif_free_open_file_table(mount);
+    fif_free_dentry_cache(mount);
+    fif_free_inode_cache(mount);
+    fif_volume_free_block_cache(mount);
+    fif_free_inode_table_index(mount);
+    fif_volume_free_freeblock_index(mount);
     free(mount);
 }
 
@@ -31,10 +45,11 @@ int fif_volume_write_descriptor(fif_mount_handle mount)
     volume_header.first_free_block = mount->first_free_block;
     volume_header.last_free_block = mount->last_free_block;
     volume_header.root_inode = mount->root_inode;
+    volume_header.first_partial_smallfile_block = mount->first_partial_smallfile_block;
+    volume_header.flags = mount->volume_flags | ((mount->descriptor_dirty) ? FIF_VOLUME_FORMAT_FLAG_DIRTY : 0);
 
-    // seek and write it
-    if (mount->io.io_seek(mount->io.userdata, 0, FIF_SEEK_MODE_SET) != 0 ||
-        mount->io.io_write(mount->io.userdata, &volume_header, sizeof(volume_header)) != sizeof(volume_header))
+    // the header always lives at the start of block zero
+    if (fif_volume_write_block(mount, 0, 0, &volume_header, sizeof(volume_header)) != FIF_ERROR_SUCCESS)
     {
         // failed to write or seek
         fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_volume_write_descriptor: failed to write volume descriptor");
@@ -45,12 +60,58 @@ int fif_volume_write_descriptor(fif_mount_handle mount)
     return FIF_ERROR_SUCCESS;
 }
 
+int fif_volume_update_descriptor(fif_mount_handle mount)
+{
+    int result;
+
+    // the first change after a clean write marks the superblock dirty on disk straight away, so a crash before the next sync shows up at mount
+    if (!mount->descriptor_dirty)
+    {
+        mount->descriptor_dirty = true;
+        mount->descriptor_change_count = 0;
+        if ((result = fif_volume_write_descriptor(mount)) != FIF_ERROR_SUCCESS)
+            return result;
+
+        return fif_volume_flush_cached_block(mount, 0);
+    }
+
+    // after that the in-memory copy is what counts, and it's only written every so often
+    if (mount->descriptor_write_interval > 0 && ++mount->descriptor_change_count >= mount->descriptor_write_interval)
+    {
+        mount->descriptor_change_count = 0;
+        return fif_volume_write_descriptor(mount);
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int write_clean_descriptor(fif_mount_handle mount)
+{
+    int result;
+    if (!mount->descriptor_dirty)
+        return FIF_ERROR_SUCCESS;
+
+    // everything else has to be out before the superblock says it's clean
+    if ((result = fif_volume_flush_block_cache(mount)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    mount->descriptor_dirty = false;
+    if ((result = fif_volume_write_descriptor(mount)) != FIF_ERROR_SUCCESS)
+    {
+        mount->descriptor_dirty = true;
+        return result;
+    }
+
+    return fif_volume_flush_block_cache(mount);
+}
+
 void fif_set_default_volume_options(fif_volume_options *options)
 {
     options->block_size = 1024;
     options->smallfile_size = 64;
     options->hash_table_size = 512;
     options->inode_table_count = 4;
+    options->ordered_directories = false;
 }
 
 void fif_set_default_mount_options(fif_mount_options *options)
@@ -60,6 +121,16 @@ void fif_set_default_mount_options(fif_mount_options *options)
     options->new_file_compression_algorithm = FIF_COMPRESSION_ALGORITHM_NONE;
     options->new_file_compression_level = 0;
     options->fragmentation_threshold = 128;
+    options->skip_zero_freed_blocks = false;
+    options->max_readahead_size = 256 * 1024;
+    options->volume_growth_blocks = 64;
+    options->volume_growth_percent = 25;
+    options->trim_on_unmount = true;
+    options->descriptor_write_interval = 256;
+    options->batch_cache_size = 4096;
+    options->delayed_allocation_size = 1024 * 1024;
+    options->inode_cache_size = 1024;
+    options->dentry_cache_size = 4096;
 }
 
 int fif_create_volume(fif_mount_handle *out_mount_handle, const fif_io *io, fif_log_callback log_callback, const fif_volume_options *archive_options, const fif_mount_options *mount_options)
@@ -84,6 +155,19 @@ int fif_create_volume(fif_mount_handle *out_mount_handle, const fif_io *io, fif_
     mount->new_file_compression_algorithm = mount_options->new_file_compression_algorithm;
     mount->new_file_compression_level = mount_options->new_file_compression_level;
     mount->fragmentation_threshold = mount_options->fragmentation_threshold;
+    mount->skip_zero_freed_blocks = mount_options->skip_zero_freed_blocks;
+    mount->max_readahead_size = mount_options->max_readahead_size;
+    mount->volume_growth_blocks = mount_options->volume_growth_blocks;
+    mount->volume_growth_percent = mount_options->volume_growth_percent;
+    mount->trim_on_unmount = mount_options->trim_on_unmount;
+    mount->descriptor_write_interval = mount_options->descriptor_write_interval;
+    mount->batch_cache_size = mount_options->batch_cache_size;
+    mount->delayed_allocation_size = mount_options->delayed_allocation_size;
+    mount->inode_cache_size = mount_options->inode_cache_size;
+    mount->dentry_cache_size = mount_options->dentry_cache_size;
+    mount->descriptor_change_count = 0;
+    mount->batch_depth = 0;
+    mount->batch_block_cache = false;
     mount->block_size = archive_options->block_size;
     mount->smallfile_size = archive_options->smallfile_size;
     mount->hash_table_size = archive_options->hash_table_size;
@@ -98,13 +182,36 @@ int fif_create_volume(fif_mount_handle *out_mount_handle, const fif_io *io, fif_
     mount->first_free_block = 0;
     mount->last_free_block = 0;
     mount->root_inode = 0;
+    mount->first_partial_smallfile_block = 0;
+    mount->volume_flags = (archive_options->ordered_directories) ? FIF_VOLUME_FORMAT_FLAG_ORDERED_DIRECTORIES : 0;
+    mount->descriptor_dirty = false;
+    mount->inode_table_blocks = NULL;
+    mount->inode_table_blocks_reserve = 0;
+    mount->freeblock_nodes = NULL;
+    mount->freeblock_order = NULL;
+    mount->inode_cache_buckets = NULL;
+    mount->dentry_cache_buckets = NULL;
     mount->open_file_count = 0;
     mount->open_files = NULL;
+    mount->open_file_free_slots = NULL;
+    mount->open_file_free_count = 0;
     mount->trace_stream = NULL;
 
     // fill in calculated fields
     finalize_mount_structure(mount);
 
+    // set up the block, inode and path lookup caches
+    if ((result = fif_volume_init_block_cache(mount, mount->block_cache_size)) != FIF_ERROR_SUCCESS ||
+        (result = fif_init_inode_cache(mount)) != FIF_ERROR_SUCCESS ||
+        (result = fif_init_dentry_cache(mount)) != FIF_ERROR_SUCCESS)
+    {
+        goto ERROR_LABEL;
+    }
+
+    // nothing is free yet, this just sets up the empty index
+    if ((result = fif_volume_load_freeblock_index(mount)) != FIF_ERROR_SUCCESS)
+        goto ERROR_LABEL;
+
     // truncate the file to the block size (the first block is always the header)
     if (mount->io.io_ftruncate(mount->io.userdata, mount->block_size) != 0)
     {
@@ -128,7 +235,7 @@ int fif_create_volume(fif_mount_handle *out_mount_handle, const fif_io *io, fif_
         goto ERROR_LABEL;
 
     // use helper methods to rewrite the header
-    if ((result = fif_volume_write_descriptor(mount)) != FIF_ERROR_SUCCESS)
+    if ((result = fif_volume_update_descriptor(mount)) != FIF_ERROR_SUCCESS)
         goto ERROR_LABEL;
 
     // all done
@@ -141,12 +248,36 @@ ERROR_LABEL:
     return result;
 }
 
+static int recover_allocation_state(fif_mount_handle mount)
+{
+    // the free inode, small file and freeblock chains are all worked out again from what the inodes use
+    int result;
+    unsigned char *block_usage = (unsigned char *)calloc(mount->block_count, 1);
+    if (block_usage == NULL)
+        return FIF_ERROR_OUT_OF_MEMORY;
+
+    block_usage[0] = FIF_BLOCK_USAGE_USED;
+    if ((result = fif_rebuild_free_inode_chain(mount, block_usage)) == FIF_ERROR_SUCCESS &&
+        (result = fif_rebuild_smallfile_chain(mount, block_usage)) == FIF_ERROR_SUCCESS)
+    {
+        result = fif_volume_rebuild_freeblock_index(mount, block_usage);
+    }
+
+    free(block_usage);
+    return result;
+}
+
 int fif_mount_volume(fif_mount_handle *out_mount_handle, const fif_io *io, fif_log_callback log_callback, const fif_mount_options *mount_options)
 {
     // read superblock
     FIF_VOLUME_FORMAT_HEADER header;
-    if (io->io_seek(io->userdata, 0, FIF_SEEK_MODE_SET) != 0 ||
-        io->io_read(io->userdata, &header, sizeof(header)) != sizeof(header))
+    if (io->io_pread != NULL)
+    {
+        if (io->io_pread(io->userdata, &header, sizeof(header), 0) != sizeof(header))
+            return FIF_ERROR_IO_ERROR;
+    }
+    else if (io->io_seek(io->userdata, 0, FIF_SEEK_MODE_SET) != 0 ||
+             io->io_read(io->userdata, &header, sizeof(header)) != sizeof(header))
     {
         return FIF_ERROR_IO_ERROR;
     }
@@ -169,6 +300,19 @@ int fif_mount_volume(fif_mount_handle *out_mount_handle, const fif_io *io, fif_l
     mount->new_file_compression_algorithm = mount_options->new_file_compression_algorithm;
     mount->new_file_compression_level = mount_options->new_file_compression_level;
     mount->fragmentation_threshold = mount_options->fragmentation_threshold;
+    mount->skip_zero_freed_blocks = mount_options->skip_zero_freed_blocks;
+    mount->max_readahead_size = mount_options->max_readahead_size;
+    mount->volume_growth_blocks = mount_options->volume_growth_blocks;
+    mount->volume_growth_percent = mount_options->volume_growth_percent;
+    mount->trim_on_unmount = mount_options->trim_on_unmount;
+    mount->descriptor_write_interval = mount_options->descriptor_write_interval;
+    mount->batch_cache_size = mount_options->batch_cache_size;
+    mount->delayed_allocation_size = mount_options->delayed_allocation_size;
+    mount->inode_cache_size = mount_options->inode_cache_size;
+    mount->dentry_cache_size = mount_options->dentry_cache_size;
+    mount->descriptor_change_count = 0;
+    mount->batch_depth = 0;
+    mount->batch_block_cache = false;
     mount->block_size = header.block_size;
     mount->smallfile_size = header.smallfile_size;
     mount->hash_table_size = header.hash_table_size;
@@ -183,13 +327,58 @@ int fif_mount_volume(fif_mount_handle *out_mount_handle, const fif_io *io, fif_l
     mount->first_free_block = header.first_free_block;
     mount->last_free_block = header.last_free_block;
     mount->root_inode = header.root_inode;
+    mount->first_partial_smallfile_block = header.first_partial_smallfile_block;
+    mount->volume_flags = header.flags & ~FIF_VOLUME_FORMAT_FLAG_DIRTY;
+    mount->descriptor_dirty = false;
+    mount->inode_table_blocks = NULL;
+    mount->inode_table_blocks_reserve = 0;
+    mount->freeblock_nodes = NULL;
+    mount->freeblock_order = NULL;
+    mount->inode_cache_buckets = NULL;
+    mount->dentry_cache_buckets = NULL;
     mount->open_file_count = 0;
     mount->open_files = NULL;
+    mount->open_file_free_slots = NULL;
+    mount->open_file_free_count = 0;
     mount->trace_stream = NULL;
 
+    // a superblock still marked dirty wasn't written back after its last change, so it may be out of date
+    bool recover = (header.flags & FIF_VOLUME_FORMAT_FLAG_DIRTY) != 0;
+    if (recover)
+    {
+        fif_log_msg(mount, FIF_LOG_LEVEL_WARNING, "fif_mount_volume: volume was not unmounted cleanly, recovering the superblock");
+        mount->descriptor_dirty = !mount->read_only;
+
+        // the archive is resized before the superblock catches up, so its size is the real block count
+        int64_t file_size = mount->io.io_filesize(mount->io.userdata);
+        if (file_size > 0 && (fif_block_index_t)(file_size / mount->block_size) != mount->block_count)
+        {
+            fif_log_fmt(mount, FIF_LOG_LEVEL_WARNING, "fif_mount_volume: superblock says %u blocks, archive has %u", mount->block_count, (fif_block_index_t)(file_size / mount->block_size));
+            mount->block_count = (fif_block_index_t)(file_size / mount->block_size);
+        }
+    }
+
     // fill in calculated fields
     finalize_mount_structure(mount);
 
+    // set up the block, inode and path lookup caches
+    int result;
+    if ((result = fif_volume_init_block_cache(mount, mount->block_cache_size)) != FIF_ERROR_SUCCESS ||
+        (result = fif_init_inode_cache(mount)) != FIF_ERROR_SUCCESS ||
+        (result = fif_init_dentry_cache(mount)) != FIF_ERROR_SUCCESS)
+    {
+        free_mount_structure(mount);
+        return result;
+    }
+
+    // locate every inode table and free block range up front
+    if ((result = fif_load_inode_table_index(mount, recover)) != FIF_ERROR_SUCCESS ||
+        (result = ((recover) ? recover_allocation_state(mount) : fif_volume_load_freeblock_index(mount))) != FIF_ERROR_SUCCESS)
+    {
+        free_mount_structure(mount);
+        return result;
+    }
+
     // done
     *out_mount_handle = mount;
     return FIF_ERROR_SUCCESS;
@@ -207,6 +396,77 @@ void fif_get_volume_options(fif_mount_handle mount, fif_volume_options *options)
     (void)options;
 }
 
+int fif_sync(fif_mount_handle mount)
+{
+    int result;
+    if (mount->trace_stream != NULL && (result = fif_trace_write_sync(mount)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    if (mount->read_only)
+        return FIF_ERROR_SUCCESS;
+
+    // dirty inodes go into the block cache, then it all goes out with the superblock last
+    if ((result = fif_flush_inode_cache(mount)) != FIF_ERROR_SUCCESS ||
+        (result = write_clean_descriptor(mount)) != FIF_ERROR_SUCCESS ||
+        (result = fif_volume_flush_block_cache(mount)) != FIF_ERROR_SUCCESS)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_sync: failed to write back volume (%i)", result);
+        return result;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_begin_batch(fif_mount_handle mount)
+{
+    int result;
+    if (mount->trace_stream != NULL && (result = fif_trace_write_begin_batch(mount)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    // the outermost batch needs frames to hold the blocks in, a mount without a block cache gets one for the length of the batch
+    if (mount->batch_depth == 0 && mount->block_cache_entries == NULL && mount->batch_cache_size > 0 && !mount->read_only)
+    {
+        if ((result = fif_volume_init_block_cache(mount, mount->batch_cache_size)) != FIF_ERROR_SUCCESS)
+        {
+            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_begin_batch: failed to allocate batch cache of %u blocks", mount->batch_cache_size);
+            return result;
+        }
+
+        mount->batch_block_cache = true;
+    }
+
+    mount->batch_depth++;
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_commit_batch(fif_mount_handle mount)
+{
+    int result;
+    if (mount->trace_stream != NULL && (result = fif_trace_write_commit_batch(mount)) != FIF_ERROR_SUCCESS)
+        return result;
+
+    if (mount->batch_depth == 0)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_commit_batch: no batch in progress");
+        return FIF_ERROR_GENERIC_ERROR;
+    }
+
+    // nested batches are written by the outermost commit
+    if (--mount->batch_depth > 0)
+        return FIF_ERROR_SUCCESS;
+
+    // dirty inodes go into the block cache, then every held block goes out in block order
+    if ((result = fif_flush_inode_cache(mount)) != FIF_ERROR_SUCCESS ||
+        (result = fif_volume_flush_block_cache(mount)) != FIF_ERROR_SUCCESS)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_commit_batch: failed to write back batch (%i)", result);
+        return result;
+    }
+
+    // a cache allocated for the batch goes away with it, or with the last read view that still points into one of its frames
+    return fif_volume_free_batch_block_cache(mount);
+}
+
 int fif_unmount_volume(fif_mount_handle mount)
 {
     // cleanup the mount
@@ -222,6 +482,32 @@ int fif_unmount_volume(fif_mount_handle mount)
         mount->trace_stream = NULL;
     }
 
+    // write back dirty inodes first, they land in the block cache
+    int result = fif_flush_inode_cache(mount);
+    if (result != FIF_ERROR_SUCCESS)
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_unmount_volume: failed to flush inode cache (%i)", result);
+
+    // drop the unused end of the archive, this has to happen before the block cache is written back
+    if (mount->trim_on_unmount && !mount->read_only)
+    {
+        int trim_result = fif_volume_trim(mount);
+        if (trim_result != FIF_ERROR_SUCCESS)
+        {
+            fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_unmount_volume: failed to trim volume (%i)", trim_result);
+            result = trim_result;
+        }
+    }
+
+    // write back anything left in the block cache, and mark the superblock clean once that's done
+    int block_cache_result = write_clean_descriptor(mount);
+    if (block_cache_result == FIF_ERROR_SUCCESS)
+        block_cache_result = fif_volume_flush_block_cache(mount);
+    if (block_cache_result != FIF_ERROR_SUCCESS)
+    {
+        fif_log_fmt(mount, FIF_LOG_LEVEL_ERROR, "fif_unmount_volume: failed to flush block cache (%i)", block_cache_result);
+        result = block_cache_result;
+    }
+
     free_mount_structure(mount);
-    return FIF_ERROR_SUCCESS;
+    return result;
 }
@@ -43,6 +43,21 @@ int fif_trace_write_open(fif_mount_handle mount, const char *path, unsigned int
     return FIF_ERROR_SUCCESS;
 }
 
+int fif_trace_write_open_ex(fif_mount_handle mount, const char *path, unsigned int mode, fif_offset_t expected_size)
+{
+    int result;
+
+    if ((result = trace_stream_write_byte(mount->trace_stream, FIF_TRACE_COMMAND_OPEN_EX)) != FIF_ERROR_SUCCESS ||
+        (result = trace_stream_write_string(mount->trace_stream, path)) != FIF_ERROR_SUCCESS ||
+        (result = trace_stream_write_uint(mount->trace_stream, mode)) != FIF_ERROR_SUCCESS ||
+        (result = trace_stream_write_long(mount->trace_stream, expected_size)) != FIF_ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
 int fif_trace_write_read(fif_mount_handle mount, fif_file_handle file, unsigned int count)
 {
     int result;
@@ -119,6 +134,21 @@ int fif_trace_write_ftruncate(fif_mount_handle mount, fif_file_handle file, fif_
 }
 
 
+int fif_trace_write_fallocate(fif_mount_handle mount, fif_file_handle file, fif_offset_t size)
+{
+    int result;
+
+    if ((result = trace_stream_write_byte(mount->trace_stream, FIF_TRACE_COMMAND_FALLOCATE)) != FIF_ERROR_SUCCESS ||
+        (result = trace_stream_write_uint(mount->trace_stream, file->handle_index)) != FIF_ERROR_SUCCESS ||
+        (result = trace_stream_write_long(mount->trace_stream, size)) != FIF_ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+
 int fif_trace_write_close(fif_mount_handle mount, fif_file_handle file)
 {
     int result;
@@ -231,6 +261,51 @@ int fif_trace_write_rmdir(fif_mount_handle mount, const char *dirname)
     return FIF_ERROR_SUCCESS;
 }
 
+int fif_trace_write_enumdir_range(fif_mount_handle mount, const char *dirname, const char *start, const char *end)
+{
+    int result;
+
+    // open bounds are written as empty strings, which mean the same thing
+    if ((result = trace_stream_write_byte(mount->trace_stream, FIF_TRACE_COMMAND_ENUMDIR_RANGE)) != FIF_ERROR_SUCCESS ||
+        (result = trace_stream_write_string(mount->trace_stream, dirname)) != FIF_ERROR_SUCCESS ||
+        (result = trace_stream_write_string(mount->trace_stream, (start != NULL) ? start : "")) != FIF_ERROR_SUCCESS ||
+        (result = trace_stream_write_string(mount->trace_stream, (end != NULL) ? end : "")) != FIF_ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_trace_write_readdir_plus(fif_mount_handle mount, const char *dirname, unsigned int max_entries)
+{
+    int result;
+
+    if ((result = trace_stream_write_byte(mount->trace_stream, FIF_TRACE_COMMAND_READDIR_PLUS)) != FIF_ERROR_SUCCESS ||
+        (result = trace_stream_write_string(mount->trace_stream, dirname)) != FIF_ERROR_SUCCESS ||
+        (result = trace_stream_write_uint(mount->trace_stream, max_entries)) != FIF_ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+int fif_trace_write_sync(fif_mount_handle mount)
+{
+    return trace_stream_write_byte(mount->trace_stream, FIF_TRACE_COMMAND_SYNC);
+}
+
+int fif_trace_write_begin_batch(fif_mount_handle mount)
+{
+    return trace_stream_write_byte(mount->trace_stream, FIF_TRACE_COMMAND_BEGIN_BATCH);
+}
+
+int fif_trace_write_commit_batch(fif_mount_handle mount)
+{
+    return trace_stream_write_byte(mount->trace_stream, FIF_TRACE_COMMAND_COMMIT_BATCH);
+}
+
 int fif_trace_create_volume(fif_mount_handle *out_mount_handle, const fif_io *io, fif_log_callback log_callback, const fif_volume_options *archive_options, const fif_mount_options *mount_options, const fif_io *trace_io)
 {
     int result;
@@ -284,6 +359,14 @@ static int trace_dummy_enumdir_callback(void *userdata, const char *filename)
     return FIF_ERROR_SUCCESS;
 }
 
+static int trace_dummy_readdir_plus_callback(void *userdata, const fif_direntry *entries, unsigned int count)
+{
+    (void)userdata;
+    (void)entries;
+    (void)count;
+    return FIF_ERROR_SUCCESS;
+}
+
 static int trace_replay_command(fif_mount_handle mount, struct fif_trace_stream *trace_stream, enum FIF_TRACE_COMMAND command)
 {
     int result;
@@ -571,6 +654,130 @@ static int trace_replay_command(fif_mount_handle mount, struct fif_trace_stream
             return FIF_ERROR_SUCCESS;
         }
         break;
+
+    case FIF_TRACE_COMMAND_ENUMDIR_RANGE:
+        {
+            char *filename;
+            if ((result = trace_stream_read_string(trace_stream, &filename)) != FIF_ERROR_SUCCESS)
+                return result;
+
+            char *start;
+            if ((result = trace_stream_read_string(trace_stream, &start)) != FIF_ERROR_SUCCESS)
+            {
+                free(filename);
+                return result;
+            }
+
+            char *end;
+            if ((result = trace_stream_read_string(trace_stream, &end)) != FIF_ERROR_SUCCESS)
+            {
+                free(start);
+                free(filename);
+                return result;
+            }
+
+            fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "[trace replay] fif_enumdir_range(dirname: %s, start: %s, end: %s)", filename, start, end);
+
+            fif_enumdir_range(mount, filename, start, end, trace_dummy_enumdir_callback, NULL);
+            free(end);
+            free(start);
+            free(filename);
+            return FIF_ERROR_SUCCESS;
+        }
+        break;
+
+    case FIF_TRACE_COMMAND_READDIR_PLUS:
+        {
+            char *filename;
+            if ((result = trace_stream_read_string(trace_stream, &filename)) != FIF_ERROR_SUCCESS)
+                return result;
+
+            unsigned int max_entries;
+            if ((result = trace_stream_read_uint(trace_stream, &max_entries)) != FIF_ERROR_SUCCESS)
+            {
+                free(filename);
+                return result;
+            }
+
+            fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "[trace replay] fif_readdir_plus(dirname: %s, max_entries: %u)", filename, max_entries);
+
+            fif_direntry *entries = (fif_direntry *)malloc(((max_entries > 0) ? max_entries : 1) * sizeof(fif_direntry));
+            fif_readdir_plus(mount, filename, entries, max_entries, trace_dummy_readdir_plus_callback, NULL);
+            free(entries);
+            free(filename);
+            return FIF_ERROR_SUCCESS;
+        }
+        break;
+
+    case FIF_TRACE_COMMAND_OPEN_EX:
+        {
+            char *filename;
+            unsigned int mode;
+            fif_offset_t expected_size;
+            if ((result = trace_stream_read_string(trace_stream, &filename)) != FIF_ERROR_SUCCESS)
+                return result;
+            if ((result = trace_stream_read_uint(trace_stream, &mode)) != FIF_ERROR_SUCCESS ||
+                (result = trace_stream_read_long(trace_stream, &expected_size)) != FIF_ERROR_SUCCESS)
+            {
+                free(filename);
+                return result;
+            }
+
+            fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "[trace replay] fif_open_ex(filename: %s, mode: %x, expected_size: %lld)", filename, mode, expected_size);
+
+            fif_file_handle file;
+            fif_open_ex(mount, filename, mode, expected_size, &file);
+            free(filename);
+            return FIF_ERROR_SUCCESS;
+        }
+        break;
+
+    case FIF_TRACE_COMMAND_FALLOCATE:
+        {
+            unsigned int handle_index;
+            fif_offset_t size;
+            if ((result = trace_stream_read_uint(trace_stream, &handle_index)) != FIF_ERROR_SUCCESS ||
+                (result = trace_stream_read_long(trace_stream, &size)) != FIF_ERROR_SUCCESS)
+            {
+                return result;
+            }
+
+            if (handle_index >= mount->open_file_count || mount->open_files[handle_index] == NULL)
+                return FIF_ERROR_GENERIC_ERROR;
+
+            fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "[trace replay] fif_fallocate(handle: %u, size: %lld)", handle_index, size);
+
+            fif_fallocate(mount, mount->open_files[handle_index], size);
+            return FIF_ERROR_SUCCESS;
+        }
+        break;
+
+    case FIF_TRACE_COMMAND_SYNC:
+        {
+            fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "[trace replay] fif_sync()");
+
+            fif_sync(mount);
+            return FIF_ERROR_SUCCESS;
+        }
+        break;
+
+    case FIF_TRACE_COMMAND_BEGIN_BATCH:
+        {
+            fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "[trace replay] fif_begin_batch()");
+
+            fif_begin_batch(mount);
+            return FIF_ERROR_SUCCESS;
+        }
+        break;
+
+    case FIF_TRACE_COMMAND_COMMIT_BATCH:
+        {
+            fif_log_fmt(mount, FIF_LOG_LEVEL_DEBUG, "[trace replay] fif_commit_batch()");
+
+            fif_commit_batch(mount);
+            return FIF_ERROR_SUCCESS;
+        }
+        break;
     }
 
     return FIF_ERROR_GENERIC_ERROR;
@@ -7,11 +7,13 @@
 int fif_trace_write_stat(fif_mount_handle mount, const char *path);
 int fif_trace_write_fstat(fif_mount_handle mount, fif_file_handle file);
 int fif_trace_write_open(fif_mount_handle mount, const char *path, unsigned int mode);
+int fif_trace_write_open_ex(fif_mount_handle mount, const char *path, unsigned int mode, fif_offset_t expected_size);
 int fif_trace_write_read(fif_mount_handle mount, fif_file_handle file, unsigned int count);
 int fif_trace_write_write(fif_mount_handle mount, fif_file_handle file, const void *in_buffer, unsigned int count);
 int fif_trace_write_seek(fif_mount_handle mount, fif_file_handle file, fif_offset_t offset, enum FIF_SEEK_MODE mode);
 int fif_trace_write_tell(fif_mount_handle mount, fif_file_handle file);
 int fif_trace_write_ftruncate(fif_mount_handle mount, fif_file_handle file, fif_offset_t size);
+int fif_trace_write_fallocate(fif_mount_handle mount, fif_file_handle file, fif_offset_t size);
 int fif_trace_write_close(fif_mount_handle mount, fif_file_handle file);
 int fif_trace_write_unlink(fif_mount_handle mount, const char *filename);
 
@@ -24,5 +26,12 @@ int fif_trace_write_compress_file(fif_mount_handle mount, const char *filename,
 int fif_trace_write_enumdir(fif_mount_handle mount, const char *dirname);
 int fif_trace_write_mkdir(fif_mount_handle mount, const char *dirname);
 int fif_trace_write_rmdir(fif_mount_handle mount, const char *dirname);
+int fif_trace_write_enumdir_range(fif_mount_handle mount, const char *dirname, const char *start, const char *end);
+int fif_trace_write_readdir_plus(fif_mount_handle mount, const char *dirname, unsigned int max_entries);
+
+// Volume operations
+int fif_trace_write_sync(fif_mount_handle mount);
+int fif_trace_write_begin_batch(fif_mount_handle mount);
+int fif_trace_write_commit_batch(fif_mount_handle mount);
 
 #endif      // __FIF_TRACE_H
\ No newline at end of file
@@ -20,7 +20,14 @@ enum FIF_TRACE_COMMAND
     FIF_TRACE_COMMAND_COMPRESS_FILE,
     FIF_TRACE_COMMAND_ENUMDIR,
     FIF_TRACE_COMMAND_MKDIR,
-    FIF_TRACE_COMMAND_RMDIR
+    FIF_TRACE_COMMAND_RMDIR,
+    FIF_TRACE_COMMAND_ENUMDIR_RANGE,
+    FIF_TRACE_COMMAND_READDIR_PLUS,
+    FIF_TRACE_COMMAND_OPEN_EX,
+    FIF_TRACE_COMMAND_FALLOCATE,
+    FIF_TRACE_COMMAND_SYNC,
+    FIF_TRACE_COMMAND_BEGIN_BATCH,
+    FIF_TRACE_COMMAND_COMMIT_BATCH
 };
 /*
 #pragma pack(push, 1)
@@ -284,7 +284,7 @@ int trace_stream_write_int(struct fif_trace_stream *stream, int value)
 int trace_stream_write_uint(struct fif_trace_stream *stream, unsigned int value)
 {
     int result;
-    if ((result = trace_stream_write_bytes(stream, &value, sizeof(unsigned long long))) != sizeof(unsigned long long))
+    if ((result = trace_stream_write_bytes(stream, &value, sizeof(unsigned int))) != sizeof(unsigned int))
         return (result >= 0) ? FIF_ERROR_BAD_OFFSET : result;
 
     return FIF_ERROR_SUCCESS;
@@ -65,7 +65,7 @@ void fif_split_path_dirbase(char *path, char **dirname, char **basename)
         // remove the rightmost slash, and set pointers
         *rightmost_slash = '\0';
         *dirname = path;
-        *basename = rightmost_slash;
+        *basename = rightmost_slash + 1;
     }
 }
 
@@ -167,3 +167,24 @@ bool fif_canonicalize_path(char *dest, int dest_size, const char *path)
     return true;
 }
 
+uint32_t fif_hash_filename(const char *filename, unsigned int filename_length)
+{
+    // fnv-1a over the lowercased name, since filename comparisons are case-insensitive
+    uint32_t hash = 2166136261U;
+    for (unsigned int i = 0; i < filename_length; i++)
+    {
+        unsigned char ch = (unsigned char)filename[i];
+        if (ch >= 'A' && ch <= 'Z')
+            ch += 'a' - 'A';
+
+        hash ^= ch;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+void fif_io_init(fif_io *io)
+{
+    memset(io, 0, sizeof(*io));
+}
@@ -4,6 +4,2954 @@
 
 #include "libfif/fif.h"
 
+// directory tests create file000 onwards in a directory, then remove every third one
+#define TEST_DIRECTORY_FILE_COUNT 200
+#define TEST_FILE_MAX_SIZE 16384
+
+typedef unsigned int(*test_file_size_function)(unsigned int index);
+
+struct test_enum_state
+{
+    unsigned int count;
+    unsigned int last_index;
+    int unexpected;
+    int unordered;
+};
+
+static void fill_test_file_data(unsigned char *buffer, unsigned int index, unsigned int size)
+{
+    for (unsigned int i = 0; i < size; i++)
+        buffer[i] = (unsigned char)(index * 31 + i);
+}
+
+static void make_test_path(char *path, const char *dirname, unsigned int index)
+{
+    // dirname/fileNNN
+    size_t dirname_length = strlen(dirname);
+    memcpy(path, dirname, dirname_length);
+    memcpy(path + dirname_length, "/file", 5);
+    path[dirname_length + 5] = (char)('0' + (index / 100) % 10);
+    path[dirname_length + 6] = (char)('0' + (index / 10) % 10);
+    path[dirname_length + 7] = (char)('0' + index % 10);
+    path[dirname_length + 8] = '\0';
+}
+
+static int create_test_volume(fif_io *io, fif_mount_handle *mount, const fif_volume_options *volume_options, const fif_mount_options *mount_options)
+{
+    int result;
+    fif_io_close_local_file(io);
+    if ((result = fif_io_open_local_file("test.fif", FIF_OPEN_MODE_CREATE | FIF_OPEN_MODE_READ | FIF_OPEN_MODE_WRITE | FIF_OPEN_MODE_TRUNCATE, io)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_io_open_local_file() failed: %i\n", result);
+        return result;
+    }
+    if ((result = fif_create_volume(mount, io, NULL, volume_options, mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_create() failed: %i\n", result);
+        return result;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int remount_test_volume(fif_io *io, fif_mount_handle *mount, const fif_mount_options *mount_options)
+{
+    int result;
+    fif_unmount_volume(*mount);
+    if ((result = fif_mount_volume(mount, io, NULL, mount_options)) != FIF_ERROR_SUCCESS)
+        printf("fif_mount_volume() failed: %i\n", result);
+
+    return result;
+}
+
+static int fill_test_directory(fif_mount_handle mount, const char *dirname, test_file_size_function file_size, unsigned int chunk_size)
+{
+    int result;
+    static unsigned char data[TEST_FILE_MAX_SIZE];
+    char path[64];
+    if ((result = fif_mkdir(mount, dirname)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_mkdir(%s) failed: %i\n", dirname, result);
+        return result;
+    }
+
+    // every file grows by a chunk in turn, so a small chunk leaves each file's blocks between the others'
+    for (unsigned int offset = 0; offset < TEST_FILE_MAX_SIZE; offset += chunk_size)
+    {
+        for (unsigned int i = 0; i < TEST_DIRECTORY_FILE_COUNT; i++)
+        {
+            unsigned int size = file_size(i);
+            if (offset >= size)
+                continue;
+
+            unsigned int count = ((size - offset) < chunk_size) ? (size - offset) : chunk_size;
+            fif_file_handle file;
+            fill_test_file_data(data, i, size);
+            make_test_path(path, dirname, i);
+            if ((result = fif_open(mount, path, FIF_OPEN_MODE_CREATE | FIF_OPEN_MODE_WRITE, &file)) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_open(%s) failed: %i\n", path, result);
+                return result;
+            }
+            if (fif_seek(mount, file, offset, FIF_SEEK_MODE_SET) != (fif_offset_t)offset || (result = fif_write(mount, file, data + offset, count)) != (int)count)
+            {
+                printf("fif_write(%s) failed: %i\n", path, result);
+                return -1;
+            }
+            if ((result = fif_close(mount, file)) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_close(%s) failed: %i\n", path, result);
+                return result;
+            }
+        }
+    }
+
+    // remove every third file
+    for (unsigned int i = 0; i < TEST_DIRECTORY_FILE_COUNT; i += 3)
+    {
+        make_test_path(path, dirname, i);
+        if ((result = fif_unlink(mount, path)) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_unlink(%s) failed: %i\n", path, result);
+            return result;
+        }
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_enum_callback(void *userdata, const char *filename)
+{
+    struct test_enum_state *state = (struct test_enum_state *)userdata;
+    unsigned int index = 0;
+    if (strlen(filename) != 7 || memcmp(filename, "file", 4) != 0)
+        state->unexpected = 1;
+    else
+        index = (unsigned int)(filename[4] - '0') * 100 + (unsigned int)(filename[5] - '0') * 10 + (unsigned int)(filename[6] - '0');
+
+    if (index >= TEST_DIRECTORY_FILE_COUNT || (index % 3) == 0)
+        state->unexpected = 1;
+    else if (state->count > 0 && index <= state->last_index)
+        state->unordered = 1;
+
+    state->count++;
+    state->last_index = index;
+    return 0;
+}
+
+static int check_test_directory(fif_mount_handle mount, const char *dirname, test_file_size_function file_size, int ordered)
+{
+    int result;
+    static unsigned char expected[TEST_FILE_MAX_SIZE], data[TEST_FILE_MAX_SIZE];
+    char path[64];
+
+    // removed files are gone, the rest can be looked up and hold what was written
+    unsigned int remaining_count = 0;
+    for (unsigned int i = 0; i < TEST_DIRECTORY_FILE_COUNT; i++)
+    {
+        make_test_path(path, dirname, i);
+        if ((i % 3) == 0)
+        {
+            fif_fileinfo fileinfo;
+            if ((result = fif_stat(mount, path, &fileinfo)) != FIF_ERROR_FILE_NOT_FOUND)
+            {
+                printf("removed file %s was found: %i\n", path, result);
+                return -1;
+            }
+
+            continue;
+        }
+
+        unsigned int size = file_size(i);
+        fill_test_file_data(expected, i, size);
+        if ((result = fif_get_file_contents(mount, path, data, sizeof(data))) != (int)size || memcmp(data, expected, size) != 0)
+        {
+            printf("%s contents are wrong: %i\n", path, result);
+            return -1;
+        }
+
+        remaining_count++;
+    }
+
+    // every remaining name is listed once, sorted if the directory is ordered
+    struct test_enum_state state = { 0, 0, 0, 0 };
+    if ((result = fif_enumdir(mount, dirname, test_enum_callback, &state)) != FIF_ERROR_SUCCESS || state.count != remaining_count || state.unexpected ||
+        (ordered && state.unordered))
+    {
+        printf("fif_enumdir(%s) failed: %i (%u of %u names)\n", dirname, result, state.count, remaining_count);
+        return -1;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static unsigned int count_test_files_with_attribute(fif_mount_handle mount, const char *dirname, unsigned int attribute)
+{
+    char path[64];
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < TEST_DIRECTORY_FILE_COUNT; i++)
+    {
+        fif_fileinfo fileinfo;
+        make_test_path(path, dirname, i);
+        if (fif_stat(mount, path, &fileinfo) == FIF_ERROR_SUCCESS && (fileinfo.attributes & attribute))
+            count++;
+    }
+
+    return count;
+}
+
+static unsigned int hashed_test_file_size(unsigned int index)
+{
+    return 100 + index;
+}
+
+static unsigned int ordered_test_file_size(unsigned int index)
+{
+    return 200 + index * 2;
+}
+
+static unsigned int fragmented_test_file_size(unsigned int index)
+{
+    return 6000 + index * 20;
+}
+
+static unsigned int small_test_file_size(unsigned int index)
+{
+    return 1 + (index % 60);
+}
+
+// counts what a mount asks of its io, and passes it on to the io underneath
+struct test_io_counts
+{
+    unsigned int reads;
+    unsigned int writes;
+    unsigned int seeks;
+    unsigned int zeros;
+    unsigned int truncates;
+    unsigned int preads;
+    unsigned int pwrites;
+    unsigned int copies;
+    unsigned int discards;
+    unsigned int batches;
+    unsigned int superblock_writes;
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    unsigned int last_read_count;
+    unsigned int largest_read_count;
+};
+
+struct test_counting_io
+{
+    fif_io inner;
+    struct test_io_counts counts;
+};
+
+static int test_io_read(fif_io_userdata userdata, void *buffer, unsigned int count)
+{
+    struct test_counting_io *counting_io = (struct test_counting_io *)userdata;
+    counting_io->counts.reads++;
+    counting_io->counts.read_bytes += count;
+    counting_io->counts.last_read_count = count;
+    if (count > counting_io->counts.largest_read_count)
+        counting_io->counts.largest_read_count = count;
+    return counting_io->inner.io_read(counting_io->inner.userdata, buffer, count);
+}
+
+static int test_io_write(fif_io_userdata userdata, const void *buffer, unsigned int count)
+{
+    struct test_counting_io *counting_io = (struct test_counting_io *)userdata;
+    counting_io->counts.writes++;
+    counting_io->counts.write_bytes += count;
+    return counting_io->inner.io_write(counting_io->inner.userdata, buffer, count);
+}
+
+static int64_t test_io_seek(fif_io_userdata userdata, fif_offset_t offset, enum FIF_SEEK_MODE mode)
+{
+    struct test_counting_io *counting_io = (struct test_counting_io *)userdata;
+    counting_io->counts.seeks++;
+    return counting_io->inner.io_seek(counting_io->inner.userdata, offset, mode);
+}
+
+static int test_io_zero(fif_io_userdata userdata, fif_offset_t offset, unsigned int count)
+{
+    struct test_counting_io *counting_io = (struct test_counting_io *)userdata;
+    counting_io->counts.zeros++;
+    return counting_io->inner.io_zero(counting_io->inner.userdata, offset, count);
+}
+
+static int test_io_ftruncate(fif_io_userdata userdata, fif_offset_t newsize)
+{
+    struct test_counting_io *counting_io = (struct test_counting_io *)userdata;
+    counting_io->counts.truncates++;
+    return counting_io->inner.io_ftruncate(counting_io->inner.userdata, newsize);
+}
+
+static int64_t test_io_filesize(fif_io_userdata userdata)
+{
+    struct test_counting_io *counting_io = (struct test_counting_io *)userdata;
+    return counting_io->inner.io_filesize(counting_io->inner.userdata);
+}
+
+static int test_io_pread(fif_io_userdata userdata, void *buffer, unsigned int count, fif_offset_t offset)
+{
+    struct test_counting_io *counting_io = (struct test_counting_io *)userdata;
+    counting_io->counts.preads++;
+    counting_io->counts.read_bytes += count;
+    counting_io->counts.last_read_count = count;
+    if (count > counting_io->counts.largest_read_count)
+        counting_io->counts.largest_read_count = count;
+    return counting_io->inner.io_pread(counting_io->inner.userdata, buffer, count, offset);
+}
+
+static int test_io_pwrite(fif_io_userdata userdata, const void *buffer, unsigned int count, fif_offset_t offset)
+{
+    struct test_counting_io *counting_io = (struct test_counting_io *)userdata;
+    counting_io->counts.pwrites++;
+    counting_io->counts.superblock_writes += (offset == 0) ? 1 : 0;
+    counting_io->counts.write_bytes += count;
+    return counting_io->inner.io_pwrite(counting_io->inner.userdata, buffer, count, offset);
+}
+
+static void *test_io_get_pointer(fif_io_userdata userdata, fif_offset_t offset, unsigned int count)
+{
+    struct test_counting_io *counting_io = (struct test_counting_io *)userdata;
+    return counting_io->inner.io_get_pointer(counting_io->inner.userdata, offset, count);
+}
+
+static int test_io_copy_range(fif_io_userdata userdata, fif_offset_t src_offset, fif_offset_t dst_offset, unsigned int count)
+{
+    struct test_counting_io *counting_io = (struct test_counting_io *)userdata;
+    counting_io->counts.copies++;
+    return counting_io->inner.io_copy_range(counting_io->inner.userdata, src_offset, dst_offset, count);
+}
+
+static int test_io_discard(fif_io_userdata userdata, fif_offset_t offset, unsigned int count)
+{
+    struct test_counting_io *counting_io = (struct test_counting_io *)userdata;
+    counting_io->counts.discards++;
+    return counting_io->inner.io_discard(counting_io->inner.userdata, offset, count);
+}
+
+static int test_io_submit_batch(fif_io_userdata userdata, const fif_io_batch_request *requests, unsigned int request_count)
+{
+    struct test_counting_io *counting_io = (struct test_counting_io *)userdata;
+    counting_io->counts.batches++;
+    for (unsigned int i = 0; i < request_count; i++)
+    {
+        if (requests[i].write)
+        {
+            counting_io->counts.superblock_writes += (requests[i].offset == 0) ? 1 : 0;
+            counting_io->counts.write_bytes += requests[i].count;
+        }
+        else
+            counting_io->counts.read_bytes += requests[i].count;
+    }
+
+    return counting_io->inner.io_submit_batch(counting_io->inner.userdata, requests, request_count);
+}
+
+// wraps inner in counting_io, the optional callbacks are only passed on if inner has them
+static void wrap_test_io(struct test_counting_io *counting_io, const fif_io *inner, fif_io *out_io)
+{
+    memcpy(&counting_io->inner, inner, sizeof(fif_io));
+    memset(&counting_io->counts, 0, sizeof(counting_io->counts));
+
+    fif_io_init(out_io);
+    out_io->io_read = test_io_read;
+    out_io->io_write = test_io_write;
+    out_io->io_seek = test_io_seek;
+    out_io->io_zero = test_io_zero;
+    out_io->io_ftruncate = test_io_ftruncate;
+    out_io->io_filesize = test_io_filesize;
+    out_io->userdata = (fif_io_userdata)counting_io;
+    out_io->io_pread = (inner->io_pread != NULL) ? test_io_pread : NULL;
+    out_io->io_pwrite = (inner->io_pwrite != NULL) ? test_io_pwrite : NULL;
+    out_io->io_get_pointer = (inner->io_get_pointer != NULL) ? test_io_get_pointer : NULL;
+    out_io->io_copy_range = (inner->io_copy_range != NULL) ? test_io_copy_range : NULL;
+    out_io->io_discard = (inner->io_discard != NULL) ? test_io_discard : NULL;
+    out_io->io_submit_batch = (inner->io_submit_batch != NULL) ? test_io_submit_batch : NULL;
+}
+
+static int create_counted_test_volume(struct test_counting_io *counting_io, fif_io *io, fif_mount_handle *mount, const fif_volume_options *volume_options, const fif_mount_options *mount_options)
+{
+    int result;
+    fif_io memory_io;
+    fif_io_open_memory(&memory_io);
+    wrap_test_io(counting_io, &memory_io, io);
+    if ((result = fif_create_volume(mount, io, NULL, volume_options, mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_create() failed: %i\n", result);
+        fif_io_close_memory(&memory_io);
+        return result;
+    }
+
+    memset(&counting_io->counts, 0, sizeof(counting_io->counts));
+    return FIF_ERROR_SUCCESS;
+}
+
+static void close_counted_test_volume(struct test_counting_io *counting_io, fif_mount_handle mount)
+{
+    fif_unmount_volume(mount);
+    fif_io_close_memory(&counting_io->inner);
+}
+
+static int test_positional_io(void)
+{
+    int result;
+    static unsigned char expected[65536], data[65536];
+    fill_test_file_data(expected, 1, sizeof(expected));
+
+    // the same volume without the positional callbacks, where every access has to seek first
+    for (int positional = 1; positional >= 0; positional--)
+    {
+        fif_volume_options volume_options;
+        fif_mount_options mount_options;
+        fif_set_default_volume_options(&volume_options);
+        fif_set_default_mount_options(&mount_options);
+
+        struct test_counting_io counting_io;
+        fif_io memory_io, io;
+        fif_mount_handle mount;
+        fif_io_open_memory(&memory_io);
+        wrap_test_io(&counting_io, &memory_io, &io);
+        if (!positional)
+        {
+            io.io_pread = NULL;
+            io.io_pwrite = NULL;
+        }
+
+        if ((result = fif_create_volume(&mount, &io, NULL, &volume_options, &mount_options)) != FIF_ERROR_SUCCESS ||
+            (result = fif_put_file_contents(mount, "positional.bin", expected, sizeof(expected))) != FIF_ERROR_SUCCESS ||
+            (result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS ||
+            (result = fif_get_file_contents(mount, "positional.bin", data, sizeof(data))) != (int)sizeof(data) || memcmp(data, expected, sizeof(data)) != 0)
+        {
+            printf("positional.bin round trip failed: %i\n", result);
+            return -1;
+        }
+        fif_unmount_volume(mount);
+        fif_io_close_memory(&memory_io);
+
+        if ((positional && (counting_io.counts.seeks != 0 || counting_io.counts.preads == 0 || counting_io.counts.pwrites == 0)) ||
+            (!positional && (counting_io.counts.seeks == 0 || counting_io.counts.preads != 0 || counting_io.counts.pwrites != 0)))
+        {
+            printf("%s volume made %u seeks, %u preads and %u pwrites\n", (positional) ? "positional" : "seeking", counting_io.counts.seeks, counting_io.counts.preads, counting_io.counts.pwrites);
+            return -1;
+        }
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_block_cache(void)
+{
+    int result;
+    static unsigned char expected[4096], data[4096];
+    fill_test_file_data(expected, 2, sizeof(expected));
+
+    // with the inode and path caches off, every stat reads the inode table blocks again, unless the block cache holds them.
+    // directory contents are file data, which is read around the cache, so those reads happen either way.
+    unsigned int repeat_reads[2];
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+        fif_volume_options volume_options;
+        fif_mount_options mount_options;
+        fif_set_default_volume_options(&volume_options);
+        fif_set_default_mount_options(&mount_options);
+        mount_options.block_cache_size = (pass == 0) ? 64 : 0;
+        mount_options.inode_cache_size = 0;
+        mount_options.dentry_cache_size = 0;
+
+        struct test_counting_io counting_io;
+        fif_io io;
+        fif_mount_handle mount;
+        if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+            return -1;
+        if ((result = fif_mkdir(mount, "cached")) != FIF_ERROR_SUCCESS ||
+            (result = fif_put_file_contents(mount, "cached/file.bin", expected, sizeof(expected))) != FIF_ERROR_SUCCESS ||
+            (result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS)
+        {
+            printf("cached/file.bin setup failed: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+
+        // the first stat fills the cache, the rest are counted
+        unsigned int first_reads = 0;
+        for (unsigned int i = 0; i < 17; i++)
+        {
+            fif_fileinfo fileinfo;
+            if ((result = fif_stat(mount, "cached/file.bin", &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.size != sizeof(expected))
+            {
+                printf("fif_stat(cached/file.bin) failed: %i\n", result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+            if (i == 0)
+                first_reads = counting_io.counts.preads;
+        }
+
+        repeat_reads[pass] = counting_io.counts.preads - first_reads;
+        result = fif_get_file_contents(mount, "cached/file.bin", data, sizeof(data));
+        close_counted_test_volume(&counting_io, mount);
+        if (result != (int)sizeof(data) || memcmp(data, expected, sizeof(data)) != 0)
+        {
+            printf("cached/file.bin contents are wrong: %i\n", result);
+            return -1;
+        }
+    }
+
+    if (repeat_reads[0] >= repeat_reads[1])
+    {
+        printf("repeated stats made %u reads with a block cache, %u without\n", repeat_reads[0], repeat_reads[1]);
+        return -1;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_mapped_io(void)
+{
+    int result;
+    static unsigned char expected[65536], data[65536];
+    fill_test_file_data(expected, 3, sizeof(expected));
+
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+
+    fif_io mapped_io, io;
+    struct test_counting_io counting_io;
+    if ((result = fif_io_open_mapped_file("mapped.fif", FIF_OPEN_MODE_CREATE | FIF_OPEN_MODE_READ | FIF_OPEN_MODE_WRITE | FIF_OPEN_MODE_TRUNCATE, &mapped_io)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_io_open_mapped_file() failed: %i\n", result);
+        return -1;
+    }
+
+    wrap_test_io(&counting_io, &mapped_io, &io);
+    fif_mount_handle mount;
+    if ((result = fif_create_volume(&mount, &io, NULL, &volume_options, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_create() failed: %i\n", result);
+        fif_io_close_mapped_file(&mapped_io);
+        return -1;
+    }
+    if ((result = fif_put_file_contents(mount, "mapped.bin", expected, sizeof(expected))) != FIF_ERROR_SUCCESS ||
+        (result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("mapped.bin setup failed: %i\n", result);
+        fif_unmount_volume(mount);
+        fif_io_close_mapped_file(&mapped_io);
+        return -1;
+    }
+
+    // with no block cache in the way, file data is copied straight out of the mapping, only small metadata reads reach the io
+    memset(&counting_io.counts, 0, sizeof(counting_io.counts));
+    result = fif_get_file_contents(mount, "mapped.bin", data, sizeof(data));
+    unsigned long long read_bytes = counting_io.counts.read_bytes;
+    fif_unmount_volume(mount);
+    fif_io_close_mapped_file(&mapped_io);
+    if (result != (int)sizeof(data) || memcmp(data, expected, sizeof(data)) != 0)
+    {
+        printf("mapped.bin contents are wrong: %i\n", result);
+        return -1;
+    }
+    if (read_bytes >= sizeof(data))
+    {
+        printf("reading mapped.bin read %llu bytes through the io\n", read_bytes);
+        return -1;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_coalesced_io(void)
+{
+    int result;
+    static unsigned char expected[65536], data[65536];
+    fill_test_file_data(expected, 4, sizeof(expected));
+
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+
+    struct test_counting_io counting_io;
+    fif_io io;
+    fif_mount_handle mount;
+    if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+
+    // the file's blocks are contiguous, so its data goes out and comes back in a handful of calls rather than one per block
+    unsigned int block_count = sizeof(expected) / volume_options.block_size;
+    result = fif_put_file_contents(mount, "coalesced.bin", expected, sizeof(expected));
+    unsigned int writes = counting_io.counts.pwrites;
+    if (result != FIF_ERROR_SUCCESS || (result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("coalesced.bin setup failed: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    memset(&counting_io.counts, 0, sizeof(counting_io.counts));
+    result = fif_get_file_contents(mount, "coalesced.bin", data, sizeof(data));
+    unsigned int reads = counting_io.counts.preads;
+    close_counted_test_volume(&counting_io, mount);
+    if (result != (int)sizeof(data) || memcmp(data, expected, sizeof(data)) != 0)
+    {
+        printf("coalesced.bin contents are wrong: %i\n", result);
+        return -1;
+    }
+    if (writes >= block_count / 4 || reads >= block_count / 4)
+    {
+        printf("%u blocks took %u writes and %u reads\n", block_count, writes, reads);
+        return -1;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_copy_range(void)
+{
+    int result;
+    static unsigned char expected[16384], data[16384];
+    fill_test_file_data(expected, 5, sizeof(expected));
+
+    // a file with no room to grow in place and fragments turned off has to move, which copies its blocks within the volume
+    for (int copy_range = 1; copy_range >= 0; copy_range--)
+    {
+        fif_volume_options volume_options;
+        fif_mount_options mount_options;
+        fif_set_default_volume_options(&volume_options);
+        fif_set_default_mount_options(&mount_options);
+        mount_options.fragmentation_threshold = 0;
+
+        struct test_counting_io counting_io;
+        fif_io memory_io, io;
+        fif_mount_handle mount;
+        fif_io_open_memory(&memory_io);
+        wrap_test_io(&counting_io, &memory_io, &io);
+        if (!copy_range)
+            io.io_copy_range = NULL;
+
+        fif_file_handle file;
+        if ((result = fif_create_volume(&mount, &io, NULL, &volume_options, &mount_options)) != FIF_ERROR_SUCCESS ||
+            (result = fif_put_file_contents(mount, "moved.bin", expected, 8192)) != FIF_ERROR_SUCCESS ||
+            (result = fif_put_file_contents(mount, "after.bin", expected, 100)) != FIF_ERROR_SUCCESS ||
+            (result = fif_open(mount, "moved.bin", FIF_OPEN_MODE_WRITE, &file)) != FIF_ERROR_SUCCESS)
+        {
+            printf("moved.bin setup failed: %i\n", result);
+            fif_unmount_volume(mount);
+            fif_io_close_memory(&memory_io);
+            return -1;
+        }
+        if (fif_seek(mount, file, 0, FIF_SEEK_MODE_END) != 8192 || (result = fif_write(mount, file, expected + 8192, 8192)) != 8192 ||
+            (result = fif_close(mount, file)) != FIF_ERROR_SUCCESS ||
+            (result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS ||
+            (result = fif_get_file_contents(mount, "moved.bin", data, sizeof(data))) != (int)sizeof(data) || memcmp(data, expected, sizeof(data)) != 0)
+        {
+            printf("moved.bin contents are wrong: %i\n", result);
+            fif_unmount_volume(mount);
+            fif_io_close_memory(&memory_io);
+            return -1;
+        }
+        fif_unmount_volume(mount);
+        fif_io_close_memory(&memory_io);
+
+        if ((copy_range && counting_io.counts.copies == 0) || (!copy_range && counting_io.counts.copies != 0))
+        {
+            printf("moving moved.bin made %u range copies\n", counting_io.counts.copies);
+            return -1;
+        }
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_discard(void)
+{
+    int result;
+    static unsigned char expected[16384], data[16384];
+    fill_test_file_data(expected, 6, sizeof(expected));
+
+    // freed blocks are cleared by discarding them when the io can, and only written with zeros when it can't
+    for (int discard = 1; discard >= 0; discard--)
+    {
+        fif_volume_options volume_options;
+        fif_mount_options mount_options;
+        fif_set_default_volume_options(&volume_options);
+        fif_set_default_mount_options(&mount_options);
+
+        struct test_counting_io counting_io;
+        fif_io memory_io, io;
+        fif_mount_handle mount;
+        fif_io_open_memory(&memory_io);
+        wrap_test_io(&counting_io, &memory_io, &io);
+        if (!discard)
+            io.io_discard = NULL;
+
+        if ((result = fif_create_volume(&mount, &io, NULL, &volume_options, &mount_options)) != FIF_ERROR_SUCCESS ||
+            (result = fif_put_file_contents(mount, "discarded.bin", expected, sizeof(expected))) != FIF_ERROR_SUCCESS ||
+            (result = fif_put_file_contents(mount, "kept.bin", expected, sizeof(expected))) != FIF_ERROR_SUCCESS)
+        {
+            printf("discarded.bin setup failed: %i\n", result);
+            fif_unmount_volume(mount);
+            fif_io_close_memory(&memory_io);
+            return -1;
+        }
+
+        memset(&counting_io.counts, 0, sizeof(counting_io.counts));
+        if ((result = fif_unlink(mount, "discarded.bin")) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_unlink(discarded.bin) failed: %i\n", result);
+            fif_unmount_volume(mount);
+            fif_io_close_memory(&memory_io);
+            return -1;
+        }
+
+        struct test_io_counts counts = counting_io.counts;
+        result = fif_get_file_contents(mount, "kept.bin", data, sizeof(data));
+        fif_unmount_volume(mount);
+        fif_io_close_memory(&memory_io);
+        if (result != (int)sizeof(data) || memcmp(data, expected, sizeof(data)) != 0)
+        {
+            printf("kept.bin contents are wrong: %i\n", result);
+            return -1;
+        }
+        if ((discard && (counts.discards == 0 || counts.zeros != 0)) || (!discard && (counts.discards != 0 || counts.zeros == 0)))
+        {
+            printf("freeing discarded.bin made %u discards and %u zero writes\n", counts.discards, counts.zeros);
+            return -1;
+        }
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_uring_io(void)
+{
+    int result;
+    static unsigned char expected[1048576], data[1048576];
+    fill_test_file_data(expected, 7, sizeof(expected));
+
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+
+    // the backend only exists on linux kernels with io_uring, anywhere else there's nothing to test
+    fif_io uring_io, io;
+    struct test_counting_io counting_io;
+    if ((result = fif_io_open_uring_file("uring.fif", FIF_OPEN_MODE_CREATE | FIF_OPEN_MODE_READ | FIF_OPEN_MODE_WRITE | FIF_OPEN_MODE_TRUNCATE, &uring_io)) != FIF_ERROR_SUCCESS)
+    {
+        printf("io_uring is not available (%i), skipping\n", result);
+        return FIF_ERROR_SUCCESS;
+    }
+
+    wrap_test_io(&counting_io, &uring_io, &io);
+    fif_mount_handle mount;
+    if ((result = fif_create_volume(&mount, &io, NULL, &volume_options, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_create() failed: %i\n", result);
+        fif_io_close_uring_file(&uring_io);
+        return -1;
+    }
+    if ((result = fif_put_file_contents(mount, "uring.bin", expected, sizeof(expected))) != FIF_ERROR_SUCCESS ||
+        (result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("uring.bin setup failed: %i\n", result);
+        fif_unmount_volume(mount);
+        fif_io_close_uring_file(&uring_io);
+        return -1;
+    }
+
+    // a run this long is split into several requests handed to the ring at once
+    memset(&counting_io.counts, 0, sizeof(counting_io.counts));
+    result = fif_get_file_contents(mount, "uring.bin", data, sizeof(data));
+    unsigned int batches = counting_io.counts.batches;
+    fif_unmount_volume(mount);
+    fif_io_close_uring_file(&uring_io);
+    if (result != (int)sizeof(data) || memcmp(data, expected, sizeof(data)) != 0)
+    {
+        printf("uring.bin contents are wrong: %i\n", result);
+        return -1;
+    }
+    if (batches == 0)
+    {
+        printf("reading uring.bin submitted no batches\n");
+        return -1;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_readahead(void)
+{
+    int result;
+    static unsigned char expected[262144];
+    unsigned char data[512];
+    fill_test_file_data(expected, 8, sizeof(expected));
+
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+    mount_options.max_readahead_size = 65536;
+
+    struct test_counting_io counting_io;
+    fif_io io;
+    fif_mount_handle mount;
+    if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+
+    fif_file_handle file;
+    if ((result = fif_put_file_contents(mount, "readahead.bin", expected, sizeof(expected))) != FIF_ERROR_SUCCESS ||
+        (result = fif_open(mount, "readahead.bin", FIF_OPEN_MODE_READ, &file)) != FIF_ERROR_SUCCESS)
+    {
+        printf("readahead.bin setup failed: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    // a sequential reader's window doubles from a block up to max_readahead_size, so small reads turn into a few large ones
+    memset(&counting_io.counts, 0, sizeof(counting_io.counts));
+    for (unsigned int offset = 0; offset < sizeof(expected); offset += sizeof(data))
+    {
+        if ((result = fif_read(mount, file, data, sizeof(data))) != (int)sizeof(data) || memcmp(data, expected + offset, sizeof(data)) != 0)
+        {
+            printf("sequential read of readahead.bin at %u failed: %i\n", offset, result);
+            fif_close(mount, file);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+    }
+
+    unsigned int sequential_reads = counting_io.counts.preads;
+    unsigned int largest_window = counting_io.counts.largest_read_count;
+    if (sequential_reads > 16 || largest_window != mount_options.max_readahead_size)
+    {
+        printf("reading readahead.bin took %u reads, the largest %u bytes\n", sequential_reads, largest_window);
+        fif_close(mount, file);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    // a seek elsewhere drops the window back to a block, and reading on past it doubles it again
+    unsigned int windows[2] = { 0, 0 };
+    const unsigned int seek_offset = 4096;
+    if (fif_seek(mount, file, seek_offset, FIF_SEEK_MODE_SET) != (fif_offset_t)seek_offset)
+    {
+        printf("fif_seek() in readahead.bin failed\n");
+        fif_close(mount, file);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    for (unsigned int offset = seek_offset; offset < seek_offset + volume_options.block_size * 2; offset += sizeof(data))
+    {
+        if ((result = fif_read(mount, file, data, sizeof(data))) != (int)sizeof(data) || memcmp(data, expected + offset, sizeof(data)) != 0)
+        {
+            printf("read of readahead.bin at %u failed: %i\n", offset, result);
+            fif_close(mount, file);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+
+        windows[(offset - seek_offset) / volume_options.block_size] = counting_io.counts.last_read_count;
+    }
+
+    fif_close(mount, file);
+    close_counted_test_volume(&counting_io, mount);
+    if (windows[0] != volume_options.block_size || windows[1] != volume_options.block_size * 2)
+    {
+        printf("read-ahead after a seek read %u then %u bytes\n", windows[0], windows[1]);
+        return -1;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_direct_io(void)
+{
+    int result;
+    static unsigned char expected[40000], data[40000];
+    fill_test_file_data(expected, 9, sizeof(expected));
+
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+
+    // O_DIRECT isn't supported by every filesystem, so a backend that can't be opened is skipped
+    fif_io direct_io, io;
+    struct test_counting_io counting_io;
+    if ((result = fif_io_open_direct_file("direct.fif", FIF_OPEN_MODE_CREATE | FIF_OPEN_MODE_READ | FIF_OPEN_MODE_WRITE | FIF_OPEN_MODE_TRUNCATE, &direct_io)) != FIF_ERROR_SUCCESS)
+    {
+        printf("O_DIRECT is not available (%i), skipping\n", result);
+        return FIF_ERROR_SUCCESS;
+    }
+
+    wrap_test_io(&counting_io, &direct_io, &io);
+    fif_mount_handle mount;
+    if ((result = fif_create_volume(&mount, &io, NULL, &volume_options, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_create() failed: %i\n", result);
+        fif_io_close_direct_file(&direct_io);
+        return -1;
+    }
+
+    // unbuffered handles write each call straight through, in pieces that line up with neither the blocks nor the backend's alignment
+    fif_file_handle file;
+    if ((result = fif_open(mount, "direct.bin", FIF_OPEN_MODE_CREATE | FIF_OPEN_MODE_WRITE | FIF_OPEN_MODE_DIRECT, &file)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_open(direct.bin) failed: %i\n", result);
+        fif_unmount_volume(mount);
+        fif_io_close_direct_file(&direct_io);
+        return -1;
+    }
+    for (unsigned int offset = 0; offset < sizeof(expected) && result >= 0; offset += 3001)
+    {
+        unsigned int count = ((sizeof(expected) - offset) < 3001) ? (sizeof(expected) - offset) : 3001;
+        if ((result = fif_write(mount, file, expected + offset, count)) != (int)count)
+            result = -1;
+    }
+    if (result < 0 || (result = fif_close(mount, file)) != FIF_ERROR_SUCCESS ||
+        (result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS ||
+        (result = fif_open(mount, "direct.bin", FIF_OPEN_MODE_READ | FIF_OPEN_MODE_DIRECT, &file)) != FIF_ERROR_SUCCESS)
+    {
+        printf("writing direct.bin failed: %i\n", result);
+        fif_unmount_volume(mount);
+        fif_io_close_direct_file(&direct_io);
+        return -1;
+    }
+
+    // and read each call from the volume, even when the same bytes were just read
+    memset(&counting_io.counts, 0, sizeof(counting_io.counts));
+    for (unsigned int pass = 0; pass < 2 && result >= 0; pass++)
+    {
+        if (fif_seek(mount, file, 777, FIF_SEEK_MODE_SET) != 777 || (result = fif_read(mount, file, data, 100)) != 100 || memcmp(data, expected + 777, 100) != 0)
+            result = -1;
+    }
+    unsigned int reads = counting_io.counts.reads + counting_io.counts.preads;
+    if (result >= 0 && (fif_seek(mount, file, 0, FIF_SEEK_MODE_SET) != 0 || (result = fif_read(mount, file, data, sizeof(data))) != (int)sizeof(data) || memcmp(data, expected, sizeof(data)) != 0))
+        result = -1;
+
+    fif_close(mount, file);
+    fif_unmount_volume(mount);
+    fif_io_close_direct_file(&direct_io);
+    if (result < 0)
+    {
+        printf("direct.bin contents are wrong: %i\n", result);
+        return -1;
+    }
+    if (reads != 2)
+    {
+        printf("two unbuffered reads of direct.bin made %u io reads\n", reads);
+        return -1;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_read_view(void)
+{
+    int result;
+    static unsigned char expected[8192];
+    fill_test_file_data(expected, 10, sizeof(expected));
+
+    // views point into the block cache when there is one, and are private copies when there isn't
+    for (unsigned int block_cache_size = 64; ; block_cache_size = 0)
+    {
+        fif_volume_options volume_options;
+        fif_mount_options mount_options;
+        fif_set_default_volume_options(&volume_options);
+        fif_set_default_mount_options(&mount_options);
+        mount_options.block_cache_size = block_cache_size;
+
+        struct test_counting_io counting_io;
+        fif_io io;
+        fif_mount_handle mount;
+        if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+            return -1;
+
+        fif_file_handle file;
+        if ((result = fif_put_file_contents(mount, "view.bin", expected, sizeof(expected))) != FIF_ERROR_SUCCESS ||
+            (result = fif_open(mount, "view.bin", FIF_OPEN_MODE_READ, &file)) != FIF_ERROR_SUCCESS)
+        {
+            printf("view.bin setup failed: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+
+        // the same range twice, the second comes out of the cache without touching the volume
+        const void *pointers[2];
+        unsigned int counts[2];
+        unsigned int repeat_reads = 0;
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            if (i == 1)
+                repeat_reads = counting_io.counts.preads;
+            if ((result = fif_read_view(mount, file, 1500, 500, &pointers[i], &counts[i])) != FIF_ERROR_SUCCESS ||
+                counts[i] == 0 || counts[i] > 500 || memcmp(pointers[i], expected + 1500, counts[i]) != 0)
+            {
+                printf("fif_read_view(view.bin) failed: %i\n", result);
+                fif_close(mount, file);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+        repeat_reads = counting_io.counts.preads - repeat_reads;
+
+        // the views don't move the file pointer, each is released once, and there's nothing to see past the end
+        const void *end_pointer;
+        unsigned int end_count;
+        unsigned char data[16];
+        if (fif_tell(mount, file) != 0 || (result = fif_read(mount, file, data, sizeof(data))) != (int)sizeof(data) || memcmp(data, expected, sizeof(data)) != 0 ||
+            fif_release_view(mount, file, pointers[1]) != FIF_ERROR_SUCCESS || fif_release_view(mount, file, pointers[0]) != FIF_ERROR_SUCCESS ||
+            fif_release_view(mount, file, pointers[0]) == FIF_ERROR_SUCCESS ||
+            fif_read_view(mount, file, sizeof(expected), 100, &end_pointer, &end_count) != FIF_ERROR_SUCCESS || end_count != 0)
+        {
+            printf("view.bin views with a block cache of %u are wrong\n", block_cache_size);
+            fif_close(mount, file);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+
+        fif_close(mount, file);
+        close_counted_test_volume(&counting_io, mount);
+        if ((block_cache_size > 0 && repeat_reads != 0) || (block_cache_size == 0 && repeat_reads == 0))
+        {
+            printf("repeating a view with a block cache of %u made %u reads\n", block_cache_size, repeat_reads);
+            return -1;
+        }
+
+        if (block_cache_size == 0)
+            break;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_inode_table_index(void)
+{
+    int result;
+    char path[64];
+    unsigned char data[8];
+
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+    volume_options.inode_table_count = 1;
+    mount_options.inode_cache_size = 0;
+    mount_options.dentry_cache_size = 0;
+
+    struct test_counting_io counting_io;
+    fif_io io;
+    fif_mount_handle mount;
+    if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+
+    // enough files that the volume chains on a table after table for them
+    if ((result = fif_mkdir(mount, "inodes")) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_mkdir(inodes) failed: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    for (unsigned int i = 0; i < 300; i++)
+    {
+        make_test_path(path, "inodes", i);
+        fill_test_file_data(data, i, sizeof(data));
+        if ((result = fif_put_file_contents(mount, path, data, sizeof(data))) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_put_file_contents(%s) failed: %i\n", path, result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+    }
+    if ((result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    // finding the last file's inode costs about the same as the first's, rather than a read per table before it
+    unsigned int reads[2];
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        fif_fileinfo fileinfo;
+        make_test_path(path, "inodes", (i == 0) ? 0 : 299);
+        unsigned int start_reads = counting_io.counts.preads;
+        if ((result = fif_stat(mount, path, &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.size != sizeof(data))
+        {
+            printf("fif_stat(%s) failed: %i\n", path, result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+
+        reads[i] = counting_io.counts.preads - start_reads;
+    }
+
+    close_counted_test_volume(&counting_io, mount);
+
+    // the two directory lookups can differ by a read or so, walking the chain would add one for each of the ~18 tables in between
+    if (reads[1] > reads[0] + 4)
+    {
+        printf("stat of the first file made %u reads, the last %u\n", reads[0], reads[1]);
+        return -1;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_inode_cache(void)
+{
+    int result;
+    char path[64];
+    static unsigned char expected[2048], data[2048];
+
+    // a closed file's inode stays cached, so stat-ing it again reads less than with the cache off
+    unsigned int repeat_reads[2];
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+        fif_volume_options volume_options;
+        fif_mount_options mount_options;
+        fif_set_default_volume_options(&volume_options);
+        fif_set_default_mount_options(&mount_options);
+        mount_options.inode_cache_size = (pass == 0) ? 16 : 0;
+        mount_options.dentry_cache_size = 0;
+
+        struct test_counting_io counting_io;
+        fif_io io;
+        fif_mount_handle mount;
+        if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+            return -1;
+
+        fif_fileinfo fileinfo;
+        fill_test_file_data(expected, 12, sizeof(expected));
+        if ((result = fif_put_file_contents(mount, "inode.bin", expected, sizeof(expected))) != FIF_ERROR_SUCCESS ||
+            (result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS ||
+            (result = fif_stat(mount, "inode.bin", &fileinfo)) != FIF_ERROR_SUCCESS)
+        {
+            printf("inode.bin setup failed: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+
+        unsigned int start_reads = counting_io.counts.preads;
+        result = fif_stat(mount, "inode.bin", &fileinfo);
+        repeat_reads[pass] = counting_io.counts.preads - start_reads;
+        if (result != FIF_ERROR_SUCCESS || fileinfo.size != sizeof(expected))
+        {
+            printf("fif_stat(inode.bin) failed: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+
+        // readers share the one cached inode, which counts them, so a writer is turned away until the last one closes
+        fif_file_handle readers[2], writer;
+        if (pass == 0)
+        {
+            fif_fileinfo reader_fileinfo;
+            if ((result = fif_open(mount, "inode.bin", FIF_OPEN_MODE_READ, &readers[0])) != FIF_ERROR_SUCCESS ||
+                (result = fif_open(mount, "inode.bin", FIF_OPEN_MODE_READ, &readers[1])) != FIF_ERROR_SUCCESS ||
+                fif_open(mount, "inode.bin", FIF_OPEN_MODE_WRITE, &writer) != FIF_ERROR_SHARING_VIOLATION ||
+                (result = fif_close(mount, readers[0])) != FIF_ERROR_SUCCESS ||
+                (result = fif_fstat(mount, readers[1], &reader_fileinfo)) != FIF_ERROR_SUCCESS || reader_fileinfo.size != sizeof(expected) ||
+                fif_open(mount, "inode.bin", FIF_OPEN_MODE_WRITE, &writer) != FIF_ERROR_SHARING_VIOLATION ||
+                (result = fif_close(mount, readers[1])) != FIF_ERROR_SUCCESS ||
+                (result = fif_open(mount, "inode.bin", FIF_OPEN_MODE_WRITE, &writer)) != FIF_ERROR_SUCCESS ||
+                (result = fif_close(mount, writer)) != FIF_ERROR_SUCCESS)
+            {
+                printf("sharing inode.bin between handles failed: %i\n", result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+
+        close_counted_test_volume(&counting_io, mount);
+    }
+
+    if (repeat_reads[0] >= repeat_reads[1])
+    {
+        printf("repeated stat made %u reads with an inode cache, %u without\n", repeat_reads[0], repeat_reads[1]);
+        return -1;
+    }
+
+    // changed inodes pushed out of a small cache are written back, and all of them survive a remount
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+    mount_options.inode_cache_size = 2;
+
+    struct test_counting_io counting_io;
+    fif_io io;
+    fif_mount_handle mount;
+    if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+    if ((result = fif_mkdir(mount, "evicted")) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_mkdir(evicted) failed: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+        for (unsigned int i = 0; i < 20; i++)
+        {
+            unsigned int size = (pass == 0) ? 100 : (1000 + i * 50);
+            make_test_path(path, "evicted", i);
+            fill_test_file_data(expected, i + pass, size);
+            if ((result = fif_put_file_contents(mount, path, expected, size)) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_put_file_contents(%s) failed: %i\n", path, result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+    }
+    if ((result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    for (unsigned int i = 0; i < 20; i++)
+    {
+        unsigned int size = 1000 + i * 50;
+        make_test_path(path, "evicted", i);
+        fill_test_file_data(expected, i + 1, size);
+        if ((result = fif_get_file_contents(mount, path, data, sizeof(data))) != (int)size || memcmp(data, expected, size) != 0)
+        {
+            printf("%s contents are wrong: %i\n", path, result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+    }
+
+    close_counted_test_volume(&counting_io, mount);
+    return FIF_ERROR_SUCCESS;
+}
+
+// a hashed directory is a 28 byte header, a 4 byte offset per bucket, then 16 bytes plus the name for each entry ever added until it's compacted
+#define TEST_HASHED_DIRECTORY_SIZE(hash_table_size, entry_count) (28 + (hash_table_size) * 4 + (entry_count) * (16 + 7))
+
+static int test_hashed_directory(fif_io *io)
+{
+    int result;
+    char path[64];
+    static unsigned char expected[TEST_FILE_MAX_SIZE], data[TEST_FILE_MAX_SIZE];
+
+    // a small table so the bucket chains get long
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+    volume_options.hash_table_size = 16;
+
+    fif_mount_handle mount;
+    if (create_test_volume(io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+    if (fill_test_directory(mount, "hashed", hashed_test_file_size, TEST_FILE_MAX_SIZE) != FIF_ERROR_SUCCESS ||
+        check_test_directory(mount, "hashed", hashed_test_file_size, 0) != FIF_ERROR_SUCCESS ||
+        remount_test_volume(io, &mount, &mount_options) != FIF_ERROR_SUCCESS ||
+        check_test_directory(mount, "hashed", hashed_test_file_size, 0) != FIF_ERROR_SUCCESS)
+    {
+        fif_unmount_volume(mount);
+        return -1;
+    }
+
+    // the directory is laid out hashed (a linear one would be 20 bytes plus 15 per entry), with the removed third still in place
+    fif_fileinfo fileinfo;
+    if ((result = fif_stat(mount, "hashed", &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.size != TEST_HASHED_DIRECTORY_SIZE(16, TEST_DIRECTORY_FILE_COUNT))
+    {
+        printf("hashed directory is %u bytes, expected %u: %i\n", fileinfo.size, TEST_HASHED_DIRECTORY_SIZE(16, TEST_DIRECTORY_FILE_COUNT), result);
+        fif_unmount_volume(mount);
+        return -1;
+    }
+
+    // removing another third takes the dead entries past half the directory, which compacts it
+    for (unsigned int i = 1; i < TEST_DIRECTORY_FILE_COUNT; i += 3)
+    {
+        make_test_path(path, "hashed", i);
+        if ((result = fif_unlink(mount, path)) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_unlink(%s) failed: %i\n", path, result);
+            fif_unmount_volume(mount);
+            return -1;
+        }
+    }
+    if ((result = fif_stat(mount, "hashed", &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.size >= TEST_HASHED_DIRECTORY_SIZE(16, TEST_DIRECTORY_FILE_COUNT))
+    {
+        printf("hashed directory wasn't compacted, it's %u bytes: %i\n", fileinfo.size, result);
+        fif_unmount_volume(mount);
+        return -1;
+    }
+
+    // and the relinked chains still find every remaining file, and none of the removed ones, before and after a remount
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1 && remount_test_volume(io, &mount, &mount_options) != FIF_ERROR_SUCCESS)
+        {
+            fif_unmount_volume(mount);
+            return -1;
+        }
+
+        unsigned int remaining_count = 0;
+        for (unsigned int i = 0; i < TEST_DIRECTORY_FILE_COUNT; i++)
+        {
+            make_test_path(path, "hashed", i);
+            if ((i % 3) != 2)
+            {
+                if ((result = fif_stat(mount, path, &fileinfo)) != FIF_ERROR_FILE_NOT_FOUND)
+                {
+                    printf("removed file %s was found after compaction: %i\n", path, result);
+                    fif_unmount_volume(mount);
+                    return -1;
+                }
+
+                continue;
+            }
+
+            unsigned int size = hashed_test_file_size(i);
+            fill_test_file_data(expected, i, size);
+            if ((result = fif_get_file_contents(mount, path, data, sizeof(data))) != (int)size || memcmp(data, expected, size) != 0)
+            {
+                printf("%s contents are wrong after compaction: %i\n", path, result);
+                fif_unmount_volume(mount);
+                return -1;
+            }
+
+            remaining_count++;
+        }
+
+        struct test_enum_state state = { 0, 0, 0, 0 };
+        if ((result = fif_enumdir(mount, "hashed", test_enum_callback, &state)) != FIF_ERROR_SUCCESS || state.count != remaining_count || state.unexpected)
+        {
+            printf("fif_enumdir(hashed) after compaction failed: %i (%u of %u names)\n", result, state.count, remaining_count);
+            fif_unmount_volume(mount);
+            return -1;
+        }
+    }
+
+    fif_unmount_volume(mount);
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_dentry_cache(void)
+{
+    int result;
+    static const char *const directories[] = { "a", "a/b", "a/b/c", "a/b/c/d" };
+    static unsigned char expected[512], data[512];
+
+    // a path that's been looked up resolves again without reading any of its directories, or a missing name's
+    unsigned int repeat_reads[2];
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+        fif_volume_options volume_options;
+        fif_mount_options mount_options;
+        fif_set_default_volume_options(&volume_options);
+        fif_set_default_mount_options(&mount_options);
+        mount_options.dentry_cache_size = (pass == 0) ? 64 : 0;
+
+        struct test_counting_io counting_io;
+        fif_io io;
+        fif_mount_handle mount;
+        if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+            return -1;
+
+        fif_fileinfo fileinfo;
+        for (unsigned int i = 0; i < sizeof(directories) / sizeof(directories[0]); i++)
+        {
+            if ((result = fif_mkdir(mount, directories[i])) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_mkdir(%s) failed: %i\n", directories[i], result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+        fill_test_file_data(expected, 14, sizeof(expected));
+        if ((result = fif_put_file_contents(mount, "a/b/c/d/deep.bin", expected, sizeof(expected))) != FIF_ERROR_SUCCESS ||
+            (result = fif_stat(mount, "a/b/c/d/deep.bin", &fileinfo)) != FIF_ERROR_SUCCESS ||
+            (result = fif_stat(mount, "a/b/c/missing.bin", &fileinfo)) != FIF_ERROR_FILE_NOT_FOUND)
+        {
+            printf("a/b/c/d/deep.bin setup failed: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+
+        unsigned int start_reads = counting_io.counts.reads + counting_io.counts.preads;
+        if ((result = fif_stat(mount, "a/b/c/d/deep.bin", &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.size != sizeof(expected) ||
+            (result = fif_stat(mount, "A/B/C/D/DEEP.BIN", &fileinfo)) != FIF_ERROR_SUCCESS ||
+            (result = fif_stat(mount, "a/b/c/missing.bin", &fileinfo)) != FIF_ERROR_FILE_NOT_FOUND)
+        {
+            printf("repeated stat failed: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+        repeat_reads[pass] = counting_io.counts.reads + counting_io.counts.preads - start_reads;
+
+        close_counted_test_volume(&counting_io, mount);
+    }
+
+    if (repeat_reads[0] != 0 || repeat_reads[1] == 0)
+    {
+        printf("repeated stat made %u reads with a dentry cache, %u without\n", repeat_reads[0], repeat_reads[1]);
+        return -1;
+    }
+
+    // creating, unlinking and removing directories replace the cached answers, negative ones included
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+
+    struct test_counting_io counting_io;
+    fif_io io;
+    fif_mount_handle mount;
+    if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+
+    fif_fileinfo fileinfo;
+    for (unsigned int i = 0; i < sizeof(directories) / sizeof(directories[0]); i++)
+    {
+        if ((result = fif_mkdir(mount, directories[i])) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_mkdir(%s) failed: %i\n", directories[i], result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+    }
+    fill_test_file_data(expected, 15, sizeof(expected));
+    if ((result = fif_stat(mount, "a/b/c/d/late.bin", &fileinfo)) != FIF_ERROR_FILE_NOT_FOUND ||
+        (result = fif_put_file_contents(mount, "a/b/c/d/late.bin", expected, 100)) != FIF_ERROR_SUCCESS ||
+        (result = fif_stat(mount, "a/b/c/d/late.bin", &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.size != 100)
+    {
+        printf("a missing name wasn't found once created: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    if ((result = fif_unlink(mount, "a/b/c/d/late.bin")) != FIF_ERROR_SUCCESS ||
+        (result = fif_stat(mount, "a/b/c/d/late.bin", &fileinfo)) != FIF_ERROR_FILE_NOT_FOUND ||
+        (result = fif_put_file_contents(mount, "a/b/c/d/late.bin", expected, sizeof(expected))) != FIF_ERROR_SUCCESS ||
+        (result = fif_get_file_contents(mount, "a/b/c/d/late.bin", data, sizeof(data))) != (int)sizeof(expected) ||
+        memcmp(data, expected, sizeof(expected)) != 0)
+    {
+        printf("an unlinked name was still found, or its replacement wasn't: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    // a removed directory's names go with it, even when a new directory takes over its inode
+    if ((result = fif_unlink(mount, "a/b/c/d/late.bin")) != FIF_ERROR_SUCCESS ||
+        (result = fif_rmdir(mount, "a/b/c/d")) != FIF_ERROR_SUCCESS ||
+        (result = fif_stat(mount, "a/b/c/d", &fileinfo)) != FIF_ERROR_FILE_NOT_FOUND ||
+        (result = fif_stat(mount, "a/b/c/d/late.bin", &fileinfo)) != FIF_ERROR_FILE_NOT_FOUND ||
+        (result = fif_mkdir(mount, "a/b/c/e")) != FIF_ERROR_SUCCESS ||
+        (result = fif_stat(mount, "a/b/c/e/late.bin", &fileinfo)) != FIF_ERROR_FILE_NOT_FOUND ||
+        (result = fif_mkdir(mount, "a/b/c/d")) != FIF_ERROR_SUCCESS ||
+        (result = fif_stat(mount, "a/b/c/d", &fileinfo)) != FIF_ERROR_SUCCESS || (fileinfo.attributes & FIF_FILE_ATTRIBUTE_DIRECTORY) == 0 ||
+        (result = fif_stat(mount, "a/b/c/d/late.bin", &fileinfo)) != FIF_ERROR_FILE_NOT_FOUND)
+    {
+        printf("removing and recreating a/b/c/d failed: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    close_counted_test_volume(&counting_io, mount);
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_freeblock_index(void)
+{
+    int result;
+    char path[64];
+    static unsigned char expected[128 * 1024], data[128 * 1024];
+
+    // once mounted, allocating reads no freeblock headers, so it costs the same with 1 free range as with 64
+    unsigned int alloc_reads[2];
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+        fif_volume_options volume_options;
+        fif_mount_options mount_options;
+        fif_set_default_volume_options(&volume_options);
+        fif_set_default_mount_options(&mount_options);
+
+        struct test_counting_io counting_io;
+        fif_io io;
+        fif_mount_handle mount;
+        if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+            return -1;
+        if ((result = fif_mkdir(mount, "holes")) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_mkdir(holes) failed: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+
+        // one block files back to back, then half of them removed, either all together or every other one
+        for (unsigned int i = 0; i < 128; i++)
+        {
+            make_test_path(path, "holes", i);
+            fill_test_file_data(expected, i, 1000);
+            if ((result = fif_put_file_contents(mount, path, expected, 1000)) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_put_file_contents(%s) failed: %i\n", path, result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+        for (unsigned int i = 0; i < 64; i++)
+        {
+            make_test_path(path, "holes", (pass == 0) ? i : (i * 2));
+            if ((result = fif_unlink(mount, path)) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_unlink(%s) failed: %i\n", path, result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+        if (remount_test_volume(&io, &mount, &mount_options) != FIF_ERROR_SUCCESS)
+        {
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+
+        // too big for any of the holes
+        unsigned int start_reads = counting_io.counts.reads + counting_io.counts.preads;
+        fill_test_file_data(expected, 15, 80 * 1024);
+        if ((result = fif_put_file_contents(mount, "big.bin", expected, 80 * 1024)) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_put_file_contents(big.bin) failed: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+        alloc_reads[pass] = counting_io.counts.reads + counting_io.counts.preads - start_reads;
+
+        // a file that fits a hole, and the holes merging with their neighbours as the rest go, then one file across all of them
+        fill_test_file_data(expected, 16, 1000);
+        if ((result = fif_put_file_contents(mount, "small.bin", expected, 1000)) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_put_file_contents(small.bin) failed: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+        for (unsigned int i = 0; i < 128; i++)
+        {
+            make_test_path(path, "holes", i);
+            if ((pass == 0) ? (i < 64) : ((i % 2) == 0))
+                continue;
+            if ((result = fif_unlink(mount, path)) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_unlink(%s) failed: %i\n", path, result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+        fill_test_file_data(expected, 17, sizeof(expected));
+        if ((result = fif_put_file_contents(mount, "merged.bin", expected, sizeof(expected))) != FIF_ERROR_SUCCESS ||
+            (result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS ||
+            (result = fif_get_file_contents(mount, "merged.bin", data, sizeof(data))) != (int)sizeof(expected) ||
+            memcmp(data, expected, sizeof(expected)) != 0)
+        {
+            printf("merged.bin contents are wrong: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+        fill_test_file_data(expected, 15, 80 * 1024);
+        if ((result = fif_get_file_contents(mount, "big.bin", data, sizeof(data))) != 80 * 1024 || memcmp(data, expected, 80 * 1024) != 0)
+        {
+            printf("big.bin contents are wrong: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+        fill_test_file_data(expected, 16, 1000);
+        if ((result = fif_get_file_contents(mount, "small.bin", data, sizeof(data))) != 1000 || memcmp(data, expected, 1000) != 0)
+        {
+            printf("small.bin contents are wrong: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+
+        close_counted_test_volume(&counting_io, mount);
+    }
+
+    if (alloc_reads[0] != alloc_reads[1])
+    {
+        printf("allocating made %u reads with 1 free range, %u with 64\n", alloc_reads[0], alloc_reads[1]);
+        return -1;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_fragmented_files(fif_io *io)
+{
+    int result;
+    char path[64];
+    static unsigned char expected[TEST_FILE_MAX_SIZE], data[TEST_FILE_MAX_SIZE];
+
+    // grown a block at a time in turn so none of them can grow in place
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+    mount_options.fragmentation_threshold = 4;
+
+    fif_mount_handle mount;
+    if (create_test_volume(io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+    if (fill_test_directory(mount, "fragmented", fragmented_test_file_size, 1024) != FIF_ERROR_SUCCESS ||
+        check_test_directory(mount, "fragmented", fragmented_test_file_size, 0) != FIF_ERROR_SUCCESS ||
+        remount_test_volume(io, &mount, &mount_options) != FIF_ERROR_SUCCESS ||
+        check_test_directory(mount, "fragmented", fragmented_test_file_size, 0) != FIF_ERROR_SUCCESS)
+    {
+        fif_unmount_volume(mount);
+        return -1;
+    }
+    if (count_test_files_with_attribute(mount, "fragmented", FIF_FILE_ATTRIBUTE_FRAGMENTED) == 0)
+    {
+        printf("no file was fragmented\n");
+        fif_unmount_volume(mount);
+        return -1;
+    }
+
+    // cutting every file in half drops and trims fragments from the end, keeping what's left of the map
+    for (unsigned int i = 1; i < TEST_DIRECTORY_FILE_COUNT; i++)
+    {
+        if ((i % 3) == 0)
+            continue;
+
+        fif_file_handle file;
+        unsigned int size = fragmented_test_file_size(i) / 2;
+        make_test_path(path, "fragmented", i);
+        if ((result = fif_open(mount, path, FIF_OPEN_MODE_WRITE, &file)) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_open(%s) failed: %i\n", path, result);
+            fif_unmount_volume(mount);
+            return -1;
+        }
+        if ((result = fif_ftruncate(mount, file, size)) != FIF_ERROR_SUCCESS || (result = fif_close(mount, file)) != FIF_ERROR_SUCCESS)
+        {
+            printf("shrinking %s failed: %i\n", path, result);
+            fif_unmount_volume(mount);
+            return -1;
+        }
+
+        fill_test_file_data(expected, i, size);
+        if ((result = fif_get_file_contents(mount, path, data, sizeof(data))) != (int)size || memcmp(data, expected, size) != 0)
+        {
+            printf("%s contents are wrong after shrinking: %i\n", path, result);
+            fif_unmount_volume(mount);
+            return -1;
+        }
+    }
+
+    // then growing them back in turn adds fragments to the shortened maps
+    for (unsigned int offset = 0; offset < TEST_FILE_MAX_SIZE; offset += 1024)
+    {
+        for (unsigned int i = 1; i < TEST_DIRECTORY_FILE_COUNT; i++)
+        {
+            unsigned int size = fragmented_test_file_size(i);
+            if ((i % 3) == 0 || offset + 1024 <= size / 2 || offset >= size)
+                continue;
+
+            fif_file_handle file;
+            unsigned int start = (offset > size / 2) ? offset : (size / 2);
+            unsigned int count = ((size - start) < (offset + 1024 - start)) ? (size - start) : (offset + 1024 - start);
+            fill_test_file_data(expected, i, size);
+            make_test_path(path, "fragmented", i);
+            if ((result = fif_open(mount, path, FIF_OPEN_MODE_WRITE, &file)) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_open(%s) failed: %i\n", path, result);
+                fif_unmount_volume(mount);
+                return -1;
+            }
+            if (fif_seek(mount, file, start, FIF_SEEK_MODE_SET) != (fif_offset_t)start || (result = fif_write(mount, file, expected + start, count)) != (int)count ||
+                (result = fif_close(mount, file)) != FIF_ERROR_SUCCESS)
+            {
+                printf("regrowing %s failed: %i\n", path, result);
+                fif_unmount_volume(mount);
+                return -1;
+            }
+        }
+    }
+
+    if (check_test_directory(mount, "fragmented", fragmented_test_file_size, 0) != FIF_ERROR_SUCCESS ||
+        remount_test_volume(io, &mount, &mount_options) != FIF_ERROR_SUCCESS ||
+        check_test_directory(mount, "fragmented", fragmented_test_file_size, 0) != FIF_ERROR_SUCCESS)
+    {
+        fif_unmount_volume(mount);
+        return -1;
+    }
+    if (count_test_files_with_attribute(mount, "fragmented", FIF_FILE_ATTRIBUTE_FRAGMENTED) == 0)
+    {
+        printf("no file was fragmented after regrowing\n");
+        fif_unmount_volume(mount);
+        return -1;
+    }
+
+    fif_unmount_volume(mount);
+    return FIF_ERROR_SUCCESS;
+}
+
+static fif_offset_t test_volume_size(fif_io *io)
+{
+    return (fif_offset_t)io->io_filesize(io->userdata);
+}
+
+static int test_small_files(fif_io *io)
+{
+    int result;
+    char path[64];
+    static unsigned char expected[TEST_FILE_MAX_SIZE], data[TEST_FILE_MAX_SIZE];
+
+    // small files share slabs of blocks instead of taking a block each
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+
+    fif_mount_handle mount;
+    if (create_test_volume(io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+    if (fill_test_directory(mount, "small", small_test_file_size, TEST_FILE_MAX_SIZE) != FIF_ERROR_SUCCESS ||
+        check_test_directory(mount, "small", small_test_file_size, 0) != FIF_ERROR_SUCCESS ||
+        remount_test_volume(io, &mount, &mount_options) != FIF_ERROR_SUCCESS ||
+        check_test_directory(mount, "small", small_test_file_size, 0) != FIF_ERROR_SUCCESS)
+    {
+        fif_unmount_volume(mount);
+        return -1;
+    }
+    if (count_test_files_with_attribute(mount, "small", FIF_FILE_ATTRIBUTE_SMALL_FILE) != (TEST_DIRECTORY_FILE_COUNT - (TEST_DIRECTORY_FILE_COUNT + 2) / 3))
+    {
+        printf("not every remaining file is a small file\n");
+        fif_unmount_volume(mount);
+        return -1;
+    }
+    fif_unmount_volume(mount);
+
+    // the rest is measured by the trimmed size of the archive, so it grows by exactly what's needed and never needs another inode table.
+    // a linear directory closes up the gap a removed name leaves, so swapping names of the same length doesn't change its size either.
+    volume_options.hash_table_size = 0;
+    volume_options.inode_table_count = 8;
+    mount_options.volume_growth_blocks = 0;
+    mount_options.volume_growth_percent = 0;
+    if (create_test_volume(io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+    if ((result = fif_mkdir(mount, "slabs")) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_mkdir(slabs) failed: %i\n", result);
+        fif_unmount_volume(mount);
+        return -1;
+    }
+    fif_unmount_volume(mount);
+    fif_offset_t empty_size = test_volume_size(io);
+    if ((result = fif_mount_volume(&mount, io, NULL, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_mount_volume() failed: %i\n", result);
+        return -1;
+    }
+    for (unsigned int i = 0; i < 60; i++)
+    {
+        make_test_path(path, "slabs", i);
+        fill_test_file_data(expected, i, small_test_file_size(i));
+        if ((result = fif_put_file_contents(mount, path, expected, small_test_file_size(i))) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_put_file_contents(%s) failed: %i\n", path, result);
+            fif_unmount_volume(mount);
+            return -1;
+        }
+    }
+    fif_unmount_volume(mount);
+    fif_offset_t full_size = test_volume_size(io);
+
+    // new small files go in the slots removed ones left behind, so the archive doesn't grow
+    if ((result = fif_mount_volume(&mount, io, NULL, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_mount_volume() failed: %i\n", result);
+        return -1;
+    }
+    for (unsigned int i = 0; i < 60; i += 2)
+    {
+        make_test_path(path, "slabs", i);
+        if ((result = fif_unlink(mount, path)) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_unlink(%s) failed: %i\n", path, result);
+            fif_unmount_volume(mount);
+            return -1;
+        }
+    }
+    for (unsigned int i = 100; i < 130; i++)
+    {
+        make_test_path(path, "slabs", i);
+        fill_test_file_data(expected, i, small_test_file_size(i));
+        if ((result = fif_put_file_contents(mount, path, expected, small_test_file_size(i))) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_put_file_contents(%s) failed: %i\n", path, result);
+            fif_unmount_volume(mount);
+            return -1;
+        }
+    }
+    fif_unmount_volume(mount);
+    if (test_volume_size(io) != full_size)
+    {
+        printf("replacing small files grew the archive from %u to %u bytes\n", (unsigned int)full_size, (unsigned int)test_volume_size(io));
+        return -1;
+    }
+
+    // all of them still hold what was written, and once they're gone every slab is freed
+    if ((result = fif_mount_volume(&mount, io, NULL, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_mount_volume() failed: %i\n", result);
+        return -1;
+    }
+    for (unsigned int i = 1; i < 130; i++)
+    {
+        if ((i < 60 && (i % 2) == 0) || (i >= 60 && i < 100))
+            continue;
+
+        unsigned int size = small_test_file_size(i);
+        make_test_path(path, "slabs", i);
+        fill_test_file_data(expected, i, size);
+        if ((result = fif_get_file_contents(mount, path, data, sizeof(data))) != (int)size || memcmp(data, expected, size) != 0)
+        {
+            printf("%s contents are wrong: %i\n", path, result);
+            fif_unmount_volume(mount);
+            return -1;
+        }
+        if ((result = fif_unlink(mount, path)) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_unlink(%s) failed: %i\n", path, result);
+            fif_unmount_volume(mount);
+            return -1;
+        }
+    }
+    fif_unmount_volume(mount);
+    if (test_volume_size(io) != empty_size)
+    {
+        printf("archive is %u bytes with every small file removed, %u before any were added\n", (unsigned int)test_volume_size(io), (unsigned int)empty_size);
+        return -1;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static void make_long_test_path(char *path, const char *dirname, unsigned int index)
+{
+    // dirname/longNN followed by enough x's to make a 200 character name
+    size_t dirname_length = strlen(dirname);
+    memcpy(path, dirname, dirname_length);
+    memcpy(path + dirname_length, "/long", 5);
+    path[dirname_length + 5] = (char)('0' + (index / 10) % 10);
+    path[dirname_length + 6] = (char)('0' + index % 10);
+    memset(path + dirname_length + 7, 'x', 200 - 6);
+    path[dirname_length + 1 + 200] = '\0';
+}
+
+static int test_ordered_directory(fif_io *io)
+{
+    int result;
+    char path[256];
+    static unsigned char expected[512], data[512];
+
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+    volume_options.ordered_directories = 1;
+
+    fif_mount_handle mount;
+    if (create_test_volume(io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+    if (fill_test_directory(mount, "ordered", ordered_test_file_size, TEST_FILE_MAX_SIZE) != FIF_ERROR_SUCCESS ||
+        check_test_directory(mount, "ordered", ordered_test_file_size, 1) != FIF_ERROR_SUCCESS ||
+        remount_test_volume(io, &mount, &mount_options) != FIF_ERROR_SUCCESS ||
+        check_test_directory(mount, "ordered", ordered_test_file_size, 1) != FIF_ERROR_SUCCESS)
+    {
+        fif_unmount_volume(mount);
+        return -1;
+    }
+
+    // the short names all fit in the root leaf, long ones split it under a branch. a directory with a header node,
+    // a branch and two leaves is at least four 4096 byte nodes.
+    for (unsigned int i = 0; i < 40; i++)
+    {
+        make_long_test_path(path, "ordered", i);
+        fill_test_file_data(expected, i, sizeof(expected));
+        if ((result = fif_put_file_contents(mount, path, expected, sizeof(expected))) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_put_file_contents(%s) failed: %i\n", path, result);
+            fif_unmount_volume(mount);
+            return -1;
+        }
+    }
+    fif_fileinfo fileinfo;
+    if ((result = fif_stat(mount, "ordered", &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.size < 4 * 4096)
+    {
+        printf("ordered directory didn't split, it's %u bytes: %i\n", fileinfo.size, result);
+        fif_unmount_volume(mount);
+        return -1;
+    }
+    unsigned int split_size = fileinfo.size;
+
+    // a range lists just the names inside it, in order, even with the long names after them
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1 && remount_test_volume(io, &mount, &mount_options) != FIF_ERROR_SUCCESS)
+        {
+            fif_unmount_volume(mount);
+            return -1;
+        }
+
+        struct test_enum_state state = { 0, 0, 0, 0 };
+        if ((result = fif_enumdir_range(mount, "ordered", "file050", "file100", test_enum_callback, &state)) != FIF_ERROR_SUCCESS ||
+            state.count != 33 || state.unexpected || state.unordered)
+        {
+            printf("fif_enumdir_range(ordered) failed: %i (%u of 33 names)\n", result, state.count);
+            fif_unmount_volume(mount);
+            return -1;
+        }
+        for (unsigned int i = 0; i < 40; i++)
+        {
+            make_long_test_path(path, "ordered", i);
+            fill_test_file_data(expected, i, sizeof(expected));
+            if ((result = fif_get_file_contents(mount, path, data, sizeof(data))) != (int)sizeof(expected) || memcmp(data, expected, sizeof(expected)) != 0)
+            {
+                printf("long name %u contents are wrong: %i\n", i, result);
+                fif_unmount_volume(mount);
+                return -1;
+            }
+        }
+    }
+
+    // removing the long names leaves the nodes mostly empty, so the directory is rebuilt smaller
+    for (unsigned int i = 0; i < 40; i++)
+    {
+        make_long_test_path(path, "ordered", i);
+        if ((result = fif_unlink(mount, path)) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_unlink(long name %u) failed: %i\n", i, result);
+            fif_unmount_volume(mount);
+            return -1;
+        }
+    }
+    if ((result = fif_stat(mount, "ordered", &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.size >= split_size)
+    {
+        printf("ordered directory wasn't rebuilt, it's %u bytes: %i\n", fileinfo.size, result);
+        fif_unmount_volume(mount);
+        return -1;
+    }
+
+    struct test_enum_state state = { 0, 0, 0, 0 };
+    if (check_test_directory(mount, "ordered", ordered_test_file_size, 1) != FIF_ERROR_SUCCESS ||
+        remount_test_volume(io, &mount, &mount_options) != FIF_ERROR_SUCCESS ||
+        check_test_directory(mount, "ordered", ordered_test_file_size, 1) != FIF_ERROR_SUCCESS ||
+        (result = fif_enumdir_range(mount, "ordered", "file050", "file100", test_enum_callback, &state)) != FIF_ERROR_SUCCESS ||
+        state.count != 33 || state.unexpected || state.unordered)
+    {
+        printf("ordered directory is wrong after its rebuild: %i\n", result);
+        fif_unmount_volume(mount);
+        return -1;
+    }
+
+    fif_unmount_volume(mount);
+    return FIF_ERROR_SUCCESS;
+}
+
+struct test_readdir_plus_state
+{
+    unsigned int batch_count;
+    unsigned int short_batch_count;
+    unsigned int entry_count;
+    fif_fileinfo fileinfos[50];
+    unsigned char seen[50];
+    int wrong;
+};
+
+static int test_readdir_plus_callback(void *userdata, const fif_direntry *entries, unsigned int count)
+{
+    // only the last batch can be short, and every name turns up once
+    struct test_readdir_plus_state *state = (struct test_readdir_plus_state *)userdata;
+    if (state->short_batch_count > 0 || count == 0 || count > 8)
+        state->wrong = 1;
+    if (count < 8)
+        state->short_batch_count++;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        const char *filename = entries[i].filename;
+        unsigned int index = 0;
+        if (strlen(filename) != 7 || memcmp(filename, "file", 4) != 0)
+            state->wrong = 1;
+        else
+            index = (unsigned int)(filename[4] - '0') * 100 + (unsigned int)(filename[5] - '0') * 10 + (unsigned int)(filename[6] - '0');
+        if (index >= 50 || state->seen[index])
+        {
+            state->wrong = 1;
+            continue;
+        }
+
+        state->fileinfos[index] = entries[i].fileinfo;
+        state->seen[index] = 1;
+    }
+
+    state->batch_count++;
+    state->entry_count += count;
+    return 0;
+}
+
+static int test_stat_enum_callback(void *userdata, const char *filename)
+{
+    // what a listing with file info costs without readdir_plus
+    char path[64];
+    fif_fileinfo fileinfo;
+    memcpy(path, "plus/", 5);
+    memcpy(path + 5, filename, strlen(filename) + 1);
+    return fif_stat((fif_mount_handle)userdata, path, &fileinfo);
+}
+
+static int test_readdir_plus(void)
+{
+    int result;
+    char path[64];
+    static unsigned char expected[512];
+
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+
+    struct test_counting_io counting_io;
+    fif_io io;
+    fif_mount_handle mount;
+    if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+    if ((result = fif_mkdir(mount, "plus")) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_mkdir(plus) failed: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    for (unsigned int i = 0; i < 50; i++)
+    {
+        make_test_path(path, "plus", i);
+        fill_test_file_data(expected, i, 100 + i * 7);
+        if ((result = fif_put_file_contents(mount, path, expected, 100 + i * 7)) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_put_file_contents(%s) failed: %i\n", path, result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+    }
+
+    // a cold listing with file info reads less than listing names and stat-ing each one
+    if ((result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    unsigned int start_reads = counting_io.counts.reads + counting_io.counts.preads;
+    if ((result = fif_enumdir(mount, "plus", test_stat_enum_callback, mount)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_enumdir(plus) with fif_stat failed: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    unsigned int stat_reads = counting_io.counts.reads + counting_io.counts.preads - start_reads;
+
+    if ((result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    fif_direntry entries[8];
+    static struct test_readdir_plus_state state;
+    memset(&state, 0, sizeof(state));
+    start_reads = counting_io.counts.reads + counting_io.counts.preads;
+    result = fif_readdir_plus(mount, "plus", entries, 8, test_readdir_plus_callback, &state);
+    unsigned int plus_reads = counting_io.counts.reads + counting_io.counts.preads - start_reads;
+    if (result != FIF_ERROR_SUCCESS || state.wrong || state.entry_count != 50 || state.batch_count != (50 + 7) / 8)
+    {
+        printf("fif_readdir_plus(plus) failed: %i (%u entries in %u batches)\n", result, state.entry_count, state.batch_count);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    if (plus_reads >= stat_reads)
+    {
+        printf("listing with file info made %u reads, listing and stat-ing made %u\n", plus_reads, stat_reads);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    // and each entry held what fif_stat says for the name
+    for (unsigned int i = 0; i < 50; i++)
+    {
+        fif_fileinfo fileinfo;
+        make_test_path(path, "plus", i);
+        if ((result = fif_stat(mount, path, &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.size != 100 + i * 7 ||
+            state.fileinfos[i].size != fileinfo.size || state.fileinfos[i].attributes != fileinfo.attributes ||
+            state.fileinfos[i].block_count != fileinfo.block_count || state.fileinfos[i].data_size != fileinfo.data_size ||
+            state.fileinfos[i].checksum != fileinfo.checksum || state.fileinfos[i].modify_timestamp != fileinfo.modify_timestamp)
+        {
+            printf("fif_readdir_plus(plus) entry for %s doesn't match fif_stat: %i\n", path, result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+    }
+
+    close_counted_test_volume(&counting_io, mount);
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_preallocation(void)
+{
+    int result;
+    static unsigned char expected[2][16384], data[16384];
+
+    // two files written a block at a time in turn get in each other's way, unless their size was given up front
+    unsigned int moves[2];
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+        fif_volume_options volume_options;
+        fif_mount_options mount_options;
+        fif_set_default_volume_options(&volume_options);
+        fif_set_default_mount_options(&mount_options);
+        mount_options.fragmentation_threshold = 0;
+        mount_options.delayed_allocation_size = 0;
+
+        struct test_counting_io counting_io;
+        fif_io io;
+        fif_mount_handle mount;
+        if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+            return -1;
+
+        static const char *const paths[2] = { "first.bin", "second.bin" };
+        fif_file_handle files[2];
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            fill_test_file_data(expected[i], 20 + i, sizeof(expected[i]));
+            if (pass == 0)
+                result = fif_open(mount, paths[i], FIF_OPEN_MODE_CREATE | FIF_OPEN_MODE_WRITE, &files[i]);
+            else
+                result = fif_open_ex(mount, paths[i], FIF_OPEN_MODE_CREATE | FIF_OPEN_MODE_WRITE, sizeof(expected[i]), &files[i]);
+            if (result != FIF_ERROR_SUCCESS)
+            {
+                printf("opening %s failed: %i\n", paths[i], result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+
+        unsigned int start_moves = counting_io.counts.reads + counting_io.counts.preads + counting_io.counts.copies;
+        for (unsigned int offset = 0; offset < sizeof(expected[0]); offset += 1024)
+        {
+            for (unsigned int i = 0; i < 2; i++)
+            {
+                if ((result = fif_write(mount, files[i], expected[i] + offset, 1024)) != 1024)
+                {
+                    printf("fif_write(%s) failed: %i\n", paths[i], result);
+                    close_counted_test_volume(&counting_io, mount);
+                    return -1;
+                }
+            }
+        }
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            if ((result = fif_close(mount, files[i])) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_close(%s) failed: %i\n", paths[i], result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+        moves[pass] = counting_io.counts.reads + counting_io.counts.preads + counting_io.counts.copies - start_moves;
+
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            if ((result = fif_get_file_contents(mount, paths[i], data, sizeof(data))) != (int)sizeof(data) || memcmp(data, expected[i], sizeof(data)) != 0)
+            {
+                printf("%s contents are wrong: %i\n", paths[i], result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+
+        close_counted_test_volume(&counting_io, mount);
+    }
+
+    if (moves[1] != 0 || moves[0] == 0)
+    {
+        printf("interleaved writes made %u reads and copies with a size hint, %u without\n", moves[1], moves[0]);
+        return -1;
+    }
+
+    // a size hint gives back what wasn't written at close, fif_fallocate keeps it until the file is truncated
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+
+    struct test_counting_io counting_io;
+    fif_io io;
+    fif_mount_handle mount;
+    if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+
+    fif_file_handle file;
+    fif_fileinfo fileinfo;
+    if ((result = fif_open_ex(mount, "hinted.bin", FIF_OPEN_MODE_CREATE | FIF_OPEN_MODE_WRITE, 16384, &file)) != FIF_ERROR_SUCCESS ||
+        (result = fif_fstat(mount, file, &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.block_count != 16 ||
+        (result = fif_write(mount, file, expected[0], 5000)) != 5000 ||
+        (result = fif_close(mount, file)) != FIF_ERROR_SUCCESS ||
+        (result = fif_stat(mount, "hinted.bin", &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.size != 5000 || fileinfo.block_count != 5)
+    {
+        printf("hinted.bin didn't reserve 16 blocks then keep 5: %i (%u blocks)\n", result, fileinfo.block_count);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    if ((result = fif_open(mount, "reserved.bin", FIF_OPEN_MODE_CREATE | FIF_OPEN_MODE_WRITE, &file)) != FIF_ERROR_SUCCESS ||
+        (result = fif_fallocate(mount, file, 16384)) != FIF_ERROR_SUCCESS ||
+        (result = fif_fstat(mount, file, &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.size != 0 || fileinfo.block_count != 16 ||
+        (result = fif_write(mount, file, expected[1], 5000)) != 5000 ||
+        (result = fif_close(mount, file)) != FIF_ERROR_SUCCESS ||
+        (result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS ||
+        (result = fif_stat(mount, "reserved.bin", &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.size != 5000 || fileinfo.block_count != 16)
+    {
+        printf("reserved.bin didn't keep its 16 blocks: %i (%u blocks)\n", result, fileinfo.block_count);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    if ((result = fif_open(mount, "reserved.bin", FIF_OPEN_MODE_WRITE, &file)) != FIF_ERROR_SUCCESS ||
+        (result = fif_ftruncate(mount, file, 5000)) != FIF_ERROR_SUCCESS ||
+        (result = fif_close(mount, file)) != FIF_ERROR_SUCCESS ||
+        (result = fif_stat(mount, "reserved.bin", &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.block_count != 5)
+    {
+        printf("truncating reserved.bin didn't give back its reservation: %i (%u blocks)\n", result, fileinfo.block_count);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        const char *path = (i == 0) ? "hinted.bin" : "reserved.bin";
+        if ((result = fif_get_file_contents(mount, path, data, sizeof(data))) != 5000 || memcmp(data, expected[i], 5000) != 0)
+        {
+            printf("%s contents are wrong: %i\n", path, result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+    }
+
+    close_counted_test_volume(&counting_io, mount);
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_volume_growth(void)
+{
+    int result;
+    char path[64];
+    static unsigned char expected[2000], data[2000];
+
+    // growing by exactly what's needed truncates the archive for every file, growing in steps only now and then
+    unsigned int truncates[2];
+    fif_offset_t trimmed_size[2];
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+        fif_volume_options volume_options;
+        fif_mount_options mount_options;
+        fif_set_default_volume_options(&volume_options);
+        fif_set_default_mount_options(&mount_options);
+        mount_options.trim_on_unmount = 0;
+        if (pass == 0)
+        {
+            mount_options.volume_growth_blocks = 0;
+            mount_options.volume_growth_percent = 0;
+        }
+
+        struct test_counting_io counting_io;
+        fif_io io;
+        fif_mount_handle mount;
+        if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+            return -1;
+        if ((result = fif_mkdir(mount, "growth")) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_mkdir(growth) failed: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+
+        unsigned int start_truncates = counting_io.counts.truncates;
+        for (unsigned int i = 0; i < 100; i++)
+        {
+            make_test_path(path, "growth", i);
+            fill_test_file_data(expected, i, sizeof(expected));
+            if ((result = fif_put_file_contents(mount, path, expected, sizeof(expected))) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_put_file_contents(%s) failed: %i\n", path, result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+        truncates[pass] = counting_io.counts.truncates - start_truncates;
+
+        // the surplus is kept at unmount unless it's asked to be trimmed
+        fif_offset_t grown_size = test_volume_size(&io);
+        mount_options.trim_on_unmount = 1;
+        if ((result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS)
+        {
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+        if (test_volume_size(&io) != grown_size)
+        {
+            printf("archive was trimmed from %u to %u bytes at unmount without trim_on_unmount\n", (unsigned int)grown_size, (unsigned int)test_volume_size(&io));
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+        if ((result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS)
+        {
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+        trimmed_size[pass] = test_volume_size(&io);
+
+        for (unsigned int i = 0; i < 100; i++)
+        {
+            make_test_path(path, "growth", i);
+            fill_test_file_data(expected, i, sizeof(expected));
+            if ((result = fif_get_file_contents(mount, path, data, sizeof(data))) != (int)sizeof(expected) || memcmp(data, expected, sizeof(expected)) != 0)
+            {
+                printf("%s contents are wrong: %i\n", path, result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+
+        close_counted_test_volume(&counting_io, mount);
+    }
+
+    if (truncates[0] < 100 || truncates[1] * 10 > truncates[0])
+    {
+        printf("writing 100 files truncated the archive %u times growing in steps, %u times growing exactly\n", truncates[1], truncates[0]);
+        return -1;
+    }
+
+    // and trimmed at unmount, what's left is what growing exactly would have made
+    if (trimmed_size[1] != trimmed_size[0])
+    {
+        printf("archive trimmed to %u bytes after growing in steps, %u after growing exactly\n", (unsigned int)trimmed_size[1], (unsigned int)trimmed_size[0]);
+        return -1;
+    }
+
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_deferred_superblock(void)
+{
+    int result;
+    char path[64];
+    static unsigned char expected[3000], data[3000];
+
+    // with inodes written straight through and no periodic superblock writes, only the superblock is left behind in memory
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+    mount_options.descriptor_write_interval = 0;
+    mount_options.inode_cache_size = 0;
+
+    struct test_counting_io counting_io;
+    fif_io io;
+    fif_mount_handle mount;
+    if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+    if ((result = fif_mkdir(mount, "deferred")) != FIF_ERROR_SUCCESS || (result = fif_sync(mount)) != FIF_ERROR_SUCCESS)
+    {
+        printf("deferred setup failed: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    // the first change marks the superblock dirty, after that it isn't written until fif_sync
+    unsigned int start_writes = counting_io.counts.superblock_writes;
+    for (unsigned int i = 0; i < 30; i++)
+    {
+        make_test_path(path, "deferred", i);
+        fill_test_file_data(expected, i, 1000 + i * 50);
+        if ((result = fif_put_file_contents(mount, path, expected, 1000 + i * 50)) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_put_file_contents(%s) failed: %i\n", path, result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+    }
+    unsigned int dirty_writes = counting_io.counts.superblock_writes - start_writes;
+    if (dirty_writes != 1)
+    {
+        printf("writing 30 files wrote the superblock %u times\n", dirty_writes);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    // a copy of the archive as it is now is what a crash would leave behind
+    fif_offset_t snapshot_size = test_volume_size(&io);
+    unsigned char *snapshot = (unsigned char *)malloc((size_t)snapshot_size);
+    fif_io crashed_io;
+    if (snapshot == NULL || counting_io.inner.io_pread(counting_io.inner.userdata, snapshot, (unsigned int)snapshot_size, 0) != (int)snapshot_size ||
+        fif_io_open_memory(&crashed_io) != FIF_ERROR_SUCCESS)
+    {
+        printf("copying the archive failed\n");
+        free(snapshot);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    result = crashed_io.io_pwrite(crashed_io.userdata, snapshot, (unsigned int)snapshot_size, 0);
+    free(snapshot);
+    if (result != (int)snapshot_size)
+    {
+        printf("copying the archive failed: %i\n", result);
+        fif_io_close_memory(&crashed_io);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    start_writes = counting_io.counts.superblock_writes;
+    if ((result = fif_sync(mount)) != FIF_ERROR_SUCCESS || counting_io.counts.superblock_writes == start_writes)
+    {
+        printf("fif_sync didn't write the superblock: %i\n", result);
+        fif_io_close_memory(&crashed_io);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    close_counted_test_volume(&counting_io, mount);
+
+    // mounting the copy rebuilds the free lists from what's in use, so the files are intact and new ones don't land on them
+    fif_mount_handle crashed_mount;
+    if ((result = fif_mount_volume(&crashed_mount, &crashed_io, NULL, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("mounting the dirty archive failed: %i\n", result);
+        fif_io_close_memory(&crashed_io);
+        return -1;
+    }
+    for (unsigned int i = 30; i < 60; i++)
+    {
+        make_test_path(path, "deferred", i);
+        fill_test_file_data(expected, i, 1000 + i * 50 - 1500);
+        if ((result = fif_put_file_contents(crashed_mount, path, expected, 1000 + i * 50 - 1500)) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_put_file_contents(%s) failed: %i\n", path, result);
+            fif_unmount_volume(crashed_mount);
+            fif_io_close_memory(&crashed_io);
+            return -1;
+        }
+    }
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1 && (result = remount_test_volume(&crashed_io, &crashed_mount, &mount_options)) != FIF_ERROR_SUCCESS)
+        {
+            fif_unmount_volume(crashed_mount);
+            fif_io_close_memory(&crashed_io);
+            return -1;
+        }
+
+        for (unsigned int i = 0; i < 60; i++)
+        {
+            unsigned int size = (i < 30) ? (1000 + i * 50) : (1000 + i * 50 - 1500);
+            make_test_path(path, "deferred", i);
+            fill_test_file_data(expected, i, size);
+            if ((result = fif_get_file_contents(crashed_mount, path, data, sizeof(data))) != (int)size || memcmp(data, expected, size) != 0)
+            {
+                printf("%s contents are wrong after recovery: %i\n", path, result);
+                fif_unmount_volume(crashed_mount);
+                fif_io_close_memory(&crashed_io);
+                return -1;
+            }
+        }
+    }
+
+    fif_unmount_volume(crashed_mount);
+    fif_io_close_memory(&crashed_io);
+    return FIF_ERROR_SUCCESS;
+}
+
+static unsigned int test_write_count(const struct test_counting_io *counting_io)
+{
+    return counting_io->counts.writes + counting_io->counts.pwrites + counting_io->counts.batches;
+}
+
+static int test_batch(void)
+{
+    int result;
+    char path[64];
+    static unsigned char expected[4096], data[4096];
+
+    // creating files inside a batch writes far less than creating them one by one, and only when the outermost batch commits
+    unsigned int create_writes[2];
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+        fif_volume_options volume_options;
+        fif_mount_options mount_options;
+        fif_set_default_volume_options(&volume_options);
+        fif_set_default_mount_options(&mount_options);
+
+        struct test_counting_io counting_io;
+        fif_io io;
+        fif_mount_handle mount;
+        if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+            return -1;
+        if ((result = fif_mkdir(mount, "batched")) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_mkdir(batched) failed: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+
+        unsigned int start_writes = test_write_count(&counting_io);
+        if (pass == 1 && ((result = fif_begin_batch(mount)) != FIF_ERROR_SUCCESS || (result = fif_begin_batch(mount)) != FIF_ERROR_SUCCESS))
+        {
+            printf("fif_begin_batch failed: %i\n", result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+        for (unsigned int i = 0; i < 40; i++)
+        {
+            make_test_path(path, "batched", i);
+            fill_test_file_data(expected, i, 10 + i);
+            if ((result = fif_put_file_contents(mount, path, expected, 10 + i)) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_put_file_contents(%s) failed: %i\n", path, result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+        if (pass == 1)
+        {
+            // the inner commit writes nothing, and what's held is still what gets read back
+            unsigned int inner_writes = test_write_count(&counting_io);
+            if ((result = fif_commit_batch(mount)) != FIF_ERROR_SUCCESS || test_write_count(&counting_io) != inner_writes)
+            {
+                printf("inner fif_commit_batch made %u writes: %i\n", test_write_count(&counting_io) - inner_writes, result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+            for (unsigned int i = 0; i < 40; i++)
+            {
+                make_test_path(path, "batched", i);
+                fill_test_file_data(expected, i, 10 + i);
+                if ((result = fif_get_file_contents(mount, path, data, sizeof(data))) != (int)(10 + i) || memcmp(data, expected, 10 + i) != 0)
+                {
+                    printf("%s contents are wrong inside the batch: %i\n", path, result);
+                    close_counted_test_volume(&counting_io, mount);
+                    return -1;
+                }
+            }
+
+            unsigned int outer_writes = test_write_count(&counting_io);
+            if ((result = fif_commit_batch(mount)) != FIF_ERROR_SUCCESS || test_write_count(&counting_io) == outer_writes ||
+                fif_commit_batch(mount) == FIF_ERROR_SUCCESS)
+            {
+                printf("outer fif_commit_batch didn't write the batch: %i\n", result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+        create_writes[pass] = test_write_count(&counting_io) - start_writes;
+
+        if ((result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS)
+        {
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+        for (unsigned int i = 0; i < 40; i++)
+        {
+            make_test_path(path, "batched", i);
+            fill_test_file_data(expected, i, 10 + i);
+            if ((result = fif_get_file_contents(mount, path, data, sizeof(data))) != (int)(10 + i) || memcmp(data, expected, 10 + i) != 0)
+            {
+                printf("%s contents are wrong: %i\n", path, result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+
+        close_counted_test_volume(&counting_io, mount);
+    }
+
+    if (create_writes[1] * 2 > create_writes[0])
+    {
+        printf("creating 40 files made %u writes in a batch, %u without\n", create_writes[1], create_writes[0]);
+        return -1;
+    }
+
+    // a view into the batch's cache outlives the commit, and the cache is only let go with the view.
+    // without a mapping to point into, the view has to be a pinned frame.
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+
+    struct test_counting_io counting_io;
+    fif_io memory_io, io;
+    fif_mount_handle mount;
+    fif_io_open_memory(&memory_io);
+    wrap_test_io(&counting_io, &memory_io, &io);
+    io.io_get_pointer = NULL;
+    if ((result = fif_create_volume(&mount, &io, NULL, &volume_options, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_create() failed: %i\n", result);
+        fif_io_close_memory(&memory_io);
+        return -1;
+    }
+
+    fif_file_handle file;
+    const void *view;
+    unsigned int view_count;
+    fill_test_file_data(expected, 23, sizeof(expected));
+    if ((result = fif_put_file_contents(mount, "view.bin", expected, sizeof(expected))) != FIF_ERROR_SUCCESS ||
+        (result = fif_begin_batch(mount)) != FIF_ERROR_SUCCESS ||
+        (result = fif_open(mount, "view.bin", FIF_OPEN_MODE_READ, &file)) != FIF_ERROR_SUCCESS)
+    {
+        printf("view.bin setup failed: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    if ((result = fif_read_view(mount, file, 0, sizeof(expected), &view, &view_count)) != FIF_ERROR_SUCCESS || view_count == 0 ||
+        (result = fif_put_file_contents(mount, "during.bin", expected, 100)) != FIF_ERROR_SUCCESS ||
+        (result = fif_commit_batch(mount)) != FIF_ERROR_SUCCESS ||
+        memcmp(view, expected, view_count) != 0 ||
+        (result = fif_put_file_contents(mount, "after.bin", expected, 200)) != FIF_ERROR_SUCCESS ||
+        memcmp(view, expected, view_count) != 0 ||
+        (result = fif_release_view(mount, file, view)) != FIF_ERROR_SUCCESS ||
+        (result = fif_close(mount, file)) != FIF_ERROR_SUCCESS)
+    {
+        printf("a view held across fif_commit_batch failed: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    // including what was written through the cache between the commit and the release
+    if ((result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS ||
+        (result = fif_get_file_contents(mount, "during.bin", data, sizeof(data))) != 100 || memcmp(data, expected, 100) != 0 ||
+        (result = fif_get_file_contents(mount, "after.bin", data, sizeof(data))) != 200 || memcmp(data, expected, 200) != 0)
+    {
+        printf("files written around a held view are wrong: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    close_counted_test_volume(&counting_io, mount);
+    return FIF_ERROR_SUCCESS;
+}
+
+static int test_delayed_allocation(void)
+{
+    int result;
+    static unsigned char expected[2][65536], data[65536];
+
+    // two files appended to a block at a time in turn only get their blocks at close, so neither has to move
+    unsigned int moves[2];
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+        fif_volume_options volume_options;
+        fif_mount_options mount_options;
+        fif_set_default_volume_options(&volume_options);
+        fif_set_default_mount_options(&mount_options);
+        mount_options.fragmentation_threshold = 0;
+        mount_options.delayed_allocation_size = (pass == 0) ? 0 : (1024 * 1024);
+
+        struct test_counting_io counting_io;
+        fif_io io;
+        fif_mount_handle mount;
+        if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+            return -1;
+
+        static const char *const paths[2] = { "first.log", "second.log" };
+        fif_file_handle files[2];
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            fill_test_file_data(expected[i], 24 + i, sizeof(expected[i]));
+            if ((result = fif_open(mount, paths[i], FIF_OPEN_MODE_CREATE | FIF_OPEN_MODE_WRITE, &files[i])) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_open(%s) failed: %i\n", paths[i], result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+
+        unsigned int start_moves = counting_io.counts.reads + counting_io.counts.preads + counting_io.counts.copies;
+        for (unsigned int offset = 0; offset < sizeof(expected[0]); offset += 1024)
+        {
+            for (unsigned int i = 0; i < 2; i++)
+            {
+                if ((result = fif_write(mount, files[i], expected[i] + offset, 1024)) != 1024 || (result = fif_tell(mount, files[i])) != (int)(offset + 1024))
+                {
+                    printf("appending to %s failed: %i\n", paths[i], result);
+                    close_counted_test_volume(&counting_io, mount);
+                    return -1;
+                }
+            }
+        }
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            if ((result = fif_close(mount, files[i])) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_close(%s) failed: %i\n", paths[i], result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+        moves[pass] = counting_io.counts.reads + counting_io.counts.preads + counting_io.counts.copies - start_moves;
+
+        if ((result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS)
+        {
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            fif_fileinfo fileinfo;
+            if ((result = fif_get_file_contents(mount, paths[i], data, sizeof(data))) != (int)sizeof(data) || memcmp(data, expected[i], sizeof(data)) != 0 ||
+                (result = fif_stat(mount, paths[i], &fileinfo)) != FIF_ERROR_SUCCESS || fileinfo.block_count != sizeof(data) / 1024)
+            {
+                printf("%s is wrong: %i\n", paths[i], result);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+
+        close_counted_test_volume(&counting_io, mount);
+    }
+
+    if (moves[1] != 0 || moves[0] == 0)
+    {
+        printf("interleaved appends made %u reads and copies with delayed allocation, %u without\n", moves[1], moves[0]);
+        return -1;
+    }
+
+    // a writer holding less than it's appended allocates a piece at a time, and still ends up with everything
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+    mount_options.delayed_allocation_size = 8192;
+
+    struct test_counting_io counting_io;
+    fif_io io;
+    fif_mount_handle mount;
+    if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+
+    fif_file_handle file;
+    if ((result = fif_open(mount, "held.log", FIF_OPEN_MODE_CREATE | FIF_OPEN_MODE_WRITE, &file)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_open(held.log) failed: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    unsigned int start_writes = counting_io.counts.writes + counting_io.counts.pwrites;
+    unsigned int writes_before_limit = 0;
+    for (unsigned int offset = 0; offset < sizeof(expected[0]); offset += 1024)
+    {
+        if ((result = fif_write(mount, file, expected[0] + offset, 1024)) != 1024)
+        {
+            printf("fif_write(held.log) failed: %i\n", result);
+            fif_close(mount, file);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+        if (offset + 1024 < 8192)
+            writes_before_limit = counting_io.counts.writes + counting_io.counts.pwrites - start_writes;
+    }
+    if ((result = fif_close(mount, file)) != FIF_ERROR_SUCCESS ||
+        (result = remount_test_volume(&io, &mount, &mount_options)) != FIF_ERROR_SUCCESS ||
+        (result = fif_get_file_contents(mount, "held.log", data, sizeof(data))) != (int)sizeof(data) || memcmp(data, expected[0], sizeof(data)) != 0)
+    {
+        printf("held.log contents are wrong: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    if (writes_before_limit != 0)
+    {
+        printf("appending less than delayed_allocation_size made %u writes\n", writes_before_limit);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    close_counted_test_volume(&counting_io, mount);
+    return FIF_ERROR_SUCCESS;
+}
+
+static void close_test_files(fif_mount_handle mount, fif_file_handle *files, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (files[i] != NULL)
+            fif_close(mount, files[i]);
+        files[i] = NULL;
+    }
+}
+
+static int test_open_file_table(void)
+{
+    int result;
+    char path[64];
+    unsigned char expected[64], data[64];
+    static fif_file_handle files[512];
+
+    // more files are open than the inode cache holds, so sharing is tracked beyond the cached inodes
+    fif_volume_options volume_options;
+    fif_mount_options mount_options;
+    fif_set_default_volume_options(&volume_options);
+    fif_set_default_mount_options(&mount_options);
+    mount_options.inode_cache_size = 16;
+
+    struct test_counting_io counting_io;
+    fif_io io;
+    fif_mount_handle mount;
+    if (create_counted_test_volume(&counting_io, &io, &mount, &volume_options, &mount_options) != FIF_ERROR_SUCCESS)
+        return -1;
+
+    if ((result = fif_mkdir(mount, "open")) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_mkdir(open) failed: %i\n", result);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    for (unsigned int i = 0; i < 512; i++)
+    {
+        make_test_path(path, "open", i);
+        fill_test_file_data(expected, i, sizeof(expected));
+        if ((result = fif_put_file_contents(mount, path, expected, sizeof(expected))) != FIF_ERROR_SUCCESS)
+        {
+            printf("fif_put_file_contents(%s) failed: %i\n", path, result);
+            close_counted_test_volume(&counting_io, mount);
+            return -1;
+        }
+    }
+
+    // open every file, close two thirds of them in a scattered order and reopen those in reverse, a few times over
+    memset(files, 0, sizeof(files));
+    for (unsigned int round = 0; round < 4; round++)
+    {
+        for (unsigned int i = 0; i < 512; i++)
+        {
+            make_test_path(path, "open", i);
+            if (files[i] == NULL && (result = fif_open(mount, path, FIF_OPEN_MODE_READ, &files[i])) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_open(%s) failed: %i\n", path, result);
+                close_test_files(mount, files, 512);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+        for (unsigned int i = 0; i < 512; i++)
+        {
+            unsigned int index = (i * 37 + round) % 512;
+            if ((index % 3) != 0)
+            {
+                fif_close(mount, files[index]);
+                files[index] = NULL;
+            }
+        }
+        for (unsigned int i = 512; i > 0; i--)
+        {
+            make_test_path(path, "open", i - 1);
+            if (files[i - 1] == NULL && (result = fif_open(mount, path, FIF_OPEN_MODE_READ, &files[i - 1])) != FIF_ERROR_SUCCESS)
+            {
+                printf("fif_open(%s) after closing failed: %i\n", path, result);
+                close_test_files(mount, files, 512);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+
+        // every handle still reads its own file
+        for (unsigned int i = 0; i < 512; i++)
+        {
+            fill_test_file_data(expected, i, sizeof(expected));
+            if (fif_seek(mount, files[i], 0, FIF_SEEK_MODE_SET) != 0 ||
+                (result = fif_read(mount, files[i], data, sizeof(data))) != (int)sizeof(data) || memcmp(data, expected, sizeof(data)) != 0)
+            {
+                make_test_path(path, "open", i);
+                printf("reading %s in round %u failed: %i\n", path, round, result);
+                close_test_files(mount, files, 512);
+                close_counted_test_volume(&counting_io, mount);
+                return -1;
+            }
+        }
+        if (round < 3)
+            close_test_files(mount, files, 512);
+    }
+
+    // with the other files open, readers of open/file000 share it but keep out writers and unlink
+    fif_file_handle reader, writer;
+    make_test_path(path, "open", 0);
+    fill_test_file_data(expected, 0, sizeof(expected));
+    if ((result = fif_open(mount, path, FIF_OPEN_MODE_READ, &reader)) != FIF_ERROR_SUCCESS)
+    {
+        printf("second reader of %s failed: %i\n", path, result);
+        close_test_files(mount, files, 512);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    if ((result = fif_open(mount, path, FIF_OPEN_MODE_WRITE, &writer)) != FIF_ERROR_SHARING_VIOLATION ||
+        (result = fif_put_file_contents(mount, path, expected, sizeof(expected))) != FIF_ERROR_SHARING_VIOLATION ||
+        (result = fif_unlink(mount, path)) != FIF_ERROR_SHARING_VIOLATION)
+    {
+        printf("writing or unlinking %s while it is being read returned %i\n", path, result);
+        fif_close(mount, reader);
+        close_test_files(mount, files, 512);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    fif_close(mount, files[0]);
+    files[0] = NULL;
+    if ((result = fif_open(mount, path, FIF_OPEN_MODE_WRITE, &writer)) != FIF_ERROR_SHARING_VIOLATION)
+    {
+        printf("writing %s with one reader left returned %i\n", path, result);
+        fif_close(mount, reader);
+        close_test_files(mount, files, 512);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    fif_close(mount, reader);
+
+    // a writer keeps out readers and unlink until it closes
+    if ((result = fif_open(mount, path, FIF_OPEN_MODE_WRITE, &writer)) != FIF_ERROR_SUCCESS)
+    {
+        printf("writing %s after its readers closed failed: %i\n", path, result);
+        close_test_files(mount, files, 512);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    if ((result = fif_open(mount, path, FIF_OPEN_MODE_READ, &reader)) != FIF_ERROR_SHARING_VIOLATION ||
+        (result = fif_unlink(mount, path)) != FIF_ERROR_SHARING_VIOLATION)
+    {
+        printf("reading or unlinking %s while it is being written returned %i\n", path, result);
+        fif_close(mount, writer);
+        close_test_files(mount, files, 512);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+    fif_close(mount, writer);
+
+    fif_fileinfo fileinfo;
+    if ((result = fif_unlink(mount, path)) != FIF_ERROR_SUCCESS || fif_stat(mount, path, &fileinfo) == FIF_ERROR_SUCCESS)
+    {
+        printf("unlinking %s after it closed failed: %i\n", path, result);
+        close_test_files(mount, files, 512);
+        close_counted_test_volume(&counting_io, mount);
+        return -1;
+    }
+
+    close_test_files(mount, files, 512);
+    close_counted_test_volume(&counting_io, mount);
+    return FIF_ERROR_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
     int result;
@@ -67,9 +3015,239 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    // compressed files can't be truncated through a handle, and what was written is kept
+    if ((result = fif_open(mount, "test.txt", FIF_OPEN_MODE_TRUNCATE | FIF_OPEN_MODE_WRITE | FIF_OPEN_MODE_STREAMED, &file)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_open() for write failed: %i", result);
+        return -1;
+    }
+    if ((result = fif_write(mount, file, "hello", 6)) != 6)
+    {
+        printf("fif_write() failed: %i", result);
+        return -1;
+    }
+    if ((result = fif_ftruncate(mount, file, 3)) == FIF_ERROR_SUCCESS)
+    {
+        printf("fif_ftruncate() of a compressed file succeeded");
+        return -1;
+    }
+    if ((result = fif_close(mount, file)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_close() failed: %i", result);
+        return -1;
+    }
+    if ((result = fif_get_file_contents(mount, "test.txt", temp, sizeof(temp))) != 6 || memcmp(temp, "hello", 6) != 0)
+    {
+        printf("test.txt contents are wrong: %i", result);
+        return -1;
+    }
+
+    // close archive
+    fif_unmount_volume(mount);
+
+    // remount it, creating uncompressed files
+    mount_options.new_file_compression_algorithm = FIF_COMPRESSION_ALGORITHM_NONE;
+    mount_options.new_file_compression_level = 0;
+    if ((result = fif_mount_volume(&mount, &test_file_io, NULL, &mount_options)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_mount_volume() failed: %i\n", result);
+        return -1;
+    }
+
+    // read-write handle that grows its buffer appending past the end, then reads and writes behind it
+    static unsigned char expected[32768], data[32768];
+    for (unsigned int i = 0; i < 12175; i++)
+        expected[i] = (unsigned char)(i * 7 + 1);
+    if ((result = fif_put_file_contents(mount, "rewrite.bin", expected, 12175)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_put_file_contents() failed: %i", result);
+        return -1;
+    }
+    if ((result = fif_open(mount, "rewrite.bin", FIF_OPEN_MODE_READ | FIF_OPEN_MODE_WRITE, &file)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_open() for read-write failed: %i", result);
+        return -1;
+    }
+    for (unsigned int i = 0; i < 19802; i++)
+        expected[6 + i] = (unsigned char)(i * 13 + 5);
+    if (fif_seek(mount, file, 6, FIF_SEEK_MODE_SET) != 6 || (result = fif_write(mount, file, expected + 6, 19802)) != 19802)
+    {
+        printf("fif_write() past the end failed: %i", result);
+        return -1;
+    }
+    if (fif_seek(mount, file, 296, FIF_SEEK_MODE_SET) != 296 || (result = fif_read(mount, file, data, 7305)) != 7305 || memcmp(data, expected + 296, 7305) != 0)
+    {
+        printf("fif_read() behind the written data failed: %i", result);
+        return -1;
+    }
+    for (unsigned int i = 0; i < 900; i++)
+        expected[7601 + i] = (unsigned char)(i * 3 + 99);
+    if ((result = fif_write(mount, file, expected + 7601, 900)) != 900)
+    {
+        printf("fif_write() behind the written data failed: %i", result);
+        return -1;
+    }
+    for (unsigned int i = 0; i < 10; i++)
+        expected[3000 + i] = (unsigned char)(i + 200);
+    if (fif_seek(mount, file, 296, FIF_SEEK_MODE_SET) != 296 || (result = fif_read(mount, file, data, 10)) != 10 ||
+        fif_seek(mount, file, 3000, FIF_SEEK_MODE_SET) != 3000 || (result = fif_write(mount, file, expected + 3000, 10)) != 10)
+    {
+        printf("fif_write() past the read-in data failed: %i", result);
+        return -1;
+    }
+    if ((result = fif_close(mount, file)) != FIF_ERROR_SUCCESS)
+    {
+        printf("fif_close() failed: %i", result);
+        return -1;
+    }
+    if ((result = fif_get_file_contents(mount, "rewrite.bin", data, sizeof(data))) != 19808 || memcmp(data, expected, 19808) != 0)
+    {
+        printf("rewrite.bin contents are wrong: %i", result);
+        return -1;
+    }
+
     // close archive
     fif_unmount_volume(mount);
 
+    if (test_positional_io() != FIF_ERROR_SUCCESS)
+    {
+        printf("positional io test failed\n");
+        return -1;
+    }
+    if (test_block_cache() != FIF_ERROR_SUCCESS)
+    {
+        printf("block cache test failed\n");
+        return -1;
+    }
+    if (test_mapped_io() != FIF_ERROR_SUCCESS)
+    {
+        printf("mapped io test failed\n");
+        return -1;
+    }
+    if (test_coalesced_io() != FIF_ERROR_SUCCESS)
+    {
+        printf("coalesced io test failed\n");
+        return -1;
+    }
+    if (test_copy_range() != FIF_ERROR_SUCCESS)
+    {
+        printf("copy range test failed\n");
+        return -1;
+    }
+    if (test_discard() != FIF_ERROR_SUCCESS)
+    {
+        printf("discard test failed\n");
+        return -1;
+    }
+    if (test_uring_io() != FIF_ERROR_SUCCESS)
+    {
+        printf("io_uring test failed\n");
+        return -1;
+    }
+    if (test_readahead() != FIF_ERROR_SUCCESS)
+    {
+        printf("read-ahead test failed\n");
+        return -1;
+    }
+    if (test_direct_io() != FIF_ERROR_SUCCESS)
+    {
+        printf("direct io test failed\n");
+        return -1;
+    }
+    if (test_read_view() != FIF_ERROR_SUCCESS)
+    {
+        printf("read view test failed\n");
+        return -1;
+    }
+    if (test_inode_table_index() != FIF_ERROR_SUCCESS)
+    {
+        printf("inode table index test failed\n");
+        return -1;
+    }
+    if (test_inode_cache() != FIF_ERROR_SUCCESS)
+    {
+        printf("inode cache test failed\n");
+        return -1;
+    }
+
+    if (test_hashed_directory(&test_file_io) != FIF_ERROR_SUCCESS)
+    {
+        printf("hashed directory test failed\n");
+        return -1;
+    }
+
+    if (test_dentry_cache() != FIF_ERROR_SUCCESS)
+    {
+        printf("dentry cache test failed\n");
+        return -1;
+    }
+
+    if (test_freeblock_index() != FIF_ERROR_SUCCESS)
+    {
+        printf("freeblock index test failed\n");
+        return -1;
+    }
+
+    if (test_fragmented_files(&test_file_io) != FIF_ERROR_SUCCESS)
+    {
+        printf("fragmented file test failed\n");
+        return -1;
+    }
+
+    if (test_small_files(&test_file_io) != FIF_ERROR_SUCCESS)
+    {
+        printf("small file test failed\n");
+        return -1;
+    }
+
+    if (test_ordered_directory(&test_file_io) != FIF_ERROR_SUCCESS)
+    {
+        printf("ordered directory test failed\n");
+        return -1;
+    }
+
+    if (test_readdir_plus() != FIF_ERROR_SUCCESS)
+    {
+        printf("readdir_plus test failed\n");
+        return -1;
+    }
+
+    if (test_preallocation() != FIF_ERROR_SUCCESS)
+    {
+        printf("preallocation test failed\n");
+        return -1;
+    }
+
+    if (test_volume_growth() != FIF_ERROR_SUCCESS)
+    {
+        printf("volume growth test failed\n");
+        return -1;
+    }
+
+    if (test_deferred_superblock() != FIF_ERROR_SUCCESS)
+    {
+        printf("deferred superblock test failed\n");
+        return -1;
+    }
+
+    if (test_batch() != FIF_ERROR_SUCCESS)
+    {
+        printf("batch test failed\n");
+        return -1;
+    }
+
+    if (test_delayed_allocation() != FIF_ERROR_SUCCESS)
+    {
+        printf("delayed allocation test failed\n");
+        return -1;
+    }
+
+    if (test_open_file_table() != FIF_ERROR_SUCCESS)
+    {
+        printf("open file table test failed\n");
+        return -1;
+    }
+
     // close file
     fif_io_close_local_file(&test_file_io);
     return 0;